@@ -1,8 +1,11 @@
 #include "Channel.hpp"
 #include "../client/User.hpp"
 #include "../client/ClientConnection.hpp"
+#include "../metrics/Metrics.hpp"
+#include "ChannelListIndex.hpp"
 #include <algorithm>
 #include <iostream>
+#include <cstdio>
 
 // ============================================================================
 // CONSTRUCTOR / DESTRUCTOR
@@ -10,7 +13,8 @@
 
 Channel::Channel(const std::string& name) : 
     _name(name), _topic(""), _key(""), _limit(0),
-    _inviteOnly(false), _topicOpOnly(false), _hasKey(false), _hasLimit(false)
+    _inviteOnly(false), _topicOpOnly(false), _hasKey(false), _hasLimit(false), _auditorium(false),
+    _createdAt(std::time(NULL)), _topicSetAt(0), _listIndex(NULL)
 {
 }
 
@@ -18,6 +22,8 @@ Channel::~Channel()
 {
     // No borramos los usuarios (User*), pertenecen al Server.
     // Solo limpiamos las listas.
+    if (_listIndex)
+        _listIndex->erase(this);
     _members.clear();
     _operators.clear();
     _invites.clear();
@@ -44,6 +50,7 @@ std::string Channel::getModes() const
     if (_topicOpOnly) modes += "t";
     if (_hasKey) modes += "k";
     if (_hasLimit) modes += "l";
+    if (_auditorium) modes += "u";
     
     // Añadir argumentos de modos (key y limit)
     if (_hasKey) modes += " " + _key;
@@ -61,6 +68,7 @@ bool Channel::hasMode(char mode) const
     if (mode == 't') return _topicOpOnly;
     if (mode == 'k') return _hasKey;
     if (mode == 'l') return _hasLimit;
+    if (mode == 'u') return _auditorium;
     return false;
 }
 
@@ -68,6 +76,7 @@ void Channel::setMode(char mode, bool active)
 {
     if (mode == 'i') _inviteOnly = active;
     else if (mode == 't') _topicOpOnly = active;
+    else if (mode == 'u') _auditorium = active;
     // k y l se gestionan con setKey y setLimit específicamente
 }
 
@@ -96,16 +105,24 @@ void Channel::setLimit(int limit)
 void Channel::setTopic(const std::string& topic)
 {
     _topic = topic;
+    _topicSetAt = std::time(NULL);
 }
 
+time_t Channel::getTopicSetAt() const { return _topicSetAt; }
+
 // ============================================================================
 // GESTIÓN DE MIEMBROS
 // ============================================================================
 
+// Sin comprobar isMember(): con 20k miembros es recorrer 20k punteros en
+// cada JOIN. Todos los llamantes miran antes si ya estaba
 void Channel::addMember(User* user)
 {
-    if (!isMember(user))
-        _members.push_back(user);
+    _members.push_back(user);
+    if (user->getRoute())
+        _routes[user->getRoute()]++;
+    if (_listIndex)
+        _listIndex->resized(this, _members.size() - 1);
     
     // Si estaba invitado, lo sacamos de la lista de pendientes
     if (_invites.count(user->getNickname()))
@@ -115,8 +132,17 @@ void Channel::addMember(User* user)
 void Channel::removeMember(User* user)
 {
     std::vector<User*>::iterator it = std::find(_members.begin(), _members.end(), user);
-    if (it != _members.end())
-        _members.erase(it);
+    if (it == _members.end())
+        return;
+    _members.erase(it);
+    if (_listIndex)
+        _listIndex->resized(this, _members.size() + 1);
+    if (user->getRoute())
+    {
+        std::map<ClientConnection*, unsigned int>::iterator route = _routes.find(user->getRoute());
+        if (route != _routes.end() && --route->second == 0)
+            _routes.erase(route);
+    }
 
     // Si era operador, quitarlo también
     removeOperator(user);
@@ -146,22 +172,25 @@ const std::vector<User*>& Channel::getMembers() const
 // GESTIÓN DE OPERADORES
 // ============================================================================
 
+// _operators va ordenado por puntero: NAMES y WHO lo consultan por cada
+// miembro, con búsqueda binaria no es cuadrático en canales grandes
 void Channel::addOperator(User* user)
 {
-    if (!isOperator(user))
-        _operators.push_back(user);
+    std::vector<User*>::iterator it = std::lower_bound(_operators.begin(), _operators.end(), user);
+    if (it == _operators.end() || *it != user)
+        _operators.insert(it, user);
 }
 
 void Channel::removeOperator(User* user)
 {
-    std::vector<User*>::iterator it = std::find(_operators.begin(), _operators.end(), user);
-    if (it != _operators.end())
+    std::vector<User*>::iterator it = std::lower_bound(_operators.begin(), _operators.end(), user);
+    if (it != _operators.end() && *it == user)
         _operators.erase(it);
 }
 
 bool Channel::isOperator(User* user) const
 {
-    return std::find(_operators.begin(), _operators.end(), user) != _operators.end();
+    return std::binary_search(_operators.begin(), _operators.end(), user);
 }
 
 // ============================================================================
@@ -178,35 +207,217 @@ bool Channel::isInvited(User* user) const
     return _invites.find(user->getNickname()) != _invites.end();
 }
 
+const std::set<std::string>& Channel::getInvites() const
+{
+    return _invites;
+}
+
+// ============================================================================
+// LISTAS DE MÁSCARAS
+// ============================================================================
+
+MaskList* Channel::getMaskList(char mode)
+{
+    if (mode == 'b') return &_bans;
+    if (mode == 'e') return &_excepts;
+    if (mode == 'I') return &_inviteExcepts;
+    return NULL;
+}
+
+const MaskList* Channel::getMaskList(char mode) const
+{
+    return const_cast<Channel*>(this)->getMaskList(mode);
+}
+
+// Se consulta en cada JOIN y en cada mensaje al canal: las listas vacías
+// (casi todos los canales) no cuestan más que la comprobación de empty()
+bool Channel::isBanned(const User& user) const
+{
+    return _bans.matches(user) && !_excepts.matches(user);
+}
+
+bool Channel::isInviteExempt(const User& user) const
+{
+    return _inviteExcepts.matches(user);
+}
+
+// ============================================================================
+// OPERADORES RESTAURADOS
+// ============================================================================
+
+void Channel::addRestoredOperator(const std::string& mask)
+{
+    _restoredOps.insert(mask);
+}
+
+// Una sola vez por máscara: si vuelve a salir, ya no hay nada pendiente
+bool Channel::claimRestoredOperator(User* user)
+{
+    if (_restoredOps.empty() || !_restoredOps.erase(user->getPrefix()))
+        return false;
+    addOperator(user);
+    return true;
+}
+
+bool Channel::hasRestoredOperators() const
+{
+    return !_restoredOps.empty();
+}
+
+const std::set<std::string>& Channel::getRestoredOperators() const
+{
+    return _restoredOps;
+}
+
+// ============================================================================
+// ENLACES ENTRE SERVIDORES
+// ============================================================================
+
+time_t Channel::getCreatedAt() const
+{
+    return _createdAt;
+}
+
+void Channel::setCreatedAt(time_t ts)
+{
+    _createdAt = ts;
+}
+
+const std::map<ClientConnection*, unsigned int>& Channel::getRoutes() const
+{
+    return _routes;
+}
+
+// ============================================================================
+// ÍNDICE DE LIST
+// ============================================================================
+
+void Channel::setListIndex(ChannelListIndex* index)
+{
+    _listIndex = index;
+    if (_listIndex)
+        _listIndex->insert(this);
+}
+
 // ============================================================================
 // COMUNICACIÓN
 // ============================================================================
 
-void Channel::broadcast(const std::string& msg, User* excludeUser)
+void Channel::broadcast(const std::string& msg, User* excludeUser, OutputLane lane, User* actor)
 {
+    size_t recipients = 0;
     for (size_t i = 0; i < _members.size(); ++i)
     {
         if (_members[i] != excludeUser)
         {
             // Asumimos que User tiene getConnection() y ClientConnection tiene queueSend()
             if (_members[i]->getConnection())
-                _members[i]->getConnection()->queueSend(msg);
+            {
+                _members[i]->getConnection()->queueSend(msg, _members[i] == actor ? LANE_CONTROL : lane);
+                recipients++;
+            }
         }
     }
+    g_metrics.broadcasts.inc();
+    g_metrics.fanout.record(recipients);
 }
 
-std::string Channel::getNamesList() const
+// Un evento de 20k miembros con gente entrando y saliendo: sin +u cada
+// entrada cuesta N líneas y el tráfico crece con N², no con lo que se habla
+const std::vector<User*>& Channel::getPresenceAudience(User* user) const
 {
-    std::string list = "";
-    for (size_t i = 0; i < _members.size(); ++i)
+    if (!_auditorium || isOperator(user))
+        return _members;
+    return _operators;
+}
+
+void Channel::broadcastPresence(const std::string& msg, User* user, User* excludeUser)
+{
+    const std::vector<User*>& audience = getPresenceAudience(user);
+    if (&audience == &_members)
+        return broadcast(msg, excludeUser, LANE_BULK, user);
+
+    size_t recipients = 0;
+    for (size_t i = 0; i < audience.size(); ++i)
     {
-        if (i > 0) list += " ";
-        
-        // Prefijo de operador
-        if (isOperator(_members[i]))
-            list += "@";
-        
-        list += _members[i]->getNickname();
+        if (audience[i] != excludeUser && audience[i]->getConnection())
+        {
+            audience[i]->getConnection()->queueSend(msg, LANE_BULK);
+            recipients++;
+        }
+    }
+    // Él mismo no es OP (si no, habría ido a todos): va aparte
+    if (user != excludeUser && user->getConnection())
+    {
+        user->getConnection()->queueSend(msg, LANE_CONTROL);
+        recipients++;
+    }
+    g_metrics.broadcasts.inc();
+    g_metrics.fanout.record(recipients);
+}
+
+size_t Channel::memoryBytes() const
+{
+    //* std::set node: 3 pointers + color, then the string itself
+    static const size_t setNode = 4 * sizeof(void*) + sizeof(std::string);
+
+    size_t bytes = sizeof(*this) + stringHeapBytes(_name) + stringHeapBytes(_topic) + stringHeapBytes(_key)
+        + (_members.capacity() + _operators.capacity()) * sizeof(User*)
+        + _routes.size() * (4 * sizeof(void*) + sizeof(unsigned int));
+    for (std::set<std::string>::const_iterator it = _invites.begin(); it != _invites.end(); ++it)
+        bytes += setNode + stringHeapBytes(*it);
+    for (std::set<std::string>::const_iterator it = _restoredOps.begin(); it != _restoredOps.end(); ++it)
+        bytes += setNode + stringHeapBytes(*it);
+    bytes += _bans.memoryBytes() + _excepts.memoryBytes() + _inviteExcepts.memoryBytes();
+    return bytes;
+}
+
+void Channel::broadcast(const SharedLine& line, User* excludeUser)
+{
+    broadcast(line.str(), excludeUser);
+}
+
+ChannelHistory& Channel::getHistory()
+{
+    return _history;
+}
+
+const ChannelHistory& Channel::getHistory() const
+{
+    return _history;
+}
+
+// Sin el CRLF
+static const size_t NAMES_LINE_MAX = 510;
+
+void Channel::appendNamesReply(std::string& out, const std::string& head, User* viewer) const
+{
+    // Auditorio: los OPs y uno mismo, no los 20k nicks
+    const std::vector<User*>& shown = getPresenceAudience(viewer);
+    bool self = &shown != &_members && isMember(viewer);
+
+    size_t line = out.size();
+    out += head;
+    size_t empty = out.size();
+    for (size_t i = 0; i < shown.size() + self; ++i)
+    {
+        User* user = (i < shown.size()) ? shown[i] : viewer;
+        const std::string& nick = user->getNickname();
+        bool op = isOperator(user);
+
+        // Línea llena: se cierra y se empieza otra con la misma cabecera
+        if (out.size() > empty && out.size() - line + 1 + op + nick.size() > NAMES_LINE_MAX)
+        {
+            out += "\r\n";
+            line = out.size();
+            out += head;
+            empty = out.size();
+        }
+        if (out.size() > empty)
+            out += ' ';
+        if (op)
+            out += '@';
+        out += nick;
     }
-    return list;
+    out += "\r\n";
 }
@@ -4,10 +4,17 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <ctime>
 #include <algorithm>
+#include "ChannelHistory.hpp"
+#include "MaskList.hpp"
+#include "../metrics/Metrics.hpp"
 
 // Forward declaration para evitar dependencias circulares
 class User;
+class ClientConnection;
+class ChannelListIndex;
 
 class Channel
 {
@@ -28,7 +35,7 @@ class Channel
         int    getLimit() const;
         
         // ------------------------------------------------------------------
-        // MODOS DEL CANAL (+i, +t, +k, +l)
+        // MODOS DEL CANAL (+i, +t, +k, +l, +u)
         // ------------------------------------------------------------------
         std::string getModes() const;           // Devuelve string tipo "+itk" para RPL_CHANNELMODEIS
         bool        hasMode(char mode) const;
@@ -37,11 +44,12 @@ class Channel
         void        setKey(const std::string& key);
         void        setLimit(int limit);
         void        setTopic(const std::string& topic);
+        time_t      getTopicSetAt() const;  // Último cambio del topic (LIST T<n / T>n)
 
         // ------------------------------------------------------------------
         // GESTIÓN DE MIEMBROS
         // ------------------------------------------------------------------
-        void    addMember(User* user);
+        void    addMember(User* user);     // Quien llama ya sabe que no era miembro
         void    removeMember(User* user);
         bool    isMember(User* user) const;
         User* getMember(const std::string& nick) const;
@@ -66,15 +74,70 @@ class Channel
         // ------------------------------------------------------------------
         void    addInvite(const std::string& nick);
         bool    isInvited(User* user) const; // Verifica si el usuario está en la lista blanca
+        const std::set<std::string>& getInvites() const;
+
+        // ------------------------------------------------------------------
+        // LISTAS DE MÁSCARAS (+b, +e, +I)
+        // ------------------------------------------------------------------
+        MaskList*       getMaskList(char mode);         // NULL si no es b/e/I
+        const MaskList* getMaskList(char mode) const;
+        bool    isBanned(const User& user) const;       // En +b y en ninguna +e
+        bool    isInviteExempt(const User& user) const; // +I: entra aunque sea +i
+
+        // ------------------------------------------------------------------
+        // OPERADORES RESTAURADOS (snapshot)
+        // ------------------------------------------------------------------
+        // Tras un reinicio el canal vuelve vacío: quien era OP lo recupera
+        // al volver a entrar con la misma máscara nick!user@host
+        void    addRestoredOperator(const std::string& mask);
+        bool    claimRestoredOperator(User* user);
+        bool    hasRestoredOperators() const;
+        const std::set<std::string>& getRestoredOperators() const;
+
+        // ------------------------------------------------------------------
+        // ENLACES ENTRE SERVIDORES
+        // ------------------------------------------------------------------
+        // TS del canal: en un conflicto gana el más antiguo (sus modos y OPs)
+        time_t  getCreatedAt() const;
+        void    setCreatedAt(time_t ts);
+        // Enlaces por los que hay miembros remotos, y cuántos: un PRIVMSG
+        // solo se reenvía por estos
+        const std::map<ClientConnection*, unsigned int>& getRoutes() const;
+
+        // ------------------------------------------------------------------
+        // ÍNDICE DE LIST
+        // ------------------------------------------------------------------
+        // El canal avisa al índice cada vez que cambia su número de miembros
+        void    setListIndex(ChannelListIndex* index);
 
         // ------------------------------------------------------------------
         // COMUNICACIÓN
         // ------------------------------------------------------------------
-        // Enviar mensaje a todos en el canal, excepto 'excludeUser' (opcional)
-        void    broadcast(const std::string& msg, User* excludeUser);
+        // Enviar mensaje a todos en el canal, excepto 'excludeUser' (opcional).
+        // Va por la cola bulk; la copia de 'actor' (quien lo ha provocado) por
+        // control, para que no se adelanten las respuestas a sus comandos
+        void    broadcast(const std::string& msg, User* excludeUser, OutputLane lane = LANE_BULK,
+                    User* actor = NULL);
+        // JOIN/PART/QUIT/NICK de 'user': en +u (auditorio) solo a los OPs y
+        // a él mismo, salvo que sea OP (a esos los ve todo el mundo).
+        // Su propia copia va por control, la de los demás por bulk
+        void    broadcastPresence(const std::string& msg, User* user, User* excludeUser);
+        // Quién se entera de las entradas y salidas de 'user' (ver arriba)
+        const std::vector<User*>& getPresenceAudience(User* user) const;
+        // Igual, con una línea compartida (la que se guarda en el historial)
+        void    broadcast(const SharedLine& line, User* excludeUser);
+
+        // Historial reciente (CHATHISTORY), con su propio presupuesto de memoria
+        ChannelHistory&         getHistory();
+        const ChannelHistory&   getHistory() const;
         
-        // Genera la lista de nombres para RPL_NAMREPLY (ej: "@Admin +User1 User2")
-        std::string getNamesList() const;
+        // Añade a 'out' las líneas RPL_NAMREPLY ('head' + "@Admin User1 User2"),
+        // partidas para no pasar de 512 bytes. En +u, quien no es OP solo ve
+        // a los OPs y a sí mismo
+        void    appendNamesReply(std::string& out, const std::string& head, User* viewer) const;
+
+        // Memoria estimada (objeto + listas + strings), para las métricas
+        size_t  memoryBytes() const;
 
     private:
         std::string _name;
@@ -87,11 +150,24 @@ class Channel
         bool _topicOpOnly;      // +t
         bool _hasKey;           // +k activado
         bool _hasLimit;         // +l activado
+        bool _auditorium;       // +u: entradas y salidas solo para OPs
 
         // Listas internas
         std::vector<User*>    _members;   // Todos los usuarios dentro
-        std::vector<User*>    _operators; // Subconjunto de usuarios que son OP
+        std::vector<User*>    _operators; // Subconjunto de usuarios que son OP (ordenado)
         std::set<std::string> _invites;   // Nicks invitados (whitelist para +i)
+        std::set<std::string> _restoredOps; // Máscaras de OPs de antes del reinicio
+        MaskList              _bans;          // +b
+        MaskList              _excepts;       // +e
+        MaskList              _inviteExcepts; // +I
+
+        ChannelHistory        _history;   // Últimos mensajes (PRIVMSG/NOTICE)
+
+        time_t                _createdAt; // TS6 channel TS
+        std::map<ClientConnection*, unsigned int> _routes; // Enlace -> miembros detrás
+
+        time_t                _topicSetAt;
+        ChannelListIndex*     _listIndex; // Orden por tamaño (LIST), NULL fuera del Server
 
         // Constructor privado para prohibir canales sin nombre
         Channel(); 
@@ -0,0 +1,122 @@
+#include "ChannelHistory.hpp"
+
+ChannelHistory::ChannelHistory() : bytes_(0), budget_(0)
+{
+}
+
+//* The text is shared, but while the entry exists it is what keeps it alive
+size_t ChannelHistory::cost(const Entry& e)
+{
+	return sizeof(Entry) + e.line.size();
+}
+
+void ChannelHistory::setBudget(size_t bytes)
+{
+	budget_ = bytes;
+	evict();
+}
+
+void ChannelHistory::append(const SharedLine& line, unsigned long msgid, long long timeMs)
+{
+	if (budget_ == 0)
+		return;
+	Entry e;
+	e.line = line;
+	e.msgid = msgid;
+	e.timeMs = timeMs;
+	entries_.push_back(e);
+	bytes_ += cost(e);
+	evict();
+}
+
+void ChannelHistory::evict()
+{
+	while (!entries_.empty() && bytes_ > budget_)
+	{
+		bytes_ -= cost(entries_.front());
+		entries_.pop_front();
+	}
+}
+
+size_t ChannelHistory::size() const
+{
+	return (entries_.size());
+}
+
+size_t ChannelHistory::bytes() const
+{
+	return (bytes_);
+}
+
+// ========================================================================
+// 								Queries
+// ========================================================================
+
+size_t ChannelHistory::lowerBound(const Bound& bound) const
+{
+	size_t lo = 0;
+	size_t hi = entries_.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		bool less = bound.byTime ? entries_[mid].timeMs < bound.timeMs : entries_[mid].msgid < bound.msgid;
+		if (less)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+size_t ChannelHistory::upperBound(const Bound& bound) const
+{
+	size_t lo = 0;
+	size_t hi = entries_.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		bool notAfter = bound.byTime ? entries_[mid].timeMs <= bound.timeMs : entries_[mid].msgid <= bound.msgid;
+		if (notAfter)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+void ChannelHistory::collect(size_t from, size_t to, std::vector<const Entry*>& out) const
+{
+	for (size_t i = from; i < to; ++i)
+		out.push_back(&entries_[i]);
+}
+
+void ChannelHistory::latest(size_t limit, std::vector<const Entry*>& out) const
+{
+	size_t to = entries_.size();
+	collect(to > limit ? to - limit : 0, to, out);
+}
+
+//* LATEST with a reference: the newest 'limit' messages after it
+void ChannelHistory::latestAfter(const Bound& bound, size_t limit, std::vector<const Entry*>& out) const
+{
+	size_t from = upperBound(bound);
+	size_t to = entries_.size();
+	if (to - from > limit)
+		from = to - limit;
+	collect(from, to, out);
+}
+
+void ChannelHistory::before(const Bound& bound, size_t limit, std::vector<const Entry*>& out) const
+{
+	size_t to = lowerBound(bound);
+	collect(to > limit ? to - limit : 0, to, out);
+}
+
+void ChannelHistory::after(const Bound& bound, size_t limit, std::vector<const Entry*>& out) const
+{
+	size_t from = upperBound(bound);
+	size_t to = entries_.size();
+	if (to - from > limit)
+		to = from + limit;
+	collect(from, to, out);
+}
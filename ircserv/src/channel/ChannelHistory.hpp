@@ -0,0 +1,64 @@
+#ifndef CHANNEL_HISTORY_HPP
+#define CHANNEL_HISTORY_HPP
+
+#include <deque>
+#include <vector>
+#include "../irc/SharedLine.hpp"
+
+/**
+ * ChannelHistory: bounded ring of the recent messages of one channel
+ *
+ * Each entry holds the SharedLine that was broadcast (no second copy of the
+ * text), a server-wide message id and the time in ms. Ids grow with time, so
+ * entries are ordered by both and a lookup by id or timestamp is a binary
+ * search. When the bytes held exceed the budget the oldest entries go.
+ *
+ * Served by CHATHISTORY LATEST/BEFORE/AFTER.
+ */
+
+class ChannelHistory
+{
+	public:
+		struct Entry
+		{
+			SharedLine		line;
+			unsigned long	msgid;
+			long long		timeMs;				//* Unix time in milliseconds
+		};
+
+		//* Reference point of a query: a message id or a timestamp
+		struct Bound
+		{
+			bool			byTime;
+			unsigned long	msgid;
+			long long		timeMs;
+		};
+
+		ChannelHistory();
+
+		//* Bytes (text + entry overhead) kept at most; 0 disables the history
+		void	setBudget(size_t bytes);
+		void	append(const SharedLine& line, unsigned long msgid, long long timeMs);
+
+		//* Results are in chronological order, at most 'limit' entries
+		void	latest(size_t limit, std::vector<const Entry*>& out) const;
+		void	latestAfter(const Bound& bound, size_t limit, std::vector<const Entry*>& out) const;
+		void	before(const Bound& bound, size_t limit, std::vector<const Entry*>& out) const;
+		void	after(const Bound& bound, size_t limit, std::vector<const Entry*>& out) const;
+
+		size_t	size() const;
+		size_t	bytes() const;
+
+	private:
+		std::deque<Entry>	entries_;
+		size_t				bytes_;
+		size_t				budget_;
+
+		static size_t	cost(const Entry& e);
+		size_t			lowerBound(const Bound& bound) const;	//* First entry not before 'bound'
+		size_t			upperBound(const Bound& bound) const;	//* First entry after 'bound'
+		void			evict();
+		void			collect(size_t from, size_t to, std::vector<const Entry*>& out) const;
+};
+
+#endif
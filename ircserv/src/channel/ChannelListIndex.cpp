@@ -0,0 +1,32 @@
+#include "ChannelListIndex.hpp"
+#include "Channel.hpp"
+
+ChannelListIndex::ChannelListIndex()
+{
+}
+
+void ChannelListIndex::insert(Channel* channel)
+{
+	entries_.insert(Key(channel->getUserCount(), channel));
+}
+
+void ChannelListIndex::erase(Channel* channel)
+{
+	entries_.erase(Key(channel->getUserCount(), channel));
+}
+
+void ChannelListIndex::resized(Channel* channel, size_t before)
+{
+	if (entries_.erase(Key(before, channel)))
+		entries_.insert(Key(channel->getUserCount(), channel));
+}
+
+const ChannelListIndex::Set& ChannelListIndex::bySize() const
+{
+	return entries_;
+}
+
+size_t ChannelListIndex::size() const
+{
+	return entries_.size();
+}
@@ -0,0 +1,43 @@
+#ifndef CHANNEL_LIST_INDEX_HPP
+#define CHANNEL_LIST_INDEX_HPP
+
+#include <set>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+class Channel;
+
+/**
+ * ChannelListIndex: every channel, ordered by member count (largest first)
+ *
+ * Channels report their own size changes (Channel::addMember/removeMember),
+ * so the order is always current. LIST walks it from the top: ">1000" stops
+ * at the first channel that is too small, "<10" starts at a lower_bound,
+ * neither looks at the channels outside the range.
+ *
+ * A key is (members, Channel*). A paused LIST keeps the last key it sent and
+ * resumes at its upper_bound; the pointer is only compared, never followed,
+ * so the channel may be gone by then.
+ */
+
+class ChannelListIndex
+{
+	public:
+		typedef std::pair<size_t, Channel*>			Key;
+		typedef std::set<Key, std::greater<Key> >	Set;
+
+		ChannelListIndex();
+
+		void	insert(Channel* channel);
+		void	erase(Channel* channel);
+		void	resized(Channel* channel, size_t before);	//* Called after the count changed
+
+		const Set&	bySize() const;
+		size_t		size() const;
+
+	private:
+		Set		entries_;
+};
+
+#endif
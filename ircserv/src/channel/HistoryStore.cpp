@@ -0,0 +1,599 @@
+#include "HistoryStore.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t align8(size_t n)
+{
+	return (n + 7) & ~static_cast<size_t>(7);
+}
+
+HistoryStore::HistoryStore() : segmentBytes_(0), maxSegments_(1), perChannel_(1), head_(NULL), headSequence_(0),
+	indexEntries_(0), lastMsgid_(0), compacting_(0), compactOffset_(0), compactedRecords_(0)
+{
+}
+
+HistoryStore::~HistoryStore()
+{
+	close();
+}
+
+std::string HistoryStore::segmentPath(unsigned int sequence) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "/seg-%010u.hst", sequence);
+	return dir_ + name;
+}
+
+// ========================================================================
+// 								Open / close
+// ========================================================================
+
+//* Index order: msgid, and for the same msgid (a record copied by an
+//* interrupted compaction) the newer segment last
+namespace
+{
+	struct LocationOrder
+	{
+		template <typename T>
+		bool operator()(const T& a, const T& b) const
+		{
+			return a.msgid < b.msgid || (a.msgid == b.msgid && a.sequence < b.sequence);
+		}
+	};
+}
+
+bool HistoryStore::open(const std::string& dir, size_t segmentBytes, size_t maxSegments, size_t perChannel,
+	std::string& error)
+{
+	close();
+	dir_ = dir;
+	segmentBytes_ = std::max(align8(segmentBytes), static_cast<size_t>(MIN_SEGMENT_BYTES));
+	setLimits(maxSegments, perChannel);
+
+	if (mkdir(dir.c_str(), 0750) < 0 && errno != EEXIST)
+	{
+		error = dir + ": " + std::strerror(errno);
+		return false;
+	}
+	DIR* d = opendir(dir.c_str());
+	if (!d)
+	{
+		error = dir + ": " + std::strerror(errno);
+		return false;
+	}
+	std::vector<unsigned int> sequences;
+	while (struct dirent* e = readdir(d))
+	{
+		unsigned int sequence;
+		char tail[8];
+		if (std::sscanf(e->d_name, "seg-%10u.%7s", &sequence, tail) == 2 && std::strcmp(tail, "hst") == 0
+			&& sequence > 0)
+			sequences.push_back(sequence);
+	}
+	closedir(d);
+	std::sort(sequences.begin(), sequences.end());
+
+	//* One scan of every segment; the newest one stays the head
+	for (size_t i = 0; i < sequences.size(); ++i)
+	{
+		if (!load(sequences[i], i + 1 == sequences.size(), error))
+		{
+			close();
+			return false;
+		}
+	}
+	if (!head_ && !createHead(sequences.empty() ? 1 : sequences.back() + 1))
+	{
+		error = segmentPath(headSequence_) + ": " + std::strerror(errno);
+		close();
+		return false;
+	}
+
+	//* Segment order is not msgid order once compaction has copied records
+	//* forward: sort each index, keep the newest copy of a duplicate, trim,
+	//* then count what is live in each segment
+	for (std::map<std::string, Index>::iterator it = index_.begin(); it != index_.end(); ++it)
+	{
+		Index& index = it->second;
+		std::sort(index.begin(), index.end(), LocationOrder());
+		Index unique;
+		for (size_t i = 0; i < index.size(); ++i)
+			if (i + 1 == index.size() || index[i + 1].msgid != index[i].msgid)
+				unique.push_back(index[i]);
+		index.swap(unique);
+		while (index.size() > perChannel_)
+			index.pop_front();
+	}
+	indexEntries_ = 0;
+	for (std::map<std::string, Index>::iterator it = index_.begin(); it != index_.end(); ++it)
+	{
+		for (size_t i = 0; i < it->second.size(); ++i)
+			segments_[it->second[i].sequence].liveBytes += record(it->second[i])->size;
+		indexEntries_ += it->second.size();
+	}
+	return true;
+}
+
+//* Map one segment and add its records to the index. The head keeps its
+//* preallocated size (a sealed file was truncated to its data: grow it back).
+bool HistoryStore::load(unsigned int sequence, bool isHead, std::string& error)
+{
+	std::string path = segmentPath(sequence);
+	int fd = ::open(path.c_str(), isHead ? O_RDWR : O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		error = path + ": " + std::strerror(errno);
+		if (fd >= 0)
+			::close(fd);
+		return false;
+	}
+	size_t size = static_cast<size_t>(st.st_size);
+	if (isHead && size < segmentBytes_)
+	{
+		if (ftruncate(fd, segmentBytes_) < 0)
+		{
+			error = path + ": " + std::strerror(errno);
+			::close(fd);
+			return false;
+		}
+		size = segmentBytes_;
+	}
+	void* base = size >= sizeof(SegmentHeader)
+		? mmap(NULL, size, isHead ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if (base == MAP_FAILED)
+	{
+		error = path + ": cannot map";
+		return false;
+	}
+
+	const SegmentHeader* header = static_cast<const SegmentHeader*>(base);
+	if (std::memcmp(header->magic, "IRCHST1", 8) != 0 || header->version != VERSION
+		|| header->headerSize != sizeof(SegmentHeader))
+	{
+		munmap(base, size);
+		error = path + ": not a history segment";
+		return false;
+	}
+
+	Segment seg;
+	seg.base = static_cast<char*>(base);
+	seg.mapped = size;
+	seg.used = sizeof(SegmentHeader);
+	seg.liveBytes = 0;
+
+	//* A torn record (crash mid-append) ends the data; the head overwrites it
+	while (seg.used + sizeof(RecordHeader) <= size)
+	{
+		const RecordHeader* h = reinterpret_cast<const RecordHeader*>(seg.base + seg.used);
+		if (h->size == 0 || h->size < sizeof(RecordHeader) + h->nameLength + h->lineLength
+			|| h->size > size - seg.used)
+			break;
+		Location loc;
+		loc.sequence = sequence;
+		loc.offset = static_cast<unsigned int>(seg.used);
+		loc.msgid = h->msgid;
+		index_[std::string(reinterpret_cast<const char*>(h + 1), h->nameLength)].push_back(loc);
+		lastMsgid_ = std::max(lastMsgid_, h->msgid);
+		seg.used += h->size;
+	}
+	if (isHead)
+		std::memset(seg.base + seg.used, 0, std::min(size - seg.used, sizeof(RecordHeader)));
+
+	segments_[sequence] = seg;
+	if (isHead)
+	{
+		head_ = &segments_[sequence];
+		headSequence_ = sequence;
+	}
+	return true;
+}
+
+bool HistoryStore::createHead(unsigned int sequence)
+{
+	head_ = NULL;
+	headSequence_ = sequence;
+	std::string path = segmentPath(sequence);
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0640);
+	if (fd < 0)
+		return false;
+	void* base = ftruncate(fd, segmentBytes_) == 0
+		? mmap(NULL, segmentBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if (base == MAP_FAILED)
+	{
+		unlink(path.c_str());
+		return false;
+	}
+
+	SegmentHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "IRCHST1", 8);
+	header.version = VERSION;
+	header.headerSize = sizeof(SegmentHeader);
+	header.sequence = sequence;
+	std::memcpy(base, &header, sizeof(header));
+
+	Segment seg;
+	seg.base = static_cast<char*>(base);
+	seg.mapped = segmentBytes_;
+	seg.used = sizeof(SegmentHeader);
+	seg.liveBytes = 0;
+	segments_[sequence] = seg;
+	head_ = &segments_[sequence];
+	return true;
+}
+
+void HistoryStore::close()
+{
+	if (head_)
+		truncate(segmentPath(headSequence_).c_str(), head_->used);
+	for (SegmentMap::iterator it = segments_.begin(); it != segments_.end(); ++it)
+		munmap(it->second.base, it->second.mapped);
+	segments_.clear();
+	index_.clear();
+	head_ = NULL;
+	indexEntries_ = 0;
+	lastMsgid_ = 0;
+	compacting_ = 0;
+}
+
+void HistoryStore::setLimits(size_t maxSegments, size_t perChannel)
+{
+	maxSegments_ = std::max(maxSegments, static_cast<size_t>(1));
+	perChannel_ = std::max(perChannel, static_cast<size_t>(1));
+	for (std::map<std::string, Index>::iterator it = index_.begin(); it != index_.end(); ++it)
+		trim(it->second);
+}
+
+unsigned long HistoryStore::lastMsgid() const
+{
+	return lastMsgid_;
+}
+
+// ========================================================================
+// 								Append
+// ========================================================================
+
+//* The sealed file shrinks to its data; the mapping stays for readers
+void HistoryStore::seal()
+{
+	truncate(segmentPath(headSequence_).c_str(), head_->used);
+	mprotect(head_->base, head_->mapped, PROT_READ);
+}
+
+bool HistoryStore::write(const RecordHeader& header, const char* name, const char* line, Location& loc)
+{
+	if (head_->used + header.size > head_->mapped)
+	{
+		seal();
+		if (!createHead(headSequence_ + 1))
+		{
+			std::cerr << "[HISTORY] " << segmentPath(headSequence_) << ": " << std::strerror(errno)
+				<< ", store disabled" << std::endl;
+			return false;
+		}
+	}
+	//* The size goes in last: until it lands, the slot reads as the end of
+	//* data, and so does the next one (a torn record may have left bytes there)
+	char* at = head_->base + head_->used;
+	RecordHeader body = header;
+	body.size = 0;
+	std::memcpy(at, &body, sizeof(body));
+	std::memcpy(at + sizeof(body), name, header.nameLength);
+	std::memcpy(at + sizeof(body) + header.nameLength, line, header.lineLength);
+	if (head_->used + header.size + sizeof(header.size) <= head_->mapped)
+		std::memset(at + header.size, 0, sizeof(header.size));
+	__sync_synchronize();
+	reinterpret_cast<RecordHeader*>(at)->size = header.size;
+	loc.sequence = headSequence_;
+	loc.offset = static_cast<unsigned int>(head_->used);
+	loc.msgid = header.msgid;
+	head_->used += header.size;
+	head_->liveBytes += header.size;
+	return true;
+}
+
+void HistoryStore::append(const std::string& channel, unsigned long msgid, long long timeMs, const std::string& line)
+{
+	if (!head_ || channel.size() > 0xFFFF || line.size() > 0xFFFF)
+		return;
+	RecordHeader header;
+	header.nameLength = static_cast<unsigned short>(channel.size());
+	header.lineLength = static_cast<unsigned short>(line.size());
+	header.size = static_cast<unsigned int>(align8(sizeof(header) + channel.size() + line.size()));
+	header.msgid = msgid;
+	header.timeMs = timeMs;
+	if (header.size > segmentBytes_ - sizeof(SegmentHeader))
+		return;
+
+	Location loc;
+	if (!write(header, channel.data(), line.data(), loc))
+		return;
+	Index& index = index_[channel];
+	index.push_back(loc);
+	indexEntries_++;
+	lastMsgid_ = std::max(lastMsgid_, msgid);
+	trim(index);
+}
+
+//* Past the per-channel retention the oldest records become dead bytes
+void HistoryStore::trim(Index& index)
+{
+	while (index.size() > perChannel_)
+	{
+		segments_[index.front().sequence].liveBytes -= record(index.front())->size;
+		index.pop_front();
+		indexEntries_--;
+	}
+}
+
+const HistoryStore::RecordHeader* HistoryStore::record(const Location& loc) const
+{
+	SegmentMap::const_iterator it = segments_.find(loc.sequence);
+	return reinterpret_cast<const RecordHeader*>(it->second.base + loc.offset);
+}
+
+HistoryStore::Location* HistoryStore::find(const std::string& channel, unsigned long msgid)
+{
+	std::map<std::string, Index>::iterator it = index_.find(channel);
+	if (it == index_.end())
+		return NULL;
+	Index& index = it->second;
+	size_t lo = 0;
+	size_t hi = index.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (index[mid].msgid < msgid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < index.size() && index[lo].msgid == msgid) ? &index[lo] : NULL;
+}
+
+// ========================================================================
+// 								Background work
+// ========================================================================
+
+bool HistoryStore::pending() const
+{
+	if (!head_)
+		return false;
+	if (compacting_ || segments_.size() - 1 > maxSegments_)
+		return true;
+	for (SegmentMap::const_iterator it = segments_.begin(); it != segments_.end(); ++it)
+		if (it->first != headSequence_ && it->second.liveBytes * 2 < it->second.used - sizeof(SegmentHeader))
+			return true;
+	return false;
+}
+
+//* Forget a sealed segment: whatever the index still had in it is lost
+void HistoryStore::drop(unsigned int sequence)
+{
+	Segment& seg = segments_[sequence];
+	if (seg.liveBytes)
+	{
+		for (std::map<std::string, Index>::iterator it = index_.begin(); it != index_.end();)
+		{
+			Index kept;
+			for (size_t i = 0; i < it->second.size(); ++i)
+				if (it->second[i].sequence != sequence)
+					kept.push_back(it->second[i]);
+			indexEntries_ -= it->second.size() - kept.size();
+			if (kept.empty())
+				index_.erase(it++);
+			else
+				(it++)->second.swap(kept);
+		}
+	}
+	munmap(seg.base, seg.mapped);
+	unlink(segmentPath(sequence).c_str());
+	segments_.erase(sequence);
+}
+
+/**
+ * One slice of background work, at most 'budgetBytes' copied
+ *
+ * Over the segment cap the oldest sealed file goes whole. Otherwise the
+ * oldest sealed file with less than half of its bytes live is compacted:
+ * live records are appended to the head (the index entry is repointed,
+ * its position does not change since the msgid is the same) and the file
+ * is removed once the scan reaches its end.
+ */
+void HistoryStore::step(size_t budgetBytes)
+{
+	if (!head_)
+		return;
+	if (!compacting_)
+	{
+		if (segments_.size() - 1 > maxSegments_)
+			return drop(segments_.begin()->first);
+		for (SegmentMap::iterator it = segments_.begin(); it != segments_.end(); ++it)
+		{
+			if (it->first != headSequence_ && it->second.liveBytes * 2 < it->second.used - sizeof(SegmentHeader))
+			{
+				compacting_ = it->first;
+				compactOffset_ = sizeof(SegmentHeader);
+				break;
+			}
+		}
+		if (!compacting_)
+			return;
+	}
+
+	Segment& seg = segments_[compacting_];
+	size_t copied = 0;
+	while (compactOffset_ < seg.used && copied < budgetBytes && seg.liveBytes)
+	{
+		const RecordHeader* h = reinterpret_cast<const RecordHeader*>(seg.base + compactOffset_);
+		unsigned int offset = static_cast<unsigned int>(compactOffset_);
+		compactOffset_ += h->size;
+
+		const char* name = reinterpret_cast<const char*>(h + 1);
+		Location* loc = find(std::string(name, h->nameLength), h->msgid);
+		if (!loc || loc->sequence != compacting_ || loc->offset != offset)
+			continue;
+		Location moved;
+		if (!write(*h, name, name + h->nameLength, moved))
+			return;
+		*loc = moved;
+		seg.liveBytes -= h->size;
+		copied += h->size;
+		compactedRecords_++;
+	}
+	if (compactOffset_ >= seg.used || !seg.liveBytes)
+	{
+		drop(compacting_);
+		compacting_ = 0;
+	}
+}
+
+// ========================================================================
+// 								Queries
+// ========================================================================
+
+const HistoryStore::Index* HistoryStore::lookup(const std::string& channel) const
+{
+	std::map<std::string, Index>::const_iterator it = index_.find(channel);
+	return (it == index_.end()) ? NULL : &it->second;
+}
+
+//* Timestamps live in the records: a time bound reads the mapping
+bool HistoryStore::less(const Location& loc, const ChannelHistory::Bound& bound, bool orEqual) const
+{
+	if (bound.byTime)
+	{
+		long long t = record(loc)->timeMs;
+		return orEqual ? t <= bound.timeMs : t < bound.timeMs;
+	}
+	return orEqual ? loc.msgid <= bound.msgid : loc.msgid < bound.msgid;
+}
+
+size_t HistoryStore::lowerBound(const Index& index, const ChannelHistory::Bound& bound) const
+{
+	size_t lo = 0;
+	size_t hi = index.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (less(index[mid], bound, false))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+size_t HistoryStore::upperBound(const Index& index, const ChannelHistory::Bound& bound) const
+{
+	size_t lo = 0;
+	size_t hi = index.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (less(index[mid], bound, true))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void HistoryStore::collect(const Index& index, size_t from, size_t to, std::vector<Hit>& out) const
+{
+	out.reserve(out.size() + (to - from));
+	for (size_t i = from; i < to; ++i)
+	{
+		const RecordHeader* h = record(index[i]);
+		Hit hit;
+		hit.line = reinterpret_cast<const char*>(h + 1) + h->nameLength;
+		hit.length = h->lineLength;
+		hit.msgid = h->msgid;
+		hit.timeMs = h->timeMs;
+		out.push_back(hit);
+	}
+}
+
+void HistoryStore::latest(const std::string& channel, size_t limit, std::vector<Hit>& out) const
+{
+	const Index* index = lookup(channel);
+	if (!index)
+		return;
+	size_t to = index->size();
+	collect(*index, to > limit ? to - limit : 0, to, out);
+}
+
+void HistoryStore::latestAfter(const std::string& channel, const ChannelHistory::Bound& bound, size_t limit,
+	std::vector<Hit>& out) const
+{
+	const Index* index = lookup(channel);
+	if (!index)
+		return;
+	size_t from = upperBound(*index, bound);
+	size_t to = index->size();
+	if (to - from > limit)
+		from = to - limit;
+	collect(*index, from, to, out);
+}
+
+void HistoryStore::before(const std::string& channel, const ChannelHistory::Bound& bound, size_t limit,
+	std::vector<Hit>& out) const
+{
+	const Index* index = lookup(channel);
+	if (!index)
+		return;
+	size_t to = lowerBound(*index, bound);
+	collect(*index, to > limit ? to - limit : 0, to, out);
+}
+
+void HistoryStore::after(const std::string& channel, const ChannelHistory::Bound& bound, size_t limit,
+	std::vector<Hit>& out) const
+{
+	const Index* index = lookup(channel);
+	if (!index)
+		return;
+	size_t from = upperBound(*index, bound);
+	size_t to = index->size();
+	if (to - from > limit)
+		to = from + limit;
+	collect(*index, from, to, out);
+}
+
+// ========================================================================
+// 								Stats
+// ========================================================================
+
+size_t HistoryStore::segmentCount() const
+{
+	return segments_.size();
+}
+
+size_t HistoryStore::diskBytes() const
+{
+	size_t bytes = 0;
+	for (SegmentMap::const_iterator it = segments_.begin(); it != segments_.end(); ++it)
+		bytes += it->second.used;
+	return bytes;
+}
+
+//* Locations plus a rough per-channel cost (map node, deque, name)
+size_t HistoryStore::indexBytes() const
+{
+	return indexEntries_ * sizeof(Location) + index_.size() * (sizeof(Index) + 64);
+}
+
+unsigned long HistoryStore::compactedRecords() const
+{
+	return compactedRecords_;
+}
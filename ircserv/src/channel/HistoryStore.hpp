@@ -0,0 +1,164 @@
+#ifndef HISTORY_STORE_HPP
+#define HISTORY_STORE_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include "ChannelHistory.hpp"
+
+/**
+ * HistoryStore: channel history on disk, in memory-mapped segment files
+ *
+ * Optional backend behind CHATHISTORY (history_dir). Every channel message
+ * is appended, already formatted, to the head segment: a preallocated file
+ * mapped MAP_SHARED, so an append is a memcpy and the kernel writes the
+ * pages back. When the head is full it is sealed (truncated to its used
+ * size, mapped read-only) and a new one is created.
+ *
+ * The only per-message state in memory is a per-channel index of 16-byte
+ * locations, ordered by msgid. A query binary-searches it and returns
+ * pointers into the mappings: replaying a long history is a sequential
+ * copy of the stored lines into the SendQ, with no parsing.
+ *
+ * On startup the segments are scanned once to rebuild the index, so
+ * history (and the msgid sequence) survives restarts. A record's size is
+ * stored after the rest of it, so a crash mid-append leaves a zero size
+ * (the end of the data), never a valid header over a partial record.
+ *
+ * Each channel keeps its newest 'perChannel' messages; older ones become
+ * dead bytes. step() runs in the main loop and does a bounded amount of
+ * background work: a sealed segment that is mostly dead is compacted (its
+ * live records are copied to the head, then the file is removed), and past
+ * 'maxSegments' sealed files the oldest is dropped whole.
+ *
+ * Segment layout (little endian, as written by the host):
+ *   SegmentHeader
+ *   { RecordHeader; char[nameLength] channel; char[lineLength] line; pad to 8 } ...
+ *   zero bytes (unused tail of the head segment)
+ */
+
+class HistoryStore
+{
+	public:
+		struct SegmentHeader
+		{
+			char			magic[8];				//* "IRCHST1\0"
+			unsigned int	version;
+			unsigned int	headerSize;				//* sizeof(SegmentHeader)
+			unsigned long	sequence;				//* Also in the file name
+		};
+
+		struct RecordHeader
+		{
+			unsigned int	size;					//* Whole record, padded; 0 = end of data
+			unsigned short	nameLength;
+			unsigned short	lineLength;				//* Includes the CRLF
+			unsigned long	msgid;
+			long long		timeMs;
+		};
+
+		//* A stored message, pointing into the mapping
+		struct Hit
+		{
+			const char*		line;
+			size_t			length;
+			unsigned long	msgid;
+			long long		timeMs;
+		};
+
+		static const unsigned int VERSION = 1;
+		static const size_t MIN_SEGMENT_BYTES = 64 * 1024;
+
+		HistoryStore();
+		~HistoryStore();
+
+		/**
+		 * Open (creating if needed) the store in 'dir' and index its segments
+		 *
+		 * @param error [OUT] Reason when it fails; the server then keeps
+		 * the in-memory history only
+		 */
+		bool	open(const std::string& dir, size_t segmentBytes, size_t maxSegments, size_t perChannel,
+					std::string& error);
+		void	close();
+		void	setLimits(size_t maxSegments, size_t perChannel);	//* Reload; the segment cap is enforced by step()
+
+		inline bool	enabled() const { return head_ != NULL; }
+		unsigned long	lastMsgid() const;			//* Highest msgid stored (0 = empty)
+
+		void	append(const std::string& channel, unsigned long msgid, long long timeMs, const std::string& line);
+
+		//* Same semantics as ChannelHistory: chronological, at most 'limit'
+		void	latest(const std::string& channel, size_t limit, std::vector<Hit>& out) const;
+		void	latestAfter(const std::string& channel, const ChannelHistory::Bound& bound, size_t limit,
+					std::vector<Hit>& out) const;
+		void	before(const std::string& channel, const ChannelHistory::Bound& bound, size_t limit,
+					std::vector<Hit>& out) const;
+		void	after(const std::string& channel, const ChannelHistory::Bound& bound, size_t limit,
+					std::vector<Hit>& out) const;
+
+		//* Background rotation/compaction; true while work is left
+		bool	pending() const;
+		void	step(size_t budgetBytes);
+
+		size_t	segmentCount() const;
+		size_t	diskBytes() const;
+		size_t	indexBytes() const;
+		unsigned long	compactedRecords() const;
+
+	private:
+		struct Segment
+		{
+			char*			base;
+			size_t			mapped;
+			size_t			used;
+			size_t			liveBytes;				//* Records still referenced by the index
+		};
+
+		struct Location
+		{
+			unsigned int	sequence;
+			unsigned int	offset;
+			unsigned long	msgid;
+		};
+
+		typedef std::deque<Location>				Index;
+		typedef std::map<unsigned int, Segment>		SegmentMap;
+
+		std::string		dir_;
+		size_t			segmentBytes_;
+		size_t			maxSegments_;
+		size_t			perChannel_;
+		SegmentMap		segments_;
+		Segment*		head_;
+		unsigned int	headSequence_;
+		std::map<std::string, Index>	index_;
+		size_t			indexEntries_;
+		unsigned long	lastMsgid_;
+		unsigned int	compacting_;				//* Segment being compacted (0 = none)
+		size_t			compactOffset_;
+		unsigned long	compactedRecords_;
+
+		std::string		segmentPath(unsigned int sequence) const;
+		bool			load(unsigned int sequence, bool isHead, std::string& error);
+		bool			createHead(unsigned int sequence);
+		void			seal();
+		void			drop(unsigned int sequence);
+		void			trim(Index& index);
+
+		const RecordHeader*	record(const Location& loc) const;
+		Location*		find(const std::string& channel, unsigned long msgid);
+		bool			write(const RecordHeader& header, const char* name, const char* line, Location& loc);
+
+		const Index*	lookup(const std::string& channel) const;
+		size_t			lowerBound(const Index& index, const ChannelHistory::Bound& bound) const;
+		size_t			upperBound(const Index& index, const ChannelHistory::Bound& bound) const;
+		bool			less(const Location& loc, const ChannelHistory::Bound& bound, bool orEqual) const;
+		void			collect(const Index& index, size_t from, size_t to, std::vector<Hit>& out) const;
+
+		HistoryStore(const HistoryStore&);
+		HistoryStore& operator=(const HistoryStore&);
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "MaskList.hpp"
+#include "../client/User.hpp"
+#include "../irc/CommandHelpers.hpp"
+#include "../metrics/Metrics.hpp"
+#include <algorithm>
+#include <cctype>
+
+static std::string lower(const std::string& s)
+{
+	std::string out(s);
+	for (size_t i = 0; i < out.size(); ++i)
+		out[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(out[i])));
+	return out;
+}
+
+static bool isSeparator(char c)
+{
+	return c == '.' || c == ':';
+}
+
+MaskList::MaskList()
+{
+}
+
+// ========================================================================
+// 							   Masks
+// ========================================================================
+
+std::string MaskList::normalize(const std::string& mask)
+{
+	size_t bang = mask.find('!');
+	size_t at = mask.find('@', bang == std::string::npos ? 0 : bang);
+	std::string nick = mask.substr(0, std::min(bang, at));
+	std::string user;
+	std::string host;
+	if (bang != std::string::npos)
+		user = mask.substr(bang + 1, at == std::string::npos ? std::string::npos : at - bang - 1);
+	else if (at != std::string::npos)
+	{
+		user = nick;
+		nick = "*";
+	}
+	if (at != std::string::npos)
+		host = mask.substr(at + 1);
+	return (nick.empty() ? "*" : nick) + "!" + (user.empty() ? "*" : user) + "@" + (host.empty() ? "*" : host);
+}
+
+//* Where a compiled entry is filed (see the class comment): a map and its
+//* key, or no map for the generic list
+void MaskList::locate(const Entry& entry, Buckets*& map, std::string& key)
+{
+	const std::string& host = entry.host;
+	size_t first = host.find_first_of("*?");
+	map = NULL;
+	if (first == std::string::npos)
+	{
+		map = &exactHost_;
+		key = host;
+		return;
+	}
+
+	//* Literal head cut back to its last separator, literal tail cut forward
+	//* to its first one
+	std::string prefix = host.substr(0, first);
+	size_t cut = prefix.find_last_of(".:");
+	prefix = (cut == std::string::npos) ? "" : prefix.substr(0, cut + 1);
+	std::string suffix = host.substr(host.find_last_of("*?") + 1);
+	cut = suffix.find_first_of(".:");
+	suffix = (cut == std::string::npos) ? "" : suffix.substr(cut);
+
+	if (!suffix.empty() && suffix.size() >= prefix.size())
+	{
+		map = &hostSuffix_;
+		key = suffix;
+	}
+	else if (!prefix.empty())
+	{
+		map = &hostPrefix_;
+		key = prefix;
+	}
+	else if (entry.nick.find_first_of("*?") == std::string::npos)
+	{
+		map = &exactNick_;
+		key = entry.nick;
+	}
+}
+
+bool MaskList::add(const std::string& mask, const std::string& setter, time_t setAt)
+{
+	std::string key = lower(mask);
+	if (byMask_.count(key))
+		return false;
+
+	Entry entry;
+	entry.mask = mask;
+	entry.setter = setter;
+	entry.setAt = setAt;
+	size_t bang = key.find('!');
+	size_t at = key.find('@', bang);
+	entry.nick = key.substr(0, bang);
+	entry.user = key.substr(bang + 1, at - bang - 1);
+	entry.host = key.substr(at + 1);
+
+	Entries::iterator it = entries_.insert(entries_.end(), entry);
+	byMask_[key] = it;
+	Buckets* map;
+	std::string bucketKey;
+	locate(*it, map, bucketKey);
+	(map ? (*map)[bucketKey] : generic_).push_back(&*it);
+	return true;
+}
+
+bool MaskList::remove(const std::string& mask)
+{
+	std::map<std::string, Entries::iterator>::iterator found = byMask_.find(lower(mask));
+	if (found == byMask_.end())
+		return false;
+	const Entry* entry = &*found->second;
+	Buckets* map;
+	std::string key;
+	locate(*entry, map, key);
+	std::vector<const Entry*>& bucket = map ? (*map)[key] : generic_;
+	for (size_t i = 0; i < bucket.size(); ++i)
+	{
+		if (bucket[i] == entry)
+		{
+			bucket.erase(bucket.begin() + i);
+			break;
+		}
+	}
+	//* A list that churns (bans set and lifted all day) must not keep every key it saw
+	if (map && bucket.empty())
+		map->erase(key);
+	entries_.erase(found->second);
+	byMask_.erase(found);
+	return true;
+}
+
+void MaskList::clear()
+{
+	entries_.clear();
+	byMask_.clear();
+	exactHost_.clear();
+	hostSuffix_.clear();
+	hostPrefix_.clear();
+	exactNick_.clear();
+	generic_.clear();
+}
+
+// ========================================================================
+// 							   Matching
+// ========================================================================
+
+bool MaskList::check(const std::vector<const Entry*>& candidates, const std::string& nick,
+	const std::string& user, const std::string& host)
+{
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		const Entry& e = *candidates[i];
+		if (matchMask(e.host, host) && matchMask(e.user, user) && matchMask(e.nick, nick))
+			return true;
+	}
+	return false;
+}
+
+bool MaskList::check(const Buckets& buckets, const std::string& key, const std::string& nick,
+	const std::string& user, const std::string& host)
+{
+	Buckets::const_iterator it = buckets.find(key);
+	return it != buckets.end() && check(it->second, nick, user, host);
+}
+
+bool MaskList::matches(const std::string& nick, const std::string& user, const std::string& host) const
+{
+	if (entries_.empty())
+		return false;
+	std::string h = lower(host);
+	if (check(exactHost_, h, nick, user, h))
+		return true;
+	if (!hostSuffix_.empty() || !hostPrefix_.empty())
+	{
+		for (size_t i = 0; i < h.size(); ++i)
+		{
+			if (!isSeparator(h[i]))
+				continue;
+			if (check(hostSuffix_, h.substr(i), nick, user, h)
+				|| check(hostPrefix_, h.substr(0, i + 1), nick, user, h))
+				return true;
+		}
+	}
+	if (!exactNick_.empty() && check(exactNick_, lower(nick), nick, user, h))
+		return true;
+	return check(generic_, nick, user, h);
+}
+
+bool MaskList::matches(const User& user) const
+{
+	return matches(user.getNickname(), user.getUsername(), user.getHostname());
+}
+
+// ========================================================================
+// 							   Access
+// ========================================================================
+
+const std::list<MaskList::Entry>& MaskList::entries() const
+{
+	return entries_;
+}
+
+size_t MaskList::size() const
+{
+	return entries_.size();
+}
+
+bool MaskList::empty() const
+{
+	return entries_.empty();
+}
+
+size_t MaskList::memoryBytes() const
+{
+	size_t bytes = 0;
+	for (Entries::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+		bytes += sizeof(Entry) + stringHeapBytes(it->mask) + stringHeapBytes(it->setter)
+			+ stringHeapBytes(it->nick) + stringHeapBytes(it->user) + stringHeapBytes(it->host);
+	return bytes;
+}
@@ -0,0 +1,83 @@
+#ifndef MASK_LIST_HPP
+#define MASK_LIST_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <ctime>
+
+class User;
+
+/**
+ * MaskList: a channel's +b, +e or +I list, compiled for matching
+ *
+ * Every mask is "nick!user@host" ('*' and '?', case-insensitive). Instead
+ * of trying each one against a user, the list files them by a literal
+ * piece the user's own identity must contain:
+ *
+ *   host without wildcards       exact host     "*!*@10.0.0.5"
+ *   host ending in a literal     host suffix    "*!*@*.example.com"  -> ".example.com"
+ *   host starting with one       host prefix    "*!*@10.0.*"         -> "10.0."
+ *   otherwise, literal nick      exact nick     "spammer!*@*"
+ *   nothing literal              generic        "*!*bot*@*"
+ *
+ * Suffixes start and prefixes end at a '.' or ':' (the literal is cut back
+ * to one), so a host is looked up at its dots only: a handful of map
+ * lookups whatever the size of the list. Only the masks found that way,
+ * plus the generic ones, are matched as globs.
+ */
+
+class MaskList
+{
+	public:
+		struct Entry
+		{
+			std::string		mask;				//* As set (normalized)
+			std::string		setter;				//* nick!user@host or server name
+			time_t			setAt;
+			std::string		nick;				//* The three patterns, lowercase
+			std::string		user;
+			std::string		host;
+		};
+
+		//* "nick" -> "nick!*@*", "user@host" -> "*!user@host", "nick!user" -> "nick!user@*"
+		static std::string	normalize(const std::string& mask);
+
+		MaskList();
+
+		bool	add(const std::string& mask, const std::string& setter, time_t setAt);	//* false if present
+		bool	remove(const std::string& mask);										//* false if absent
+		void	clear();
+
+		bool	matches(const User& user) const;
+		bool	matches(const std::string& nick, const std::string& user, const std::string& host) const;
+
+		const std::list<Entry>&	entries() const;		//* In the order they were set
+		size_t					size() const;
+		bool					empty() const;
+		size_t					memoryBytes() const;
+
+	private:
+		typedef std::list<Entry>								Entries;
+		typedef std::map<std::string, std::vector<const Entry*> >	Buckets;
+
+		Entries								entries_;
+		std::map<std::string, Entries::iterator>	byMask_;	//* Lowercase mask -> entry
+		Buckets								exactHost_;
+		Buckets								hostSuffix_;
+		Buckets								hostPrefix_;
+		Buckets								exactNick_;
+		std::vector<const Entry*>			generic_;
+
+		void	locate(const Entry& entry, Buckets*& map, std::string& key);
+		static bool	check(const std::vector<const Entry*>& candidates, const std::string& nick,
+			const std::string& user, const std::string& host);
+		static bool	check(const Buckets& buckets, const std::string& key, const std::string& nick,
+			const std::string& user, const std::string& host);
+
+		MaskList(const MaskList&);
+		MaskList& operator=(const MaskList&);
+};
+
+#endif
@@ -12,16 +12,24 @@
 
 #include "ClientConnection.hpp"
 #include <ctime>
+#include <algorithm>
+#include <sys/uio.h>
 
-ClientConnection::ClientConnection(int fd): _fd(fd), _recvBuffer(""),
-_sendBuffer(""), _registered(false), _hasSentPass(false), _closed(false),
-_lastActivity(std::time(NULL)), _user(NULL)
+size_t ClientConnection::s_laneLimit[LANE_COUNT] = { 0, 0 };
+
+ClientConnection::ClientConnection(int fd, unsigned long id, const std::string& host,
+const NetAddress& addr): _fd(fd), _id(id), _host(host), _addr(addr), _kind(KIND_CLIENT), _recvBuffer(""),
+_bulkMidLine(false), _holding(false), _registered(false), _hasSentPass(false), _capNegotiating(false), _caps(0),
+_closed(false), _draining(false), _lingering(false), _drainDeadline(0), _closeCause(DISC_EOF), _lastActivity(std::time(NULL)), _user(NULL)
 {
 }
 
 ClientConnection::~ClientConnection()
 {
 	//? Don't delete _user (managed by Server)
+	for (int i = 0; i < LANE_COUNT; ++i)
+		g_metrics.sendqBytes[i].sub(_lanes[i].size());
+	g_metrics.sendqBytes[LANE_CONTROL].sub(_held.size());
 }
 
 // ========================================================================
@@ -48,6 +56,31 @@ bool ClientConnection::hasSentPass() const
 	return _hasSentPass;
 }
 
+void ClientConnection::setCapNegotiating(bool on)
+{
+	_capNegotiating = on;
+}
+
+bool ClientConnection::isCapNegotiating() const
+{
+	return _capNegotiating;
+}
+
+void ClientConnection::setCaps(unsigned int caps)
+{
+	_caps = caps;
+}
+
+unsigned int ClientConnection::getCaps() const
+{
+	return _caps;
+}
+
+bool ClientConnection::hasCap(Capability cap) const
+{
+	return (_caps & cap) != 0;
+}
+
 // ========================================================================
 // 							 	  Socket Info
 // ========================================================================
@@ -57,6 +90,31 @@ int ClientConnection::getFd() const
 	return _fd;
 }
 
+unsigned long ClientConnection::getId() const
+{
+	return _id;
+}
+
+const std::string& ClientConnection::getHost() const
+{
+	return _host;
+}
+
+const NetAddress& ClientConnection::getAddress() const
+{
+	return _addr;
+}
+
+ClientConnection::Kind ClientConnection::getKind() const
+{
+	return _kind;
+}
+
+void ClientConnection::setKind(Kind kind)
+{
+	_kind = kind;
+}
+
 // ========================================================================
 // 							  IO Operations
 // ========================================================================
@@ -80,24 +138,222 @@ std::string ClientConnection::popLine()
 	return line;
 }
 
-void ClientConnection::queueSend(const std::string& data)
+// ========================================================================
+// 							   Output Lanes
+// ========================================================================
+
+void ClientConnection::setLaneLimits(size_t control, size_t bulk)
+{
+	s_laneLimit[LANE_CONTROL] = control;
+	s_laneLimit[LANE_BULK] = bulk;
+}
+
+void ClientConnection::queueSend(const std::string& data, OutputLane lane)
+{
+	queueSend(data.data(), data.size(), lane);
+}
+
+void ClientConnection::queueSend(const char* data, size_t length, OutputLane lane)
+{
+	std::string& queue = (lane == LANE_CONTROL && _holding) ? _held : _lanes[lane];
+	if (lane == LANE_BULK && _closed)
+		return;		//* Closing: only control (ERROR, its own QUIT) still matters
+	size_t queued = _lanes[lane].size() + (lane == LANE_CONTROL ? _held.size() : 0);
+	if (_kind == KIND_CLIENT && s_laneLimit[lane] && queued + length > s_laneLimit[lane])
+		return overflow(lane);
+	queue.append(data, length);
+	g_metrics.sendqBytes[lane].add(length);
+	g_metrics.sendqDepth[lane].record(queued + length);
+}
+
+//* A client that does not read: its bulk backlog is dropped (except a line
+//* already half on the wire) and the ERROR goes out on control, past the limit
+void ClientConnection::overflow(OutputLane lane)
+{
+	if (_closed)
+		return;
+	g_metrics.sendqExceeded[lane].inc();
+	std::string& bulk = _lanes[LANE_BULK];
+	size_t keep = bulkHead();
+	g_metrics.sendqBytes[LANE_BULK].sub(bulk.size() - keep);
+	bulk.erase(keep);
+	g_metrics.sendqBytes[LANE_CONTROL].sub(_held.size());
+	_held.clear();
+	closeConnection("Max SendQ exceeded", DISC_SENDQ);
+
+	std::string error = "ERROR :Closing Link: " + _host + " (Max SendQ exceeded)\r\n";
+	_lanes[LANE_CONTROL] += error;
+	g_metrics.sendqBytes[LANE_CONTROL].add(error.size());
+}
+
+size_t ClientConnection::bulkHead() const
 {
-	_sendBuffer += data;
+	if (!_bulkMidLine)
+		return 0;
+	size_t eol = _lanes[LANE_BULK].find('\n');
+	return (eol == std::string::npos) ? _lanes[LANE_BULK].size() : eol + 1;
 }
 
 bool ClientConnection::hasPendingSend() const
 {
-	return !_sendBuffer.empty();
+	return !_lanes[LANE_CONTROL].empty() || !_lanes[LANE_BULK].empty();
+}
+
+size_t ClientConnection::getSendQueueSize() const
+{
+	return _lanes[LANE_CONTROL].size() + _lanes[LANE_BULK].size() + _held.size();
+}
+
+size_t ClientConnection::getLaneSize(OutputLane lane) const
+{
+	return _lanes[lane].size();
 }
 
-const std::string& ClientConnection::getSendBuffer() const
+//* Flush order: the rest of a half-sent bulk line, control, then bulk
+int ClientConnection::prepareSend(struct iovec* iov) const
 {
-	return _sendBuffer;
+	const std::string& control = _lanes[LANE_CONTROL];
+	const std::string& bulk = _lanes[LANE_BULK];
+	size_t head = bulkHead();
+	int count = 0;
+	if (head)
+	{
+		iov[count].iov_base = const_cast<char*>(bulk.data());
+		iov[count++].iov_len = head;
+	}
+	if (!control.empty())
+	{
+		iov[count].iov_base = const_cast<char*>(control.data());
+		iov[count++].iov_len = control.size();
+	}
+	if (bulk.size() > head)
+	{
+		iov[count].iov_base = const_cast<char*>(bulk.data() + head);
+		iov[count++].iov_len = bulk.size() - head;
+	}
+	return count;
 }
 
 void ClientConnection::clearSentData(size_t bytes)
 {
-	_sendBuffer.erase(0, bytes);
+	std::string& control = _lanes[LANE_CONTROL];
+	std::string& bulk = _lanes[LANE_BULK];
+
+	size_t head = bulkHead();
+	size_t n = std::min(bytes, head);
+	bulk.erase(0, n);
+	g_metrics.sendqBytes[LANE_BULK].sub(n);
+	bytes -= n;
+	if (n < head)
+		return;		//* Still inside that line
+	_bulkMidLine = false;
+
+	n = std::min(bytes, control.size());
+	control.erase(0, n);
+	g_metrics.sendqBytes[LANE_CONTROL].sub(n);
+	bytes -= n;
+
+	//* Stopping halfway through a bulk line pins it: the rest goes before
+	//* any control line queued meanwhile
+	n = std::min(bytes, bulk.size());
+	if (n == 0)
+		return;
+	_bulkMidLine = bulk[n - 1] != '\n';
+	bulk.erase(0, n);
+	g_metrics.sendqBytes[LANE_BULK].sub(n);
+}
+
+std::string ClientConnection::getPendingOutput() const
+{
+	size_t head = bulkHead();
+	return _lanes[LANE_BULK].substr(0, head) + _lanes[LANE_CONTROL] + _held + _lanes[LANE_BULK].substr(head);
+}
+
+// ========================================================================
+// 							 Streamed Replies
+// ========================================================================
+
+void ClientConnection::holdReplies()
+{
+	_holding = true;
+}
+
+void ClientConnection::releaseReplies()
+{
+	_holding = false;
+	_lanes[LANE_CONTROL] += _held;
+	_held.clear();
+}
+
+//* The caller queues them as a stream of their own, between two streams
+std::string ClientConnection::takeHeldReplies()
+{
+	std::string held;
+	held.swap(_held);
+	g_metrics.sendqBytes[LANE_CONTROL].sub(held.size());
+	return held;
+}
+
+//* Paced by the server (STREAM_LOW_WATER): no lane budget here
+void ClientConnection::queueStreamOutput(const std::string& data)
+{
+	_lanes[LANE_CONTROL] += data;
+	g_metrics.sendqBytes[LANE_CONTROL].add(data.size());
+	g_metrics.sendqDepth[LANE_CONTROL].record(_lanes[LANE_CONTROL].size());
+}
+
+const std::string& ClientConnection::getRecvBuffer() const
+{
+	return _recvBuffer;
+}
+
+//* The old process hands over getPendingOutput(): already in flush order
+void ClientConnection::restoreBuffers(const std::string& recv, const std::string& send)
+{
+	_recvBuffer = recv;
+	for (int i = 0; i < LANE_COUNT; ++i)
+	{
+		g_metrics.sendqBytes[i].sub(_lanes[i].size());
+		_lanes[i].clear();
+	}
+	_bulkMidLine = false;
+	g_metrics.sendqBytes[LANE_CONTROL].sub(_held.size());
+	_held.clear();
+	_holding = false;
+	_lanes[LANE_CONTROL] = send;
+	g_metrics.sendqBytes[LANE_CONTROL].add(send.size());
+}
+
+// ========================================================================
+// 								 Memory
+// ========================================================================
+
+size_t ClientConnection::memoryBytes() const
+{
+	return sizeof(*this) + stringHeapBytes(_host) + stringHeapBytes(_closeReason);
+}
+
+size_t ClientConnection::bufferBytes() const
+{
+	return stringHeapBytes(_recvBuffer) + stringHeapBytes(_lanes[LANE_CONTROL]) + stringHeapBytes(_lanes[LANE_BULK])
+		+ stringHeapBytes(_held);
+}
+
+//* A std::string never gives memory back on its own: after a burst it keeps
+//* its peak capacity. Swapping with a copy sized to the content (nothing if
+//* empty) releases the rest; a pending partial line or output is kept.
+static size_t shrinkToFit(std::string& buffer)
+{
+	size_t before = stringHeapBytes(buffer);
+	std::string(buffer).swap(buffer);
+	size_t after = stringHeapBytes(buffer);
+	return (before > after ? before - after : 0);
+}
+
+size_t ClientConnection::compactBuffers()
+{
+	return shrinkToFit(_recvBuffer) + shrinkToFit(_lanes[LANE_CONTROL]) + shrinkToFit(_lanes[LANE_BULK])
+		+ shrinkToFit(_held);
 }
 
 // ========================================================================
@@ -114,13 +370,28 @@ time_t ClientConnection::getLastActivity() const
 	return _lastActivity;
 }
 
+void ClientConnection::setLastActivity(time_t t)
+{
+	_lastActivity = t;
+}
+
 // ========================================================================
 // 						  Connection Management
 // ========================================================================
 
-void ClientConnection::closeConnection()
+void ClientConnection::closeConnection(const std::string& reason, DisconnectReason cause)
 {
+	if (_closed)
+		return;		//* Keep the first reason (e.g. QUIT message over a later error)
 	_closed = true;
+	_closeReason = reason;
+	_closeCause = cause;
+	releaseReplies();		//* Its ERROR line must not wait for a stream that is about to go
+}
+
+DisconnectReason ClientConnection::getCloseCause() const
+{
+	return _closeCause;
 }
 
 bool ClientConnection::isClosed() const
@@ -128,6 +399,38 @@ bool ClientConnection::isClosed() const
 	return _closed;
 }
 
+const std::string& ClientConnection::getCloseReason() const
+{
+	return _closeReason;
+}
+
+void ClientConnection::startDraining(time_t deadline)
+{
+	_closed = true;
+	_draining = true;
+	_drainDeadline = deadline;
+}
+
+bool ClientConnection::isDraining() const
+{
+	return _draining;
+}
+
+time_t ClientConnection::getDrainDeadline() const
+{
+	return _drainDeadline;
+}
+
+void ClientConnection::startLingering()
+{
+	_lingering = true;
+}
+
+bool ClientConnection::isLingering() const
+{
+	return _lingering;
+}
+
 // ========================================================================
 // 						   User Association
 // ========================================================================
@@ -16,9 +16,12 @@
 #include <iostream>
 #include <string>
 #include <ctime>
+#include "../net/AddressTable.hpp"
+#include "../metrics/Metrics.hpp"
 
 class Server;
 class User;
+struct iovec;
 
 /** 
  * -R- Manages the TCP connection state, I/O buffers, and authentication status.
@@ -27,7 +30,22 @@ class User;
 class ClientConnection
 {
     public:
-        ClientConnection(int fd);
+        enum Kind
+        {
+            KIND_CLIENT,						//* IRC client
+            KIND_SCRAPE,						//* Metrics listener request: one reply, then drain
+            KIND_SERVER							//* Link to another ircserv (TS6 lines, no User)
+        };
+
+        //* IRCv3 capabilities a client can enable with CAP REQ
+        enum Capability
+        {
+            CAP_BATCH = 1,
+            CAP_MESSAGE_TAGS = 2,
+            CAP_SERVER_TIME = 4
+        };
+
+        ClientConnection(int fd, unsigned long id, const std::string& host, const NetAddress& addr);
         ~ClientConnection();
 
         /* Connection state */
@@ -35,27 +53,74 @@ class ClientConnection
         void	setRegistered(bool r);
         void	markPassReceived();
         bool	hasSentPass() const;
+        void	setCapNegotiating(bool on);			//* CAP LS/REQ before registering: wait for CAP END
+        bool	isCapNegotiating() const;
+        void	setCaps(unsigned int caps);			//* Capability bits
+        unsigned int	getCaps() const;
+        bool	hasCap(Capability cap) const;
         
         /* Socket info */
         int		getFd() const;
+        unsigned long	getId() const;
+        const std::string& getHost() const;
+        const NetAddress& getAddress() const;
+        Kind	getKind() const;
+        void	setKind(Kind kind);
         
         /* IO operations */
         void	appendRecvData(const std::string& data);
         bool	hasCompleteLine() const;
         std::string	popLine();
         
-        void	queueSend(const std::string& data);
+        /* Output lanes: control is flushed before bulk, so a PONG never waits
+           behind channel backlog. Lanes only alternate between whole lines */
+        static const int SEND_IOV_MAX = 3;
+        //* Budget of each lane for IRC clients (0 = unlimited): over it the
+        //* client is closed with "Max SendQ exceeded"
+        static void	setLaneLimits(size_t control, size_t bulk);
+
+        void	queueSend(const std::string& data, OutputLane lane = LANE_CONTROL);
+        void	queueSend(const char* data, size_t length, OutputLane lane = LANE_CONTROL);	//* E.g. a line straight from a history mapping
         bool	hasPendingSend() const;
-        const std::string& getSendBuffer() const;
-        void	clearSentData(size_t bytes);
+        size_t	getSendQueueSize() const;				//* Both lanes and held replies
+        size_t	getLaneSize(OutputLane lane) const;
+        int		prepareSend(struct iovec* iov) const;	//* Up to SEND_IOV_MAX slices, in flush order
+        void	clearSentData(size_t bytes);			//* Consumed in that same order
+        std::string	getPendingOutput() const;			//* Everything queued, in flush order
+
+        /* Streamed replies (Server::startStream): while one is served, control
+           replies to later commands are held and go out after it */
+        void	holdReplies();
+        void	releaseReplies();						//* Held replies join the control lane
+        std::string	takeHeldReplies();					//* Held so far, out of the connection
+        void	queueStreamOutput(const std::string& data);	//* Control lane, ahead of held replies
+
+        /* Hot upgrade: the buffers move to the new process as they are */
+        const std::string& getRecvBuffer() const;
+        void	restoreBuffers(const std::string& recv, const std::string& send);
+
+        /* Memory: estimates for the metrics, and idle compaction */
+        size_t	memoryBytes() const;					//* Object + its strings, buffers excluded
+        size_t	bufferBytes() const;					//* Receive + send buffers
+        size_t	compactBuffers();						//* Release/shrink both buffers, returns bytes freed
 
         /* Activity tracking */
         void	updateActivity();
         time_t	getLastActivity() const;
+        void	setLastActivity(time_t t);
 
         /* Connection management */
-        void	closeConnection();
+        void	closeConnection(const std::string& reason = "Connection closed", DisconnectReason cause = DISC_EOF);
         bool	isClosed() const;
+        const std::string& getCloseReason() const;
+        DisconnectReason getCloseCause() const;
+
+        /* Draining: flush pending output, then shutdown(SHUT_WR), then close */
+        void	startDraining(time_t deadline);
+        bool	isDraining() const;
+        time_t	getDrainDeadline() const;
+        void	startLingering();						//* Output flushed and FIN sent
+        bool	isLingering() const;
 
         /* User association */
         void	setUser(User* user);
@@ -63,17 +128,36 @@ class ClientConnection
 
     private:
         const int _fd;							//* TCP socket (const after construction)
+        const unsigned long _id;				//* Unique per process, never reused (fds are)
+        std::string _host;						//* Peer address, handed to User when it is created
+        NetAddress _addr;						//* Per-source accounting key (AddressTable)
+        Kind _kind;
         
         std::string	_recvBuffer;				//* Incoming data buffer
-        std::string _sendBuffer;				//* Outgoing data buffer
+        std::string _lanes[LANE_COUNT];			//* Outgoing data, one buffer per OutputLane
+        bool _bulkMidLine;						//* Part of a bulk line went out: its rest goes first
+        std::string _held;						//* Control replies waiting behind a stream
+        bool _holding;							//* A stream is being served
         
         bool _registered;						//* True after PASS + NICK + USER sequence
         bool _hasSentPass;						//* True after valid PASS command
+        bool _capNegotiating;					//* Registration waits for CAP END
+        unsigned int _caps;						//* Enabled Capability bits
         bool _closed;							//* True if connection should be terminated
+        bool _draining;							//* Closed, still flushing its lanes (no more input)
+        bool _lingering;						//* Flushed + SHUT_WR sent, waiting for the peer's EOF
+        time_t _drainDeadline;					//* Force close after this, flushed or not
+        std::string _closeReason;				//* QUIT reason shown to channels
+        DisconnectReason _closeCause;			//* Same, as a metrics label
         
         time_t _lastActivity;					//* Timestamp of last received data
         
-        User* _user;							//* Pointer to associated User (NULL until registered)
+        User* _user;							//* Pointer to associated User (NULL until first NICK/USER)
+
+        static size_t s_laneLimit[LANE_COUNT];
+
+        size_t	bulkHead() const;						//* Rest of a half-sent bulk line (0 if none)
+        void	overflow(OutputLane lane);
 
         ClientConnection(const ClientConnection&);
         ClientConnection& operator=(const ClientConnection&);
@@ -11,17 +11,21 @@
 /* ************************************************************************** */
 
 #include "User.hpp"
+#include "../metrics/Metrics.hpp"
 #include <algorithm>
+#include <sstream>
 
 User::User() : _nickname(""), _username(""), _realname(""), _hostname(""),
 _isOperator(false), _isInvisible(false), _isAway(false), _awayMessage(""),
-_connection(NULL)
+_connection(NULL), _uid(""), _nickTs(0), _route(NULL), _serverId(""), _serverName(""), _hops(0),
+_whoStale(true)
 {
 }
 
 User::User(const std::string& nickname): _nickname(nickname), _username(""),
 _realname(""), _hostname(""), _isOperator(false), _isInvisible(false),
-_isAway(false), _awayMessage(""), _connection(NULL)
+_isAway(false), _awayMessage(""), _connection(NULL), _uid(""), _nickTs(0), _route(NULL),
+_serverId(""), _serverName(""), _hops(0), _whoStale(true)
 {
 }
 
@@ -62,21 +66,25 @@ const std::string& User::getHostname() const
 void User::setNickname(const std::string& nick)
 {
 	_nickname = nick;
+	_whoStale = true;
 }
 
 void User::setUsername(const std::string& user)
 {
 	_username = user;
+	_whoStale = true;
 }
 
 void User::setRealname(const std::string& real)
 {
 	_realname = real;
+	_whoStale = true;
 }
 
 void User::setHostname(const std::string& host)
 {
 	_hostname = host;
+	_whoStale = true;
 }
 
 // ========================================================================
@@ -164,6 +172,28 @@ void User::leaveChannel(Channel* channel)
 		_channels.erase(it);
 }
 
+// ========================================================================
+// 								 Memory
+// ========================================================================
+
+size_t User::memoryBytes() const
+{
+	return sizeof(*this) + stringHeapBytes(_nickname) + stringHeapBytes(_username)
+		+ stringHeapBytes(_realname) + stringHeapBytes(_hostname) + stringHeapBytes(_awayMessage)
+		+ stringHeapBytes(_uid) + stringHeapBytes(_serverId)
+		+ stringHeapBytes(_serverName) + stringHeapBytes(_whoHead) + stringHeapBytes(_whoTail)
+		+ _channels.capacity() * sizeof(Channel*);
+}
+
+size_t User::compact()
+{
+	size_t before = _channels.capacity();
+	if (before == _channels.size())
+		return 0;
+	std::vector<Channel*>(_channels).swap(_channels);
+	return (before - _channels.capacity()) * sizeof(Channel*);
+}
+
 // ========================================================================
 // 						  Connection Association
 // ========================================================================
@@ -182,3 +212,92 @@ bool User::isConnected() const
 {
 	return _connection != NULL;
 }
+
+// ========================================================================
+// 							   Server Links
+// ========================================================================
+
+const std::string& User::getUid() const
+{
+	return _uid;
+}
+
+void User::setUid(const std::string& uid)
+{
+	_uid = uid;
+}
+
+time_t User::getNickTs() const
+{
+	return _nickTs;
+}
+
+void User::setNickTs(time_t ts)
+{
+	_nickTs = ts;
+}
+
+void User::setRoute(ClientConnection* link, const std::string& sid)
+{
+	_route = link;
+	_serverId = sid;
+}
+
+ClientConnection* User::getRoute() const
+{
+	return _route;
+}
+
+const std::string& User::getServerId() const
+{
+	return _serverId;
+}
+
+bool User::isRemote() const
+{
+	return _route != NULL;
+}
+
+// ========================================================================
+// 							  WHO / WHOIS
+// ========================================================================
+
+void User::setServer(const std::string& name, unsigned int hops)
+{
+	_serverName = name;
+	_hops = hops;
+	_whoStale = true;
+}
+
+const std::string& User::getServerName() const
+{
+	return _serverName;
+}
+
+unsigned int User::getHops() const
+{
+	return _hops;
+}
+
+void User::buildWho() const
+{
+	std::ostringstream tail;
+	tail << ":" << _hops << " " << _realname;
+	_whoHead = _username + " " + _hostname + " " + _serverName + " " + _nickname;
+	_whoTail = tail.str();
+	_whoStale = false;
+}
+
+const std::string& User::getWhoHead() const
+{
+	if (_whoStale)
+		buildWho();
+	return _whoHead;
+}
+
+const std::string& User::getWhoTail() const
+{
+	if (_whoStale)
+		buildWho();
+	return _whoTail;
+}
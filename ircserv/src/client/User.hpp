@@ -15,6 +15,7 @@
 
 #include <string>
 #include <vector>
+#include <ctime>
 
 class Channel;
 class ClientConnection;
@@ -65,11 +66,32 @@ class User
         bool				isInChannel(Channel* channel) const;
         const std::vector<Channel*>& getChannels() const;
 
+        /* Memory */
+        size_t				memoryBytes() const;	//* Object + strings + channel list
+        size_t				compact();				//* Shrink the channel list, returns bytes freed
+
         /* Connection association */
         void				setConnection(ClientConnection* conn);
         ClientConnection*	getConnection() const;
         bool				isConnected() const;
 
+        /* Server links (TS6 identity) */
+        const std::string&	getUid() const;		//* SID + 6 chars, unique in the whole tree
+        void				setUid(const std::string& uid);
+        time_t				getNickTs() const;	//* When the nick was taken: the older one wins a collision
+        void				setNickTs(time_t ts);
+        void				setRoute(ClientConnection* link, const std::string& sid);
+        ClientConnection*	getRoute() const;	//* Link toward a remote user (NULL = local)
+        const std::string&	getServerId() const;	//* SID of the server the user is on
+        bool				isRemote() const;
+
+        /* WHO / WHOIS */
+        void				setServer(const std::string& name, unsigned int hops);
+        const std::string&	getServerName() const;
+        unsigned int		getHops() const;
+        const std::string&	getWhoHead() const;	//* "<user> <host> <server> <nick>"
+        const std::string&	getWhoTail() const;	//* ":<hops> <realname>"
+
     private:
         std::string	_nickname;					//* IRC nickname (NICK command)
         std::string	_username;					//* Username from USER command
@@ -84,6 +106,21 @@ class User
         std::vector<Channel*>	_channels;		//* List of joined channels
         ClientConnection*		_connection;	//* NULL if disconnected
 
+        std::string	_uid;						//* "" until registered
+        time_t		_nickTs;
+        ClientConnection*	_route;				//* Remote users only: the link they are behind
+        std::string	_serverId;					//* Remote users only
+        std::string	_serverName;				//* Server the user is on (ours for local users)
+        unsigned int	_hops;
+
+        //* 352 pieces, rebuilt on first use after a change: a WHO on a
+        //* big channel only concatenates
+        mutable std::string	_whoHead;
+        mutable std::string	_whoTail;
+        mutable bool		_whoStale;
+
+        void		buildWho() const;
+
         User(const User&);
         User& operator=(const User&);
 };
@@ -13,13 +13,16 @@
 #include "CommandHelpers.hpp"
 #include "../client/User.hpp"
 #include "../irc/NumericReplies.hpp"
-#include <iostream>
 #include <sstream>
+#include <cctype>
 
 void sendReply(ClientConnection* client, std::string num, std::string msg)
 {
-    if (!client || !client->getUser()) return;
-    std::string finalMsg = ":ft_irc " + num + " " + client->getUser()->getNickname() + " " + msg + "\r\n";
+    if (!client) return;
+    // Antes de NICK el destino es "*" (RFC 2812), y puede no existir User aún
+    User* user = client->getUser();
+    const std::string& nick = (user && !user->getNickname().empty()) ? user->getNickname() : "*";
+    std::string finalMsg = ":ft_irc " + num + " " + nick + " " + msg + "\r\n";
     client->queueSend(finalMsg);
 }
 
@@ -44,7 +47,13 @@ void sendError(ClientConnection* client, std::string num, std::string arg)
     else if (num == ERR_INVITEONLYCHAN) msg = arg + " :Cannot join channel (+i)";
     else if (num == ERR_BADCHANNELKEY) msg = arg + " :Cannot join channel (+k)";
     else if (num == ERR_CHANNELISFULL) msg = arg + " :Cannot join channel (+l)";
+    else if (num == ERR_BANNEDFROMCHAN) msg = arg + " :Cannot join channel (+b)";
+    else if (num == ERR_CANNOTSENDTOCHAN) msg = arg + " :Cannot send to channel";
     else if (num == ERR_USERNOTINCHANNEL) msg = arg + " :They aren't on that channel";
+    else if (num == ERR_NOTREGISTERED) msg = ":You have not registered";
+    else if (num == ERR_NOPRIVILEGES) msg = ":Permission Denied- You're not an IRC operator";
+    else if (num == ERR_NOOPERHOST) msg = ":No O-lines for your host";
+    else if (num == ERR_INVALIDCAPCMD) msg = arg + " :Invalid CAP command";
     else msg = arg + " :Unknown Error";
 
     sendReply(client, num, msg);
@@ -61,21 +70,34 @@ std::vector<std::string> split(const std::string &s, char delimiter) {
     return tokens;
 }
 
-void checkRegistration(ClientConnection* client)
-{
-    if (client->isRegistered()) return;
-    
-    User* user = client->getUser();
-    // Requisito: Haber mandado PASS, tener Nick y tener User
-    if (client->hasSentPass() && !user->getNickname().empty() && !user->getUsername().empty())
-    {
-        client->setRegistered(true);
-        // Mensajes de bienvenida estándar
-        sendReply(client, RPL_WELCOME, ":Welcome to the FT_IRC Network " + user->getPrefix());
-        sendReply(client, RPL_YOURHOST, ":Your host is ft_irc, running version 1.0");
-        sendReply(client, RPL_CREATED, ":This server was created today");
-        sendReply(client, RPL_MYINFO, "ft_irc 1.0 io tkl"); // Modos soportados
-        
-        std::cout << "[SERVER] User registered: " << user->getNickname() << std::endl;
+std::string toString(unsigned long n) {
+    std::ostringstream oss;
+    oss << n;
+    return oss.str();
+}
+
+// Con retroceso al último '*': lineal en la práctica, sin recursión
+bool matchMask(const std::string& mask, const std::string& text) {
+    size_t m = 0, t = 0;
+    size_t star = std::string::npos, mark = 0;
+    while (t < text.size()) {
+        if (m < mask.size() && mask[m] == '*') {
+            star = m++;
+            mark = t;
+        }
+        else if (m < mask.size() && (mask[m] == '?'
+            || std::tolower(static_cast<unsigned char>(mask[m])) == std::tolower(static_cast<unsigned char>(text[t])))) {
+            m++;
+            t++;
+        }
+        else if (star != std::string::npos) {
+            m = star + 1;
+            t = ++mark;
+        }
+        else
+            return false;
     }
+    while (m < mask.size() && mask[m] == '*')
+        m++;
+    return m == mask.size();
 }
@@ -32,6 +32,8 @@
 void sendReply(ClientConnection* client, std::string num, std::string msg);
 void sendError(ClientConnection* client, std::string num, std::string arg);
 std::vector<std::string> split(const std::string &s, char delimiter);
-void checkRegistration(ClientConnection* client);
+std::string toString(unsigned long n);
+// Máscara IRC ('*' y '?'), sin distinguir mayúsculas
+bool matchMask(const std::string& mask, const std::string& text);
 
 #endif
@@ -0,0 +1,127 @@
+#include "ListStream.hpp"
+#include "CommandHelpers.hpp"
+#include "NumericReplies.hpp"
+#include "../channel/Channel.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+ListStream::Filter::Filter() : minUsers(0), maxUsers(std::numeric_limits<size_t>::max()), createdAfter(0),
+	createdBefore(0), topicAfter(0), topicBefore(0)
+{
+}
+
+// ========================================================================
+// 							   Filters
+// ========================================================================
+
+static bool parseCount(const std::string& s, unsigned long& out)
+{
+	if (s.empty() || s.size() > 9 || s.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	out = std::strtoul(s.c_str(), NULL, 10);
+	return true;
+}
+
+//* "C<n" / "T>n" ...: n minutes ago, as a bound on a timestamp
+static bool parseAge(const std::string& token, time_t now, time_t& after, time_t& before)
+{
+	unsigned long minutes;
+	if (token.size() < 3 || !parseCount(token.substr(2), minutes))
+		return false;
+	time_t at = now - static_cast<time_t>(minutes) * 60;
+	if (token[1] == '<')
+		after = at;			//* Less than n minutes ago: newer than 'at'
+	else if (token[1] == '>')
+		before = at;
+	else
+		return false;
+	return true;
+}
+
+bool ListStream::parseToken(const std::string& token, time_t now, Filter& filter)
+{
+	unsigned long n;
+	if (token.empty())
+		return false;
+	if (token[0] == '>' && parseCount(token.substr(1), n))
+		filter.minUsers = std::max(filter.minUsers, static_cast<size_t>(n) + 1);
+	else if (token[0] == '<' && parseCount(token.substr(1), n))
+	{
+		//* "<0": nothing; the bounds cross and the walk ends at once
+		if (n == 0)
+			filter.minUsers = std::max(filter.minUsers, static_cast<size_t>(1));
+		filter.maxUsers = std::min(filter.maxUsers, n ? static_cast<size_t>(n) - 1 : 0);
+	}
+	else if (token[0] == 'C' || token[0] == 'T')
+		return parseAge(token, now, token[0] == 'C' ? filter.createdAfter : filter.topicAfter,
+			token[0] == 'C' ? filter.createdBefore : filter.topicBefore);
+	else if (token[0] == '!' && token.size() > 1)
+		filter.notMasks.push_back(token.substr(1));
+	else if (token.find_first_of("*?") != std::string::npos)
+		filter.masks.push_back(token);
+	else
+		return false;
+	return true;
+}
+
+bool ListStream::matches(const Channel& channel, const Filter& filter)
+{
+	size_t users = channel.getUserCount();
+	if (users < filter.minUsers || users > filter.maxUsers)
+		return false;
+	if ((filter.createdAfter && channel.getCreatedAt() <= filter.createdAfter)
+		|| (filter.createdBefore && channel.getCreatedAt() >= filter.createdBefore))
+		return false;
+	if ((filter.topicAfter || filter.topicBefore) && channel.getTopic().empty())
+		return false;
+	if ((filter.topicAfter && channel.getTopicSetAt() <= filter.topicAfter)
+		|| (filter.topicBefore && channel.getTopicSetAt() >= filter.topicBefore))
+		return false;
+	for (size_t i = 0; i < filter.masks.size(); ++i)
+		if (!matchMask(filter.masks[i], channel.getName()))
+			return false;
+	for (size_t i = 0; i < filter.notMasks.size(); ++i)
+		if (matchMask(filter.notMasks[i], channel.getName()))
+			return false;
+	return true;
+}
+
+void ListStream::appendLine(std::string& out, const std::string& nick, const Channel& channel)
+{
+	out += ":ft_irc " RPL_LIST " " + nick + " " + channel.getName() + " " + toString(channel.getUserCount())
+		+ " :" + channel.getTopic() + "\r\n";
+}
+
+// ========================================================================
+// 							   Streaming
+// ========================================================================
+
+ListStream::ListStream(const ChannelListIndex& index, const std::string& nick, const Filter& filter) :
+	index_(index), nick_(nick), filter_(filter), started_(false), cursor_(0, static_cast<Channel*>(NULL))
+{
+}
+
+bool ListStream::fill(std::string& out, size_t budget)
+{
+	const ChannelListIndex::Set& set = index_.bySize();
+	ChannelListIndex::Set::const_iterator it;
+	if (started_)
+		it = set.upper_bound(cursor_);
+	else if (filter_.maxUsers == std::numeric_limits<size_t>::max())
+		it = set.begin();
+	else	//* First channel with at most maxUsers members
+		it = set.lower_bound(ChannelListIndex::Key(filter_.maxUsers + 1, static_cast<Channel*>(NULL)));
+	started_ = true;
+
+	for (size_t scanned = 0; it != set.end() && it->first >= filter_.minUsers; ++it, ++scanned)
+	{
+		if (out.size() >= budget || scanned >= SCAN_STEP)
+			return true;
+		cursor_ = *it;
+		if (matches(*it->second, filter_))
+			appendLine(out, nick_, *it->second);
+	}
+	out += ":ft_irc " RPL_LISTEND " " + nick_ + " :End of /LIST\r\n";
+	return false;
+}
@@ -0,0 +1,65 @@
+#ifndef LIST_STREAM_HPP
+#define LIST_STREAM_HPP
+
+#include "ReplyStream.hpp"
+#include "../channel/ChannelListIndex.hpp"
+#include <string>
+#include <vector>
+#include <ctime>
+
+class Channel;
+
+/**
+ * ListStream: LIST over ChannelListIndex, largest channels first
+ *
+ * ELIST filters (comma-separated, all must hold):
+ *   >n  <n          more / fewer than n users
+ *   C>n C<n         created more / less than n minutes ago
+ *   T>n T<n         topic set more / less than n minutes ago
+ *   mask  !mask     name matches / does not match ('*' and '?')
+ *
+ * The user-count bounds pick the slice of the index that is walked; the
+ * other filters are checked per channel. Each fill() looks at no more than
+ * SCAN_STEP channels, so a mask that matches nothing cannot hold the loop.
+ * Channels that change size while the LIST is paused may move past the
+ * cursor: they are skipped or listed twice, as in any SAFELIST server.
+ */
+
+class ListStream : public ReplyStream
+{
+	public:
+		struct Filter
+		{
+			size_t						minUsers;		//* Inclusive
+			size_t						maxUsers;		//* Inclusive
+			time_t						createdAfter;	//* 0 = no bound
+			time_t						createdBefore;
+			time_t						topicAfter;
+			time_t						topicBefore;
+			std::vector<std::string>	masks;
+			std::vector<std::string>	notMasks;
+
+			Filter();
+		};
+
+		//* One ELIST token; false if it is not one (then it is a channel name)
+		static bool	parseToken(const std::string& token, time_t now, Filter& filter);
+		static bool	matches(const Channel& channel, const Filter& filter);
+		//* ":ft_irc 322 <nick> <channel> <users> :<topic>"
+		static void	appendLine(std::string& out, const std::string& nick, const Channel& channel);
+
+		ListStream(const ChannelListIndex& index, const std::string& nick, const Filter& filter);
+
+		bool	fill(std::string& out, size_t budget);
+
+	private:
+		static const size_t			SCAN_STEP = 4096;
+
+		const ChannelListIndex&		index_;
+		std::string					nick_;
+		Filter						filter_;
+		bool						started_;
+		ChannelListIndex::Key		cursor_;			//* Last channel looked at
+};
+
+#endif
@@ -22,13 +22,35 @@
 #define RPL_YOURHOST        "002"
 #define RPL_CREATED         "003"
 #define RPL_MYINFO          "004"
+#define RPL_ISUPPORT        "005"
+
+// MOTD
+#define RPL_MOTD            "372"
+#define RPL_MOTDSTART       "375"
+#define RPL_ENDOFMOTD       "376"
 
 // Server Ops
 #define RPL_YOUREOPER       "381"
 
+// Server links
+#define RPL_LINKS           "364" // <mask> <server> :<hopcount> <server info>
+#define RPL_ENDOFLINKS      "365"
+
+// Stats
+#define RPL_STATSCOMMANDS   "212" // <command> <count> <byte count> <remote count>
+#define RPL_ENDOFSTATS      "219" // <stats letter> :End of STATS report
+#define RPL_STATSUPTIME     "242"
+#define RPL_STATSDEBUG      "249"
+
 // Channel Info
 #define RPL_CHANNELMODEIS   "324" // <channel> <modes> <mode-params>
 #define RPL_CREATIONTIME    "329" // <channel> <creationtime>
+#define RPL_INVITELIST      "346" // <channel> <mask> <setter> <ts>  (+I)
+#define RPL_ENDOFINVITELIST "347"
+#define RPL_EXCEPTLIST      "348" // <channel> <mask> <setter> <ts>  (+e)
+#define RPL_ENDOFEXCEPTLIST "349"
+#define RPL_BANLIST         "367" // <channel> <mask> <setter> <ts>  (+b)
+#define RPL_ENDOFBANLIST    "368"
 #define RPL_NOTOPIC         "331"
 #define RPL_TOPIC           "332"
 #define RPL_INVITING        "341"
@@ -43,6 +65,17 @@
 #define RPL_WHOISIDLE       "317"
 #define RPL_ENDOFWHOIS      "318"
 #define RPL_WHOISCHANNELS   "319"
+#define RPL_AWAY            "301" // <nick> :<away message>
+#define RPL_WHOREPLY        "352" // <channel> <user> <host> <server> <nick> <flags> :<hops> <real>
+#define RPL_WHOSPCRPL       "354" // WHOX: the requested fields
+#define RPL_ENDOFWHO        "315" // <mask> :End of /WHO list
+
+// MONITOR (IRCv3)
+#define RPL_MONONLINE       "730" // :<nick!user@host>[,...]
+#define RPL_MONOFFLINE      "731" // :<nick>[,...]
+#define RPL_MONLIST         "732" // :<nick>[,...]
+#define RPL_ENDOFMONLIST    "733"
+#define ERR_MONLISTFULL     "734" // <limit> <targets> :Monitor list is full.
 
 // Lists
 #define RPL_LISTSTART       "321"
@@ -60,6 +93,7 @@
 #define ERR_CANNOTSENDTOCHAN    "404"
 #define ERR_TOOMANYCHANNELS     "405"
 #define ERR_NOORIGIN            "409"
+#define ERR_INVALIDCAPCMD       "410"
 #define ERR_NORECIPIENT         "411"
 #define ERR_NOTEXTTOSEND        "412"
 #define ERR_UNKNOWNCOMMAND      "421"
@@ -77,12 +111,14 @@
 #define ERR_NEEDMOREPARAMS      "461"
 #define ERR_ALREADYREGISTRED    "462"
 #define ERR_PASSWDMISMATCH      "464"
+#define ERR_NOOPERHOST          "491"
 
 // Channel Limits & Modes
 #define ERR_CHANNELISFULL       "471"
 #define ERR_UNKNOWNMODE         "472"
 #define ERR_INVITEONLYCHAN      "473"
 #define ERR_BANNEDFROMCHAN      "474"
+#define ERR_BANLISTFULL         "478" // <channel> <mask> :Channel list is full
 #define ERR_BADCHANNELKEY       "475"
 #define ERR_BADCHANMASK         "476"
 
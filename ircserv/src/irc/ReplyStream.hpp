@@ -0,0 +1,31 @@
+#ifndef REPLY_STREAM_HPP
+#define REPLY_STREAM_HPP
+
+#include <string>
+#include <cstddef>
+
+/**
+ * ReplyStream: a long reply produced a piece at a time
+ *
+ * Instead of queueing every line up front (LIST over every channel), the
+ * command hands the server a stream. Server::startStream() takes the first
+ * chunk at once, then Server::pumpStreams() asks it for more each loop
+ * iteration while the client's SendQ is below STREAM_LOW_WATER, so the
+ * reply follows the pace at which the client reads it and never sits whole
+ * in memory. The client's replies to later commands wait behind it.
+ *
+ * A stream must not keep pointers to channels or users across calls:
+ * they may be gone by the next one.
+ */
+
+class ReplyStream
+{
+	public:
+		virtual ~ReplyStream() {}
+
+		//* Append lines to 'out' until it holds about 'budget' bytes. True
+		//* while there is more to come; the last call sends the end numeric.
+		virtual bool	fill(std::string& out, size_t budget) = 0;
+};
+
+#endif
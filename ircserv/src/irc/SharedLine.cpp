@@ -0,0 +1,49 @@
+#include "SharedLine.hpp"
+
+SharedLine::SharedLine() : block_(NULL)
+{
+}
+
+SharedLine::SharedLine(const std::string& text) : block_(new Block)
+{
+	block_->text = text;
+	block_->refs = 1;
+}
+
+SharedLine::SharedLine(const SharedLine& other) : block_(other.block_)
+{
+	if (block_)
+		block_->refs++;
+}
+
+SharedLine& SharedLine::operator=(const SharedLine& other)
+{
+	if (other.block_)
+		other.block_->refs++;
+	release();
+	block_ = other.block_;
+	return (*this);
+}
+
+SharedLine::~SharedLine()
+{
+	release();
+}
+
+unsigned int SharedLine::useCount() const
+{
+	return (block_ ? block_->refs : 0);
+}
+
+void SharedLine::release()
+{
+	if (block_ && --block_->refs == 0)
+		delete block_;
+	block_ = NULL;
+}
+
+const std::string& SharedLine::empty()
+{
+	static const std::string none;
+	return (none);
+}
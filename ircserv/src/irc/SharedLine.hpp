@@ -0,0 +1,44 @@
+#ifndef SHARED_LINE_HPP
+#define SHARED_LINE_HPP
+
+#include <string>
+
+/**
+ * SharedLine: an immutable, reference-counted protocol line
+ *
+ * A message relayed to a channel is formatted once (":prefix PRIVMSG #c
+ * :text\r\n"). The broadcast appends it to every member's SendQ and the
+ * channel history keeps the same block alive, so storing a line in the
+ * history costs one counter increment, not a copy.
+ *
+ * Copies share the block; the last one frees it. Single-threaded: the count
+ * is a plain integer.
+ */
+
+class SharedLine
+{
+	public:
+		SharedLine();
+		explicit SharedLine(const std::string& text);
+		SharedLine(const SharedLine& other);
+		SharedLine& operator=(const SharedLine& other);
+		~SharedLine();
+
+		inline const std::string& str() const { return block_ ? block_->text : empty(); }
+		inline size_t size() const { return block_ ? block_->text.size() : 0; }
+		unsigned int useCount() const;
+
+	private:
+		struct Block
+		{
+			std::string		text;
+			unsigned int	refs;
+		};
+
+		Block*	block_;
+
+		void	release();
+		static const std::string& empty();
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "WelcomeBurst.hpp"
+#include "NumericReplies.hpp"
+#include <fstream>
+
+//* MOTD lines longer than this are cut so 372 stays under the 512 byte limit
+static const size_t MOTD_LINE_MAX = 400;
+
+WelcomeBurst::WelcomeBurst() : motdOffset_(0), motdSlot_(0), motdLines_(0)
+{
+}
+
+// ========================================================================
+// 							   Construction
+// ========================================================================
+
+void WelcomeBurst::appendSlot(SlotKind kind)
+{
+	Slot slot;
+	slot.offset = blob_.size();
+	slot.kind = kind;
+	slots_.push_back(slot);
+}
+
+//* ":ft_irc <num> <nick> " - the nick is a patch point
+void WelcomeBurst::beginNumeric(const std::string& num)
+{
+	blob_ += ":ft_irc " + num + " ";
+	appendSlot(SLOT_NICK);
+	blob_ += " ";
+}
+
+void WelcomeBurst::appendNumeric(const std::string& num, const std::string& body)
+{
+	beginNumeric(num);
+	blob_ += body + "\r\n";
+}
+
+void WelcomeBurst::build(const std::string& motdFile, const std::string& isupport)
+{
+	blob_.clear();
+	slots_.clear();
+	motdLines_ = 0;
+
+	//* 001 carries the full nick!user@host of the client
+	beginNumeric(RPL_WELCOME);
+	blob_ += ":Welcome to the FT_IRC Network ";
+	appendSlot(SLOT_PREFIX);
+	blob_ += "\r\n";
+	appendNumeric(RPL_YOURHOST, ":Your host is ft_irc, running version 1.0");
+	appendNumeric(RPL_CREATED, ":This server was created today");
+	appendNumeric(RPL_MYINFO, "ft_irc 1.0 io beIiklotu");		// Modos soportados
+	if (!isupport.empty())
+		appendNumeric(RPL_ISUPPORT, isupport + " :are supported by this server");
+
+	motdOffset_ = blob_.size();
+	motdSlot_ = slots_.size();
+
+	std::ifstream in(motdFile.c_str());
+	if (!in)
+	{
+		appendNumeric(ERR_NOMOTD, ":MOTD File is missing");
+		return;
+	}
+
+	appendNumeric(RPL_MOTDSTART, ":- ft_irc Message of the day - ");
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (line.size() > MOTD_LINE_MAX)
+			line.erase(MOTD_LINE_MAX);
+		appendNumeric(RPL_MOTD, ":- " + line);
+		motdLines_++;
+	}
+	appendNumeric(RPL_ENDOFMOTD, ":End of /MOTD command.");
+}
+
+// ========================================================================
+// 							    Rendering
+// ========================================================================
+
+void WelcomeBurst::renderFrom(size_t offset, size_t slot, const std::string& nick,
+	const std::string& prefix, std::string& out) const
+{
+	//* Size the output once: literals + every patched value
+	size_t extra = 0;
+	for (size_t i = slot; i < slots_.size(); ++i)
+		extra += (slots_[i].kind == SLOT_NICK) ? nick.size() : prefix.size();
+	out.reserve(out.size() + (blob_.size() - offset) + extra);
+
+	size_t pos = offset;
+	for (size_t i = slot; i < slots_.size(); ++i)
+	{
+		out.append(blob_, pos, slots_[i].offset - pos);
+		out.append((slots_[i].kind == SLOT_NICK) ? nick : prefix);
+		pos = slots_[i].offset;
+	}
+	out.append(blob_, pos, std::string::npos);
+}
+
+void WelcomeBurst::render(const std::string& nick, const std::string& prefix, std::string& out) const
+{
+	renderFrom(0, 0, nick, prefix, out);
+}
+
+void WelcomeBurst::renderMotd(const std::string& nick, std::string& out) const
+{
+	renderFrom(motdOffset_, motdSlot_, nick, "", out);
+}
+
+size_t WelcomeBurst::getMotdLineCount() const
+{
+	return (motdLines_);
+}
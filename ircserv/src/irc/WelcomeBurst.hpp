@@ -0,0 +1,63 @@
+#ifndef WELCOME_BURST_HPP
+#define WELCOME_BURST_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * WelcomeBurst: preformatted registration burst (001-005 + MOTD)
+ *
+ * The burst is identical for every client except for the nick (target of
+ * every numeric) and the full prefix in RPL_WELCOME. It is formatted once at
+ * startup / on reload into a single immutable blob with a list of patch
+ * points, so registering a client is one reserve() plus a few memcpy()s
+ * instead of a dozen string concatenations.
+ *
+ * Layout: [001..005][375 372* 376 | 422]
+ *                   ^ motdOffset_   (MOTD command re-sends only this part)
+ */
+
+class WelcomeBurst
+{
+	public:
+		WelcomeBurst();
+
+		/**
+		 * Rebuild the blob, reading the MOTD from disk
+		 *
+		 * @param motdFile Path to the MOTD text file (missing file = ERR_NOMOTD)
+		 * @param isupport RPL_ISUPPORT tokens ("KEY=value ..."), "" = no 005
+		 */
+		void build(const std::string& motdFile, const std::string& isupport = "");
+
+		//* Append the whole registration burst for this client to 'out'
+		void render(const std::string& nick, const std::string& prefix, std::string& out) const;
+
+		//* Append only the MOTD section (for the MOTD command)
+		void renderMotd(const std::string& nick, std::string& out) const;
+
+		size_t getMotdLineCount() const;
+
+	private:
+		enum SlotKind { SLOT_NICK, SLOT_PREFIX };
+
+		struct Slot
+		{
+			size_t		offset;					//* Position in blob_ where the value is inserted
+			SlotKind	kind;
+		};
+
+		std::string			blob_;				//* Every literal byte of the burst, slots removed
+		std::vector<Slot>	slots_;				//* Patch points, ordered by offset
+		size_t				motdOffset_;		//* Start of the MOTD section in blob_
+		size_t				motdSlot_;			//* First slot belonging to the MOTD section
+		size_t				motdLines_;			//* Number of 372 lines (0 = no MOTD)
+
+		void beginNumeric(const std::string& num);
+		void appendNumeric(const std::string& num, const std::string& body);
+		void appendSlot(SlotKind kind);
+		void renderFrom(size_t offset, size_t slot, const std::string& nick,
+			const std::string& prefix, std::string& out) const;
+};
+
+#endif
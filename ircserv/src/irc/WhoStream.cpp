@@ -0,0 +1,212 @@
+#include "WhoStream.hpp"
+#include "CommandHelpers.hpp"
+#include "NumericReplies.hpp"
+#include "../channel/Channel.hpp"
+#include "../client/User.hpp"
+#include "../client/ClientConnection.hpp"
+
+WhoStream::Query::Query() : opersOnly(false), whox(false)
+{
+}
+
+// ========================================================================
+// 							   Query
+// ========================================================================
+
+WhoStream::Query WhoStream::parseQuery(const std::string& mask, const std::string& flags)
+{
+	Query query;
+	query.mask = mask.empty() ? "*" : mask;
+	size_t percent = flags.find('%');
+	query.opersOnly = flags.substr(0, percent).find('o') != std::string::npos;
+	if (percent != std::string::npos)
+	{
+		query.whox = true;
+		std::string spec = flags.substr(percent + 1);
+		size_t comma = spec.find(',');
+		query.fields = spec.substr(0, comma);
+		if (comma != std::string::npos)
+			query.token = spec.substr(comma + 1, 3);	//* At most 3 digits (WHOX)
+	}
+	return query;
+}
+
+WhoStream::WhoStream(const Query& query, User* requester, const std::map<std::string, Channel*>& channels,
+	const NickMap& locals, const NickMap& remotes) :
+	query_(query), requester_(requester), channels_(channels), locals_(locals), remotes_(remotes),
+	phase_(PHASE_LOCAL), member_(0), started_(false), now_(std::time(NULL))
+{
+	const std::string& mask = query_.mask;
+	if (mask[0] == '#' || mask[0] == '&')
+		phase_ = PHASE_CHANNEL;
+	else if (mask != "0" && mask.find_first_of("*?") == std::string::npos)
+		phase_ = PHASE_NICK;
+}
+
+// ========================================================================
+// 							   Filters
+// ========================================================================
+
+//* +i: only for itself and for whoever shares a channel with it ('inside':
+//* the requester is in the channel being listed, checked once per fill)
+bool WhoStream::visible(User* user, bool inside) const
+{
+	if (query_.opersOnly && !user->isOperator())
+		return false;
+	if (!user->isInvisible() || user == requester_ || inside)
+		return true;
+	const std::vector<Channel*>& mine = requester_->getChannels();
+	for (size_t i = 0; i < mine.size(); ++i)
+		if (user->isInChannel(mine[i]))
+			return true;
+	return false;
+}
+
+bool WhoStream::matchesMask(User* user) const
+{
+	const std::string& mask = query_.mask;
+	if (mask == "0" || mask == "*")
+		return true;
+	return matchMask(mask, user->getNickname()) || matchMask(mask, user->getUsername())
+		|| matchMask(mask, user->getHostname()) || matchMask(mask, user->getServerName())
+		|| matchMask(mask, user->getRealname());
+}
+
+// ========================================================================
+// 							   Lines
+// ========================================================================
+
+static void appendFlags(std::string& out, User* user, Channel* channel)
+{
+	out += user->isAway() ? 'G' : 'H';
+	if (user->isOperator())
+		out += '*';
+	if (channel && channel->isOperator(user))
+		out += '@';
+}
+
+//* ":ft_irc 352 <me> <channel> <user> <host> <server> <nick> <flags> :<hops> <real>"
+void WhoStream::appendLine(std::string& out, User* user, Channel* channel) const
+{
+	if (query_.whox)
+		return appendWhox(out, user, channel);
+	//* Straight into 'out': no temporaries per line
+	out += ":ft_irc " RPL_WHOREPLY " ";
+	out += requester_->getNickname();
+	out += ' ';
+	if (channel)
+		out += channel->getName();
+	else
+		out += '*';
+	out += ' ';
+	out += user->getWhoHead();
+	out += ' ';
+	appendFlags(out, user, channel);
+	out += ' ';
+	out += user->getWhoTail();
+	out += "\r\n";
+}
+
+//* ":ft_irc 354 <me> <fields>...", in the fixed WHOX order whatever the request's
+void WhoStream::appendWhox(std::string& out, User* user, Channel* channel) const
+{
+	static const char order[] = "tcuihsnfdlaor";
+	const std::string& f = query_.fields;
+	out += ":ft_irc " RPL_WHOSPCRPL " " + requester_->getNickname();
+	for (const char* c = order; *c; ++c)
+	{
+		if (f.find(*c) == std::string::npos)
+			continue;
+		out += " ";
+		switch (*c)
+		{
+			case 't': out += query_.token.empty() ? "0" : query_.token; break;
+			case 'c': out += channel ? channel->getName() : std::string("*"); break;
+			case 'u': out += user->getUsername(); break;
+			case 'i': out += user->isRemote() ? "255.255.255.255" : user->getHostname(); break;
+			case 'h': out += user->getHostname(); break;
+			case 's': out += user->getServerName(); break;
+			case 'n': out += user->getNickname(); break;
+			case 'f': appendFlags(out, user, channel); break;
+			case 'd': out += toString(user->getHops()); break;
+			case 'l':
+				out += user->isRemote() ? "0"
+					: toString(static_cast<unsigned long>(now_ - user->getConnection()->getLastActivity()));
+				break;
+			case 'a': out += "0"; break;		//* No accounts
+			case 'o': out += "n/a"; break;
+			case 'r': out += ":" + user->getRealname(); break;
+		}
+	}
+	out += "\r\n";
+}
+
+// ========================================================================
+// 							   Streaming
+// ========================================================================
+
+//* One nick map in nick order, resuming after lastNick_
+bool WhoStream::walk(const NickMap& nicks, std::string& out, size_t budget)
+{
+	NickMap::const_iterator it = started_ ? nicks.upper_bound(lastNick_) : nicks.begin();
+	for (size_t scanned = 0; it != nicks.end(); ++it, ++scanned)
+	{
+		if (out.size() >= budget || scanned >= SCAN_STEP)
+			return true;
+		lastNick_ = it->first;
+		started_ = true;
+		User* user = it->second;
+		if (user->getConnection() && !user->getConnection()->isRegistered())
+			continue;
+		if (matchesMask(user) && visible(user, false))
+			appendLine(out, user, NULL);
+	}
+	started_ = false;
+	return false;
+}
+
+bool WhoStream::fill(std::string& out, size_t budget)
+{
+	if (phase_ == PHASE_CHANNEL)
+	{
+		std::map<std::string, Channel*>::const_iterator it = channels_.find(query_.mask);
+		if (it != channels_.end())
+		{
+			Channel* channel = it->second;
+			// Auditorio (+u): los mismos que NAMES, los OPs y uno mismo
+			const std::vector<User*>& members = channel->getPresenceAudience(requester_);
+			bool inside = channel->isMember(requester_);
+			bool self = &members != &channel->getMembers() && inside;
+			for (size_t scanned = 0; member_ < members.size() + self; ++member_, ++scanned)
+			{
+				if (out.size() >= budget || scanned >= SCAN_STEP)
+					return true;
+				User* user = (member_ < members.size()) ? members[member_] : requester_;
+				if (visible(user, inside))
+					appendLine(out, user, channel);
+			}
+		}
+	}
+	else if (phase_ == PHASE_NICK)
+	{
+		NickMap::const_iterator it = locals_.find(query_.mask);
+		User* user = NULL;
+		if (it != locals_.end() && it->second->getConnection()->isRegistered())
+			user = it->second;
+		else if ((it = remotes_.find(query_.mask)) != remotes_.end())
+			user = it->second;
+		if (user && (!query_.opersOnly || user->isOperator()))
+			appendLine(out, user, NULL);
+	}
+	else if (phase_ == PHASE_LOCAL || phase_ == PHASE_REMOTE)
+	{
+		if (phase_ == PHASE_LOCAL && walk(locals_, out, budget))
+			return true;
+		phase_ = PHASE_REMOTE;
+		if (walk(remotes_, out, budget))
+			return true;
+	}
+	phase_ = PHASE_DONE;
+	out += ":ft_irc " RPL_ENDOFWHO " " + requester_->getNickname() + " " + query_.mask + " :End of /WHO list\r\n";
+	return false;
+}
@@ -0,0 +1,79 @@
+#ifndef WHO_STREAM_HPP
+#define WHO_STREAM_HPP
+
+#include "ReplyStream.hpp"
+#include <string>
+#include <map>
+#include <ctime>
+
+class Channel;
+class User;
+
+/**
+ * WhoStream: WHO / WHOX replies
+ *
+ *   WHO #channel [o]        the members, in member order (in +u, only
+ *                           what NAMES shows: the ops and oneself)
+ *   WHO nick                one user (the nick indexes, no scan)
+ *   WHO mask [o]            every user whose nick, user, host, server or
+ *                           real name matches ('*' and '?'; "0" = all)
+ *   WHO target [o]%fields[,token]    WHOX: 354 with the requested fields,
+ *                           always in the order "tcuihsnfdlaor"
+ *
+ * The plain 352 line is three cached pieces (User::getWhoHead/getWhoTail)
+ * around the channel and the flags. Invisible users only show up for
+ * someone who shares a channel with them.
+ *
+ * Between calls the stream keeps names, not pointers: the channel is looked
+ * up again and the mask walk resumes after the last nick. The requester is
+ * the exception, its streams end before it goes (Server::releaseUser).
+ */
+
+class WhoStream : public ReplyStream
+{
+	public:
+		typedef std::map<std::string, User*>	NickMap;
+
+		struct Query
+		{
+			std::string		mask;
+			bool			opersOnly;			//* 'o' flag
+			bool			whox;
+			std::string		fields;				//* WHOX letters, as given
+			std::string		token;				//* WHOX 't' (querytype)
+
+			Query();
+		};
+
+		//* WHO <mask> [<flags>[%<fields>[,<token>]]]
+		static Query	parseQuery(const std::string& mask, const std::string& flags);
+
+		WhoStream(const Query& query, User* requester, const std::map<std::string, Channel*>& channels,
+			const NickMap& locals, const NickMap& remotes);
+
+		bool	fill(std::string& out, size_t budget);
+
+	private:
+		enum Phase { PHASE_CHANNEL, PHASE_NICK, PHASE_LOCAL, PHASE_REMOTE, PHASE_DONE };
+
+		static const size_t		SCAN_STEP = 4096;
+
+		Query								query_;
+		User*								requester_;
+		const std::map<std::string, Channel*>&	channels_;
+		const NickMap&						locals_;
+		const NickMap&						remotes_;
+		Phase								phase_;
+		size_t								member_;	//* Channel: next member index
+		std::string							lastNick_;	//* Mask walk: resume after it
+		bool								started_;	//* Mask walk: lastNick_ is set
+		time_t								now_;
+
+		bool	visible(User* user, bool inside) const;
+		bool	matchesMask(User* user) const;
+		void	appendLine(std::string& out, User* user, Channel* channel) const;
+		void	appendWhox(std::string& out, User* user, Channel* channel) const;
+		bool	walk(const NickMap& nicks, std::string& out, size_t budget);
+};
+
+#endif
@@ -17,6 +17,36 @@
 #include "CommandHelpers.hpp"
 #include "../irc/NumericReplies.hpp"
 #include <set> // Necesario para evitar spam en NICK
+#include <iostream>
+#include <ctime>
+#include <cctype>
+
+//* REGISTRATION
+//* Once PASS + NICK + USER are in (and CAP END, if CAP was started), the whole welcome burst (001-004 + MOTD)
+//* is rendered from the prebuilt blob with only the nick patched, and queued
+//* with a single append so it leaves in one send().
+void Server::checkRegistration(ClientConnection* client)
+{
+    if (client->isRegistered()) return;
+    
+    User* user = client->getUser();
+    // Requisito: Haber mandado PASS, tener Nick y tener User
+    if (user && client->hasSentPass() && !user->getNickname().empty() && !user->getUsername().empty()
+        && !client->isCapNegotiating())
+    {
+        client->setRegistered(true);
+        if (unregistered_count_ > 0)
+            unregistered_count_--;
+
+        std::string burst;
+        welcome_.render(user->getNickname(), user->getPrefix(), burst);
+        client->queueSend(burst);
+        introduceUser(user);
+        notifyMonitors(user, true);
+        
+        std::cout << "[SERVER] User registered: " << user->getNickname() << std::endl;
+    }
+}
 
 void Server::cmdPass(ClientConnection* client, const Message& msg)
 {
@@ -26,10 +56,16 @@ void Server::cmdPass(ClientConnection* client, const Message& msg)
     if (client->isRegistered())
         return sendError(client, ERR_ALREADYREGISTRED, "");
 
+    // "PASS <password> TS 6 :<sid>": otro servidor que quiere enlazar
+    if (msg.params.size() > 1 && msg.params[1] == "TS")
+        return linkPass(client, msg);
+
     if (msg.params[0] != this->password_)
     {
         sendError(client, ERR_PASSWDMISMATCH, "");
-        client->closeConnection();
+        // El cierre vacía la cola antes: el 464 y el ERROR llegan al cliente
+        client->queueSend("ERROR :Closing Link: " + client->getHost() + " (Bad password)\r\n");
+        client->closeConnection("Bad password", DISC_BAD_PASSWORD);
         return;
     }
 
@@ -47,12 +83,12 @@ void Server::cmdNick(ClientConnection* client, const Message& msg)
     if (newNick.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789[]{}\\|-_^") != std::string::npos)
         return sendError(client, ERR_ERRONEUSNICKNAME, newNick);
 
-    // Verificar si ya existe el nickname en el servidor
-    for (size_t i = 0; i < clients_.size(); ++i)
-    {
-        if (clients_[i] != client && clients_[i]->getUser() && clients_[i]->getUser()->getNickname() == newNick)
-            return sendError(client, ERR_NICKNAMEINUSE, newNick);
-    }
+    // Verificar si ya existe el nickname en el servidor (índice nicks_)
+    std::map<std::string, User*>::iterator taken = nicks_.find(newNick);
+    if (taken != nicks_.end() && taken->second != client->getUser())
+        return sendError(client, ERR_NICKNAMEINUSE, newNick);
+    if (remote_nicks_.count(newNick))
+        return sendError(client, ERR_NICKNAMEINUSE, newNick);
 
     // Notificar cambio (si ya estaba registrado)
     if (client->isRegistered())
@@ -72,24 +108,38 @@ void Server::cmdNick(ClientConnection* client, const Message& msg)
         for (size_t i = 0; i < channels.size(); ++i)
         {
             // Nota: Asegúrate de que Channel tenga el método getMembers()
-            const std::vector<User*>& members = channels[i]->getMembers();
+            // En +u un cambio de nick solo llega a los OPs (ver broadcastPresence)
+            const std::vector<User*>& members = channels[i]->getPresenceAudience(client->getUser());
             for (size_t j = 0; j < members.size(); ++j) 
             {
-                if (members[j]->getConnection() != client) { // No reenviar a mí mismo
+                // Ni a mí mismo ni a usuarios remotos (sin conexión aquí)
+                if (members[j]->getConnection() != client && members[j]->getConnection()) {
                     uniqueRecipients.insert(members[j]->getConnection());
                 }
             }
         }
 
-        // Broadcast a la lista de destinatarios únicos
+        // Broadcast a la lista de destinatarios únicos (tráfico de canal: bulk)
         for (std::set<ClientConnection*>::iterator it = uniqueRecipients.begin(); it != uniqueRecipients.end(); ++it)
         {
-            (*it)->queueSend(notification);
+            (*it)->queueSend(notification, LANE_BULK);
         }
     }
 
-    // Aplicar el cambio
-    client->getUser()->setNickname(newNick);
+    // Aplicar el cambio (el User se crea aquí si es el primer NICK). MONITOR:
+    // el nick viejo se va y llega el nuevo
+    User* user = ensureUser(client);
+    bool renamed = client->isRegistered() && user->getNickname() != newNick;
+    if (renamed)
+        notifyMonitors(user, false);
+    setLocalNick(user, newNick);
+    if (renamed)
+        notifyMonitors(user, true);
+    if (client->isRegistered())
+    {
+        user->setNickTs(std::time(NULL));
+        sendToLinks(":" + user->getUid() + " NICK " + newNick + " :" + toString(user->getNickTs()) + "\r\n", NULL);
+    }
     checkRegistration(client);
 }
 
@@ -101,22 +151,108 @@ void Server::cmdUser(ClientConnection* client, const Message& msg)
     if (msg.params.size() < 4)
         return sendError(client, ERR_NEEDMOREPARAMS, "USER");
 
-    User* user = client->getUser();
+    User* user = ensureUser(client);
     user->setUsername(msg.params[0]);
     user->setRealname(msg.params[3]);
     
     checkRegistration(client);
 }
 
+namespace
+{
+    struct CapName
+    {
+        const char*                     name;
+        ClientConnection::Capability    bit;
+    };
+
+    //* Only what CHATHISTORY can use: without them its replays are plain lines
+    const CapName CAPS[] = {
+        { "batch", ClientConnection::CAP_BATCH },
+        { "message-tags", ClientConnection::CAP_MESSAGE_TAGS },
+        { "server-time", ClientConnection::CAP_SERVER_TIME }
+    };
+    const size_t CAP_COUNT = sizeof(CAPS) / sizeof(CAPS[0]);
+}
+
+//* CAP LS [302] | LIST | REQ :<caps> | END   (IRCv3 capability negotiation)
+//* LS or REQ before registering holds the welcome until CAP END.
+void Server::cmdCap(ClientConnection* client, const Message& msg)
+{
+    if (msg.params.empty())
+        return sendError(client, ERR_NEEDMOREPARAMS, "CAP");
+
+    std::string sub = msg.params[0];
+    for (size_t i = 0; i < sub.size(); ++i)
+        sub[i] = std::toupper(sub[i]);
+    User* user = client->getUser();
+    std::string head = ":ft_irc CAP " + ((user && !user->getNickname().empty()) ? user->getNickname() : "*") + " ";
+
+    if (sub == "LS" || sub == "LIST")
+    {
+        if (sub == "LS" && !client->isRegistered())
+            client->setCapNegotiating(true);
+        std::string names;
+        for (size_t i = 0; i < CAP_COUNT; ++i)
+            if (sub == "LS" || client->hasCap(CAPS[i].bit))
+                names += (names.empty() ? "" : " ") + std::string(CAPS[i].name);
+        client->queueSend(head + sub + " :" + names + "\r\n");
+    }
+    else if (sub == "REQ")
+    {
+        if (!client->isRegistered())
+            client->setCapNegotiating(true);
+        // Todo o nada: un nombre desconocido rechaza la petición entera
+        std::string request = msg.params.size() > 1 ? msg.params[1] : "";
+        std::vector<std::string> names = split(request, ' ');
+        unsigned int caps = client->getCaps();
+        bool ok = !names.empty();
+        for (size_t n = 0; n < names.size() && ok; ++n)
+        {
+            bool remove = names[n][0] == '-';
+            std::string name = remove ? names[n].substr(1) : names[n];
+            size_t i = 0;
+            while (i < CAP_COUNT && name != CAPS[i].name)
+                ++i;
+            if (i == CAP_COUNT)
+                ok = false;
+            else
+                caps = remove ? (caps & ~CAPS[i].bit) : (caps | CAPS[i].bit);
+        }
+        if (ok)
+            client->setCaps(caps);
+        client->queueSend(head + (ok ? "ACK" : "NAK") + " :" + request + "\r\n");
+    }
+    else if (sub == "END")
+    {
+        if (!client->isCapNegotiating())
+            return;
+        client->setCapNegotiating(false);
+        checkRegistration(client);
+    }
+    else
+        sendError(client, ERR_INVALIDCAPCMD, sub);
+}
+
 void Server::cmdQuit(ClientConnection* client, const Message& msg)
 {
     std::string reason = (msg.params.empty()) ? "Client Quit" : msg.params[0];
     
     // La lógica de desconexión y limpieza de canales se maneja en el bucle principal (Server::run)
-    // al detectar que la conexión está cerrada.
-    // Solo marcamos para cerrar.
-    (void)reason; 
-    client->closeConnection();
+    // al detectar que la conexión está cerrada: el QUIT a los canales lleva este motivo
+    // y el ERROR se envía antes de cerrar (beginDrain).
+    client->queueSend("ERROR :Closing Link: " + client->getHost() + " (Quit: " + reason + ")\r\n");
+    client->closeConnection("Quit: " + reason, DISC_QUIT);
+}
+
+void Server::cmdMotd(ClientConnection* client, const Message& msg)
+{
+    (void)msg;
+    if (!client->isRegistered()) return;
+
+    std::string motd;
+    welcome_.renderMotd(client->getUser()->getNickname(), motd);
+    client->queueSend(motd);
 }
 
 void Server::cmdPing(ClientConnection* client, const Message& msg)
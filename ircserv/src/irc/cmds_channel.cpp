@@ -16,27 +16,87 @@
 #include "../channel/Channel.hpp"
 #include "CommandHelpers.hpp"
 #include "../irc/NumericReplies.hpp"
+#include "ListStream.hpp"
+#include <algorithm>
+#include <set>
+#include <ctime>
 
 // NOTA: Estas funciones son miembros de Server, pero están implementadas aquí
 // para organizar el código por temática.
 
 Channel* Server::getChannel(const std::string& name)
 {
-    for (size_t i = 0; i < channels_.size(); ++i)
-    {
-        if (channels_[i]->getName() == name)
-            return channels_[i];
-    }
-    return NULL;
+    std::map<std::string, Channel*>::const_iterator it = channel_index_.find(name);
+    return (it == channel_index_.end()) ? NULL : it->second;
+}
+
+User* Server::findUserByNick(const std::string& nick)
+{
+    std::map<std::string, User*>::iterator it = nicks_.find(nick);
+    if (it != nicks_.end())
+        return it->second->getConnection()->isRegistered() ? it->second : NULL;
+    // Usuarios de otros servidores del árbol
+    it = remote_nicks_.find(nick);
+    return (it == remote_nicks_.end()) ? NULL : it->second;
+}
+
+// Todo cambio de nick de un usuario local pasa por aquí
+void Server::setLocalNick(User* user, const std::string& nick)
+{
+    std::map<std::string, User*>::iterator it = nicks_.find(user->getNickname());
+    if (it != nicks_.end() && it->second == user)
+        nicks_.erase(it);
+    user->setNickname(nick);
+    nicks_[nick] = user;
 }
 
 Channel* Server::createChannel(const std::string& name)
 {
     Channel* newChan = new Channel(name);
+    newChan->getHistory().setBudget(historyRingBytes());
     channels_.push_back(newChan);
+    channel_index_[name] = newChan;
+    newChan->setListIndex(&list_index_);
     return newChan;
 }
 
+// Sacar el canal de la lista y del índice, y borrarlo
+void Server::destroyChannel(Channel* channel)
+{
+    std::vector<Channel*>::iterator it = std::find(channels_.begin(), channels_.end(), channel);
+    if (it != channels_.end())
+        channels_.erase(it);
+    channel_index_.erase(channel->getName());
+    delete channel;
+}
+
+// Antes de un error, lo acumulado sale primero: el orden de las respuestas
+// es el de los canales
+static void joinError(ClientConnection* client, std::string& burst, const std::string& num,
+    const std::string& chanName)
+{
+    client->queueSend(burst);
+    burst.clear();
+    sendError(client, num, chanName);
+}
+
+// ":ft_irc <num> <nick> <canal>", escrito en su sitio (sin temporales)
+static void appendNumeric(std::string& out, const char* num, const std::string& nick,
+    const std::string& chanName)
+{
+    out += ":ft_irc ";
+    out += num;
+    out += ' ';
+    out += nick;
+    out += ' ';
+    out += chanName;
+}
+
+// JOIN #a,#b,...,#z [k1,k2,...]
+// Un cliente entra en 50+ canales al conectar (y todos a la vez tras un
+// reinicio): primero se validan los nombres (sin repetidos), y todo lo que
+// recibe él (JOIN, topic, NAMES) se escribe en un solo bloque reservado de
+// antemano, que sale con un único queueSend (una escritura del loop)
 void Server::cmdJoin(ClientConnection* client, const Message& msg)
 {
     if (!client->isRegistered()) return;
@@ -47,64 +107,129 @@ void Server::cmdJoin(ClientConnection* client, const Message& msg)
     if (msg.params.size() > 1)
         keys = split(msg.params[1], ',');
 
+    User* user = client->getUser();
+    const std::string& nick = user->getNickname();
+
+    // --- 1. VALIDAR TODOS LOS DESTINOS ---
+    std::vector<std::pair<std::string, std::string> > joins;   // canal, clave
+    std::set<std::string> seen;
+    size_t estimate = 0;
     for (size_t i = 0; i < targets.size(); ++i)
     {
         std::string chanName = targets[i];
-        std::string key = (i < keys.size()) ? keys[i] : "";
 
         // Corrección: Asegurar prefijo válido (# o &). Si no tiene, poner #
         if (chanName.empty()) continue;
         if (chanName[0] != '#' && chanName[0] != '&') 
             chanName = "#" + chanName;
+        if (!seen.insert(chanName).second)
+            continue;
+
+        // JOIN + 331/332 + 366 con su cabecera, y los nicks que verá en 353
+        Channel* channel = getChannel(chanName);
+        estimate += 4 * (32 + nick.size() + chanName.size()) + user->getPrefix().size();
+        if (channel)
+            estimate += channel->getTopic().size() + channel->getPresenceAudience(user).size() * 12;
+        joins.push_back(std::make_pair(chanName, (i < keys.size()) ? keys[i] : ""));
+    }
+
+    // --- 2. ENTRAR ---
+    std::string burst;
+    burst.reserve(estimate);
+    std::string namesHead = ":ft_irc " RPL_NAMREPLY " " + nick + " = ";
+    size_t namesPrefix = namesHead.size();
+    for (size_t i = 0; i < joins.size(); ++i)
+    {
+        const std::string& chanName = joins[i].first;
+        const std::string& key = joins[i].second;
 
         Channel* channel = getChannel(chanName);
         if (!channel)
         {
             channel = createChannel(chanName);
             // El creador se convierte en Operador automáticamente
-            channel->addOperator(client->getUser());
+            channel->addOperator(user);
         }
 
-        // Si ya está dentro, no hacer nada
-        if (channel->isMember(client->getUser()))
+        // Si ya está dentro, no hacer nada (su lista de canales es corta;
+        // la de miembros de un canal grande, no)
+        if (user->isInChannel(channel))
             continue;
 
+        // Canal restaurado del snapshot: quien era OP antes del reinicio
+        // recupera el +o y no pasa por +i/+k/+l (es quien los puso)
+        bool restoredOp = channel->claimRestoredOperator(user);
+
         // --- VALIDACIONES DE MODOS ---
-        if (channel->hasMode('i') && !channel->isInvited(client->getUser()))
+        if (!restoredOp && channel->hasMode('i') && !channel->isInvited(user)
+            && !channel->isInviteExempt(*user))
+        {
+            joinError(client, burst, ERR_INVITEONLYCHAN, chanName);
+            continue;
+        }
+        if (!restoredOp && channel->isBanned(*user))
         {
-            sendError(client, ERR_INVITEONLYCHAN, chanName);
+            joinError(client, burst, ERR_BANNEDFROMCHAN, chanName);
             continue;
         }
-        if (channel->hasMode('k') && channel->getKey() != key)
+        if (!restoredOp && channel->hasMode('k') && channel->getKey() != key)
         {
-            sendError(client, ERR_BADCHANNELKEY, chanName);
+            joinError(client, burst, ERR_BADCHANNELKEY, chanName);
             continue;
         }
-        if (channel->hasMode('l') && channel->getUserCount() >= (size_t)channel->getLimit())
+        if (!restoredOp && channel->hasMode('l') && channel->getUserCount() >= (size_t)channel->getLimit())
         {
-            sendError(client, ERR_CHANNELISFULL, chanName);
+            joinError(client, burst, ERR_CHANNELISFULL, chanName);
             continue;
         }
 
         // Unirse efectivamente
-        channel->addMember(client->getUser());
-        client->getUser()->joinChannel(channel);
+        channel->addMember(user);
+        user->joinChannel(channel);
 
-        // Notificar a todos en el canal (incluido el nuevo usuario)
-        std::string joinMsg = ":" + client->getUser()->getPrefix() + " JOIN " + chanName + "\r\n";
-        channel->broadcast(joinMsg, NULL);
+        // Canal restaurado sin OPs pendientes (el único que puede estar
+        // vacío): el primero en entrar cuenta como creador
+        if (channel->getUserCount() == 1 && !channel->hasRestoredOperators()
+            && !channel->isOperator(user))
+            channel->addOperator(user);
 
-        // Enviar Topic
-        if (channel->getTopic().empty())
-            sendReply(client, RPL_NOTOPIC, chanName + " :No topic is set");
+        // Notificar a los demás en el canal (en +u solo a los OPs); el
+        // propio JOIN va en el bloque, delante de su topic y NAMES
+        std::string joinMsg = ":" + user->getPrefix() + " JOIN " + chanName + "\r\n";
+        channel->broadcastPresence(joinMsg, user, user);
+        burst += joinMsg;
+
+        // Al resto del árbol: quien crea el canal lo anuncia con sus modos (SJOIN)
+        const std::string& uid = user->getUid();
+        if (link_table_.links().empty())
+            ;   // Sin enlaces ni siquiera se formatea la línea
+        else if (channel->getUserCount() == 1 && channel->isOperator(user))
+            sendToLinks(":" + sid_ + " SJOIN " + toString(channel->getCreatedAt()) + " " + chanName + " "
+                + channel->getModes() + " :@" + uid + "\r\n", NULL);
         else
-            sendReply(client, RPL_TOPIC, chanName + " :" + channel->getTopic());
+            sendToLinks(":" + uid + " JOIN " + toString(channel->getCreatedAt()) + " " + chanName + " +\r\n", NULL);
 
-        // Enviar lista de Nombres (RPL_NAMREPLY)
-        std::string symbol = "="; // Canal público
-        sendReply(client, RPL_NAMREPLY, symbol + " " + chanName + " :" + channel->getNamesList());
-        sendReply(client, RPL_ENDOFNAMES, chanName + " :End of /NAMES list");
+        // Topic, NAMES (canal público: "=") y fin de NAMES
+        if (channel->getTopic().empty())
+        {
+            appendNumeric(burst, RPL_NOTOPIC, nick, chanName);
+            burst += " :No topic is set\r\n";
+        }
+        else
+        {
+            appendNumeric(burst, RPL_TOPIC, nick, chanName);
+            burst += " :";
+            burst += channel->getTopic();
+            burst += "\r\n";
+        }
+        namesHead.resize(namesPrefix);
+        namesHead += chanName;
+        namesHead += " :";
+        channel->appendNamesReply(burst, namesHead, user);
+        appendNumeric(burst, RPL_ENDOFNAMES, nick, chanName);
+        burst += " :End of /NAMES list\r\n";
     }
+    client->queueSend(burst);
 }
 
 void Server::cmdPart(ClientConnection* client, const Message& msg)
@@ -133,26 +258,51 @@ void Server::cmdPart(ClientConnection* client, const Message& msg)
         }
 
         std::string partMsg = ":" + client->getUser()->getPrefix() + " PART " + chanName + " :" + reason + "\r\n";
-        channel->broadcast(partMsg, NULL); // Enviar a todos
+        channel->broadcastPresence(partMsg, client->getUser(), NULL); // A todos (en +u, a los OPs)
+        sendToLinks(":" + client->getUser()->getUid() + " PART " + chanName + " :" + reason + "\r\n", NULL);
 
         channel->removeMember(client->getUser());
         client->getUser()->leaveChannel(channel);
 
         // Borrar canal si se queda vacío
         if (channel->getUserCount() == 0)
+            destroyChannel(channel);
+    }
+}
+
+// LIST [<canal>|<filtro>{,...}]
+// Con nombres exactos se contesta aquí mismo; si no, el recorrido del
+// índice por tamaño se entrega por partes según el cliente va leyendo
+void Server::cmdList(ClientConnection* client, const Message& msg)
+{
+    if (!client->isRegistered()) return;
+
+    ListStream::Filter filter;
+    std::vector<std::string> names;
+    if (!msg.params.empty())
+    {
+        std::vector<std::string> tokens = split(msg.params[0], ',');
+        time_t now = std::time(NULL);
+        for (size_t i = 0; i < tokens.size(); ++i)
         {
-            for (std::vector<Channel*>::iterator it = channels_.begin(); it != channels_.end(); )
-            {
-                if (*it == channel)
-                {
-                    delete *it;
-                    it = channels_.erase(it);
-                    break;
-                }
-                else ++it;
-            }
+            if (!ListStream::parseToken(tokens[i], now, filter))
+                names.push_back(tokens[i]);
         }
     }
+
+    const std::string& nick = client->getUser()->getNickname();
+    if (names.empty())
+        return startStream(client, new ListStream(list_index_, nick, filter));
+
+    std::string out;
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        Channel* channel = getChannel(names[i]);
+        if (channel && ListStream::matches(*channel, filter))
+            ListStream::appendLine(out, nick, *channel);
+    }
+    client->queueSend(out);
+    sendReply(client, RPL_LISTEND, ":End of /LIST");
 }
 
 void Server::cmdTopic(ClientConnection* client, const Message& msg)
@@ -181,5 +331,7 @@ void Server::cmdTopic(ClientConnection* client, const Message& msg)
     
     // Notificar el cambio a todos
     std::string topicMsg = ":" + client->getUser()->getPrefix() + " TOPIC " + channel->getName() + " :" + msg.params[1] + "\r\n";
-    channel->broadcast(topicMsg, NULL);
+    channel->broadcast(topicMsg, NULL, LANE_BULK, client->getUser());
+    sendToLinks(":" + client->getUser()->getUid() + " TOPIC " + channel->getName() + " :" + msg.params[1] + "\r\n",
+        NULL);
 }
@@ -0,0 +1,179 @@
+#include "../server/Server.hpp"
+#include "../client/ClientConnection.hpp"
+#include "../client/User.hpp"
+#include "../channel/Channel.hpp"
+#include "CommandHelpers.hpp"
+#include "../irc/NumericReplies.hpp"
+#include "SharedLine.hpp"
+#include <sys/time.h>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <ctime>
+
+static long long unixTimeMs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<long long>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+//* IRCv3 server-time: 2026-01-31T12:34:56.789Z
+static std::string formatServerTime(long long ms)
+{
+    time_t sec = static_cast<time_t>(ms / 1000);
+    struct tm tm;
+    gmtime_r(&sec, &tm);
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", tm.tm_year + 1900, tm.tm_mon + 1,
+        tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(ms % 1000));
+    return (buf);
+}
+
+//* "timestamp=<server-time>" or "msgid=<id>"
+static bool parseBound(const std::string& ref, ChannelHistory::Bound& bound)
+{
+    if (ref.compare(0, 6, "msgid=") == 0)
+    {
+        char* end;
+        bound.byTime = false;
+        bound.msgid = std::strtoul(ref.c_str() + 6, &end, 10);
+        return (end != ref.c_str() + 6 && *end == '\0');
+    }
+    if (ref.compare(0, 10, "timestamp=") == 0)
+    {
+        struct tm tm;
+        int ms = 0;
+        std::memset(&tm, 0, sizeof(tm));
+        if (std::sscanf(ref.c_str() + 10, "%4d-%2d-%2dT%2d:%2d:%2d.%3dZ", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &ms) < 6)
+            return (false);
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        bound.byTime = true;
+        bound.timeMs = static_cast<long long>(timegm(&tm)) * 1000 + ms;
+        return (true);
+    }
+    return (false);
+}
+
+static void sendFail(ClientConnection* client, const std::string& code, const std::string& context,
+    const std::string& text)
+{
+    client->queueSend(":ft_irc FAIL CHATHISTORY " + code + " " + context + " :" + text + "\r\n");
+}
+
+//* Channel message: formatted once, queued to the members and kept (shared,
+//* not copied) in the channel history
+void Server::relayToChannel(Channel* channel, User* sender, const std::string& line)
+{
+    SharedLine shared(line);
+    long long now = unixTimeMs();
+    channel->broadcast(shared, sender);
+    channel->getHistory().append(shared, next_msgid_, now);
+    if (history_store_.enabled())
+        history_store_.append(channel->getName(), next_msgid_, now, line);
+    next_msgid_++;
+}
+
+//* CHATHISTORY LATEST <target> <* | timestamp=.. | msgid=..> <limit>
+//* CHATHISTORY BEFORE|AFTER <target> <timestamp=.. | msgid=..> <limit>
+//* Members only. Messages come back in a "chathistory" BATCH, each tagged
+//* with the time and msgid stored with it, as far as the client's CAPs allow:
+//* without any they are plain lines.
+void Server::cmdChatHistory(ClientConnection* client, const Message& msg)
+{
+    if (msg.params.size() < 4)
+        return sendError(client, ERR_NEEDMOREPARAMS, "CHATHISTORY");
+
+    std::string sub = msg.params[0];
+    for (size_t i = 0; i < sub.size(); ++i)
+        sub[i] = std::toupper(sub[i]);
+    const std::string& target = msg.params[1];
+    const std::string& ref = msg.params[2];
+
+    if (sub != "LATEST" && sub != "BEFORE" && sub != "AFTER")
+        return sendFail(client, "INVALID_PARAMS", sub, "Unknown subcommand");
+
+    Channel* channel = getChannel(target);
+    if (!channel || !channel->isMember(client->getUser()))
+        return sendFail(client, "INVALID_TARGET", sub + " " + target, "Messages could not be retrieved");
+
+    char* end;
+    unsigned long limit = std::strtoul(msg.params[3].c_str(), &end, 10);
+    if (*end != '\0' || limit == 0)
+        return sendFail(client, "INVALID_PARAMS", sub, "Invalid limit");
+    if (limit > config_.historyMaxLimit)
+        limit = config_.historyMaxLimit;
+
+    ChannelHistory::Bound bound;
+    bool anchored = !(sub == "LATEST" && ref == "*");
+    if (anchored && !parseBound(ref, bound))
+        return sendFail(client, "INVALID_PARAMS", sub, "Invalid message reference");
+
+    //* Either source ends up as (line, msgid, time) triples: the line is a
+    //* pointer into the ring's shared block or into the segment mapping
+    std::vector<HistoryStore::Hit> found;
+    if (history_store_.enabled())
+    {
+        const std::string& name = channel->getName();
+        if (sub == "LATEST" && anchored)
+            history_store_.latestAfter(name, bound, limit, found);
+        else if (sub == "LATEST")
+            history_store_.latest(name, limit, found);
+        else if (sub == "BEFORE")
+            history_store_.before(name, bound, limit, found);
+        else
+            history_store_.after(name, bound, limit, found);
+    }
+    else
+    {
+        const ChannelHistory& history = channel->getHistory();
+        std::vector<const ChannelHistory::Entry*> entries;
+        if (sub == "LATEST" && anchored)
+            history.latestAfter(bound, limit, entries);
+        else if (sub == "LATEST")
+            history.latest(limit, entries);
+        else if (sub == "BEFORE")
+            history.before(bound, limit, entries);
+        else
+            history.after(bound, limit, entries);
+        found.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            found[i].line = entries[i]->line.str().data();
+            found[i].length = entries[i]->line.size();
+            found[i].msgid = entries[i]->msgid;
+            found[i].timeMs = entries[i]->timeMs;
+        }
+    }
+
+    std::string batch;
+    if (client->hasCap(ClientConnection::CAP_BATCH))
+    {
+        std::ostringstream id;
+        id << "h" << next_batch_++;
+        batch = id.str();
+        client->queueSend(":ft_irc BATCH +" + batch + " chathistory " + channel->getName() + "\r\n");
+    }
+    bool withTime = client->hasCap(ClientConnection::CAP_SERVER_TIME);
+    bool withMsgid = client->hasCap(ClientConnection::CAP_MESSAGE_TAGS);
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        //* Tags are per entry; the line itself is copied as stored
+        std::ostringstream tags;
+        if (!batch.empty())
+            tags << ";batch=" << batch;
+        if (withTime)
+            tags << ";time=" << formatServerTime(found[i].timeMs);
+        if (withMsgid)
+            tags << ";msgid=" << found[i].msgid;
+        if (tags.tellp() > 0)
+            client->queueSend("@" + tags.str().substr(1) + " ");
+        client->queueSend(found[i].line, found[i].length);
+    }
+    if (!batch.empty())
+        client->queueSend(":ft_irc BATCH -" + batch + "\r\n");
+}
@@ -0,0 +1,573 @@
+#include "../server/Server.hpp"
+#include "../client/ClientConnection.hpp"
+#include "../client/User.hpp"
+#include "../channel/Channel.hpp"
+#include "CommandHelpers.hpp"
+#include "../irc/NumericReplies.hpp"
+#include <cstdlib>
+#include <iostream>
+
+// Protocolo entre servidores (estilo TS6). Cada servidor tiene un SID
+// ("0FT") y cada usuario un UID (SID + 6 caracteres); las líneas llevan
+// como prefijo el SID o el UID de quien las origina:
+//
+//   PASS <password> TS 6 :<sid>        handshake, en los dos sentidos
+//   SERVER <name> 1 :<description>
+//   :<sid> SID <name> <hops> <sid> :<description>
+//   :<sid> UID <nick> <hops> <ts> +<modes> <user> <host> <ip> <uid> :<real>
+//   :<sid> SJOIN <ts> <#chan> +<modes> [args] :[@]<uid> ...
+//   :<uid> JOIN <ts> <#chan> +   /  PART, KICK, TOPIC, TMODE, INVITE, NICK, QUIT
+//   :<uid> PRIVMSG <#chan|uid> :<text>
+//   :<sid> KILL <uid> :<reason>  /  SQUIT <sid> :<reason>
+//
+// Cada línea se aplica aquí y se reenvía por los demás enlaces (nunca por
+// el que llegó): el árbol no tiene ciclos, así que nada llega dos veces.
+// PRIVMSG/NOTICE a un canal solo baja por los enlaces con miembros.
+
+//* Rebuild a received line to pass it on unchanged
+static std::string relayLine(const Message& msg)
+{
+    std::string line;
+    if (!msg.prefix.empty())
+        line = ":" + msg.prefix + " ";
+    line += msg.command;
+    for (size_t i = 0; i < msg.params.size(); ++i)
+    {
+        const std::string& p = msg.params[i];
+        line += " ";
+        if (i + 1 == msg.params.size() && (p.empty() || p[0] == ':' || p.find(' ') != std::string::npos))
+            line += ":";
+        line += p;
+    }
+    return line + "\r\n";
+}
+
+static bool isChannelName(const std::string& name)
+{
+    return !name.empty() && (name[0] == '#' || name[0] == '&');
+}
+
+void Server::initLinkCommands()
+{
+    _linkCommandMap["PASS"] = &Server::linkPass;
+    _linkCommandMap["SERVER"] = &Server::linkServer;
+    _linkCommandMap["CAPAB"] = &Server::linkIgnore;
+    _linkCommandMap["SVINFO"] = &Server::linkIgnore;
+    _linkCommandMap["SID"] = &Server::linkSid;
+    _linkCommandMap["SQUIT"] = &Server::linkSquit;
+    _linkCommandMap["UID"] = &Server::linkUid;
+    _linkCommandMap["NICK"] = &Server::linkNick;
+    _linkCommandMap["QUIT"] = &Server::linkQuit;
+    _linkCommandMap["KILL"] = &Server::linkKill;
+    _linkCommandMap["SJOIN"] = &Server::linkSjoin;
+    _linkCommandMap["JOIN"] = &Server::linkJoin;
+    _linkCommandMap["PART"] = &Server::linkPart;
+    _linkCommandMap["KICK"] = &Server::linkKick;
+    _linkCommandMap["TOPIC"] = &Server::linkTopic;
+    _linkCommandMap["TB"] = &Server::linkTb;
+    _linkCommandMap["TMODE"] = &Server::linkTmode;
+    _linkCommandMap["BMASK"] = &Server::linkBmask;
+    _linkCommandMap["INVITE"] = &Server::linkInvite;
+    _linkCommandMap["PRIVMSG"] = &Server::linkMessage;
+    _linkCommandMap["NOTICE"] = &Server::linkMessage;
+    _linkCommandMap["PING"] = &Server::linkPing;
+    _linkCommandMap["PONG"] = &Server::linkPong;
+    _linkCommandMap["ERROR"] = &Server::linkError;
+}
+
+//* Lines from a KIND_SERVER connection. Until SERVER is accepted only the
+//* handshake is understood.
+void Server::handleLinkMessage(ClientConnection* link, const Message& msg)
+{
+    std::map<std::string, CommandHandler>::iterator it = _linkCommandMap.find(msg.command);
+    if (it == _linkCommandMap.end())
+    {
+        g_metrics.unknownCommands.inc();
+        std::cerr << "[LINK] Unknown command from " << link->getHost() << ": " << msg.command << std::endl;
+        return;
+    }
+    LinkTable::Session* session = link_table_.session(link);
+    if ((!session || !session->established) && msg.command != "PASS" && msg.command != "SERVER"
+        && msg.command != "CAPAB" && msg.command != "SVINFO" && msg.command != "ERROR")
+        return;
+    (this->*(it->second))(link, msg);
+}
+
+// ============================================================================
+// HANDSHAKE
+// ============================================================================
+
+//* PASS <password> TS 6 :<sid>
+//* Inbound links arrive here from cmdPass ("PASS pw TS ..."), still a client
+void Server::linkPass(ClientConnection* link, const Message& msg)
+{
+    LinkTable::Session* session = link_table_.session(link);
+    if (session && session->established)
+        return;
+    if (config_.linkPassword.empty() || msg.params.size() < 4 || msg.params[0] != config_.linkPassword
+        || msg.params[1] != "TS")
+    {
+        link->queueSend("ERROR :Closing Link: " + link->getHost() + " (Bad link password)\r\n");
+        link->closeConnection("Bad link password", DISC_BAD_PASSWORD);
+        return;
+    }
+    if (!session)
+        session = &link_table_.open(link, -1);
+    session->sid = msg.params[3];
+    session->passOk = true;
+}
+
+//* SERVER on a client connection that never sent PASS ... TS: once a link
+//* session is open its lines go to handleLinkMessage() and land in linkServer()
+void Server::cmdServer(ClientConnection* client, const Message& msg)
+{
+    (void)msg;
+    client->queueSend("ERROR :Closing Link: " + client->getHost() + " (No link password)\r\n");
+    client->closeConnection("No link password", DISC_BAD_PASSWORD);
+}
+
+//* SERVER <name> <hops> :<description>
+void Server::linkServer(ClientConnection* link, const Message& msg)
+{
+    LinkTable::Session* session = link_table_.session(link);
+    if (!session || session->established)
+        return;
+    if (!session->passOk || msg.params.size() < 3)
+        return closeLink(link, "SERVER before PASS");
+    if (link->getKind() != ClientConnection::KIND_SERVER)
+    {
+        //* Inbound: not a client any more, out of the registration and per-source accounting
+        if (link->getUser())
+            return closeLink(link, "SERVER after NICK/USER");
+        if (unregistered_count_ > 0)
+            unregistered_count_--;
+        addresses_.release(link->getAddress());
+        link->setKind(ClientConnection::KIND_SERVER);
+    }
+    establishLink(link, msg.params[0], msg.params.back());
+}
+
+void Server::linkIgnore(ClientConnection* link, const Message& msg)
+{
+    (void)link;
+    (void)msg;
+}
+
+//* ERROR :<reason>   the other side is closing
+void Server::linkError(ClientConnection* link, const Message& msg)
+{
+    std::string reason = msg.params.empty() ? "ERROR" : msg.params[0];
+    std::cerr << "[LINK] ERROR from " << link->getHost() << ": " << reason << std::endl;
+    link->closeConnection(reason, DISC_ERROR);
+}
+
+//* :<sid> PING <origin> :<destination>
+void Server::linkPing(ClientConnection* link, const Message& msg)
+{
+    if (msg.params.size() > 1 && msg.params[1] != sid_)
+        return;
+    link->queueSend(":" + sid_ + " PONG " + server_name_ + " :" + msg.prefix + "\r\n");
+}
+
+//* The PONG to the PING that closed our burst: the peer is in sync
+void Server::linkPong(ClientConnection* link, const Message& msg)
+{
+    LinkTable::Session* session = link_table_.session(link);
+    if (!session || !session->burstStartedUs || msg.params.size() < 2 || msg.params[1] != sid_)
+        return;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned long now = static_cast<unsigned long>(ts.tv_sec) * 1000000UL + ts.tv_nsec / 1000UL;
+    std::cout << "[LINK] Burst to " << msg.params[0] << " acknowledged in "
+              << (now - session->burstStartedUs) / 1000.0 << " ms" << std::endl;
+    session->burstStartedUs = 0;
+}
+
+// ============================================================================
+// SERVERS
+// ============================================================================
+
+//* :<uplink> SID <name> <hops> <sid> :<description>
+void Server::linkSid(ClientConnection* link, const Message& msg)
+{
+    LinkTable::Peer* uplink = link_table_.find(msg.prefix);
+    if (!uplink || uplink->route != link || msg.params.size() < 4)
+        return;
+    const std::string& name = msg.params[0];
+    const std::string& sid = msg.params[2];
+    if (sid == sid_ || name == server_name_ || link_table_.find(sid) || link_table_.findByName(name))
+        return closeLink(link, "Server " + name + " already exists (loop)");
+
+    LinkTable::Peer peer;
+    peer.sid = sid;
+    peer.name = name;
+    peer.description = msg.params.back();
+    peer.hops = static_cast<unsigned int>(std::atoi(msg.params[1].c_str()));
+    peer.uplink = msg.prefix;
+    peer.route = link;
+    link_table_.add(peer);
+    sendToLinks(":" + msg.prefix + " SID " + name + " " + toString(peer.hops + 1) + " " + sid + " :"
+        + peer.description + "\r\n", link);
+}
+
+//* :<sid> SQUIT <sid> :<reason>
+void Server::linkSquit(ClientConnection* link, const Message& msg)
+{
+    if (msg.params.empty())
+        return;
+    const std::string& sid = msg.params[0];
+    std::string reason = msg.params.size() > 1 ? msg.params[1] : "SQUIT";
+    if (sid == sid_)
+        return closeLink(link, reason);
+
+    LinkTable::Peer* peer = link_table_.find(sid);
+    if (!peer || peer->route != link || peer->hops == 1)
+        return;
+    LinkTable::Peer* uplink = link_table_.find(peer->uplink);
+    std::string split = (uplink ? uplink->name : server_name_) + " " + peer->name;
+    std::vector<std::string> gone;
+    link_table_.subtree(sid, gone);
+    splitServers(gone, split);
+    sendToLinks(relayLine(msg), link);
+}
+
+// ============================================================================
+// USERS
+// ============================================================================
+
+//* :<sid> UID <nick> <hops> <ts> +<modes> <user> <host> <ip> <uid> :<real>
+//* Nick collision: the older nick stays, on a tie both go. Both sides of a
+//* link decide the same, so a burst crossing another one converges.
+void Server::linkUid(ClientConnection* link, const Message& msg)
+{
+    LinkTable::Peer* server = link_table_.find(msg.prefix);
+    if (!server || server->route != link || msg.params.size() < 9 || uids_.count(msg.params[7]))
+        return;
+    const std::string& nick = msg.params[0];
+    const std::string& uid = msg.params[7];
+    time_t ts = static_cast<time_t>(std::strtol(msg.params[2].c_str(), NULL, 10));
+
+    User* existing = findUserByNick(nick);
+    if (existing)
+    {
+        bool incomingLoses = existing->getNickTs() <= ts;
+        if (existing->getNickTs() >= ts)
+            killUser(existing, "Nick collision", NULL);
+        if (incomingLoses)
+        {
+            link->queueSend(":" + sid_ + " KILL " + uid + " :Nick collision\r\n");
+            return;
+        }
+    }
+
+    User* user = new User(nick);
+    user->setUsername(msg.params[4]);
+    user->setHostname(msg.params[5]);
+    user->setRealname(msg.params[8]);
+    user->setInvisible(msg.params[3].find('i') != std::string::npos);
+    user->setOperator(msg.params[3].find('o') != std::string::npos);
+    user->setUid(uid);
+    user->setNickTs(ts);
+    user->setRoute(link, msg.prefix);
+    user->setServer(server->name, static_cast<unsigned int>(std::atoi(msg.params[1].c_str())));
+    uids_[uid] = user;
+    remote_nicks_[nick] = user;
+    notifyMonitors(user, true);
+
+    Message forward = msg;
+    forward.params[1] = toString(std::atoi(msg.params[1].c_str()) + 1);
+    sendToLinks(relayLine(forward), link);
+}
+
+//* :<uid> NICK <newnick> :<ts>
+void Server::linkNick(ClientConnection* link, const Message& msg)
+{
+    User* user = findLinkUser(link, msg.prefix);
+    if (!user || msg.params.empty())
+        return;
+    const std::string& newNick = msg.params[0];
+    User* existing = findUserByNick(newNick);
+    if (existing && existing != user)
+    {
+        killUser(existing, "Nick collision", NULL);
+        killUser(user, "Nick collision", NULL);
+        return;
+    }
+    notifyCommonChannels(user, ":" + user->getPrefix() + " NICK :" + newNick + "\r\n");
+    bool renamed = user->getNickname() != newNick;
+    if (renamed)
+        notifyMonitors(user, false);
+    remote_nicks_.erase(user->getNickname());
+    user->setNickname(newNick);
+    user->setNickTs(msg.params.size() > 1 ? static_cast<time_t>(std::strtol(msg.params[1].c_str(), NULL, 10))
+        : std::time(NULL));
+    remote_nicks_[newNick] = user;
+    if (renamed)
+        notifyMonitors(user, true);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<uid> QUIT :<reason>
+void Server::linkQuit(ClientConnection* link, const Message& msg)
+{
+    User* user = findLinkUser(link, msg.prefix);
+    if (!user)
+        return;
+    quitRemoteUser(user, msg.params.empty() ? "Quit" : msg.params[0]);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<source> KILL <uid> :<reason>   (any user: it may be ours)
+void Server::linkKill(ClientConnection* link, const Message& msg)
+{
+    if (msg.params.empty())
+        return;
+    std::map<std::string, User*>::iterator it = uids_.find(msg.params[0]);
+    if (it == uids_.end())
+        return;
+    killUser(it->second, msg.params.size() > 1 ? msg.params[1] : "Killed", link);
+}
+
+// ============================================================================
+// CHANNELS
+// ============================================================================
+
+//* :<sid> SJOIN <ts> <#chan> +<modes> [args] :[@]<uid> ...
+//* Older TS: theirs wins (we drop our ops and modes). Newer: they join
+//* without their ops and modes. Same: both are merged.
+void Server::linkSjoin(ClientConnection* link, const Message& msg)
+{
+    LinkTable::Peer* server = link_table_.find(msg.prefix);
+    if (!server || server->route != link || msg.params.size() < 4 || !isChannelName(msg.params[1]))
+        return;
+    time_t ts = static_cast<time_t>(std::strtol(msg.params[0].c_str(), NULL, 10));
+    const std::string& name = msg.params[1];
+
+    Channel* channel = getChannel(name);
+    if (!channel)
+    {
+        channel = createChannel(name);
+        channel->setCreatedAt(ts);
+    }
+    else if (ts < channel->getCreatedAt())
+        loseChannelTs(channel, ts);
+    bool theirs = (ts == channel->getCreatedAt());
+    if (theirs)
+    {
+        std::vector<std::string> modes(msg.params.begin(), msg.params.end() - 1);
+        applyLinkModes(channel, server->name, modes, 2, true);
+    }
+
+    std::vector<std::string> members = split(msg.params.back(), ' ');
+    for (size_t i = 0; i < members.size(); ++i)
+    {
+        std::string uid = members[i];
+        bool op = false;
+        while (!uid.empty() && (uid[0] == '@' || uid[0] == '+'))
+        {
+            op = op || uid[0] == '@';
+            uid.erase(0, 1);
+        }
+        User* user = findLinkUser(link, uid);
+        if (!user || channel->isMember(user))
+            continue;
+        channel->addMember(user);
+        user->joinChannel(channel);
+        // OP antes del JOIN: en +u así lo ve entrar todo el canal, no solo los OPs
+        if (op && theirs)
+            channel->addOperator(user);
+        channel->broadcastPresence(":" + user->getPrefix() + " JOIN " + name + "\r\n", user, NULL);
+        if (op && theirs)
+        {
+            channel->broadcast(":" + server->name + " MODE " + name + " +o " + user->getNickname() + "\r\n", NULL);
+        }
+    }
+    if (channel->getUserCount() == 0)
+        return destroyChannel(channel);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<uid> JOIN <ts> <#chan> +
+void Server::linkJoin(ClientConnection* link, const Message& msg)
+{
+    User* user = findLinkUser(link, msg.prefix);
+    if (!user || msg.params.size() < 2 || !isChannelName(msg.params[1]))
+        return;
+    time_t ts = static_cast<time_t>(std::strtol(msg.params[0].c_str(), NULL, 10));
+    Channel* channel = getChannel(msg.params[1]);
+    if (!channel)
+    {
+        channel = createChannel(msg.params[1]);
+        channel->setCreatedAt(ts);
+    }
+    else if (ts < channel->getCreatedAt())
+        loseChannelTs(channel, ts);
+    if (!channel->isMember(user))
+    {
+        channel->addMember(user);
+        user->joinChannel(channel);
+        channel->broadcastPresence(":" + user->getPrefix() + " JOIN " + channel->getName() + "\r\n", user, NULL);
+    }
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<uid> PART <#chan> :<reason>
+void Server::linkPart(ClientConnection* link, const Message& msg)
+{
+    User* user = findLinkUser(link, msg.prefix);
+    Channel* channel = msg.params.empty() ? NULL : getChannel(msg.params[0]);
+    if (!user || !channel || !channel->isMember(user))
+        return;
+    std::string reason = msg.params.size() > 1 ? msg.params[1] : "Leaving";
+    channel->broadcastPresence(":" + user->getPrefix() + " PART " + channel->getName() + " :" + reason + "\r\n",
+        user, NULL);
+    channel->removeMember(user);
+    user->leaveChannel(channel);
+    if (channel->getUserCount() == 0)
+        destroyChannel(channel);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<uid> KICK <#chan> <uid> :<reason>
+void Server::linkKick(ClientConnection* link, const Message& msg)
+{
+    User* source = findLinkUser(link, msg.prefix);
+    Channel* channel = msg.params.size() < 2 ? NULL : getChannel(msg.params[0]);
+    std::map<std::string, User*>::iterator target = msg.params.size() < 2 ? uids_.end() : uids_.find(msg.params[1]);
+    if (!source || !channel || target == uids_.end() || !channel->isMember(target->second))
+        return;
+    User* victim = target->second;
+    std::string reason = msg.params.size() > 2 ? msg.params[2] : "Kicked";
+    channel->broadcast(":" + source->getPrefix() + " KICK " + channel->getName() + " " + victim->getNickname()
+        + " :" + reason + "\r\n", NULL, LANE_CONTROL);
+    channel->removeMember(victim);
+    victim->leaveChannel(channel);
+    if (channel->getUserCount() == 0)
+        destroyChannel(channel);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<uid> TOPIC <#chan> :<topic>
+void Server::linkTopic(ClientConnection* link, const Message& msg)
+{
+    User* user = findLinkUser(link, msg.prefix);
+    Channel* channel = msg.params.size() < 2 ? NULL : getChannel(msg.params[0]);
+    if (!user || !channel)
+        return;
+    channel->setTopic(msg.params[1]);
+    channel->broadcast(":" + user->getPrefix() + " TOPIC " + channel->getName() + " :" + msg.params[1] + "\r\n",
+        NULL);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<sid> TB <#chan> <ts> :<topic>   burst topic: kept unless we have one
+void Server::linkTb(ClientConnection* link, const Message& msg)
+{
+    LinkTable::Peer* server = link_table_.find(msg.prefix);
+    Channel* channel = msg.params.size() < 3 ? NULL : getChannel(msg.params[0]);
+    if (!server || server->route != link || !channel || !channel->getTopic().empty())
+        return;
+    channel->setTopic(msg.params[2]);
+    channel->broadcast(":" + server->name + " TOPIC " + channel->getName() + " :" + msg.params[2] + "\r\n", NULL);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<uid|sid> TMODE <ts> <#chan> <modes> [args]   ignored if their channel is newer
+void Server::linkTmode(ClientConnection* link, const Message& msg)
+{
+    Channel* channel = msg.params.size() < 3 ? NULL : getChannel(msg.params[1]);
+    if (!channel || std::strtol(msg.params[0].c_str(), NULL, 10) > channel->getCreatedAt())
+        return;
+    User* user = findLinkUser(link, msg.prefix);
+    LinkTable::Peer* server = user ? NULL : link_table_.find(msg.prefix);
+    if (!user && (!server || server->route != link))
+        return;
+    applyLinkModes(channel, user ? user->getPrefix() : server->name, msg.params, 2, false);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<sid> BMASK <ts> <#chan> <b|e|I> :<mask> ...   burst lists, added if their TS is not newer
+void Server::linkBmask(ClientConnection* link, const Message& msg)
+{
+    LinkTable::Peer* server = link_table_.find(msg.prefix);
+    Channel* channel = msg.params.size() < 4 ? NULL : getChannel(msg.params[1]);
+    if (!server || server->route != link || !channel || msg.params[2].size() != 1
+        || !channel->getMaskList(msg.params[2][0])
+        || std::strtol(msg.params[0].c_str(), NULL, 10) > channel->getCreatedAt())
+        return;
+    std::vector<std::string> masks = split(msg.params[3], ' ');
+    std::vector<std::string> modes;
+    modes.push_back("+" + std::string(masks.size(), msg.params[2][0]));
+    modes.insert(modes.end(), masks.begin(), masks.end());
+    applyLinkModes(channel, server->name, modes, 0, true);
+    sendToLinks(relayLine(msg), link);
+}
+
+//* :<uid> INVITE <uid> <#chan> <ts>   routed to the invited user's server only
+void Server::linkInvite(ClientConnection* link, const Message& msg)
+{
+    User* source = findLinkUser(link, msg.prefix);
+    std::map<std::string, User*>::iterator target = msg.params.size() < 2 ? uids_.end() : uids_.find(msg.params[0]);
+    if (!source || target == uids_.end())
+        return;
+    User* dest = target->second;
+    if (dest->isRemote())
+    {
+        if (dest->getRoute() != link)
+            dest->getRoute()->queueSend(relayLine(msg));
+        return;
+    }
+    Channel* channel = getChannel(msg.params[1]);
+    if (channel)
+        channel->addInvite(dest->getNickname());
+    dest->getConnection()->queueSend(":" + source->getPrefix() + " INVITE " + dest->getNickname() + " "
+        + msg.params[1] + "\r\n", LANE_BULK);
+}
+
+// ============================================================================
+// MESSAGES
+// ============================================================================
+
+//* :<uid> PRIVMSG|NOTICE <#chan|uid> :<text>
+void Server::linkMessage(ClientConnection* link, const Message& msg)
+{
+    User* user = findLinkUser(link, msg.prefix);
+    if (!user || msg.params.size() < 2)
+        return;
+    const std::string& target = msg.params[0];
+
+    if (isChannelName(target))
+    {
+        Channel* channel = getChannel(target);
+        if (!channel)
+            return;
+        relayToChannel(channel, user, ":" + user->getPrefix() + " " + msg.command + " " + target + " :"
+            + msg.params[1] + "\r\n");
+        forwardToChannelLinks(channel, relayLine(msg), link);
+        return;
+    }
+    std::map<std::string, User*>::iterator dest = uids_.find(target);
+    if (dest == uids_.end() || dest->second->getRoute() == link)
+        return;
+    deliverToUser(dest->second, ":" + user->getPrefix() + " " + msg.command + " " + dest->second->getNickname()
+        + " :" + msg.params[1] + "\r\n", relayLine(msg));
+}
+
+// ============================================================================
+// CLIENT COMMANDS
+// ============================================================================
+
+//* LINKS: every server of the tree, this one included
+void Server::cmdLinks(ClientConnection* client, const Message& msg)
+{
+    (void)msg;
+    const std::map<std::string, LinkTable::Peer>& peers = link_table_.peers();
+    for (std::map<std::string, LinkTable::Peer>::const_iterator it = peers.begin(); it != peers.end(); ++it)
+    {
+        LinkTable::Peer* uplink = link_table_.find(it->second.uplink);
+        sendReply(client, RPL_LINKS, it->second.name + " " + (uplink ? uplink->name : server_name_) + " :"
+            + toString(it->second.hops) + " " + it->second.description);
+    }
+    sendReply(client, RPL_LINKS, server_name_ + " " + server_name_ + " :0 " + config_.serverDescription);
+    sendReply(client, RPL_ENDOFLINKS, "* :End of /LINKS list");
+}
@@ -36,24 +36,26 @@ void Server::cmdPrivMsg(ClientConnection* client, const Message& msg)
         // if (channel->hasMode('n') && !channel->isMember(client->getUser()))
         //      return sendError(client, ERR_CANNOTSENDTOCHAN, target);
 
+        // +b: un baneado (sin +e) que sigue dentro no puede hablar, salvo si es OP
+        if (channel->isBanned(*client->getUser()) && !channel->isOperator(client->getUser()))
+            return sendError(client, ERR_CANNOTSENDTOCHAN, target);
+
         std::string fullMsg = ":" + client->getUser()->getPrefix() + " PRIVMSG " + target + " :" + text + "\r\n";
         
         // Excluimos al emisor (el cliente ya sabe lo que escribió)
-        channel->broadcast(fullMsg, client->getUser());
+        relayToChannel(channel, client->getUser(), fullMsg);
+        // Solo hacia los enlaces que tienen miembros del canal
+        forwardToChannelLinks(channel, ":" + client->getUser()->getUid() + " PRIVMSG " + target + " :" + text + "\r\n",
+            NULL);
     }
     else
     {
-        User* dest = NULL;
-        for (size_t i = 0; i < clients_.size(); ++i) {
-            if (clients_[i]->isRegistered() && clients_[i]->getUser()->getNickname() == target) {
-                dest = clients_[i]->getUser();
-                break;
-            }
-        }
+        User* dest = findUserByNick(target);
         if (!dest) return sendError(client, ERR_NOSUCHNICK, target);
 
         std::string fullMsg = ":" + client->getUser()->getPrefix() + " PRIVMSG " + target + " :" + text + "\r\n";
-        dest->getConnection()->queueSend(fullMsg);
+        deliverToUser(dest, fullMsg, ":" + client->getUser()->getUid() + " PRIVMSG " + dest->getUid() + " :" + text
+            + "\r\n");
     }
 }
 
@@ -67,17 +69,19 @@ void Server::cmdNotice(ClientConnection* client, const Message& msg)
 
     if (target[0] == '#') {
         Channel* channel = getChannel(target);
-        if (channel && channel->isMember(client->getUser())) {
+        if (channel && channel->isMember(client->getUser())
+            && (channel->isOperator(client->getUser()) || !channel->isBanned(*client->getUser()))) {
             std::string fullMsg = ":" + client->getUser()->getPrefix() + " NOTICE " + target + " :" + text + "\r\n";
-            channel->broadcast(fullMsg, client->getUser());
+            relayToChannel(channel, client->getUser(), fullMsg);
+            forwardToChannelLinks(channel, ":" + client->getUser()->getUid() + " NOTICE " + target + " :" + text
+                + "\r\n", NULL);
         }
     } else {
-        for (size_t i = 0; i < clients_.size(); ++i) {
-            if (clients_[i]->isRegistered() && clients_[i]->getUser()->getNickname() == target) {
-                std::string fullMsg = ":" + client->getUser()->getPrefix() + " NOTICE " + target + " :" + text + "\r\n";
-                clients_[i]->queueSend(fullMsg);
-                break;
-            }
+        User* dest = findUserByNick(target);
+        if (dest) {
+            std::string fullMsg = ":" + client->getUser()->getPrefix() + " NOTICE " + target + " :" + text + "\r\n";
+            deliverToUser(dest, fullMsg, ":" + client->getUser()->getUid() + " NOTICE " + dest->getUid() + " :" + text
+                + "\r\n");
         }
     }
 }
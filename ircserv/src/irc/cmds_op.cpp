@@ -19,6 +19,20 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cctype>
+#include <ctime>
+
+// MODE #canal b|e|I: la lista, con quién puso cada máscara y cuándo
+static void sendMaskList(ClientConnection* client, const Channel* channel, char mode)
+{
+    const char* item = (mode == 'b') ? RPL_BANLIST : (mode == 'e') ? RPL_EXCEPTLIST : RPL_INVITELIST;
+    const char* end = (mode == 'b') ? RPL_ENDOFBANLIST : (mode == 'e') ? RPL_ENDOFEXCEPTLIST : RPL_ENDOFINVITELIST;
+    const char* what = (mode == 'b') ? "ban" : (mode == 'e') ? "exception" : "invite";
+    const std::list<MaskList::Entry>& entries = channel->getMaskList(mode)->entries();
+    for (std::list<MaskList::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+        sendReply(client, item, channel->getName() + " " + it->mask + " " + it->setter + " "
+            + toString(static_cast<unsigned long>(it->setAt)));
+    sendReply(client, end, channel->getName() + " :End of channel " + what + " list");
+}
 
 void Server::cmdKick(ClientConnection* client, const Message& msg)
 {
@@ -40,13 +54,18 @@ void Server::cmdKick(ClientConnection* client, const Message& msg)
     if (!targetUser) 
         return sendError(client, ERR_USERNOTINCHANNEL, targetNick + " " + chanName);
 
-    // Broadcast del KICK a todos en el canal
+    // Broadcast del KICK a todos en el canal, por control: la víctima se
+    // entera aunque tenga megas de canal pendientes
     std::string kickMsg = ":" + client->getUser()->getPrefix() + " KICK " + chanName + " " + targetNick + " :" + comment + "\r\n";
-    channel->broadcast(kickMsg, NULL);
+    channel->broadcast(kickMsg, NULL, LANE_CONTROL);
+    sendToLinks(":" + client->getUser()->getUid() + " KICK " + chanName + " " + targetUser->getUid() + " :" + comment
+        + "\r\n", NULL);
 
     // Eliminar efectivamente
     channel->removeMember(targetUser);
     targetUser->leaveChannel(channel);
+    if (channel->getUserCount() == 0)
+        destroyChannel(channel);
 }
 
 void Server::cmdInvite(ClientConnection* client, const Message& msg)
@@ -72,17 +91,13 @@ void Server::cmdInvite(ClientConnection* client, const Message& msg)
     }
 
     // Buscar al usuario destino globalmente en el servidor
-    User* dest = NULL;
-    for (size_t i = 0; i < clients_.size(); ++i) {
-        if (clients_[i]->isRegistered() && clients_[i]->getUser()->getNickname() == targetNick) {
-            dest = clients_[i]->getUser();
-            break;
-        }
-    }
+    User* dest = findUserByNick(targetNick);
     if (!dest) return sendError(client, ERR_NOSUCHNICK, targetNick);
 
     std::string invMsg = ":" + client->getUser()->getPrefix() + " INVITE " + targetNick + " " + chanName + "\r\n";
-    dest->getConnection()->queueSend(invMsg);
+    // Usuario remoto: el INVITE viaja hasta su servidor, que apunta la invitación
+    deliverToUser(dest, invMsg, ":" + client->getUser()->getUid() + " INVITE " + dest->getUid() + " " + chanName
+        + " " + toString(channel ? channel->getCreatedAt() : 0) + "\r\n");
     
     sendReply(client, RPL_INVITING, targetNick + " " + chanName);
 }
@@ -148,6 +163,17 @@ void Server::cmdMode(ClientConnection* client, const Message& msg)
          return;
     }
 
+    // Consulta de una lista: "MODE #c b" (cualquiera), e/I solo OPs
+    std::string listQuery = msg.params[1];
+    if (!listQuery.empty() && listQuery[0] == '+')
+        listQuery.erase(0, 1);
+    if (msg.params.size() == 2 && listQuery.size() == 1 && channel->getMaskList(listQuery[0]))
+    {
+        if (listQuery[0] != 'b' && !channel->isOperator(client->getUser()))
+            return sendError(client, ERR_CHANOPRIVSNEEDED, target);
+        return sendMaskList(client, channel, listQuery[0]);
+    }
+
     if (!channel->isOperator(client->getUser()))
         return sendError(client, ERR_CHANOPRIVSNEEDED, target);
 
@@ -175,7 +201,8 @@ void Server::cmdMode(ClientConnection* client, const Message& msg)
                 if (action == '+') channel->addOperator(targetUser);
                 else channel->removeOperator(targetUser);
                 
-                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "o " + targetNick + "\r\n", NULL);
+                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "o " + targetNick + "\r\n", NULL, LANE_BULK, client->getUser());
+                sendChannelModeToLinks(client->getUser(), channel, std::string(1, action) + "o " + targetUser->getUid());
             } else {
                  sendError(client, ERR_USERNOTINCHANNEL, targetNick + " " + target);
             }
@@ -190,7 +217,8 @@ void Server::cmdMode(ClientConnection* client, const Message& msg)
                 if (key.find(' ') != std::string::npos) continue;
 
                 channel->setKey(key);
-                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "k " + key + "\r\n", NULL);
+                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "k " + key + "\r\n", NULL, LANE_BULK, client->getUser());
+                sendChannelModeToLinks(client->getUser(), channel, "+k " + key);
             } else {
                 // [FIX RFC] Para quitar la clave (-k), se debe proporcionar la clave actual correcta
                 if (paramIdx >= msg.params.size()) {
@@ -202,7 +230,8 @@ void Server::cmdMode(ClientConnection* client, const Message& msg)
                 // Verificamos si la clave coincide
                 if (channel->getKey() == keyParam) {
                     channel->setKey(""); 
-                    channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "k *\r\n", NULL);
+                    channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "k *\r\n", NULL, LANE_BULK, client->getUser());
+                    sendChannelModeToLinks(client->getUser(), channel, "-k *");
                 } else {
                     sendError(client, ERR_BADCHANNELKEY, channel->getName());
                 }
@@ -233,17 +262,42 @@ void Server::cmdMode(ClientConnection* client, const Message& msg)
                 channel->setLimit(limit);
                 char buff[20];
                 std::sprintf(buff, "%d", limit);
-                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "l " + std::string(buff) + "\r\n", NULL);
+                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "l " + std::string(buff) + "\r\n", NULL, LANE_BULK, client->getUser());
+                sendChannelModeToLinks(client->getUser(), channel, "+l " + std::string(buff));
             } else {
                 channel->setLimit(0); // 0 significa sin límite
-                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "l" + "\r\n", NULL);
+                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + "l" + "\r\n", NULL, LANE_BULK, client->getUser());
+                sendChannelModeToLinks(client->getUser(), channel, "-l");
+            }
+        }
+        // b/e/I: listas de máscaras (ban, excepción, excepción de invitación)
+        else if (MaskList* list = channel->getMaskList(mode)) {
+            if (paramIdx >= msg.params.size()) {
+                sendMaskList(client, channel, mode);
+                continue;
+            }
+            std::string mask = MaskList::normalize(msg.params[paramIdx++]);
+            bool changed;
+            if (action == '+') {
+                if (list->size() >= config_.channelListLimit) {
+                    sendReply(client, ERR_BANLISTFULL, target + " " + mask + " :Channel list is full");
+                    continue;
+                }
+                changed = list->add(mask, client->getUser()->getPrefix(), std::time(NULL));
+            } else
+                changed = list->remove(mask);
+            if (changed) {
+                std::string change = std::string(1, action) + mode + " " + mask;
+                channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + change + "\r\n", NULL, LANE_BULK, client->getUser());
+                sendChannelModeToLinks(client->getUser(), channel, change);
             }
         }
-        // i: Invite Only | t: Topic Restricted
-        else if (mode == 'i' || mode == 't') {
+        // i: Invite Only | t: Topic Restricted | u: Auditorio (entradas y salidas solo para OPs)
+        else if (mode == 'i' || mode == 't' || mode == 'u') {
             channel->setMode(mode, (action == '+'));
             std::string mStr(1, mode);
-            channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + mStr + "\r\n", NULL);
+            channel->broadcast(":" + client->getUser()->getPrefix() + " MODE " + target + " " + action + mStr + "\r\n", NULL, LANE_BULK, client->getUser());
+            sendChannelModeToLinks(client->getUser(), channel, action + mStr);
         }
     }
 }
@@ -0,0 +1,185 @@
+#include "../server/Server.hpp"
+#include "../client/ClientConnection.hpp"
+#include "../client/User.hpp"
+#include "../channel/Channel.hpp"
+#include "CommandHelpers.hpp"
+#include "NumericReplies.hpp"
+#include "WhoStream.hpp"
+#include <ctime>
+
+// Líneas de 319 y 730-732 por debajo de los 512 bytes, contando prefijo y nicks
+static const size_t REPLY_LIST_MAX = 400;
+
+// WHO [<máscara> [<flags>[%<campos>[,<token>]]]]
+// Siempre por stream: un canal de 50k miembros sale al ritmo del cliente
+void Server::cmdWho(ClientConnection* client, const Message& msg)
+{
+    if (!client->isRegistered()) return;
+
+    WhoStream::Query query = WhoStream::parseQuery(msg.params.empty() ? "*" : msg.params[0],
+        msg.params.size() > 1 ? msg.params[1] : "");
+    startStream(client, new WhoStream(query, client->getUser(), channel_index_, nicks_, remote_nicks_));
+}
+
+// WHOIS [<servidor>] <nick>{,<nick>}
+// Todo sale de lo que ya sabemos: el idle solo existe para usuarios locales
+void Server::cmdWhois(ClientConnection* client, const Message& msg)
+{
+    if (!client->isRegistered()) return;
+    if (msg.params.empty())
+        return sendError(client, ERR_NONICKNAMEGIVEN, "");
+
+    std::vector<std::string> targets = split(msg.params[msg.params.size() > 1 ? 1 : 0], ',');
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+        User* user = findUserByNick(targets[i]);
+        if (!user)
+        {
+            sendError(client, ERR_NOSUCHNICK, targets[i]);
+            continue;
+        }
+        const std::string& nick = user->getNickname();
+        sendReply(client, RPL_WHOISUSER, nick + " " + user->getUsername() + " " + user->getHostname()
+            + " * :" + user->getRealname());
+
+        const std::vector<Channel*>& channels = user->getChannels();
+        std::string list;
+        for (size_t j = 0; j < channels.size(); ++j)
+        {
+            if (list.size() > REPLY_LIST_MAX)
+            {
+                sendReply(client, RPL_WHOISCHANNELS, nick + " :" + list);
+                list.clear();
+            }
+            if (!list.empty())
+                list += " ";
+            if (channels[j]->isOperator(user))
+                list += "@";
+            list += channels[j]->getName();
+        }
+        if (!list.empty())
+            sendReply(client, RPL_WHOISCHANNELS, nick + " :" + list);
+
+        sendReply(client, RPL_WHOISSERVER, nick + " " + user->getServerName() + " :"
+            + (user->isRemote() ? "Linked server" : "ft_irc server"));
+        if (user->isOperator())
+            sendReply(client, RPL_WHOISOPERATOR, nick + " :is an IRC operator");
+        if (user->isAway())
+            sendReply(client, RPL_AWAY, nick + " :" + user->getAwayMessage());
+        if (!user->isRemote())
+            sendReply(client, RPL_WHOISIDLE, nick + " " + toString(static_cast<unsigned long>(
+                std::time(NULL) - user->getConnection()->getLastActivity())) + " :seconds idle");
+        sendReply(client, RPL_ENDOFWHOIS, nick + " :End of /WHOIS list");
+    }
+}
+
+// ============================================================================
+// MONITOR (IRCv3)
+// ============================================================================
+
+// Lista separada por comas, partida en varias líneas si no cabe
+static void appendToList(ClientConnection* client, const std::string& num, std::string& list,
+    const std::string& item)
+{
+    if (!list.empty() && list.size() + item.size() > REPLY_LIST_MAX)
+    {
+        sendReply(client, num, ":" + list);
+        list.clear();
+    }
+    if (!list.empty())
+        list += ",";
+    list += item;
+}
+
+static void flushList(ClientConnection* client, const std::string& num, const std::string& list)
+{
+    if (!list.empty())
+        sendReply(client, num, ":" + list);
+}
+
+// 730/731 para cada nick: en línea si hay un usuario registrado con él
+void Server::sendMonitorStatus(ClientConnection* client, const std::vector<std::string>& targets)
+{
+    std::string online, offline;
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+        User* user = findUserByNick(targets[i]);
+        if (user)
+            appendToList(client, RPL_MONONLINE, online, user->getPrefix());
+        else
+            appendToList(client, RPL_MONOFFLINE, offline, targets[i]);
+    }
+    flushList(client, RPL_MONONLINE, online);
+    flushList(client, RPL_MONOFFLINE, offline);
+}
+
+// Solo los que vigilan ese nick: O(vigilantes), no O(clientes). Por bulk,
+// como el QUIT/NICK de canal que lo acompaña: no puede adelantarlo
+void Server::notifyMonitors(User* user, bool online)
+{
+    const MonitorIndex::Watchers* watchers = monitor_.watchers(user->getNickname());
+    if (!watchers)
+        return;
+    std::string tail = online ? " :" + user->getPrefix() + "\r\n" : " :" + user->getNickname() + "\r\n";
+    for (MonitorIndex::Watchers::const_iterator it = watchers->begin(); it != watchers->end(); ++it)
+        (*it)->queueSend(std::string(":ft_irc ") + (online ? RPL_MONONLINE : RPL_MONOFFLINE) + " "
+            + (*it)->getUser()->getNickname() + tail, LANE_BULK);
+}
+
+// MONITOR + <nick>{,<nick>} | - <nick>{,<nick>} | C | L | S
+void Server::cmdMonitor(ClientConnection* client, const Message& msg)
+{
+    if (!client->isRegistered()) return;
+    if (msg.params.empty())
+        return sendError(client, ERR_NEEDMOREPARAMS, "MONITOR");
+
+    const std::string& op = msg.params[0];
+    if ((op == "+" || op == "-") && msg.params.size() < 2)
+        return sendError(client, ERR_NEEDMOREPARAMS, "MONITOR");
+
+    if (op == "+")
+    {
+        std::vector<std::string> targets = split(msg.params[1], ',');
+        std::vector<std::string> added;
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            if (targets[i].empty())
+                continue;
+            if (monitor_.count(client) >= config_.monitorLimit)
+            {
+                std::string rest = targets[i];
+                for (size_t j = i + 1; j < targets.size(); ++j)
+                    rest += "," + targets[j];
+                sendReply(client, ERR_MONLISTFULL, toString(config_.monitorLimit) + " " + rest
+                    + " :Monitor list is full.");
+                break;
+            }
+            if (monitor_.add(client, targets[i]))
+                added.push_back(targets[i]);
+        }
+        sendMonitorStatus(client, added);
+    }
+    else if (op == "-")
+    {
+        std::vector<std::string> targets = split(msg.params[1], ',');
+        for (size_t i = 0; i < targets.size(); ++i)
+            monitor_.remove(client, targets[i]);
+    }
+    else if (op == "C" || op == "c")
+        monitor_.clear(client);
+    else if (op == "L" || op == "l" || op == "S" || op == "s")
+    {
+        const MonitorIndex::List* list = monitor_.list(client);
+        std::vector<std::string> nicks;
+        if (list)
+            for (MonitorIndex::List::const_iterator it = list->begin(); it != list->end(); ++it)
+                nicks.push_back(*it);
+        if (op == "S" || op == "s")
+            return sendMonitorStatus(client, nicks);
+        std::string line;
+        for (size_t i = 0; i < nicks.size(); ++i)
+            appendToList(client, RPL_MONLIST, line, nicks[i]);
+        flushList(client, RPL_MONLIST, line);
+        sendReply(client, RPL_ENDOFMONLIST, ":End of MONITOR list");
+    }
+}
@@ -0,0 +1,151 @@
+#include "../server/Server.hpp"
+#include "../client/ClientConnection.hpp"
+#include "../client/User.hpp"
+#include "CommandHelpers.hpp"
+#include "../irc/NumericReplies.hpp"
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <ctime>
+#include <cstdlib>
+
+//* OPER <name> <password>
+//* Credentials come from "oper = <name> <password>" lines in the config.
+void Server::cmdOper(ClientConnection* client, const Message& msg)
+{
+    if (msg.params.size() < 2)
+        return sendError(client, ERR_NEEDMOREPARAMS, "OPER");
+
+    std::map<std::string, std::string>::const_iterator it = config_.opers.find(msg.params[0]);
+    if (it == config_.opers.end())
+        return sendError(client, ERR_NOOPERHOST, "");
+    if (it->second != msg.params[1])
+        return sendError(client, ERR_PASSWDMISMATCH, "");
+
+    User* user = client->getUser();
+    user->setOperator(true);
+    sendReply(client, RPL_YOUREOPER, ":You are now an IRC operator");
+    client->queueSend(":" + user->getNickname() + " MODE " + user->getNickname() + " :+o\r\n");
+    std::cout << "[SERVER] " << user->getNickname() << " is now an operator (" << msg.params[0] << ")" << std::endl;
+}
+
+//* STATS <letter>   (operators only)
+//*   m  commands dispatched, per command (212)
+//*   u  uptime (242)
+//*   d  dispatch latency per command: p50/p99/p999/max in ns (249)
+//*   p  loop profile over the rolling window: iterations/s, phases, worst (249)
+//*   z  every registered metric, one per line (249)
+void Server::cmdStats(ClientConnection* client, const Message& msg)
+{
+    if (!client->getUser()->isOperator())
+        return sendError(client, ERR_NOPRIVILEGES, "");
+
+    std::string query = msg.params.empty() ? "*" : msg.params[0].substr(0, 1);
+
+    if (query == "m")
+    {
+        for (std::map<std::string, CommandEntry>::const_iterator it = _commandMap.begin(); it != _commandMap.end(); ++it)
+        {
+            std::ostringstream line;
+            line << it->first << " " << it->second.calls->value << " 0 0";
+            sendReply(client, RPL_STATSCOMMANDS, line.str());
+        }
+    }
+    else if (query == "u")
+    {
+        long up = static_cast<long>(std::time(NULL) - started_at_);
+        char buf[64];
+        snprintf(buf, sizeof(buf), ":Server Up %ld days %ld:%02ld:%02ld",
+            up / 86400, (up / 3600) % 24, (up / 60) % 60, up % 60);
+        sendReply(client, RPL_STATSUPTIME, buf);
+    }
+    else if (query == "d")
+    {
+        std::vector<std::string> lines;
+        formatCommandLatency(lines);
+        for (size_t i = 0; i < lines.size(); ++i)
+            sendReply(client, RPL_STATSDEBUG, "d :" + lines[i]);
+    }
+    else if (query == "p")
+    {
+        std::vector<std::string> lines;
+        profiler_.formatWindow(lines);
+        for (size_t i = 0; i < lines.size(); ++i)
+            sendReply(client, RPL_STATSDEBUG, "p :" + lines[i]);
+    }
+    else if (query == "z")
+    {
+        syncMetricGauges();
+        std::vector<std::string> lines;
+        g_metrics.registry.renderLines(lines);
+        for (size_t i = 0; i < lines.size(); ++i)
+            sendReply(client, RPL_STATSDEBUG, "z :" + lines[i]);
+    }
+
+    sendReply(client, RPL_ENDOFSTATS, query + " :End of STATS report");
+}
+
+//* CAPTURE [<seconds> | OFF]   (operators only)
+//* Records every received line (PASS/OPER passwords redacted) to
+//* capture_dir/ircserv-capture-<time>.bin for tools/ircreplay. Without
+//* arguments it reports whether a capture is running.
+void Server::cmdCapture(ClientConnection* client, const Message& msg)
+{
+    if (!client->getUser()->isOperator())
+        return sendError(client, ERR_NOPRIVILEGES, "");
+
+    const std::string& nick = client->getUser()->getNickname();
+    std::ostringstream reply;
+    reply << ":ft_irc NOTICE " << nick << " :";
+
+    if (msg.params.empty())
+    {
+        if (capture_.active())
+            reply << "Capture running, " << capture_.records() << " records, "
+                  << capture_.bytes() << " bytes, "
+                  << static_cast<long>(capture_.deadline() - std::time(NULL)) << "s left";
+        else
+            reply << "No capture running";
+    }
+    else if (msg.params[0] == "OFF" || msg.params[0] == "off")
+    {
+        reply << "Capture stopped (" << capture_.records() << " records)";
+        stopCapture();
+    }
+    else
+    {
+        unsigned int seconds = static_cast<unsigned int>(std::strtoul(msg.params[0].c_str(), NULL, 10));
+        if (seconds == 0)
+            return sendError(client, ERR_NEEDMOREPARAMS, "CAPTURE");
+        if (seconds > config_.captureMaxSeconds)
+            seconds = config_.captureMaxSeconds;
+
+        std::string path;
+        if (startCapture(seconds, path))
+            reply << "Capturing to " << path << " for " << seconds << "s";
+        else
+            reply << "Cannot open a capture file in " << config_.captureDir;
+    }
+    client->queueSend(reply.str() + "\r\n");
+}
+
+//* UPGRADE   (operators only)
+//* Replaces the running binary without dropping anyone: the new one (the
+//* same path, i.e. a freshly built ircserv, or upgrade_binary) is exec'd,
+//* receives every socket and the whole state, and takes over. The outcome
+//* arrives as a NOTICE, from the new process if it worked. Any argument is
+//* ignored: an O-line must not be able to exec whatever it names
+void Server::cmdUpgrade(ClientConnection* client, const Message& msg)
+{
+    (void)msg;
+    if (!client->getUser()->isOperator())
+        return sendError(client, ERR_NOPRIVILEGES, "");
+
+    std::string error;
+    std::string reply = ":ft_irc NOTICE " + client->getUser()->getNickname() + " :";
+    if (beginUpgrade(client->getId(), error))
+        reply += "Upgrade started";
+    else
+        reply += "Cannot upgrade: " + error;
+    client->queueSend(reply + "\r\n");
+}
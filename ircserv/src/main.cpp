@@ -23,7 +23,31 @@ Server* g_server = NULL;
 // No debe contener 'delete', 'cout', 'malloc', etc.
 void signalHandler(int signum)
 {
-    (void)signum; // Silenciar warning de variable no usada
+    if (g_server && signum == SIGHUP)
+    {
+        // Recargar config + MOTD: run() lo aplica fuera del handler
+        g_server->requestReload();
+        return;
+    }
+    if (g_server && signum == SIGUSR1)
+    {
+        // Volcar latencias por comando al log (lo hace run())
+        g_server->requestLatencyDump();
+        return;
+    }
+    if (g_server && signum == SIGUSR2)
+    {
+        // Volcar el flight recorder a disco (lo hace run())
+        g_server->requestFlightDump();
+        return;
+    }
+    if (g_server && signum == SIGTERM)
+    {
+        // Apagado ordenado: dejar de aceptar y vaciar las colas de todos
+        // (un segundo SIGTERM fuerza la parada inmediata)
+        g_server->requestDrain();
+        return;
+    }
     if (g_server) 
     {
         // Solo indicamos al servidor que detenga su bucle principal.
@@ -40,11 +64,12 @@ bool isValidPort(int port)
 int main(int argc, char **argv)
 {
     //* ARGUMENT VALIDATION
-    if (argc != 3) 
+    if (argc != 3 && argc != 4) 
     {
-        std::cerr << "Usage: " << argv[0] << " <port> <password>\n";
+        std::cerr << "Usage: " << argv[0] << " <port> <password> [config]\n";
         std::cerr << "  port: 1025-65535\n";
         std::cerr << "  password: connection password\n";
+        std::cerr << "  config: optional key = value file (reloaded on SIGHUP)\n";
         return (1);
     }
     
@@ -60,10 +85,19 @@ int main(int argc, char **argv)
         return (1);
     }
     
+    ServerConfig config;
+    if (argc == 4 && !config.load(argv[3])) {
+        std::cerr << "[ERROR] Invalid config file\n";
+        return (1);
+    }
+
     //* CONFIGURE SIGNALS
     // SIGINT (Ctrl+C) y SIGTERM son las señales estándar de terminación
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
+    signal(SIGHUP, signalHandler);
+    signal(SIGUSR1, signalHandler);
+    signal(SIGUSR2, signalHandler);
     
     // SIGPIPE es crucial en servidores de red. Si un cliente cierra la conexión
     // mientras intentamos escribirle, el OS envía SIGPIPE que crashea el programa
@@ -71,7 +105,7 @@ int main(int argc, char **argv)
     signal(SIGPIPE, SIG_IGN);
     
     //* CREATE AND START SERVER
-    g_server = new Server(port, password);
+    g_server = new Server(port, password, config);
     
     if (!g_server->start()) {
         std::cerr << "[FATAL] Could not start server\n";
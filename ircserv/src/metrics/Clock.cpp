@@ -0,0 +1,63 @@
+#include "Clock.hpp"
+#if defined(__x86_64__)
+# include <cpuid.h>
+#endif
+
+bool Clock::useTsc_ = false;
+unsigned long Clock::nsMult_ = 1UL << 32;
+
+unsigned long Clock::monotonicNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + static_cast<unsigned long>(ts.tv_nsec);
+}
+
+//* CPUID 0x80000007 EDX bit 8: the TSC ticks at a constant rate in every
+//* P-/C-state, so it can be used as a wall clock
+static bool hasInvariantTsc()
+{
+#if defined(__x86_64__)
+	unsigned int eax;
+	unsigned int ebx;
+	unsigned int ecx;
+	unsigned int edx;
+	if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+		return false;
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return (edx & (1u << 8)) != 0;
+#else
+	return false;
+#endif
+}
+
+void Clock::calibrate()
+{
+	static bool done = false;
+	if (done)
+		return;
+	done = true;
+
+	if (!hasInvariantTsc())
+		return;
+
+	useTsc_ = true;
+	unsigned long ns0 = monotonicNs();
+	unsigned long t0 = now();
+	unsigned long ns1 = ns0;
+	while (ns1 - ns0 < 20000000UL)			//* 20 ms of spinning: ~1e-4 error
+		ns1 = monotonicNs();
+	unsigned long t1 = now();
+
+	if (t1 <= t0)
+	{
+		useTsc_ = false;
+		return;
+	}
+	nsMult_ = static_cast<unsigned long>((static_cast<unsigned __int128>(ns1 - ns0) << 32) / (t1 - t0));
+}
+
+const char* Clock::sourceName()
+{
+	return useTsc_ ? "tsc" : "clock_gettime";
+}
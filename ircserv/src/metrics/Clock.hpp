@@ -0,0 +1,58 @@
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <ctime>
+
+/**
+ * Clock: cheap monotonic timestamps for profiling the loop
+ *
+ * On x86-64 with an invariant TSC, now() is a bare rdtsc (a few ns) and
+ * ticks are converted to nanoseconds with a fixed-point multiply calibrated
+ * once against CLOCK_MONOTONIC. Anywhere else it falls back to
+ * clock_gettime(CLOCK_MONOTONIC), which is a vDSO call (~20 ns), with ticks
+ * already in nanoseconds.
+ *
+ * Only differences between two now() values are meaningful.
+ *
+ * All functions are static - no instances needed.
+ */
+
+class Clock
+{
+	public:
+		//* Pick the source and calibrate it (blocks ~20 ms the first time)
+		static void	calibrate();
+
+		static inline unsigned long now()
+		{
+#if defined(__x86_64__)
+			if (useTsc_)
+			{
+				unsigned int lo;
+				unsigned int hi;
+				__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+				return (static_cast<unsigned long>(hi) << 32) | lo;
+			}
+#endif
+			return monotonicNs();
+		}
+
+		static inline unsigned long toNs(unsigned long ticks)
+		{
+			if (!useTsc_)
+				return ticks;
+			//* 128-bit product so long intervals do not overflow
+			return static_cast<unsigned long>((static_cast<unsigned __int128>(ticks) * nsMult_) >> 32);
+		}
+
+		static unsigned long	monotonicNs();
+		static const char*		sourceName();
+
+	private:
+		static bool				useTsc_;
+		static unsigned long	nsMult_;			//* ns per tick, 32.32 fixed point
+
+		Clock();
+};
+
+#endif
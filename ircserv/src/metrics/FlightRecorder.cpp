@@ -0,0 +1,113 @@
+#include "FlightRecorder.hpp"
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sstream>
+
+FlightRecorder::FlightRecorder() : mask_(0), recorded_(0), epochTicks_(0), startRealtimeNs_(0)
+{
+}
+
+void FlightRecorder::start(size_t capacity)
+{
+	if (capacity == 0)
+		return;
+	size_t cap = 1;
+	while (cap < capacity)
+		cap <<= 1;
+
+	ring_.resize(cap);
+	std::memset(&ring_[0], 0, cap * sizeof(Event));
+	mask_ = cap - 1;
+	recorded_ = 0;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	epochTicks_ = Clock::now();
+	startRealtimeNs_ = static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + static_cast<unsigned long>(ts.tv_nsec);
+}
+
+void FlightRecorder::setNames(NameTable table, const std::vector<std::string>& names)
+{
+	names_[table] = names;
+}
+
+bool FlightRecorder::enabled() const
+{
+	return !ring_.empty();
+}
+
+size_t FlightRecorder::capacity() const
+{
+	return ring_.size();
+}
+
+//* Loop until everything is written (regular file: short writes are rare)
+static bool writeAll(int fd, const void* data, size_t size)
+{
+	const char* p = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		ssize_t n = write(fd, p, size);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= static_cast<size_t>(n);
+	}
+	return true;
+}
+
+bool FlightRecorder::dump(const std::string& dir, const std::string& reason, std::string& path)
+{
+	if (ring_.empty())
+		return false;
+
+	//* Marker first, so the dump moment is visible in the file itself
+	record(EV_DUMP, -1, 0, 0, 0, 0);
+
+	std::ostringstream name;
+	name << dir << "/ircserv-flight-" << std::time(NULL) << "-" << reason << ".bin";
+	path = name.str();
+
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0640);
+	if (fd < 0)
+		return false;
+
+	FileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "IRCFLT1", 8);
+	header.version = VERSION;
+	header.eventSize = sizeof(Event);
+	header.events = recorded_ < ring_.size() ? recorded_ : ring_.size();
+	header.recorded = recorded_;
+	header.startRealtimeNs = startRealtimeNs_;
+	header.dumpTimeNs = nowNs();
+
+	bool ok = writeAll(fd, &header, sizeof(header));
+	for (int t = 0; ok && t < NAME_TABLE_COUNT; ++t)
+	{
+		unsigned int count = static_cast<unsigned int>(names_[t].size());
+		ok = writeAll(fd, &count, sizeof(count));
+		for (unsigned int i = 0; ok && i < count; ++i)
+		{
+			unsigned char len = static_cast<unsigned char>(names_[t][i].size() > 255 ? 255 : names_[t][i].size());
+			ok = writeAll(fd, &len, 1) && writeAll(fd, names_[t][i].data(), len);
+		}
+	}
+
+	//* Oldest first: when wrapped, the slot after the newest is the oldest
+	unsigned long first = recorded_ - header.events;
+	size_t begin = static_cast<size_t>(first & mask_);
+	size_t tail = ring_.size() - begin;
+	if (tail > header.events)
+		tail = static_cast<size_t>(header.events);
+	if (ok)
+		ok = writeAll(fd, &ring_[begin], tail * sizeof(Event));
+	if (ok && tail < header.events)
+		ok = writeAll(fd, &ring_[0], (static_cast<size_t>(header.events) - tail) * sizeof(Event));
+
+	close(fd);
+	return ok;
+}
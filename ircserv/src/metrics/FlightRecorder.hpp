@@ -0,0 +1,132 @@
+#ifndef FLIGHT_RECORDER_HPP
+#define FLIGHT_RECORDER_HPP
+
+#include <string>
+#include <vector>
+#include "Clock.hpp"
+
+/**
+ * FlightRecorder: always-on ring of the last N protocol events
+ *
+ * Every accept, reject, disconnect and dispatched command leaves a 32-byte
+ * record in a fixed ring allocated once at startup. record() is a handful
+ * of stores into the next slot: no allocation, no formatting, no I/O. Old
+ * events are overwritten.
+ *
+ * dump() writes the ring (oldest first) to a binary file that is
+ * self-describing: the header carries the clock origin and the name tables
+ * for the numeric codes, so tools/flightdump can decode it without knowing
+ * this build. The server dumps on SIGUSR2 and on bursts of abnormal
+ * disconnects.
+ *
+ * File layout (little endian, as written by the host):
+ *   FileHeader
+ *   NAME_TABLE_COUNT x { uint32 count; count x { uint8 len; char[len] } }
+ *   header.events x Event, oldest first
+ */
+
+class FlightRecorder
+{
+	public:
+		enum EventType
+		{
+			EV_ACCEPT = 1,							//* New client (code = listener kind)
+			EV_REJECT,								//* Closed at accept (code = RejectReason)
+			EV_DISCONNECT,							//* code = DisconnectReason, bytes = unsent output
+			EV_COMMAND,								//* code = command id, duration, bytes = SendQ after
+			EV_DRAIN_TIMEOUT,						//* bytes = output dropped
+			EV_LOOP_STALL,							//* duration = busy ns of the iteration
+			EV_DUMP									//* Marker: a dump was taken here
+		};
+
+		enum NameTable
+		{
+			TABLE_COMMANDS,
+			TABLE_DISCONNECT_REASONS,
+			TABLE_REJECT_REASONS,
+			NAME_TABLE_COUNT
+		};
+
+		static const unsigned short CODE_UNKNOWN = 0xFFFF;	//* Command not in the table
+
+		struct Event
+		{
+			unsigned long	timeNs;					//* Since the recorder started
+			unsigned int	connId;					//* Low 32 bits of ClientConnection::getId()
+			int				fd;
+			unsigned short	type;					//* EventType
+			unsigned short	code;
+			unsigned int	durationNs;				//* Saturates at ~4.29 s
+			unsigned int	bytes;
+			unsigned int	reserved;
+		};
+
+		struct FileHeader
+		{
+			char			magic[8];				//* "IRCFLT1\0"
+			unsigned int	version;
+			unsigned int	eventSize;				//* sizeof(Event)
+			unsigned long	events;					//* Records in this file
+			unsigned long	recorded;				//* Records ever made (events < recorded = wrapped)
+			unsigned long	startRealtimeNs;		//* Wall clock when timeNs was 0
+			unsigned long	dumpTimeNs;				//* timeNs at the moment of the dump
+		};
+
+		static const unsigned int VERSION = 1;
+
+		FlightRecorder();
+
+		/**
+		 * Allocate the ring and set the clock origin (call after Clock::calibrate)
+		 *
+		 * @param capacity Events kept, rounded up to a power of two (0 = disabled)
+		 */
+		void	start(size_t capacity);
+		void	setNames(NameTable table, const std::vector<std::string>& names);
+
+		inline void record(EventType type, int fd, unsigned long connId, unsigned short code,
+			unsigned long durationNs, unsigned long bytes)
+		{
+			if (ring_.empty())
+				return;
+			Event& e = ring_[recorded_ & mask_];
+			e.timeNs = nowNs();
+			e.connId = static_cast<unsigned int>(connId);
+			e.fd = fd;
+			e.type = static_cast<unsigned short>(type);
+			e.code = code;
+			e.durationNs = durationNs > 0xFFFFFFFFUL ? 0xFFFFFFFFU : static_cast<unsigned int>(durationNs);
+			e.bytes = bytes > 0xFFFFFFFFUL ? 0xFFFFFFFFU : static_cast<unsigned int>(bytes);
+			e.reserved = 0;
+			recorded_++;
+		}
+
+		/**
+		 * Write the ring to 'dir'/ircserv-flight-<unix time>-<reason>.bin
+		 *
+		 * @param path [OUT] File written
+		 * @return false if disabled or the file could not be written
+		 */
+		bool	dump(const std::string& dir, const std::string& reason, std::string& path);
+
+		bool	enabled() const;
+		size_t	capacity() const;
+
+	private:
+		std::vector<Event>					ring_;
+		unsigned long						mask_;
+		unsigned long						recorded_;
+		unsigned long						epochTicks_;
+		unsigned long						startRealtimeNs_;
+		std::vector<std::string>			names_[NAME_TABLE_COUNT];
+
+		inline unsigned long nowNs() const
+		{
+			return Clock::toNs(Clock::now() - epochTicks_);
+		}
+
+		FlightRecorder(const FlightRecorder&);
+		FlightRecorder& operator=(const FlightRecorder&);
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "Histogram.hpp"
+#include <cstring>
+
+Histogram::Histogram()
+{
+	reset();
+}
+
+void Histogram::reset()
+{
+	std::memset(buckets_, 0, sizeof(buckets_));
+	count_ = 0;
+	sum_ = 0;
+	max_ = 0;
+}
+
+unsigned long Histogram::count() const
+{
+	return count_;
+}
+
+unsigned long Histogram::sum() const
+{
+	return sum_;
+}
+
+unsigned long Histogram::max() const
+{
+	return max_;
+}
+
+//* Largest value that lands in bucket 'index'
+unsigned long Histogram::upperBound(unsigned int index)
+{
+	if (index < SUB_COUNT)
+		return index;
+	unsigned int group = index / SUB_COUNT;
+	unsigned long sub = index % SUB_COUNT;
+	unsigned int shift = group - 1;
+	unsigned long lower = (SUB_COUNT + sub) << shift;
+	return lower + ((1UL << shift) - 1);
+}
+
+unsigned long Histogram::bucketAt(unsigned int index) const
+{
+	return (index < BUCKETS) ? buckets_[index] : 0;
+}
+
+unsigned long Histogram::percentile(double q) const
+{
+	if (count_ == 0)
+		return 0;
+	if (q < 0.0)
+		q = 0.0;
+	if (q > 1.0)
+		q = 1.0;
+
+	//* Rank of the wanted sample (1-based), at least the first one
+	unsigned long rank = static_cast<unsigned long>(q * static_cast<double>(count_) + 0.5);
+	if (rank == 0)
+		rank = 1;
+
+	unsigned long seen = 0;
+	for (unsigned int i = 0; i < BUCKETS; ++i)
+	{
+		seen += buckets_[i];
+		if (seen >= rank)
+		{
+			unsigned long bound = upperBound(i);
+			return (bound < max_) ? bound : max_;
+		}
+	}
+	return max_;
+}
+
+unsigned long Histogram::countAtOrBelow(unsigned long limit) const
+{
+	unsigned int last = indexOf(limit);
+	unsigned long total = 0;
+	for (unsigned int i = 0; i <= last; ++i)
+		total += buckets_[i];
+	return total;
+}
@@ -0,0 +1,66 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <cstddef>
+
+/**
+ * Histogram: log-linear (HDR-style) bucketed distribution
+ *
+ * Values below 16 get one bucket each. Above that, every power of two is
+ * split into 16 linear sub-buckets, so any recorded value is known to within
+ * 1/16 (6.25%) of its magnitude, from 1 up to 2^64, in a fixed 7.8 KB array.
+ *
+ * record() is a clz, a shift and two adds: no allocation, no branches on
+ * the bucket layout. Percentiles are computed on demand by walking buckets.
+ */
+
+class Histogram
+{
+	public:
+		static const unsigned int SUB_BITS = 4;
+		static const unsigned int SUB_COUNT = 1u << SUB_BITS;
+		static const unsigned int BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+		Histogram();
+
+		inline void record(unsigned long value)
+		{
+			buckets_[indexOf(value)]++;
+			count_++;
+			sum_ += value;
+			if (value > max_)
+				max_ = value;
+		}
+
+		unsigned long	count() const;
+		unsigned long	sum() const;
+		unsigned long	max() const;
+
+		//* Upper bound of the bucket holding the q-th quantile (0.0 - 1.0)
+		unsigned long	percentile(double q) const;
+
+		//* Number of values <= limit (exact when limit is a bucket upper bound)
+		unsigned long	countAtOrBelow(unsigned long limit) const;
+
+		void			reset();
+
+		static inline unsigned int indexOf(unsigned long value)
+		{
+			if (value < SUB_COUNT)
+				return static_cast<unsigned int>(value);
+			unsigned int msb = 63 - static_cast<unsigned int>(__builtin_clzl(value));
+			unsigned int group = msb - SUB_BITS + 1;
+			return group * SUB_COUNT + static_cast<unsigned int>((value >> (msb - SUB_BITS)) - SUB_COUNT);
+		}
+
+		static unsigned long upperBound(unsigned int index);
+		unsigned long	bucketAt(unsigned int index) const;
+
+	private:
+		unsigned long	buckets_[BUCKETS];
+		unsigned long	count_;
+		unsigned long	sum_;
+		unsigned long	max_;
+};
+
+#endif
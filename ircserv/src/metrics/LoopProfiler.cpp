@@ -0,0 +1,140 @@
+#include "LoopProfiler.hpp"
+#include <cstring>
+#include <sstream>
+#include <iostream>
+
+LoopProfiler::LoopProfiler() : iterStart_(0), last_(0), budgetNs_(50000000UL), lastWarning_(0)
+{
+	std::memset(window_, 0, sizeof(window_));
+	resetIteration();
+
+	g_metrics.registry.add("ircserv_loop_iterations_total", "", "Main loop iterations", &iterations_);
+	g_metrics.registry.add("ircserv_loop_budget_overruns_total", "", "Iterations busier than loop_budget_ms",
+		&overruns_);
+	for (int i = 0; i < PHASE_COUNT; ++i)
+		g_metrics.registry.add("ircserv_loop_phase_ns_total",
+			std::string("phase=\"") + phaseName(static_cast<Phase>(i)) + "\"",
+			"Time spent per loop phase", &phaseTotalNs_[i]);
+	g_metrics.registry.add("ircserv_loop_busy_ns", "", "Iteration time outside poll()", &busyNs_);
+	g_metrics.registry.add("ircserv_loop_window_worst_ns", "", "Busiest iteration in the rolling window",
+		&windowWorstNs_);
+}
+
+void LoopProfiler::setBudgetMs(unsigned int ms)
+{
+	budgetNs_ = static_cast<unsigned long>(ms) * 1000000UL;
+}
+
+const char* LoopProfiler::phaseName(Phase phase)
+{
+	static const char* names[PHASE_COUNT] = {
+		"poll", "accept", "read", "parse", "dispatch", "flush", "other"
+	};
+	return (phase < PHASE_COUNT ? names[phase] : "unknown");
+}
+
+void LoopProfiler::resetIteration()
+{
+	std::memset(iterPhase_, 0, sizeof(iterPhase_));
+	iterWorst_ = 0;
+	iterWorstFd_ = -1;
+	iterWorstWhat_ = "";
+}
+
+//* Slot of the current second; a stale slot (from a previous turn of the
+//* ring) is cleared before it is reused
+LoopProfiler::Slot& LoopProfiler::slotFor(time_t second)
+{
+	Slot& slot = window_[static_cast<unsigned long>(second) % WINDOW_SECONDS];
+	if (slot.second != second)
+	{
+		std::memset(&slot, 0, sizeof(slot));
+		slot.second = second;
+	}
+	return (slot);
+}
+
+unsigned long LoopProfiler::end()
+{
+	unsigned long phaseNs[PHASE_COUNT];
+	unsigned long busy = 0;
+	for (int i = 0; i < PHASE_COUNT; ++i)
+	{
+		phaseNs[i] = Clock::toNs(iterPhase_[i]);
+		phaseTotalNs_[i].add(phaseNs[i]);
+		if (i != PHASE_POLL)
+			busy += phaseNs[i];
+	}
+	iterations_.inc();
+	busyNs_.record(busy);
+
+	time_t now = std::time(NULL);
+	Slot& slot = slotFor(now);
+	slot.iterations++;
+	slot.busyNs += busy;
+	if (busy > slot.worstNs)
+		slot.worstNs = busy;
+	for (int i = 0; i < PHASE_COUNT; ++i)
+		slot.phaseNs[i] += phaseNs[i];
+
+	unsigned long worst = 0;
+	for (unsigned int i = 0; i < WINDOW_SECONDS; ++i)
+	{
+		if (now - window_[i].second < static_cast<time_t>(WINDOW_SECONDS) && window_[i].worstNs > worst)
+			worst = window_[i].worstNs;
+	}
+	windowWorstNs_.set(worst);
+
+	if (budgetNs_ && busy > budgetNs_)
+	{
+		overruns_.inc();
+		if (now != lastWarning_)
+		{
+			lastWarning_ = now;
+			std::cerr << "[LOOP] Iteration took " << busy / 1000 << " us (budget "
+					  << budgetNs_ / 1000 << " us), slowest: " << iterWorstWhat_;
+			if (iterWorstFd_ >= 0)
+				std::cerr << " fd=" << iterWorstFd_;
+			std::cerr << " " << Clock::toNs(iterWorst_) / 1000 << " us" << std::endl;
+		}
+	}
+	resetIteration();
+	return (busy);
+}
+
+void LoopProfiler::formatWindow(std::vector<std::string>& lines) const
+{
+	time_t now = std::time(NULL);
+	unsigned long iterations = 0;
+	unsigned long busy = 0;
+	unsigned long worst = 0;
+	unsigned long phases[PHASE_COUNT] = { 0 };
+	unsigned int seconds = 0;
+
+	//* Completed seconds only: the current one is still filling up
+	for (unsigned int i = 0; i < WINDOW_SECONDS; ++i)
+	{
+		const Slot& s = window_[i];
+		if (s.second == 0 || s.second >= now || now - s.second > static_cast<time_t>(WINDOW_SECONDS))
+			continue;
+		seconds++;
+		iterations += s.iterations;
+		busy += s.busyNs;
+		if (s.worstNs > worst)
+			worst = s.worstNs;
+		for (int p = 0; p < PHASE_COUNT; ++p)
+			phases[p] += s.phaseNs[p];
+	}
+
+	std::ostringstream head;
+	head << "window=" << WINDOW_SECONDS << "s iterations/s=" << (seconds ? iterations / seconds : 0)
+		 << " busy_us/s=" << (seconds ? busy / seconds / 1000 : 0)
+		 << " worst=" << worst / 1000 << "us overruns=" << overruns_.value;
+	lines.push_back(head.str());
+
+	std::ostringstream split;
+	split << "phase_us/s";
+	for (int p = 0; p < PHASE_COUNT; ++p)
+		split << " " << phaseName(static_cast<Phase>(p)) << "=" << (seconds ? phases[p] / seconds / 1000 : 0);
+	lines.push_back(split.str());
+}
@@ -0,0 +1,122 @@
+#ifndef LOOP_PROFILER_HPP
+#define LOOP_PROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include "Clock.hpp"
+#include "Metrics.hpp"
+
+/**
+ * LoopProfiler: where each iteration of Server::run() spends its time
+ *
+ * Time is measured in laps: lap(phase) reads the clock once and charges
+ * everything since the previous lap to 'phase'. The loop calls it at every
+ * phase boundary (after poll, after an accept burst, after recv, after a
+ * line is parsed, after its handler, after send...), so each boundary costs
+ * one Clock::now() and nothing is counted twice.
+ *
+ * Per iteration it keeps the busy time (everything but the poll wait) and
+ * the single slowest lap, with the fd and command/phase that caused it. An
+ * iteration busier than the budget bumps a counter and logs that culprit
+ * (at most once per second).
+ *
+ * A rolling window of one-second slots gives iterations/sec, the phase split
+ * and the worst iteration over the last WINDOW_SECONDS.
+ */
+
+class LoopProfiler
+{
+	public:
+		enum Phase
+		{
+			PHASE_POLL,								//* Waiting in poll()
+			PHASE_ACCEPT,
+			PHASE_READ,								//* recv() + buffering
+			PHASE_PARSE,							//* popLine + Parser::parse + lookup
+			PHASE_DISPATCH,							//* Command handlers (fan-out included)
+			PHASE_FLUSH,							//* send()
+			PHASE_OTHER,							//* Timers, disconnects, poll bookkeeping
+			PHASE_COUNT
+		};
+
+		static const unsigned int WINDOW_SECONDS = 10;
+
+		LoopProfiler();
+
+		void	setBudgetMs(unsigned int ms);
+
+		//* Start of an iteration (right before poll)
+		inline void	begin()
+		{
+			iterStart_ = last_ = Clock::now();
+		}
+
+		/**
+		 * Charge the time since the previous lap to 'phase'
+		 *
+		 * @param fd Connection responsible (-1 = none), reported on overruns
+		 * @param what Command name (static or long-lived storage), NULL = phase name
+		 * @return The clock value read (usable as the next start)
+		 */
+		inline unsigned long lap(Phase phase, int fd = -1, const char* what = NULL)
+		{
+			unsigned long t = Clock::now();
+			unsigned long delta = t - last_;
+			last_ = t;
+			iterPhase_[phase] += delta;
+			if (phase != PHASE_POLL && delta > iterWorst_)
+			{
+				iterWorst_ = delta;
+				iterWorstFd_ = fd;
+				iterWorstWhat_ = what ? what : phaseName(phase);
+			}
+			return t;
+		}
+
+		//* End of an iteration: fold it into the totals, window and budget check.
+		//* Returns the busy ns of the iteration.
+		unsigned long	end();
+
+		//* Human readable window summary (STATS, logs)
+		void	formatWindow(std::vector<std::string>& lines) const;
+
+		static const char*	phaseName(Phase phase);
+
+	private:
+		struct Slot
+		{
+			time_t			second;
+			unsigned long	iterations;
+			unsigned long	busyNs;
+			unsigned long	worstNs;
+			unsigned long	phaseNs[PHASE_COUNT];
+		};
+
+		unsigned long	iterStart_;
+		unsigned long	last_;
+		unsigned long	iterPhase_[PHASE_COUNT];		//* Ticks, current iteration
+		unsigned long	iterWorst_;
+		int				iterWorstFd_;
+		const char*		iterWorstWhat_;
+
+		unsigned long	budgetNs_;
+		time_t			lastWarning_;
+
+		Slot			window_[WINDOW_SECONDS];
+
+		//* Exported through g_metrics.registry
+		Counter			iterations_;
+		Counter			overruns_;
+		Counter			phaseTotalNs_[PHASE_COUNT];
+		Histogram		busyNs_;
+		Gauge			windowWorstNs_;
+
+		Slot&	slotFor(time_t second);
+		void	resetIteration();
+
+		LoopProfiler(const LoopProfiler&);
+		LoopProfiler& operator=(const LoopProfiler&);
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "Metrics.hpp"
+#include <sstream>
+
+ServerMetrics g_metrics;
+
+// ========================================================================
+// 							   Registry
+// ========================================================================
+
+MetricsRegistry::MetricsRegistry()
+{
+}
+
+void MetricsRegistry::push(const std::string& name, const std::string& labels, const std::string& help,
+	Type type, void* metric)
+{
+	Entry e;
+	e.name = name;
+	e.labels = labels;
+	e.help = help;
+	e.type = type;
+	e.metric = metric;
+	entries_.push_back(e);
+}
+
+void MetricsRegistry::add(const std::string& name, const std::string& labels, const std::string& help, Counter* c)
+{
+	push(name, labels, help, TYPE_COUNTER, c);
+}
+
+void MetricsRegistry::add(const std::string& name, const std::string& labels, const std::string& help, Gauge* g)
+{
+	push(name, labels, help, TYPE_GAUGE, g);
+}
+
+void MetricsRegistry::add(const std::string& name, const std::string& labels, const std::string& help, Histogram* h)
+{
+	push(name, labels, help, TYPE_HISTOGRAM, h);
+}
+
+Counter* MetricsRegistry::newCounter(const std::string& name, const std::string& labels, const std::string& help)
+{
+	ownedCounters_.push_back(Counter());
+	add(name, labels, help, &ownedCounters_.back());
+	return (&ownedCounters_.back());
+}
+
+Histogram* MetricsRegistry::newHistogram(const std::string& name, const std::string& labels, const std::string& help)
+{
+	ownedHistograms_.push_back(Histogram());
+	add(name, labels, help, &ownedHistograms_.back());
+	return (&ownedHistograms_.back());
+}
+
+// ========================================================================
+// 							   Rendering
+// ========================================================================
+
+//* "name{labels}" or "name{labels,extra}" or plain "name"
+static std::string series(const std::string& name, const std::string& labels, const std::string& extra = "")
+{
+	std::string all = labels;
+	if (!extra.empty())
+		all += (all.empty() ? "" : ",") + extra;
+	return (all.empty() ? name : name + "{" + all + "}");
+}
+
+//* Cumulative buckets at powers of two (le = 2^k - 1) up to the maximum seen:
+//* exact with this layout, and short enough to scrape every second
+static void renderHistogram(std::ostringstream& out, const std::string& name, const std::string& labels,
+	const Histogram& h)
+{
+	unsigned long cumulative = 0;
+	unsigned int index = 0;
+	for (unsigned int k = 0; k < 64; ++k)
+	{
+		unsigned long le = (1UL << k) - 1;
+		unsigned int last = Histogram::indexOf(le);
+		while (index <= last)
+			cumulative += h.bucketAt(index++);
+
+		std::ostringstream bound;
+		bound << "le=\"" << le << "\"";
+		out << series(name + "_bucket", labels, bound.str()) << " " << cumulative << "\n";
+		if (le >= h.max())
+			break;
+	}
+	out << series(name + "_bucket", labels, "le=\"+Inf\"") << " " << h.count() << "\n";
+	out << series(name + "_sum", labels) << " " << h.sum() << "\n";
+	out << series(name + "_count", labels) << " " << h.count() << "\n";
+}
+
+void MetricsRegistry::renderText(std::string& out) const
+{
+	static const char* typeNames[] = { "counter", "gauge", "histogram" };
+	std::ostringstream oss;
+
+	for (size_t i = 0; i < entries_.size(); ++i)
+	{
+		const Entry& e = entries_[i];
+		if (i == 0 || entries_[i - 1].name != e.name)
+		{
+			oss << "# HELP " << e.name << " " << e.help << "\n";
+			oss << "# TYPE " << e.name << " " << typeNames[e.type] << "\n";
+		}
+
+		if (e.type == TYPE_COUNTER)
+			oss << series(e.name, e.labels) << " " << static_cast<Counter*>(e.metric)->value << "\n";
+		else if (e.type == TYPE_GAUGE)
+			oss << series(e.name, e.labels) << " " << static_cast<Gauge*>(e.metric)->value << "\n";
+		else
+			renderHistogram(oss, e.name, e.labels, *static_cast<Histogram*>(e.metric));
+	}
+	out += oss.str();
+}
+
+void MetricsRegistry::renderLines(std::vector<std::string>& lines) const
+{
+	for (size_t i = 0; i < entries_.size(); ++i)
+	{
+		const Entry& e = entries_[i];
+		std::ostringstream oss;
+		oss << series(e.name, e.labels) << " ";
+
+		if (e.type == TYPE_COUNTER)
+			oss << static_cast<Counter*>(e.metric)->value;
+		else if (e.type == TYPE_GAUGE)
+			oss << static_cast<Gauge*>(e.metric)->value;
+		else
+		{
+			const Histogram& h = *static_cast<Histogram*>(e.metric);
+			oss << "count=" << h.count() << " p50=" << h.percentile(0.50)
+				<< " p99=" << h.percentile(0.99) << " max=" << h.max();
+		}
+		lines.push_back(oss.str());
+	}
+}
+
+// ========================================================================
+// 							 Server metrics
+// ========================================================================
+
+const char* ServerMetrics::disconnectReasonName(DisconnectReason reason)
+{
+	static const char* names[DISC_REASON_COUNT] = {
+		"eof", "error", "quit", "bad_password", "registration_timeout", "shutdown", "killed",
+		"sendq_exceeded"
+	};
+	return (reason < DISC_REASON_COUNT ? names[reason] : "unknown");
+}
+
+const char* ServerMetrics::rejectReasonName(RejectReason reason)
+{
+	static const char* names[REJECT_REASON_COUNT] = { "unregistered_cap", "per_source", "throttled" };
+	return (reason < REJECT_REASON_COUNT ? names[reason] : "unknown");
+}
+
+const char* ServerMetrics::memorySubsystemName(MemorySubsystem subsystem)
+{
+	static const char* names[MEM_SUBSYSTEM_COUNT] = { "connections", "queues", "users", "channels", "history" };
+	return (subsystem < MEM_SUBSYSTEM_COUNT ? names[subsystem] : "unknown");
+}
+
+const char* ServerMetrics::laneName(OutputLane lane)
+{
+	static const char* names[LANE_COUNT] = { "control", "bulk" };
+	return (lane < LANE_COUNT ? names[lane] : "unknown");
+}
+
+static std::string laneLabel(int lane)
+{
+	return std::string("lane=\"") + ServerMetrics::laneName(static_cast<OutputLane>(lane)) + "\"";
+}
+
+ServerMetrics::ServerMetrics()
+{
+	registry.add("ircserv_accepted_total", "", "Connections accepted as clients", &accepted);
+	for (int i = 0; i < REJECT_REASON_COUNT; ++i)
+		registry.add("ircserv_rejected_total",
+			std::string("reason=\"") + rejectReasonName(static_cast<RejectReason>(i)) + "\"",
+			"Connections closed right after accept", &rejected[i]);
+	for (int i = 0; i < DISC_REASON_COUNT; ++i)
+		registry.add("ircserv_disconnects_total",
+			std::string("reason=\"") + disconnectReasonName(static_cast<DisconnectReason>(i)) + "\"",
+			"Client connections closed, by reason", &disconnects[i]);
+	registry.add("ircserv_drain_timeouts_total", "", "Closing connections dropped with output still queued", &drainTimeouts);
+	registry.add("ircserv_scrapes_total", "", "Requests served by the metrics listener", &scrapes);
+	registry.add("ircserv_clients", "", "Open client connections", &clients);
+	registry.add("ircserv_unregistered", "", "Connections that have not completed registration", &unregistered);
+	registry.add("ircserv_channels", "", "Existing channels", &channels);
+	registry.add("ircserv_address_entries", "", "Sources tracked for per-address limits", &addressEntries);
+
+	registry.add("ircserv_bytes_in_total", "", "Bytes read from clients", &bytesIn);
+	registry.add("ircserv_bytes_out_total", "", "Bytes written to clients", &bytesOut);
+	registry.add("ircserv_lines_in_total", "", "Protocol lines received", &linesIn);
+	registry.add("ircserv_unknown_commands_total", "", "Lines with a command the server does not implement", &unknownCommands);
+	registry.add("ircserv_not_registered_total", "", "Commands refused before registration (451)", &notRegistered);
+
+	//* One loop per name: the registry groups a family by consecutive entries
+	for (int i = 0; i < LANE_COUNT; ++i)
+		registry.add("ircserv_sendq_bytes", laneLabel(i), "Output queued across all connections, by lane",
+			&sendqBytes[i]);
+	for (int i = 0; i < LANE_COUNT; ++i)
+		registry.add("ircserv_sendq_depth_bytes", laneLabel(i), "Connection lane size after each append",
+			&sendqDepth[i]);
+	for (int i = 0; i < LANE_COUNT; ++i)
+		registry.add("ircserv_lane_bytes_out_total", laneLabel(i), "Bytes written, by output lane",
+			&laneBytesOut[i]);
+	for (int i = 0; i < LANE_COUNT; ++i)
+		registry.add("ircserv_sendq_exceeded_total", laneLabel(i), "Clients closed for going over a lane budget",
+			&sendqExceeded[i]);
+	registry.add("ircserv_broadcasts_total", "", "Channel broadcasts", &broadcasts);
+	registry.add("ircserv_broadcast_fanout", "", "Recipients per channel broadcast", &fanout);
+
+	for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i)
+		registry.add("ircserv_memory_bytes",
+			std::string("subsystem=\"") + memorySubsystemName(static_cast<MemorySubsystem>(i)) + "\"",
+			"Estimated heap and object bytes, by subsystem", &memoryBytes[i]);
+	registry.add("ircserv_memory_per_client_bytes", "", "Connection, queue and user bytes per client", &memoryPerClient);
+	registry.add("ircserv_compactions_total", "", "Idle connections whose buffers were released", &compactions);
+	registry.add("ircserv_compacted_bytes_total", "", "Buffer bytes released by idle compaction", &compactedBytes);
+
+	registry.add("ircserv_history_disk_bytes", "", "Bytes used in the history segment files", &historyDiskBytes);
+	registry.add("ircserv_history_segments", "", "History segment files, head included", &historySegments);
+	registry.add("ircserv_history_compacted_records", "", "Records copied forward by segment compaction",
+		&historyCompactedRecords);
+
+	registry.add("ircserv_links", "", "Established direct server links", &links);
+	registry.add("ircserv_remote_users", "", "Users on other servers of the link tree", &remoteUsers);
+	registry.add("ircserv_link_forwards_total", "", "Channel messages forwarded to a link, one per link",
+		&linkForwards);
+}
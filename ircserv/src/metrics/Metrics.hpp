@@ -0,0 +1,199 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include "Histogram.hpp"
+
+/**
+ * Metrics: counters, gauges and histograms about the server itself
+ *
+ * The loop is single-threaded, so a metric is a plain integer: updating it on
+ * the hot path is one non-atomic add on a global, no lookup, no lock. The
+ * registry only keeps name/labels/help and a pointer to each metric, and is
+ * walked when someone asks (STATS, the scrape listener).
+ *
+ * Well-known metrics live as plain members of ServerMetrics (g_metrics);
+ * per-command ones are created by the registry and their address is kept
+ * next to the handler in the command map.
+ */
+
+struct Counter
+{
+	unsigned long	value;
+
+	Counter() : value(0) {}
+	inline void	inc() { ++value; }
+	inline void	add(unsigned long n) { value += n; }
+};
+
+struct Gauge
+{
+	long	value;
+
+	Gauge() : value(0) {}
+	inline void	set(long v) { value = v; }
+	inline void	add(long n) { value += n; }
+	inline void	sub(long n) { value -= n; }
+};
+
+class MetricsRegistry
+{
+	public:
+		MetricsRegistry();
+
+		//* Register a metric owned by someone else (it must outlive the registry)
+		void		add(const std::string& name, const std::string& labels, const std::string& help, Counter* c);
+		void		add(const std::string& name, const std::string& labels, const std::string& help, Gauge* g);
+		void		add(const std::string& name, const std::string& labels, const std::string& help, Histogram* h);
+
+		//* Create a metric owned by the registry (stable address)
+		Counter*	newCounter(const std::string& name, const std::string& labels, const std::string& help);
+		Histogram*	newHistogram(const std::string& name, const std::string& labels, const std::string& help);
+
+		/**
+		 * Plain-text exposition (Prometheus text format 0.0.4)
+		 * Metrics sharing a name must be registered one after another.
+		 */
+		void		renderText(std::string& out) const;
+
+		//* One short "name{labels} value" line per metric (STATS, logs)
+		void		renderLines(std::vector<std::string>& lines) const;
+
+	private:
+		enum Type
+		{
+			TYPE_COUNTER,
+			TYPE_GAUGE,
+			TYPE_HISTOGRAM
+		};
+
+		struct Entry
+		{
+			std::string	name;
+			std::string	labels;					//* 'key="value"' list without braces, may be ""
+			std::string	help;
+			Type		type;
+			void*		metric;
+		};
+
+		std::vector<Entry>		entries_;
+		std::list<Counter>		ownedCounters_;
+		std::list<Histogram>	ownedHistograms_;
+
+		void	push(const std::string& name, const std::string& labels, const std::string& help, Type type, void* metric);
+
+		MetricsRegistry(const MetricsRegistry&);
+		MetricsRegistry& operator=(const MetricsRegistry&);
+};
+
+/**
+ * Heap bytes owned by a std::string: its capacity once it outgrows the
+ * inline (SSO) buffer, 0 before. Used for the memory gauges.
+ */
+inline size_t stringHeapBytes(const std::string& s)
+{
+	static const size_t inlineCapacity = std::string().capacity();
+	return (s.capacity() > inlineCapacity ? s.capacity() + 1 : 0);
+}
+
+//* Memory accounting buckets (ircserv_memory_bytes{subsystem})
+enum MemorySubsystem
+{
+	MEM_CONNECTIONS,						//* ClientConnection objects + their strings
+	MEM_QUEUES,								//* Receive and send buffers
+	MEM_USERS,								//* User objects + identity strings + channel lists
+	MEM_CHANNELS,							//* Channel objects + member/operator/invite lists
+	MEM_HISTORY,							//* CHATHISTORY rings (shared lines they keep alive) + disk index
+	MEM_SUBSYSTEM_COUNT
+};
+
+//* Why a connection ended (ClientConnection::closeConnection)
+enum DisconnectReason
+{
+	DISC_EOF,								//* Peer closed the socket
+	DISC_ERROR,								//* recv/send error, POLLERR, reset
+	DISC_QUIT,								//* QUIT command
+	DISC_BAD_PASSWORD,
+	DISC_REGISTRATION_TIMEOUT,
+	DISC_SHUTDOWN,							//* Server-wide drain (SIGTERM)
+	DISC_KILLED,							//* KILL from the link tree (nick collision)
+	DISC_SENDQ,								//* An output lane went over its budget
+	DISC_REASON_COUNT
+};
+
+//* Output lanes of a connection (ClientConnection::queueSend), flushed in this order
+enum OutputLane
+{
+	LANE_CONTROL,							//* Replies to its own commands (streamed ones too), PONG, ERROR, KICK
+	LANE_BULK,								//* What others cause: channel fan-out, chat, MONITOR notices
+	LANE_COUNT
+};
+
+//* Why an accepted socket was closed before becoming a client
+enum RejectReason
+{
+	REJECT_UNREGISTERED_CAP,
+	REJECT_PER_SOURCE,
+	REJECT_THROTTLED,
+	REJECT_REASON_COUNT
+};
+
+struct ServerMetrics
+{
+	MetricsRegistry	registry;
+
+	//* CONNECTIONS
+	Counter		accepted;
+	Counter		rejected[REJECT_REASON_COUNT];
+	Counter		disconnects[DISC_REASON_COUNT];
+	Counter		drainTimeouts;					//* Closed with output still queued
+	Counter		scrapes;						//* Requests served on the metrics listener
+	Gauge		clients;						//* Refreshed before rendering
+	Gauge		unregistered;					//* Refreshed before rendering
+	Gauge		channels;						//* Refreshed before rendering
+	Gauge		addressEntries;					//* Refreshed before rendering
+
+	//* TRAFFIC
+	Counter		bytesIn;
+	Counter		bytesOut;
+	Counter		linesIn;
+	Counter		unknownCommands;
+	Counter		notRegistered;					//* 451 before registration
+
+	//* OUTPUT QUEUES
+	Gauge		sendqBytes[LANE_COUNT];			//* Sum of every connection's queued output, per lane
+	Histogram	sendqDepth[LANE_COUNT];			//* A connection's lane after each append
+	Counter		laneBytesOut[LANE_COUNT];		//* Bytes written from each lane
+	Counter		sendqExceeded[LANE_COUNT];		//* Clients closed for going over the lane budget
+	Counter		broadcasts;
+	Histogram	fanout;							//* Recipients per channel broadcast
+
+	//* MEMORY (estimates from object sizes and string/vector capacities)
+	Gauge		memoryBytes[MEM_SUBSYSTEM_COUNT];	//* Refreshed before rendering
+	Gauge		memoryPerClient;				//* Connections + queues + users per client
+	Counter		compactions;					//* Idle connections whose buffers were released
+	Counter		compactedBytes;
+
+	//* HISTORY STORE (history_dir)
+	Gauge		historyDiskBytes;				//* Refreshed before rendering
+	Gauge		historySegments;				//* Refreshed before rendering
+	Gauge		historyCompactedRecords;		//* Records copied forward by segment compaction
+
+	//* SERVER LINKS
+	Gauge		links;							//* Established direct links, refreshed before rendering
+	Gauge		remoteUsers;					//* Users on other servers, refreshed before rendering
+	Counter		linkForwards;					//* Channel messages sent down a link (one per link)
+
+	ServerMetrics();
+
+	static const char*	disconnectReasonName(DisconnectReason reason);
+	static const char*	rejectReasonName(RejectReason reason);
+	static const char*	memorySubsystemName(MemorySubsystem subsystem);
+	static const char*	laneName(OutputLane lane);
+};
+
+extern ServerMetrics g_metrics;
+
+#endif
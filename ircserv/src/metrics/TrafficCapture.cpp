@@ -0,0 +1,131 @@
+#include "TrafficCapture.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sstream>
+
+TrafficCapture::TrafficCapture() : fd_(-1), deadline_(0), epochTicks_(0), records_(0), written_(0)
+{
+}
+
+TrafficCapture::~TrafficCapture()
+{
+	stop();
+}
+
+bool TrafficCapture::start(const std::string& dir, unsigned int seconds, std::string& path)
+{
+	stop();
+
+	std::ostringstream name;
+	name << dir << "/ircserv-capture-" << std::time(NULL) << ".bin";
+	path = name.str();
+
+	fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0640);
+	if (fd_ < 0)
+		return false;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	FileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "IRCCAP1", 8);
+	header.version = VERSION;
+	header.recordSize = sizeof(Record);
+	header.startRealtimeNs = static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + static_cast<unsigned long>(ts.tv_nsec);
+
+	buffer_.clear();
+	buffer_.reserve(BUFFER_BYTES + 65536);
+	buffer_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	epochTicks_ = Clock::now();
+	deadline_ = std::time(NULL) + seconds;
+	records_ = 0;
+	written_ = 0;
+	return true;
+}
+
+void TrafficCapture::stop()
+{
+	if (fd_ < 0)
+		return;
+	flush();
+	::close(fd_);
+	fd_ = -1;
+	std::string().swap(buffer_);
+}
+
+time_t TrafficCapture::deadline() const
+{
+	return deadline_;
+}
+
+unsigned long TrafficCapture::records() const
+{
+	return records_;
+}
+
+unsigned long TrafficCapture::bytes() const
+{
+	return written_ + buffer_.size();
+}
+
+void TrafficCapture::line(unsigned long connId, const std::string& command, const std::string& raw)
+{
+	if (fd_ < 0)
+		return;
+
+	//* Passwords never reach the file
+	if (command == "PASS")
+		return append(REC_LINE, connId, "PASS *", 6);
+	if (command == "OPER")
+	{
+		std::istringstream iss(raw);
+		std::string verb;
+		std::string name;
+		iss >> verb >> name;
+		std::string redacted = "OPER " + name + " *";
+		return append(REC_LINE, connId, redacted.data(), redacted.size());
+	}
+	append(REC_LINE, connId, raw.data(), raw.size());
+}
+
+void TrafficCapture::prologue(unsigned long connId, const std::string& raw)
+{
+	if (fd_ < 0)
+		return;
+	if (raw.empty())
+		append(REC_OPEN, connId, NULL, 0, true);
+	else
+		append(REC_LINE, connId, raw.data(), raw.size(), true);
+}
+
+void TrafficCapture::append(RecordType type, unsigned long connId, const char* data, size_t length, bool atZero)
+{
+	Record r;
+	r.timeNs = atZero ? 0 : Clock::toNs(Clock::now() - epochTicks_);
+	r.connId = static_cast<unsigned int>(connId);
+	r.type = static_cast<unsigned short>(type);
+	r.length = static_cast<unsigned short>(length > 0xFFFF ? 0xFFFF : length);
+	buffer_.append(reinterpret_cast<const char*>(&r), sizeof(r));
+	if (r.length)
+		buffer_.append(data, r.length);
+	records_++;
+	if (buffer_.size() >= BUFFER_BYTES)
+		flush();
+}
+
+//* Regular file: a short write only happens on a full disk, then give up
+void TrafficCapture::flush()
+{
+	size_t done = 0;
+	while (done < buffer_.size())
+	{
+		ssize_t n = write(fd_, buffer_.data() + done, buffer_.size() - done);
+		if (n <= 0)
+			break;
+		done += static_cast<size_t>(n);
+	}
+	written_ += done;
+	buffer_.clear();
+}
@@ -0,0 +1,107 @@
+#ifndef TRAFFIC_CAPTURE_HPP
+#define TRAFFIC_CAPTURE_HPP
+
+#include <string>
+#include <ctime>
+#include "Clock.hpp"
+
+/**
+ * TrafficCapture: every received line, timestamped, for offline replay
+ *
+ * Started for a bounded window (oper CAPTURE command). While active, each
+ * line a client sends is appended to an in-memory buffer as a 16-byte
+ * record header plus the raw bytes; the buffer goes to disk with one
+ * write() every BUFFER_BYTES, so the cost per line is a clock read and a
+ * memcpy. Connection opens and closes are recorded too, so
+ * tools/ircreplay can re-create the same connection pattern.
+ *
+ * Connections already open when the capture starts get a synthetic
+ * OPEN + PASS/NICK/USER/JOIN prologue at time 0 rebuilding their state.
+ * Secrets never reach the file: PASS and OPER passwords become "*".
+ *
+ * File layout (little endian, as written by the host):
+ *   FileHeader
+ *   { Record; char[length] } ... until EOF
+ */
+
+class TrafficCapture
+{
+	public:
+		enum RecordType
+		{
+			REC_OPEN = 1,							//* Connection accepted (no payload)
+			REC_LINE,								//* One line received, without CRLF
+			REC_CLOSE								//* Connection gone (no payload)
+		};
+
+		struct Record
+		{
+			unsigned long	timeNs;					//* Since the capture started
+			unsigned int	connId;					//* Low 32 bits of ClientConnection::getId()
+			unsigned short	type;					//* RecordType
+			unsigned short	length;					//* Payload bytes (lines are capped at 65535)
+		};
+
+		struct FileHeader
+		{
+			char			magic[8];				//* "IRCCAP1\0"
+			unsigned int	version;
+			unsigned int	recordSize;				//* sizeof(Record)
+			unsigned long	startRealtimeNs;		//* Wall clock when timeNs was 0
+		};
+
+		static const unsigned int VERSION = 1;
+		static const size_t BUFFER_BYTES = 256 * 1024;
+
+		TrafficCapture();
+		~TrafficCapture();
+
+		/**
+		 * Open 'dir'/ircserv-capture-<unix time>.bin and start recording
+		 *
+		 * @param seconds Window length; the server calls stop() after it
+		 * @param path [OUT] File being written
+		 */
+		bool	start(const std::string& dir, unsigned int seconds, std::string& path);
+		void	stop();
+
+		inline bool	active() const { return fd_ >= 0; }
+		inline int	fd() const { return fd_; }				//* -1 when not capturing
+		time_t		deadline() const;
+		unsigned long	records() const;
+		unsigned long	bytes() const;				//* Written + buffered
+
+		inline void open(unsigned long connId)
+		{
+			if (fd_ >= 0)
+				append(REC_OPEN, connId, NULL, 0);
+		}
+
+		inline void close(unsigned long connId)
+		{
+			if (fd_ >= 0)
+				append(REC_CLOSE, connId, NULL, 0);
+		}
+
+		//* 'command' is the parsed (uppercase) command: decides redaction
+		void	line(unsigned long connId, const std::string& command, const std::string& raw);
+
+		//* Synthetic record at time 0 (state of connections open at start)
+		void	prologue(unsigned long connId, const std::string& raw);
+
+	private:
+		int				fd_;
+		time_t			deadline_;
+		unsigned long	epochTicks_;
+		unsigned long	records_;
+		unsigned long	written_;
+		std::string		buffer_;
+
+		void	append(RecordType type, unsigned long connId, const char* data, size_t length, bool atZero = false);
+		void	flush();
+
+		TrafficCapture(const TrafficCapture&);
+		TrafficCapture& operator=(const TrafficCapture&);
+};
+
+#endif
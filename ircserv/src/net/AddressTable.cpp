@@ -0,0 +1,239 @@
+#include "AddressTable.hpp"
+#include <cstring>
+#include <cmath>
+
+//* Grow (after pruning) once the table is 70% full
+static const size_t LOAD_NUM = 7;
+static const size_t LOAD_DEN = 10;
+
+//* Below this decayed rate an idle entry carries no information anymore
+static const float RATE_FORGET = 0.5f;
+
+// ========================================================================
+// 							   NetAddress
+// ========================================================================
+
+bool NetAddress::operator==(const NetAddress& other) const
+{
+	return std::memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+}
+
+bool NetAddress::isZero() const
+{
+	for (size_t i = 0; i < sizeof(bytes); ++i)
+	{
+		if (bytes[i])
+			return false;
+	}
+	return true;
+}
+
+bool NetAddress::isV4Mapped() const
+{
+	static const unsigned char prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+	return std::memcmp(bytes, prefix, sizeof(prefix)) == 0;
+}
+
+void NetAddress::maskTo(unsigned int prefixBits)
+{
+	if (prefixBits >= 128 || isV4Mapped())
+		return;
+	size_t full = prefixBits / 8;
+	if (prefixBits % 8)
+		bytes[full++] &= static_cast<unsigned char>(0xff << (8 - prefixBits % 8));
+	std::memset(bytes + full, 0, sizeof(bytes) - full);
+}
+
+// ========================================================================
+// 							  Construction
+// ========================================================================
+
+AddressTable::AddressTable(size_t initialCapacity) : count_(0), maxLive_(0), maxRate_(0), halflife_(1)
+{
+	size_t cap = 16;
+	while (cap < initialCapacity)
+		cap <<= 1;
+	slots_.resize(cap);
+	std::memset(&slots_[0], 0, cap * sizeof(Entry));
+}
+
+void AddressTable::setLimits(unsigned int maxLive, unsigned int maxRate, unsigned int halflife)
+{
+	maxLive_ = maxLive;
+	maxRate_ = maxRate;
+	halflife_ = halflife ? halflife : 1;
+}
+
+// ========================================================================
+// 							    Probing
+// ========================================================================
+
+//* Mix both halves of the address (splitmix64 finalizer)
+size_t AddressTable::hash(const NetAddress& addr) const
+{
+	unsigned long lo;
+	unsigned long hi;
+	std::memcpy(&lo, addr.bytes, sizeof(lo));
+	std::memcpy(&hi, addr.bytes + 8, sizeof(hi));
+
+	unsigned long h = lo ^ (hi * 0x9E3779B97F4A7C15UL);
+	h ^= h >> 30;
+	h *= 0xBF58476D1CE4E5B9UL;
+	h ^= h >> 27;
+	h *= 0x94D049BB133111EBUL;
+	h ^= h >> 31;
+	return static_cast<size_t>(h);
+}
+
+size_t AddressTable::findSlot(const NetAddress& addr) const
+{
+	size_t mask = slots_.size() - 1;
+	for (size_t i = hash(addr) & mask; slots_[i].used; i = (i + 1) & mask)
+	{
+		if (slots_[i].addr == addr)
+			return i;
+	}
+	return slots_.size();
+}
+
+size_t AddressTable::insert(const NetAddress& addr)
+{
+	size_t mask = slots_.size() - 1;
+	size_t i = hash(addr) & mask;
+	while (slots_[i].used)
+		i = (i + 1) & mask;
+
+	std::memset(&slots_[i], 0, sizeof(Entry));
+	slots_[i].addr = addr;
+	slots_[i].used = 1;
+	count_++;
+	return i;
+}
+
+//* Backward-shift deletion: pull later members of the cluster into the hole
+//* so lookups never need tombstones
+void AddressTable::erase(size_t idx)
+{
+	size_t mask = slots_.size() - 1;
+	size_t hole = idx;
+	size_t i = (idx + 1) & mask;
+
+	while (slots_[i].used)
+	{
+		size_t home = hash(slots_[i].addr) & mask;
+		//* Entry at i may move into the hole only if its home is not in (hole, i]
+		bool movable = (hole <= i) ? (home <= hole || home > i) : (home <= hole && home > i);
+		if (movable)
+		{
+			slots_[hole] = slots_[i];
+			hole = i;
+		}
+		i = (i + 1) & mask;
+	}
+	slots_[hole].used = 0;
+	count_--;
+}
+
+float AddressTable::decayedRate(const Entry& e, time_t now) const
+{
+	unsigned int elapsed = static_cast<unsigned int>(now) - e.stamp;
+	if (elapsed == 0 || e.rate == 0.0f)
+		return e.rate;
+	return e.rate * static_cast<float>(std::pow(2.0, -static_cast<double>(elapsed) / halflife_));
+}
+
+//* Drop idle entries whose rate has decayed away
+void AddressTable::prune(time_t now)
+{
+	size_t i = 0;
+	while (i < slots_.size())
+	{
+		if (slots_[i].used && slots_[i].live == 0 && decayedRate(slots_[i], now) < RATE_FORGET)
+			erase(i);			//* Something else may have shifted into i: re-check it
+		else
+			i++;
+	}
+}
+
+void AddressTable::grow()
+{
+	std::vector<Entry> old;
+	old.swap(slots_);
+	slots_.resize(old.size() * 2);
+	std::memset(&slots_[0], 0, slots_.size() * sizeof(Entry));
+	count_ = 0;
+
+	for (size_t i = 0; i < old.size(); ++i)
+	{
+		if (old[i].used)
+			slots_[insert(old[i].addr)] = old[i];
+	}
+}
+
+// ========================================================================
+// 							   Accounting
+// ========================================================================
+
+bool AddressTable::tryAcquire(const NetAddress& addr, time_t now)
+{
+	size_t idx = findSlot(addr);
+	if (idx == slots_.size())
+	{
+		if ((count_ + 1) * LOAD_DEN > slots_.size() * LOAD_NUM)
+		{
+			prune(now);
+			if ((count_ + 1) * LOAD_DEN > slots_.size() * LOAD_NUM)
+				grow();
+		}
+		idx = insert(addr);
+	}
+
+	Entry& e = slots_[idx];
+	e.rate = decayedRate(e, now) + 1.0f;
+	e.stamp = static_cast<unsigned int>(now);
+
+	if (maxLive_ && e.live >= maxLive_)
+		return false;
+	if (maxRate_ && e.rate > static_cast<float>(maxRate_))
+		return false;
+
+	e.live++;
+	return true;
+}
+
+void AddressTable::adopt(const NetAddress& addr, time_t now)
+{
+	size_t idx = findSlot(addr);
+	if (idx == slots_.size())
+	{
+		if ((count_ + 1) * LOAD_DEN > slots_.size() * LOAD_NUM)
+			grow();
+		idx = insert(addr);
+		slots_[idx].stamp = static_cast<unsigned int>(now);
+	}
+	slots_[idx].live++;
+}
+
+void AddressTable::release(const NetAddress& addr)
+{
+	size_t idx = findSlot(addr);
+	if (idx == slots_.size() || slots_[idx].live == 0)
+		return;
+	slots_[idx].live--;
+}
+
+unsigned int AddressTable::getLive(const NetAddress& addr) const
+{
+	size_t idx = findSlot(addr);
+	return (idx == slots_.size()) ? 0 : slots_[idx].live;
+}
+
+size_t AddressTable::size() const
+{
+	return count_;
+}
+
+size_t AddressTable::capacity() const
+{
+	return slots_.size();
+}
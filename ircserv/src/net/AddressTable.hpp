@@ -0,0 +1,93 @@
+#ifndef ADDRESS_TABLE_HPP
+#define ADDRESS_TABLE_HPP
+
+#include <vector>
+#include <ctime>
+
+/**
+ * NetAddress: 16-byte binary key for a client address
+ *
+ * IPv4 is stored IPv4-mapped (::ffff:a.b.c.d) so both families share one key
+ * space. For accounting the IPv6 key is masked to a prefix (ipv6_cidr,
+ * default /64) because a single host usually controls a whole /64.
+ * UNIX domain peers have an all-zero key.
+ */
+struct NetAddress
+{
+	unsigned char	bytes[16];
+
+	bool operator==(const NetAddress& other) const;
+	bool isZero() const;
+	bool isV4Mapped() const;
+
+	//* Keep the first 'prefixBits' bits of an IPv6 key (IPv4-mapped untouched)
+	void maskTo(unsigned int prefixBits);
+};
+
+/**
+ * AddressTable: per-source connection accounting
+ *
+ * Open addressing with linear probing and backward-shift deletion (no
+ * tombstones), power-of-two capacity, 32-byte entries stored inline in one
+ * vector. Each entry holds the number of live connections from that source
+ * and an exponentially decaying connect rate:
+ *
+ *     rate = rate * 2^(-elapsed / halflife) + 1      (on every attempt)
+ *
+ * Entries with no live connection are kept while their rate still matters,
+ * so disconnecting and reconnecting does not reset the throttle. They are
+ * pruned lazily before the table grows.
+ */
+
+class AddressTable
+{
+	public:
+		AddressTable(size_t initialCapacity = 1024);
+
+		//* Limits; 0 disables the corresponding check
+		void	setLimits(unsigned int maxLive, unsigned int maxRate, unsigned int halflife);
+
+		/**
+		 * Account a new connection attempt from 'addr'
+		 *
+		 * @return true if accepted (live count incremented), false if the
+		 *         source is over its live or rate limit (attempt still counted)
+		 */
+		bool	tryAcquire(const NetAddress& addr, time_t now);
+
+		//* A connection accepted by tryAcquire() has closed
+		void	release(const NetAddress& addr);
+
+		//* Count a connection accepted elsewhere (hot upgrade): no limits
+		void	adopt(const NetAddress& addr, time_t now);
+
+		unsigned int	getLive(const NetAddress& addr) const;
+		size_t			size() const;
+		size_t			capacity() const;
+
+	private:
+		struct Entry
+		{
+			NetAddress		addr;
+			unsigned int	live;					//* Open connections from this source
+			float			rate;					//* Decayed connect attempts
+			unsigned int	stamp;					//* Second of the last rate update (low 32 bits)
+			unsigned int	used;					//* Slot occupied
+		};
+
+		std::vector<Entry>	slots_;
+		size_t				count_;
+		unsigned int		maxLive_;
+		unsigned int		maxRate_;
+		unsigned int		halflife_;
+
+		size_t	hash(const NetAddress& addr) const;
+		size_t	findSlot(const NetAddress& addr) const;		//* slots_.size() if absent
+		size_t	insert(const NetAddress& addr);
+		void	erase(size_t idx);
+		float	decayedRate(const Entry& e, time_t now) const;
+		void	prune(time_t now);
+		void	grow();
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "Listener.hpp"
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+
+Listener::Listener() : kind(LISTEN_TCP), role(ROLE_CLIENT), host(""), port(0), path(""), v6only(false),
+	acceptBudget(0), fd(-1)
+{
+}
+
+static bool parsePort(const std::string& s, int& port)
+{
+	if (s.empty() || s.size() > 5 || s.find_first_not_of("0123456789") != std::string::npos)
+		return (false);
+	port = std::atoi(s.c_str());
+	return (port > 0 && port < 65536);
+}
+
+bool Listener::parse(const std::string& spec, Listener& out)
+{
+	std::istringstream words(spec);
+	std::string addr;
+	if (!(words >> addr))
+		return (false);
+
+	out = Listener();
+	if (addr.compare(0, 5, "unix:") == 0)
+	{
+		out.kind = LISTEN_UNIX;
+		out.path = addr.substr(5);
+		if (out.path.empty())
+			return (false);
+	}
+	else if (addr[0] == '[')
+	{
+		//* [v6-literal]:port
+		size_t close = addr.find("]:");
+		if (close == std::string::npos || !parsePort(addr.substr(close + 2), out.port))
+			return (false);
+		out.host = addr.substr(1, close - 1);
+		if (out.host.empty())
+			return (false);
+	}
+	else
+	{
+		size_t colon = addr.rfind(':');
+		if (colon == std::string::npos || !parsePort(addr.substr(colon + 1), out.port))
+			return (false);
+		out.host = addr.substr(0, colon);
+		if (out.host.empty())
+			out.host = "*";
+	}
+
+	std::string opt;
+	while (words >> opt)
+	{
+		if (opt == "v6only")
+			out.v6only = true;
+		else if (opt.compare(0, 7, "budget=") == 0)
+		{
+			std::string n = opt.substr(7);
+			if (n.empty() || n.find_first_not_of("0123456789") != std::string::npos)
+				return (false);
+			out.acceptBudget = static_cast<unsigned int>(std::atoi(n.c_str()));
+		}
+		else
+			return (false);
+	}
+	return (true);
+}
+
+std::string Listener::describe() const
+{
+	if (kind == LISTEN_UNIX)
+		return ("unix:" + path);
+
+	std::ostringstream oss;
+	if (host.find(':') != std::string::npos)
+		oss << "[" << host << "]:" << port;
+	else
+		oss << host << ":" << port;
+	return (oss.str());
+}
+
+bool Listener::isLocal() const
+{
+	if (kind == LISTEN_UNIX)
+		return (true);
+	//* Literals only, parsed the way bindSocket() will: a name could resolve anywhere
+	struct in_addr v4;
+	if (inet_pton(AF_INET, host.c_str(), &v4) == 1)
+		return ((ntohl(v4.s_addr) >> 24) == 127);
+	struct in6_addr v6;
+	return (inet_pton(AF_INET6, host.c_str(), &v6) == 1 && std::memcmp(&v6, &in6addr_loopback, sizeof(v6)) == 0);
+}
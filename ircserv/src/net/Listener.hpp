@@ -0,0 +1,67 @@
+#ifndef LISTENER_HPP
+#define LISTENER_HPP
+
+#include <string>
+
+/**
+ * Listener: one listening socket registered in the poll() loop
+ *
+ * Spec syntax (config "listen = ..." lines, may repeat):
+ *
+ *   *:6667                  dual-stack [::]:6667, falls back to 0.0.0.0 without IPv6
+ *   0.0.0.0:6667            IPv4 only, all interfaces
+ *   192.168.1.10:6667       IPv4, one address
+ *   [::]:6667               IPv6 dual-stack (also accepts IPv4-mapped peers)
+ *   [::1]:6667 v6only       IPv6 only
+ *   unix:/tmp/ircserv.sock  UNIX domain socket (local bots)
+ *
+ * Optional trailing words: "v6only", "budget=N" (max accepts per loop
+ * iteration for this listener, so a flood on one port cannot starve the
+ * others or the clients already connected).
+ *
+ * "metrics_listen = ..." uses the same syntax for the plain-text metrics
+ * scrape listener, which must be loopback or a UNIX socket.
+ */
+
+struct Listener
+{
+	enum Kind
+	{
+		LISTEN_TCP,
+		LISTEN_UNIX
+	};
+
+	enum Role
+	{
+		ROLE_CLIENT,						//* IRC clients
+		ROLE_METRICS						//* Plain-text metrics, one reply per connection
+	};
+
+	Kind			kind;
+	Role			role;
+	std::string		host;					//* "" / "*" = any; IPv6 literal without brackets
+	int				port;
+	std::string		path;					//* UNIX socket path
+	bool			v6only;
+	unsigned int	acceptBudget;			//* 0 = use the server default
+	int				fd;						//* -1 until opened
+
+	Listener();
+
+	/**
+	 * Parse a listen spec
+	 *
+	 * @param spec Text after "listen ="
+	 * @param out [OUT] Parsed listener (fd = -1)
+	 * @return false on syntax error
+	 */
+	static bool parse(const std::string& spec, Listener& out);
+
+	//* Human readable address, e.g. "[::]:6667" or "unix:/tmp/ircserv.sock"
+	std::string describe() const;
+
+	//* UNIX socket, or a 127.0.0.0/8 or ::1 literal: not reachable from other hosts
+	bool isLocal() const;
+};
+
+#endif
@@ -17,7 +17,9 @@
 #include <fcntl.h>
 #include <cstring>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
 
 //* ========================================
 //* SOCKET CONFIGURATION
@@ -79,13 +81,13 @@ bool	SocketUtils::setReuseAddr(int fd)
 //* SERVER SOCKET CREATION
 //* ========================================
 
-int		SocketUtils::createServerSocket()
+int		SocketUtils::createServerSocket(int family)
 {
 	//* CREATE A SOCKET -->
-	//* AF_INET = IPv4 (DOMAIN)
+	//* AF_INET = IPv4 / AF_INET6 = IPv6 (DOMAIN)
     //* SOCK_STREAM = TCP (TYPE)
     //* 0 = protocol by default (TCP for SOCK_STREAM)
-	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	int fd = socket(family, SOCK_STREAM, 0);
 	if (fd == -1)
 	{
 		std::cerr << "[SOCKET] socket() failed: " << strerror(errno) << std::endl;
@@ -106,29 +108,102 @@ int		SocketUtils::createServerSocket()
     return (fd);
 }
 
+int		SocketUtils::createUnixSocket()
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+	{
+		std::cerr << "[SOCKET] socket(AF_UNIX) failed: " << strerror(errno) << std::endl;
+		return (-1);
+	}
+    if (!setNonBlocking(fd))
+	{
+        close(fd);
+        return (-1);
+    }
+	return (fd);
+}
+
+bool	SocketUtils::setV6Only(int fd, bool only)
+{
+	int opt = only ? 1 : 0;
+
+	if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt)) == -1)
+	{
+		std::cerr << "[SOCKET] setsockopt(IPV6_V6ONLY) failed: " << strerror(errno) << std::endl;
+		return (false);
+	}
+	return (true);
+}
+
 //* ========================================
-//* BIND: Attach socket to a specific port
+//* BIND: Attach socket to a specific address + port
 //* Purpose: Associates the socket with a port number so clients know where to connect
 //* Think of it like: "This socket will listen on port 6667"
+//* The address family is taken from the literal: dotted = IPv4, colons = IPv6
 //* ========================================
-bool	SocketUtils::bindSocket(int fd, int port)
+bool	SocketUtils::bindSocket(int fd, const std::string& host, int port)
 {
-	//* Prepare address structure for IPv4
-	struct sockaddr_in addr;
-	std::memset(&addr, 0, sizeof(addr));               //* Zero out the structure (good practice)
+	int rc;
 
-	addr.sin_family = AF_INET;                         //* Address family: IPv4
-	addr.sin_addr.s_addr = INADDR_ANY;                 //* Bind to all network interfaces (0.0.0.0)
-	addr.sin_port = htons(port);                       //* Convert port to network byte order (big-endian)
+	if (host.find(':') != std::string::npos)
+	{
+		struct sockaddr_in6 addr6;
+		std::memset(&addr6, 0, sizeof(addr6));
+		addr6.sin6_family = AF_INET6;                   //* Address family: IPv6
+		addr6.sin6_port = htons(port);
+		if (inet_pton(AF_INET6, host.c_str(), &addr6.sin6_addr) != 1)
+		{
+			std::cerr << "[SOCKET] Invalid IPv6 address: " << host << std::endl;
+			return (false);
+		}
+		rc = bind(fd, (struct sockaddr*)&addr6, sizeof(addr6));
+	}
+	else
+	{
+		//* Prepare address structure for IPv4
+		struct sockaddr_in addr;
+		std::memset(&addr, 0, sizeof(addr));               //* Zero out the structure (good practice)
+		addr.sin_family = AF_INET;                         //* Address family: IPv4
+		addr.sin_port = htons(port);                       //* Convert port to network byte order (big-endian)
+		if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+		{
+			std::cerr << "[SOCKET] Invalid IPv4 address: " << host << std::endl;
+			return (false);
+		}
+		rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	}
 
 	//* Attach the socket to the port
-	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+	if (rc == -1)
 	{
-		std::cerr << "[SOCKET] bind() failed on port " << port 
+		std::cerr << "[SOCKET] bind() failed on " << host << " port " << port 
 				<< ": " << strerror(errno) << std::endl;
 		return (false);
 	}
-	std::cout << "[SOCKET] ✓ Bound to 0.0.0.0:" << port << std::endl;
+	std::cout << "[SOCKET] ✓ Bound to " << host << " port " << port << std::endl;
+	return (true);
+}
+
+bool	SocketUtils::bindUnixSocket(int fd, const std::string& path)
+{
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+	{
+		std::cerr << "[SOCKET] UNIX socket path too long: " << path << std::endl;
+		return (false);
+	}
+	std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+	unlink(path.c_str());                                  //* Stale socket from a previous run
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+	{
+		std::cerr << "[SOCKET] bind() failed on " << path << ": " << strerror(errno) << std::endl;
+		return (false);
+	}
+	std::cout << "[SOCKET] ✓ Bound to unix:" << path << std::endl;
 	return (true);
 }
 
@@ -152,9 +227,9 @@ bool	SocketUtils::listenSocket(int fd, int backlog)
 //* Accepts a new client connection on the server socket and configures it as non-blocking.
 //* Returns: Client file descriptor on success, -1 on failure
 //* ========================================
-int		SocketUtils::acceptClient(int server_fd, std::string& client_ip)
+int		SocketUtils::acceptClient(int server_fd, std::string& client_ip, NetAddress& client_addr)
 {
-	struct sockaddr_in cli_addr;                                      //* Structure to store client address information (IPv4)
+	struct sockaddr_storage cli_addr;                                 //* Large enough for IPv4, IPv6 and UNIX peers
 	socklen_t cli_len = sizeof(cli_addr);                             //* Size of the client address structure
 
 	int client_fd = accept(server_fd, (struct sockaddr*)&cli_addr, &cli_len); //* Accept incoming connection and get a new fd, the client socket FD exactly
@@ -166,9 +241,31 @@ int		SocketUtils::acceptClient(int server_fd, std::string& client_ip)
 		return (-1);
 	}
 	
-	char ip_str[INET_ADDRSTRLEN];                                     //* Buffer to hold IP address in string format
-	inet_ntop(AF_INET, &cli_addr.sin_addr, ip_str, sizeof(ip_str));   //* Convert binary IP to dotted-decimal notation (e.g., "192.168.1.1")
-	client_ip = ip_str;                                               //* Store the IP address in output parameter
+	char ip_str[INET6_ADDRSTRLEN];                                    //* Buffer to hold IP address in string format
+	std::memset(client_addr.bytes, 0, sizeof(client_addr.bytes));
+	if (cli_addr.ss_family == AF_INET)
+	{
+		struct sockaddr_in* in4 = (struct sockaddr_in*)&cli_addr;
+		inet_ntop(AF_INET, &in4->sin_addr, ip_str, sizeof(ip_str));   //* Convert binary IP to dotted-decimal notation (e.g., "192.168.1.1")
+		client_addr.bytes[10] = 0xff;                                 //* IPv4-mapped key: ::ffff:a.b.c.d
+		client_addr.bytes[11] = 0xff;
+		std::memcpy(client_addr.bytes + 12, &in4->sin_addr, 4);
+		client_ip = ip_str;
+	}
+	else if (cli_addr.ss_family == AF_INET6)
+	{
+		struct sockaddr_in6* in6 = (struct sockaddr_in6*)&cli_addr;
+		std::memcpy(client_addr.bytes, &in6->sin6_addr, 16);
+		if (client_addr.isV4Mapped())                                 //* IPv4 peer on a dual-stack socket
+			inet_ntop(AF_INET, client_addr.bytes + 12, ip_str, sizeof(ip_str));
+		else
+			inet_ntop(AF_INET6, &in6->sin6_addr, ip_str, sizeof(ip_str));
+		client_ip = ip_str;
+		if (client_ip[0] == ':')                                      //* "::1" would read as a trailing parameter
+			client_ip = "0" + client_ip;
+	}
+	else
+		client_ip = "localhost";                                      //* UNIX domain peer: all-zero key
 	
 	if (!setNonBlocking(client_fd))                                   //* Configure client socket to non-blocking mode
 	{
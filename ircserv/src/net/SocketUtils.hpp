@@ -15,6 +15,8 @@
 
 #include <string>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include "AddressTable.hpp"
 
 /**
  * SocketUtils: Low-level socket operations utility class
@@ -64,19 +66,50 @@ public:
 	 * - SO_REUSEADDR option
 	 * - Non-blocking mode
 	 * 
+	 * @param family AF_INET or AF_INET6
 	 * @return socket fd on success, -1 on error
 	 */
-	static int createServerSocket();
+	static int createServerSocket(int family = AF_INET);
 	
 	/**
-	 * Bind server socket to a specific port
-	 * Binds to all interfaces (0.0.0.0)
+	 * Create a UNIX domain stream server socket (non-blocking)
+	 * 
+	 * @return socket fd on success, -1 on error
+	 */
+	static int createUnixSocket();
+	
+	/**
+	 * Set IPV6_V6ONLY on an AF_INET6 socket
+	 * false = dual-stack: IPv4 peers arrive as ::ffff:a.b.c.d
+	 * 
+	 * @param fd AF_INET6 socket
+	 * @param only true to refuse IPv4-mapped connections
+	 * @return true on success, false on error
+	 */
+	static bool setV6Only(int fd, bool only);
+	
+	/**
+	 * Bind server socket to an address and port
+	 * The family of 'host' must match the socket:
+	 * - "0.0.0.0", "192.168.1.10"   -> AF_INET
+	 * - "::", "::1", "fe80::1"      -> AF_INET6
 	 * 
 	 * @param fd Socket file descriptor
+	 * @param host Numeric address to bind to
 	 * @param port Port number (recommended: 1024-65535)
 	 * @return true on success, false on error
 	 */
-	static bool bindSocket(int fd, int port);
+	static bool bindSocket(int fd, const std::string& host, int port);
+	
+	/**
+	 * Bind a UNIX socket to a filesystem path
+	 * A stale socket file left by a previous run is removed first.
+	 * 
+	 * @param fd AF_UNIX socket
+	 * @param path Socket path (max ~107 bytes)
+	 * @return true on success, false on error
+	 */
+	static bool bindUnixSocket(int fd, const std::string& path);
 	
 	/**
 	 * Put socket in listening mode
@@ -94,12 +127,17 @@ public:
 	/**
 	 * Accept a new client connection (non-blocking)
 	 * Automatically sets client socket to non-blocking mode
+	 * Works on IPv4, IPv6 (IPv4-mapped peers are reported as IPv4) and UNIX
+	 * listeners (reported as "localhost" with an all-zero address key).
+	 * IPv6 hosts starting with ':' get a leading '0' so they stay valid in
+	 * IRC prefixes and parameters ("::1" -> "0::1").
 	 * 
 	 * @param server_fd Server socket file descriptor
 	 * @param client_ip [OUT] Client IP address as string (e.g., "192.168.1.100")
+	 * @param client_addr [OUT] Binary address key for per-source accounting
 	 * @return client fd on success, -1 if no connection available or error
 	 */
-	static int acceptClient(int server_fd, std::string& client_ip);
+	static int acceptClient(int server_fd, std::string& client_ip, NetAddress& client_addr);
 	
 	//* ========================================
 	//* I/O OPERATIONS
@@ -0,0 +1,160 @@
+#include "HotUpgrade.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const char* HotUpgrade::ENV_FD = "IRCSERV_UPGRADE_FD";
+
+unsigned long HotUpgrade::monotonicUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long>(ts.tv_sec) * 1000000UL + static_cast<unsigned long>(ts.tv_nsec) / 1000UL;
+}
+
+static bool writeAll(int sock, const char* data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t n = send(sock, data, length, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		data += n;
+		length -= static_cast<size_t>(n);
+	}
+	return true;
+}
+
+static bool readAll(int sock, char* data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t n = recv(sock, data, length, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		data += n;
+		length -= static_cast<size_t>(n);
+	}
+	return true;
+}
+
+bool HotUpgrade::sendByte(int sock, char byte)
+{
+	return writeAll(sock, &byte, 1);
+}
+
+int HotUpgrade::receiveByte(int sock, bool block, int timeoutMs)
+{
+	struct pollfd pfd;
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	int ready = poll(&pfd, 1, block ? timeoutMs : 0);
+	if (ready == 0)
+		return block ? 0 : -1;
+	if (ready < 0)
+		return (errno == EINTR && !block) ? -1 : 0;
+	unsigned char byte;
+	ssize_t n = recv(sock, &byte, 1, MSG_DONTWAIT);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return block ? 0 : -1;
+	return (n == 1) ? byte : 0;
+}
+
+bool HotUpgrade::sendState(int sock, const std::string& state, const std::vector<int>& fds, unsigned long frozenAtUs)
+{
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "IRCUPG1", 8);
+	header.version = VERSION;
+	header.fdCount = static_cast<unsigned int>(fds.size());
+	header.stateBytes = state.size();
+	header.frozenAtUs = frozenAtUs;
+	if (!writeAll(sock, reinterpret_cast<const char*>(&header), sizeof(header))
+		|| !writeAll(sock, state.data(), state.size()))
+		return false;
+
+	for (size_t sent = 0; sent < fds.size(); sent += FD_BATCH)
+	{
+		size_t count = std::min(static_cast<size_t>(FD_BATCH), fds.size() - sent);
+		std::vector<char> control(CMSG_SPACE(count * sizeof(int)), 0);
+		char payload = 'F';
+		struct iovec iov;
+		iov.iov_base = &payload;
+		iov.iov_len = 1;
+
+		struct msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+		std::memcpy(CMSG_DATA(cmsg), &fds[sent], count * sizeof(int));
+
+		ssize_t n;
+		do
+			n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+		while (n < 0 && errno == EINTR);
+		if (n != 1)
+			return false;
+	}
+	return true;
+}
+
+bool HotUpgrade::receiveState(int sock, std::string& state, std::vector<int>& fds, unsigned long& frozenAtUs)
+{
+	Header header;
+	if (!readAll(sock, reinterpret_cast<char*>(&header), sizeof(header))
+		|| std::memcmp(header.magic, "IRCUPG1", 8) != 0 || header.version != VERSION)
+		return false;
+	frozenAtUs = header.frozenAtUs;
+	state.resize(header.stateBytes);
+	if (header.stateBytes && !readAll(sock, &state[0], header.stateBytes))
+		return false;
+
+	fds.clear();
+	fds.reserve(header.fdCount);
+	while (fds.size() < header.fdCount)
+	{
+		size_t count = std::min(static_cast<size_t>(FD_BATCH), header.fdCount - fds.size());
+		std::vector<char> control(CMSG_SPACE(count * sizeof(int)), 0);
+		char payload;
+		struct iovec iov;
+		iov.iov_base = &payload;
+		iov.iov_len = 1;
+
+		struct msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+
+		ssize_t n;
+		do
+			n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+		while (n < 0 && errno == EINTR);
+		struct cmsghdr* cmsg = (n == 1) ? CMSG_FIRSTHDR(&msg) : NULL;
+		if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+			|| (msg.msg_flags & MSG_CTRUNC))
+			return false;
+		size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+		fds.insert(fds.end(), data, data + received);
+		if (received != count)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,121 @@
+#ifndef HOT_UPGRADE_HPP
+#define HOT_UPGRADE_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+/**
+ * HotUpgrade: hand the live server over to a freshly exec'd binary
+ *
+ * The oper UPGRADE command forks and execs the new binary with a UNIX
+ * socketpair end in IRCSERV_UPGRADE_FD, and keeps serving meanwhile. The
+ * new process initialises, then writes READY. Only then does the old one
+ * freeze: it serialises its state (listeners, connections with their
+ * buffers and registration, users, channels with members and history)
+ * into one blob and sends it, followed by every socket fd as SCM_RIGHTS
+ * ancillary data. The new process rebuilds the state around the received
+ * fds and answers ACK; the old one _exit()s without touching the sockets
+ * (no shutdown(), no FIN), so clients never see a disconnect.
+ *
+ * If the new binary dies, answers anything else or takes too long, the
+ * old process closes the socketpair and carries on as if nothing happened.
+ *
+ * Wire format on the socketpair:
+ *   new -> old   READY
+ *   old -> new   Header; char[stateBytes]; fds in batches of FD_BATCH,
+ *                each batch sent with a 1-byte payload
+ *   new -> old   ACK
+ */
+
+class HotUpgrade
+{
+	public:
+		struct Header
+		{
+			char			magic[8];				//* "IRCUPG1\0"
+			unsigned int	version;
+			unsigned int	fdCount;
+			unsigned long	stateBytes;
+			unsigned long	frozenAtUs;				//* CLOCK_MONOTONIC when the old process froze
+		};
+
+		static const char*			ENV_FD;		//* "IRCSERV_UPGRADE_FD"
+		static const unsigned int	VERSION = 2;		//* 2: CAP state per client
+		static const size_t			FD_BATCH = 250;		//* Below the kernel's SCM_MAX_FD (253)
+		static const char			READY = 'R';
+		static const char			ACK = 'A';
+
+		static unsigned long	monotonicUs();
+
+		//* Blocking: the sender is frozen anyway
+		static bool	sendState(int sock, const std::string& state, const std::vector<int>& fds,
+						unsigned long frozenAtUs);
+		static bool	receiveState(int sock, std::string& state, std::vector<int>& fds, unsigned long& frozenAtUs);
+
+		static bool	sendByte(int sock, char byte);
+		//* -1 = nothing yet (only when !block), 0 = peer gone, else the byte
+		static int	receiveByte(int sock, bool block, int timeoutMs = -1);
+
+		//* Flat state blob: fixed-size values and length-prefixed strings
+		class Writer
+		{
+			public:
+				std::string		data;
+
+				template <typename T>
+				void	put(const T& value)
+				{
+					data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+				}
+				void	putString(const std::string& s)
+				{
+					put(static_cast<unsigned int>(s.size()));
+					data.append(s);
+				}
+		};
+
+		class Reader
+		{
+			public:
+				Reader(const std::string& data) : at_(data.data()), end_(data.data() + data.size()), ok_(true) {}
+
+				template <typename T>
+				T	get()
+				{
+					T value = T();
+					if (static_cast<size_t>(end_ - at_) < sizeof(T))
+						ok_ = false;
+					else
+					{
+						std::memcpy(&value, at_, sizeof(T));
+						at_ += sizeof(T);
+					}
+					return value;
+				}
+				std::string	getString()
+				{
+					size_t n = get<unsigned int>();
+					if (static_cast<size_t>(end_ - at_) < n)
+					{
+						ok_ = false;
+						return std::string();
+					}
+					std::string s(at_, n);
+					at_ += n;
+					return s;
+				}
+				bool	ok() const { return ok_; }
+				bool	done() const { return ok_ && at_ == end_; }
+
+			private:
+				const char*	at_;
+				const char*	end_;
+				bool		ok_;
+		};
+
+	private:
+		HotUpgrade();
+};
+
+#endif
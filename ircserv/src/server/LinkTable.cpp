@@ -0,0 +1,101 @@
+#include "LinkTable.hpp"
+#include <algorithm>
+
+LinkTable::LinkTable()
+{
+}
+
+// ========================================================================
+// 								 Peers
+// ========================================================================
+
+bool LinkTable::add(const Peer& peer)
+{
+	if (peers_.count(peer.sid) || findByName(peer.name))
+		return false;
+	peers_[peer.sid] = peer;
+	if (peer.hops == 1)
+		links_.push_back(peer.route);
+	return true;
+}
+
+LinkTable::Peer* LinkTable::find(const std::string& sid)
+{
+	std::map<std::string, Peer>::iterator it = peers_.find(sid);
+	return (it == peers_.end()) ? NULL : &it->second;
+}
+
+LinkTable::Peer* LinkTable::findByName(const std::string& name)
+{
+	for (std::map<std::string, Peer>::iterator it = peers_.begin(); it != peers_.end(); ++it)
+		if (it->second.name == name)
+			return &it->second;
+	return NULL;
+}
+
+//* A handful of servers: repeated scans are cheaper than keeping child lists
+void LinkTable::subtree(const std::string& sid, std::vector<std::string>& out) const
+{
+	if (!peers_.count(sid))
+		return;
+	size_t first = out.size();
+	out.push_back(sid);
+	for (size_t i = first; i < out.size(); ++i)
+		for (std::map<std::string, Peer>::const_iterator it = peers_.begin(); it != peers_.end(); ++it)
+			if (it->second.uplink == out[i])
+				out.push_back(it->first);
+}
+
+void LinkTable::remove(const std::string& sid)
+{
+	std::map<std::string, Peer>::iterator it = peers_.find(sid);
+	if (it == peers_.end())
+		return;
+	if (it->second.hops == 1)
+		links_.erase(std::remove(links_.begin(), links_.end(), it->second.route), links_.end());
+	peers_.erase(it);
+}
+
+const std::map<std::string, LinkTable::Peer>& LinkTable::peers() const
+{
+	return peers_;
+}
+
+const std::vector<ClientConnection*>& LinkTable::links() const
+{
+	return links_;
+}
+
+// ========================================================================
+// 							Handshake Sessions
+// ========================================================================
+
+LinkTable::Session* LinkTable::session(ClientConnection* conn)
+{
+	std::map<ClientConnection*, Session>::iterator it = sessions_.find(conn);
+	return (it == sessions_.end()) ? NULL : &it->second;
+}
+
+LinkTable::Session& LinkTable::open(ClientConnection* conn, int connectIndex)
+{
+	Session& s = sessions_[conn];
+	s.sid = "";
+	s.connectIndex = connectIndex;
+	s.passOk = false;
+	s.established = false;
+	s.burstStartedUs = 0;
+	return s;
+}
+
+void LinkTable::close(ClientConnection* conn)
+{
+	sessions_.erase(conn);
+}
+
+bool LinkTable::connecting(int connectIndex) const
+{
+	for (std::map<ClientConnection*, Session>::const_iterator it = sessions_.begin(); it != sessions_.end(); ++it)
+		if (it->second.connectIndex == connectIndex)
+			return true;
+	return false;
+}
@@ -0,0 +1,71 @@
+#ifndef LINK_TABLE_HPP
+#define LINK_TABLE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+class ClientConnection;
+
+/**
+ * LinkTable: the other servers of the spanning tree, as seen from here
+ *
+ * Every server is known by its SID (TS6: a digit and two alphanumerics).
+ * A direct link is a peer with hops 1 whose route is its own connection;
+ * the servers it introduces later (SID) get the same route, so anything
+ * addressed to them, or to their users, leaves through that connection.
+ * There is exactly one path between two servers: a SID that is already
+ * known arriving on another link would close a loop, and is refused.
+ *
+ * Connections also have a handshake session (PASS/SERVER) before they
+ * become a peer: links we open ourselves (connect = ...) and links that
+ * arrived on a listener and presented the link password.
+ */
+
+class LinkTable
+{
+	public:
+		struct Peer
+		{
+			std::string			sid;
+			std::string			name;
+			std::string			description;
+			unsigned int		hops;				//* 1 = direct link
+			std::string			uplink;				//* SID of the server that introduced it
+			ClientConnection*	route;				//* Direct link toward it
+		};
+
+		struct Session
+		{
+			std::string		sid;					//* From PASS
+			int				connectIndex;			//* config connect line, -1 = inbound
+			bool			passOk;
+			bool			established;			//* SERVER accepted, burst sent
+			unsigned long	burstStartedUs;			//* Until the PONG after our burst
+		};
+
+		LinkTable();
+
+		//* PEERS
+		bool	add(const Peer& peer);				//* false if the SID or the name is taken
+		Peer*	find(const std::string& sid);
+		Peer*	findByName(const std::string& name);
+		//* 'sid' and every server introduced behind it
+		void	subtree(const std::string& sid, std::vector<std::string>& out) const;
+		void	remove(const std::string& sid);
+		const std::map<std::string, Peer>&	peers() const;
+		const std::vector<ClientConnection*>&	links() const;	//* Established direct links
+
+		//* HANDSHAKE SESSIONS
+		Session*	session(ClientConnection* conn);
+		Session&	open(ClientConnection* conn, int connectIndex);
+		void		close(ClientConnection* conn);
+		bool		connecting(int connectIndex) const;	//* A session for that connect line exists
+
+	private:
+		std::map<std::string, Peer>					peers_;
+		std::vector<ClientConnection*>				links_;
+		std::map<ClientConnection*, Session>		sessions_;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "MonitorIndex.hpp"
+
+MonitorIndex::MonitorIndex()
+{
+}
+
+bool MonitorIndex::add(ClientConnection* client, const std::string& nick)
+{
+	if (!lists_[client].insert(nick).second)
+		return false;
+	watchers_[nick].insert(client);
+	return true;
+}
+
+void MonitorIndex::remove(ClientConnection* client, const std::string& nick)
+{
+	std::map<ClientConnection*, List>::iterator l = lists_.find(client);
+	if (l == lists_.end() || !l->second.erase(nick))
+		return;
+	if (l->second.empty())
+		lists_.erase(l);
+	std::map<std::string, Watchers>::iterator w = watchers_.find(nick);
+	if (w == watchers_.end())
+		return;
+	w->second.erase(client);
+	if (w->second.empty())
+		watchers_.erase(w);
+}
+
+void MonitorIndex::clear(ClientConnection* client)
+{
+	std::map<ClientConnection*, List>::iterator l = lists_.find(client);
+	if (l == lists_.end())
+		return;
+	for (List::iterator it = l->second.begin(); it != l->second.end(); ++it)
+	{
+		std::map<std::string, Watchers>::iterator w = watchers_.find(*it);
+		if (w == watchers_.end())
+			continue;
+		w->second.erase(client);
+		if (w->second.empty())
+			watchers_.erase(w);
+	}
+	lists_.erase(l);
+}
+
+const MonitorIndex::Watchers* MonitorIndex::watchers(const std::string& nick) const
+{
+	std::map<std::string, Watchers>::const_iterator it = watchers_.find(nick);
+	return (it == watchers_.end()) ? NULL : &it->second;
+}
+
+const MonitorIndex::List* MonitorIndex::list(ClientConnection* client) const
+{
+	std::map<ClientConnection*, List>::const_iterator it = lists_.find(client);
+	return (it == lists_.end()) ? NULL : &it->second;
+}
+
+size_t MonitorIndex::count(ClientConnection* client) const
+{
+	const List* l = list(client);
+	return l ? l->size() : 0;
+}
+
+size_t MonitorIndex::nicks() const
+{
+	return watchers_.size();
+}
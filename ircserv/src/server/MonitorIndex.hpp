@@ -0,0 +1,47 @@
+#ifndef MONITOR_INDEX_HPP
+#define MONITOR_INDEX_HPP
+
+#include <string>
+#include <map>
+#include <set>
+
+class ClientConnection;
+
+/**
+ * MonitorIndex: IRCv3 MONITOR, both directions
+ *
+ * watchers: nick -> connections watching it. A nick coming or going
+ * (registration, NICK, QUIT) looks up its own entry and notifies those,
+ * never the whole client list: the cost is the number of watchers.
+ *
+ * lists: connection -> the nicks it watches, for MONITOR L/C/S and to undo
+ * everything when the watcher disconnects.
+ *
+ * Nicks are compared exactly, like the server's nick index (findUserByNick):
+ * "Alice" and "alice" are two nicks, and the 730/731 a watcher gets always
+ * agree with the status MONITOR S reports.
+ */
+
+class MonitorIndex
+{
+	public:
+		typedef std::set<ClientConnection*>				Watchers;
+		typedef std::set<std::string>					List;
+
+		MonitorIndex();
+
+		bool	add(ClientConnection* client, const std::string& nick);	//* false if already there
+		void	remove(ClientConnection* client, const std::string& nick);
+		void	clear(ClientConnection* client);
+
+		const Watchers*	watchers(const std::string& nick) const;		//* NULL if nobody
+		const List*		list(ClientConnection* client) const;			//* NULL if empty
+		size_t			count(ClientConnection* client) const;
+		size_t			nicks() const;									//* Distinct nicks watched
+
+	private:
+		std::map<std::string, Watchers>		watchers_;
+		std::map<ClientConnection*, List>	lists_;
+};
+
+#endif
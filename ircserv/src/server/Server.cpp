@@ -16,22 +16,78 @@
 #include "../channel/Channel.hpp"
 #include "../net/SocketUtils.hpp"
 #include "../irc/Parser.hpp"
+#include "../irc/CommandHelpers.hpp"
+#include "../irc/NumericReplies.hpp"
+#include "../metrics/Clock.hpp"
+#include "StateSnapshot.hpp"
+#include "HotUpgrade.hpp"
+#include "../irc/ReplyStream.hpp"
 
 #include <unistd.h>
+#include <sys/wait.h>
 #include <cerrno>
 #include <cstring>
 #include <algorithm>
 #include <iostream>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <ctime>
+#include <sstream>
+#include <cstdlib>
+
+//* Preformatted rejection lines: sent as-is before any per-client allocation
+static const std::string ERROR_TOO_MANY_UNREGISTERED = "ERROR :Closing Link: (Too many unregistered connections)\r\n";
+static const std::string ERROR_TOO_MANY_FROM_HOST = "ERROR :Closing Link: (Too many connections from your host)\r\n";
+static const std::string ERROR_THROTTLED = "ERROR :Closing Link: (Connecting too fast, throttled)\r\n";
+
+//* History segment compaction copied per loop iteration
+static const size_t HISTORY_STEP_BYTES = 256 * 1024;
+
+//* Streamed replies: refilled by STREAM_CHUNK once the SendQ drops below STREAM_LOW_WATER
+static const size_t STREAM_LOW_WATER = 16 * 1024;
+static const size_t STREAM_CHUNK = 32 * 1024;
+
+//* Monotonic milliseconds, immune to wall clock changes (drain timing)
+static long monotonicMs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000L + ts.tv_nsec / 1000000L);
+}
 
 //* ============================================================================
 //* CONSTRUCTOR Y DESTRUCTOR
 //* ============================================================================
 
-Server::Server(int port, const std::string& password) : port_(port), 
-	password_(password), server_fd_(-1), running_(false)
+Server::Server(int port, const std::string& password, const ServerConfig& config) : port_(port), 
+	password_(password), running_(false), reload_pending_(false), drain_pending_(false),
+	latency_dump_pending_(false), flight_dump_pending_(false), draining_(false),
+	drain_started_ms_(0), last_drain_ms_(-1), started_at_(std::time(NULL)), config_(config),
+	unregistered_count_(0), next_conn_id_(1), burst_second_(0), burst_count_(0), last_flight_dump_(0),
+	compact_cursor_(0), last_compact_(0), next_msgid_(1), next_batch_(1),
+	snapshot_pid_(0), last_snapshot_(std::time(NULL)), final_snapshot_done_(false), upgrade_sock_(-1), upgrade_pid_(0),
+	upgrade_deadline_(0), upgrade_requester_(0), adopt_fd_(-1), sid_(config.serverId),
+	server_name_(config.serverName), next_uid_(0), stream_backlog_(false)
 {
+	Clock::calibrate();
+	recorder_.start(config_.flightRecorderEvents);
+	//* Started by UPGRADE: the state (and the history store) comes from the old process
+	const char* adopt = std::getenv(HotUpgrade::ENV_FD);
+	if (adopt)
+	{
+		adopt_fd_ = std::atoi(adopt);
+		unsetenv(HotUpgrade::ENV_FD);
+	}
+	else
+	{
+		openHistoryStore();
+		restoreSnapshot();
+	}
 	initCommands();
+	welcome_.build(config_.motdFile, isupportTokens());
+	applyAddressLimits();
+	ClientConnection::setLaneLimits(config_.sendqControl, config_.sendqBulk);
+	profiler_.setBudgetMs(config_.loopBudgetMs);
     std::cout << "[SERVER] Initializing on port " << port << std::endl;	
 }
 
@@ -39,17 +95,36 @@ Server::~Server()
 {
     std::cout << "[SERVER] Shutting down..." << std::endl;
 
-	//* CLOSE SERVER SOCKET
-	if (server_fd_ >= 0)
-		close(server_fd_);
+	if (upgrade_sock_ >= 0)
+		abortUpgrade("the server is shutting down");
+
+	//* FINAL SNAPSHOT: unless the SIGTERM drain already wrote it (by now its
+	//* channels are gone, this one would be empty)
+	if (!final_snapshot_done_)
+		writeFinalSnapshot();
+
+	//* CLOSE LISTENING SOCKETS
+	for (size_t i = 0; i < listeners_.size(); ++i)
+	{
+		if (listeners_[i].fd < 0)
+			continue;
+		close(listeners_[i].fd);
+		if (listeners_[i].kind == Listener::LISTEN_UNIX)
+			unlink(listeners_[i].path.c_str());
+	}
 
 	//* CLEANUP CLIENTS
+	//* Last chance for queued output: one non-blocking send, then FIN
 	for (size_t i = 0; i < clients_.size(); i++)
 	{
 		if (clients_[i])
 		{
 			User* user = clients_[i]->getUser();		//* Get associated User before deleting connection
 
+			std::string pending = clients_[i]->getPendingOutput();
+			if (!pending.empty())
+				send(clients_[i]->getFd(), pending.c_str(), pending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+			shutdown(clients_[i]->getFd(), SHUT_WR);
 			close(clients_[i]->getFd());
 			delete clients_[i];							//* Delete ClientConnection
 			
@@ -58,6 +133,15 @@ Server::~Server()
 		}
 	}
 
+	for (std::map<ClientConnection*, std::deque<ReplyStream*> >::iterator it = streams_.begin();
+		it != streams_.end(); ++it)
+		for (size_t i = 0; i < it->second.size(); ++i)
+			delete it->second[i];
+
+	//* CLEANUP REMOTE USERS (no connection of their own)
+	for (std::map<std::string, User*>::iterator it = remote_nicks_.begin(); it != remote_nicks_.end(); ++it)
+		delete it->second;
+
 	//* CLEANUP CHANNELS
 	for (size_t i = 0; i < channels_.size(); ++i)
 		delete channels_[i];
@@ -67,24 +151,86 @@ Server::~Server()
 //* SETUP - Uses SocketUtils for all socket operations
 //* ============================================================================
 
-bool Server::setupServerSocket()
+//* OPEN ONE LISTENER
+//* "*" = dual-stack [::] when the host has IPv6, plain 0.0.0.0 otherwise.
+bool Server::openListener(Listener& l)
 {
-	server_fd_ = SocketUtils::createServerSocket();               //* Create a non-blocking TCP socket for the server
-	if (server_fd_ < 0)
+	if (l.kind == Listener::LISTEN_UNIX)
+	{
+		l.fd = SocketUtils::createUnixSocket();
+		if (l.fd >= 0 && !SocketUtils::bindUnixSocket(l.fd, l.path))
+		{
+			close(l.fd);
+			l.fd = -1;
+		}
+	}
+	else
+	{
+		std::string host = l.host;
+		bool v6 = (host.find(':') != std::string::npos);
+		if (host == "*")
+		{
+			l.fd = SocketUtils::createServerSocket(AF_INET6);
+			host = (l.fd >= 0) ? "::" : "0.0.0.0";
+			v6 = (l.fd >= 0);
+		}
+		if (l.fd < 0)
+			l.fd = SocketUtils::createServerSocket(v6 ? AF_INET6 : AF_INET);   //* Create a non-blocking TCP socket
+		if (l.fd >= 0 && ((v6 && !SocketUtils::setV6Only(l.fd, l.v6only))
+			|| !SocketUtils::bindSocket(l.fd, host, l.port)))                 //* Bind socket to address + port
+		{
+			close(l.fd);
+			l.fd = -1;
+		}
+	}
+	if (l.fd < 0)
 		return (false);
-	
-	if (!SocketUtils::bindSocket(server_fd_, port_))              //* Bind socket to specified port (associates socket with network address)
+
+	if (!SocketUtils::listenSocket(l.fd, SOMAXCONN))        //* Mark socket as passive (ready to accept connections), SOMAXCONN = max queue size
 	{
-		close(server_fd_);
-		server_fd_ = -1;
+		close(l.fd);
+		l.fd = -1;
 		return (false);
 	}
+	if (l.acceptBudget == 0)
+		l.acceptBudget = config_.acceptBudget;
+
+	//* ADD LISTENER TO POLL
+	struct pollfd pfd;                     //* POSIX structure to monitor file descriptors for I/O events
+	pfd.fd = l.fd;                         //* Tell poll() which socket to monitor (a listening socket)
+	pfd.events = POLLIN;                   //* Register interest in read events (POLLIN = new connection ready)
+	pfd.revents = 0;                       //* Clear "returned events" field (poll() fills this with actual events that occurred)
+	poll_fds_.push_back(pfd);
+	return (true);
+}
 
-	if (!SocketUtils::listenSocket(server_fd_, SOMAXCONN))        //* Mark socket as passive (ready to accept connections), SOMAXCONN = max queue size
+//* SETUP LISTENERS
+//* All configured listeners must open, otherwise the server refuses to start
+//* (a silently missing port is worse than a clear startup failure).
+bool Server::setupListeners()
+{
+	listeners_ = config_.listeners;
+	bool hasClientListener = false;
+	for (size_t i = 0; i < listeners_.size(); ++i)
+		hasClientListener = hasClientListener || listeners_[i].role == Listener::ROLE_CLIENT;
+	if (!hasClientListener)
 	{
-		close(server_fd_);
-		server_fd_ = 1;
-		return (false);
+		Listener def;
+		def.host = "*";
+		def.port = port_;
+		listeners_.push_back(def);
+	}
+
+	for (size_t i = 0; i < listeners_.size(); ++i)
+	{
+		if (!openListener(listeners_[i]))
+		{
+			std::cerr << "[SERVER] Cannot listen on " << listeners_[i].describe() << std::endl;
+			return (false);
+		}
+		std::cout << "[SERVER] ✓ Listening on " << listeners_[i].describe()
+				  << (listeners_[i].role == Listener::ROLE_METRICS ? " [metrics]" : "")
+				  << " (fd=" << listeners_[i].fd << ", budget=" << listeners_[i].acceptBudget << ")" << std::endl;
 	}
 	return (true);
 }
@@ -93,16 +239,11 @@ bool Server::start()
 {
 	std::cout << "[SERVER] Starting..." << std::endl;
 
-	if (!setupServerSocket())
+	if (adopt_fd_ >= 0)
+		return (adoptUpgrade());
+	if (!setupListeners())
 		return (false);
 	
-	//* ADD SERVER SOCKET TO POLL
-	struct pollfd server_pfd;              //* POSIX structure to monitor file descriptors for I/O events
-	server_pfd.fd = server_fd_;            //* Tell poll() which socket to monitor (server's listening socket)
-	server_pfd.events = POLLIN;            //* Register interest in read events (POLLIN = data available to read = new connection ready)
-	server_pfd.revents = 0;                //* Clear "returned events" field (poll() fills this with actual events that occurred)
-	poll_fds_.push_back(server_pfd);       //* Add to vector so poll() can monitor server socket + all client sockets together (MULTIPLE USERS!)
-	
 	running_ = true;
 	std::cout << "[SERVER] ✓ Ready on port " << port_ << std::endl;
 	return (true);
@@ -113,6 +254,44 @@ void Server::stop()
     running_ = false;
 }
 
+void Server::requestReload()
+{
+    reload_pending_ = true;
+}
+
+//* RELOAD (SIGHUP)
+//* Re-reads the config file (if one was given) and rebuilds the preformatted
+//* welcome burst / MOTD. Runs from the main loop, never from the handler.
+void Server::reloadConfig()
+{
+    reload_pending_ = false;
+
+    if (!config_.path.empty())
+    {
+        ServerConfig fresh;
+        if (!fresh.load(config_.path))
+        {
+            std::cerr << "[SERVER] Reload failed, keeping current config" << std::endl;
+            return;
+        }
+        config_ = fresh;
+    }
+    welcome_.build(config_.motdFile, isupportTokens());
+    applyAddressLimits();
+    ClientConnection::setLaneLimits(config_.sendqControl, config_.sendqBulk);
+    profiler_.setBudgetMs(config_.loopBudgetMs);
+    for (size_t i = 0; i < channels_.size(); ++i)
+        channels_[i]->getHistory().setBudget(historyRingBytes());
+    history_store_.setLimits(config_.historySegments, config_.historyPerChannel);
+    std::cout << "[SERVER] Configuration reloaded (MOTD: " << welcome_.getMotdLineCount()
+              << " lines)" << std::endl;
+}
+
+void Server::applyAddressLimits()
+{
+    addresses_.setLimits(config_.maxPerIp, config_.connectRateLimit, config_.connectRateHalflife);
+}
+
 //* ============================================================================
 //* MAIN LOOP - SINGLE poll() (required by 42)
 //* ============================================================================
@@ -126,13 +305,35 @@ void Server::run()
 		//* WAIT FOR ACTIVITY on any socket (server + all clients)
 		//* poll() with "-1" blocks here until something happens
 		//* Returns: number of sockets with activity, or -1 on error
-		int poll_count = poll(&poll_fds_[0], poll_fds_.size(), -1);
+		//* Block forever unless a deadline is pending: then wake up at the
+		//* next second boundary so the timer wheel can tick
+		profiler_.begin();
+		int poll_count = poll(&poll_fds_[0], poll_fds_.size(),
+				stream_backlog_ ? 0 : (history_store_.pending() || upgrade_sock_ >= 0) ? 10
+			: (timers_.empty() && !capture_.active() && !config_.idleCompactSeconds
+				&& config_.snapshotFile.empty() && config_.connects.empty()) ? -1 : 1000);
+		profiler_.lap(LoopProfiler::PHASE_POLL);
+
+		if (reload_pending_)
+			reloadConfig();
+		if (drain_pending_ && !draining_)
+			startServerDrain();
+		if (latency_dump_pending_)
+			dumpCommandLatency();
+		if (flight_dump_pending_)
+		{
+			flight_dump_pending_ = false;
+			dumpFlightRecorder("signal");
+		}
 		
 		//* HANDLE POLL ERRORS
 		if (poll_count < 0)
 		{
 			if (errno == EINTR)              //* Interrupted by signal (e.g., Ctrl+C) - not fatal
+			{
+				profiler_.end();
 				continue;                     //* Restart poll() loop
+			}
 			std::cerr << "[ERROR] poll() failed" << std::endl; //* If it is other error...
 			break;                            //* Fatal error - exit loop
 		}
@@ -144,24 +345,67 @@ void Server::run()
         // y el siguiente elemento ocupa la posición actual 'i'.
 		for (size_t i = 0; i < poll_fds_.size(); /* vacío */)
         {
-            // Caso 1: Server Socket (Nuevas conexiones)
-            if (poll_fds_[i].fd == server_fd_)
+            // Caso 1: Listener (Nuevas conexiones)
+            Listener* listener = findListener(poll_fds_[i].fd);
+            if (listener)
             {
                 if (poll_fds_[i].revents & POLLIN)
-                    acceptNewConnections();
-                i++; // El server socket nunca se borra aquí
+                {
+                    acceptNewConnections(*listener);
+                    profiler_.lap(LoopProfiler::PHASE_ACCEPT, listener->fd);
+                }
+                i++; // Los listeners nunca se borran aquí
             }
+            // Sin eventos: nada que hacer (ni medir)
+            else if (poll_fds_[i].revents == 0)
+                i++;
             // Caso 2: Client Socket
             else
             {
                 // Si retorna false, el cliente fue borrado y 'poll_fds_' se redujo.
                 // No incrementamos 'i' porque el siguiente cliente ahora está en 'i'.
-                if (!handleClientEvent(i))
+                int fd = poll_fds_[i].fd;
+                bool alive = handleClientEvent(i);
+                profiler_.lap(LoopProfiler::PHASE_OTHER, fd);
+                if (!alive)
                     continue; 
                 
                 i++; // Cliente sigue vivo, pasamos al siguiente
             }
         }
+
+        //* Deadlines are checked after the events so poll indexes stay valid above
+        if (!timers_.empty())
+            expireTimers();
+        time_t now = std::time(NULL);
+        if (capture_.active() && now >= capture_.deadline())
+            stopCapture();
+        if (config_.idleCompactSeconds && now != last_compact_)
+            compactIdleConnections(now);
+        if (history_store_.pending())
+            history_store_.step(HISTORY_STEP_BYTES);
+        if (snapshot_pid_)
+            reapSnapshot(false);
+        else if (!draining_ && !config_.snapshotFile.empty() && now - last_snapshot_ >= (time_t)config_.snapshotInterval)
+            startSnapshot();
+        if (upgrade_sock_ >= 0)
+            pollUpgrade();
+        if (!config_.connects.empty())
+            connectLinks(now);
+
+        if (!streams_.empty())
+            pumpStreams();
+
+        //* Anyone may have queued output for anyone: ask for POLLOUT where needed
+        refreshPollEvents();
+
+        if (draining_)
+            checkServerDrain();
+
+        profiler_.lap(LoopProfiler::PHASE_OTHER);
+        unsigned long busy = profiler_.end();
+        if (config_.loopBudgetMs && busy > config_.loopBudgetMs * 1000000UL)
+            recorder_.record(FlightRecorder::EV_LOOP_STALL, -1, 0, 0, busy, 0);
     }
     std::cout << "[SERVER] Main loop ended" << std::endl;
 }
@@ -190,36 +434,471 @@ int Server::getClientCount() const
 //* the new client to both the clients_ vector and poll monitoring system.
 //* Uses non-blocking socket operations to accept multiple pending connections.
 
-void Server::acceptNewConnections()
+void Server::acceptNewConnections(Listener& listener)
 {
-	//* ACCEPT ALL PENDING CONNECTIONS in a loop (non-blocking)
-	while (true)
+	//* ACCEPT PENDING CONNECTIONS in a loop (non-blocking), at most 'acceptBudget'
+	//* per iteration: whatever is left stays in the kernel backlog, poll() reports
+	//* it again next round, and the other listeners/clients get their turn first
+	for (unsigned int accepted = 0; accepted < listener.acceptBudget; ++accepted)
 	{
 		std::string client_ip;                                             //* Will store client's IP address
-		int client_fd = SocketUtils::acceptClient(server_fd_, client_ip);  //* Accept one connection, get client socket fd and IP
+		NetAddress client_addr;                                            //* Binary key for per-source limits
+		int client_fd = SocketUtils::acceptClient(listener.fd, client_ip, client_addr); //* Accept one connection, get client socket fd and IP
 
 		//* BREAK if no more connections pending (non-blocking would return -1)
 		if (client_fd < 0)
 			break;
 
-		//* CREATE CLIENT CONNECTION OBJECT (manages socket I/O and buffers)
-		ClientConnection* connection = new ClientConnection(client_fd);
+		//* METRICS LISTENER: not an IRC client, no limits (loopback only)
+		if (listener.role == Listener::ROLE_METRICS)
+		{
+			serveScrape(client_fd, client_ip, client_addr);
+			continue;
+		}
 
-		//* CREATE USER OBJECT (stores IRC user data: nick, username, channels, etc.)
-		User* user = new User();
-		user->setHostname(client_ip);                                       //* Store client's IP address in user profile
-		user->setConnection(connection);                                    //* Link User -> ClientConnection (bidirectional relationship)
-		connection->setUser(user);                                          //* Link ClientConnection -> User
+		//* PRE-REGISTRATION CAP: half-open connections are cheap to open and
+		//* each one holds an fd + poll slot until the deadline, so bound them
+		if (unregistered_count_ >= config_.maxUnregistered)
+		{
+			rejectConnection(client_fd, ERROR_TOO_MANY_UNREGISTERED, REJECT_UNREGISTERED_CAP);
+			continue;
+		}
+
+		//* PER-SOURCE LIMITS: live connections and decaying connect rate.
+		//* Checked before anything is allocated for this client. Local
+		//* UNIX socket peers (bots) are trusted and not accounted.
+		client_addr.maskTo(config_.ipv6Cidr);
+		if (listener.kind != Listener::LISTEN_UNIX
+			&& !addresses_.tryAcquire(client_addr, std::time(NULL)))
+		{
+			bool overLive = config_.maxPerIp && addresses_.getLive(client_addr) >= config_.maxPerIp;
+			std::cout << "[SERVER] ✗ Rejected " << client_ip << " (fd=" << client_fd << "): "
+					  << (overLive ? "too many connections" : "throttled") << std::endl;
+			if (overLive)
+				rejectConnection(client_fd, ERROR_TOO_MANY_FROM_HOST, REJECT_PER_SOURCE);
+			else
+				rejectConnection(client_fd, ERROR_THROTTLED, REJECT_THROTTLED);
+			continue;
+		}
+
+		//* CREATE CLIENT CONNECTION OBJECT (manages socket I/O and buffers)
+		//* The User is allocated lazily on the first NICK/USER (see ensureUser),
+		//* so a connection that never speaks costs only this object.
+		ClientConnection* connection = new ClientConnection(client_fd, next_conn_id_++, client_ip, client_addr);
 
 		//* REGISTER CLIENT in server's client list
 		clients_.push_back(connection);                                     //* Add to vector for tracking all connected clients
+		if (by_fd_.size() <= static_cast<size_t>(client_fd))
+			by_fd_.resize(client_fd + 1, NULL);
+		by_fd_[client_fd] = connection;                                     //* O(1) fd -> connection
 		addClientToPoll(connection);                                        //* Add client's fd to poll_fds_ for I/O monitoring
+		unregistered_count_++;
+		g_metrics.accepted.inc();
+		recorder_.record(FlightRecorder::EV_ACCEPT, client_fd, connection->getId(), listener.kind, 0, 0);
+		capture_.open(connection->getId());
+
+		//* ARM REGISTRATION DEADLINE (validated against the connection id when it fires)
+		timers_.schedule(std::time(NULL), config_.registrationTimeout,
+			client_fd, connection->getId(), TimerWheel::REGISTRATION_DEADLINE);
 
 		std::cout << "[SERVER] ✓ New client from " << client_ip 
 				  << " (fd=" << client_fd << ", total=" << clients_.size() << ")" << std::endl;
 	}
 }
 
+//* REJECT CONNECTION
+//* Best-effort ERROR line on a socket we are not going to keep: one
+//* non-blocking send, no buffering, no ClientConnection/User allocated.
+void Server::rejectConnection(int fd, const std::string& errorLine, RejectReason reason)
+{
+	g_metrics.rejected[reason].inc();
+	recorder_.record(FlightRecorder::EV_REJECT, fd, 0, reason, 0, 0);
+	send(fd, errorLine.c_str(), errorLine.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+	close(fd);
+}
+
+//* ============================================================================
+//* METRICS
+//* ============================================================================
+
+//* SYNC METRIC GAUGES
+//* Gauges that are cheap to read from the server state are refreshed right
+//* before rendering instead of being maintained on every change.
+void Server::syncMetricGauges()
+{
+	g_metrics.clients.set(clients_.size());
+	g_metrics.unregistered.set(unregistered_count_);
+	g_metrics.channels.set(channels_.size());
+	g_metrics.addressEntries.set(addresses_.size());
+	g_metrics.links.set(link_table_.links().size());
+	g_metrics.remoteUsers.set(remote_nicks_.size());
+
+	//* Memory: one walk over everything, only when someone asks
+	long bytes[MEM_SUBSYSTEM_COUNT] = { 0 };
+	for (size_t i = 0; i < clients_.size(); ++i)
+	{
+		bytes[MEM_CONNECTIONS] += clients_[i]->memoryBytes();
+		bytes[MEM_QUEUES] += clients_[i]->bufferBytes();
+		if (clients_[i]->getUser())
+			bytes[MEM_USERS] += clients_[i]->getUser()->memoryBytes();
+	}
+	for (std::map<std::string, User*>::iterator it = remote_nicks_.begin(); it != remote_nicks_.end(); ++it)
+		bytes[MEM_USERS] += it->second->memoryBytes();
+	bytes[MEM_CONNECTIONS] += (clients_.capacity() + by_fd_.capacity()) * sizeof(ClientConnection*)
+		+ poll_fds_.capacity() * sizeof(struct pollfd);
+	for (size_t i = 0; i < channels_.size(); ++i)
+	{
+		bytes[MEM_CHANNELS] += channels_[i]->memoryBytes();
+		bytes[MEM_HISTORY] += channels_[i]->getHistory().bytes();
+	}
+	bytes[MEM_CHANNELS] += channels_.capacity() * sizeof(Channel*);
+	bytes[MEM_HISTORY] += history_store_.indexBytes();
+	g_metrics.historyDiskBytes.set(history_store_.diskBytes());
+	g_metrics.historySegments.set(history_store_.segmentCount());
+	g_metrics.historyCompactedRecords.set(history_store_.compactedRecords());
+
+	for (int i = 0; i < MEM_SUBSYSTEM_COUNT; ++i)
+		g_metrics.memoryBytes[i].set(bytes[i]);
+	g_metrics.memoryPerClient.set(clients_.empty() ? 0
+		: (bytes[MEM_CONNECTIONS] + bytes[MEM_QUEUES] + bytes[MEM_USERS]) / static_cast<long>(clients_.size()));
+}
+
+//* ISUPPORT (005) tokens advertised in the welcome burst
+std::string Server::isupportTokens() const
+{
+	std::ostringstream tokens;
+	tokens << "CHANMODES=beI,k,l,itu EXCEPTS INVEX MAXLIST=beI:" << config_.channelListLimit
+		<< " ELIST=CMNTU SAFELIST WHOX MONITOR=" << config_.monitorLimit;
+	if (config_.historyChannelBytes || history_store_.enabled())
+		tokens << " CHATHISTORY=" << config_.historyMaxLimit;
+	return (tokens.str());
+}
+
+//* HISTORY STORE (history_dir, startup only)
+//* Opening it rebuilds the per-channel index from the segments and resumes
+//* the msgid sequence where the previous run stopped. If it cannot be
+//* opened the server runs with the in-memory rings only.
+void Server::openHistoryStore()
+{
+	if (config_.historyDir.empty())
+		return;
+	std::string error;
+	if (!history_store_.open(config_.historyDir, config_.historySegmentBytes, config_.historySegments,
+			config_.historyPerChannel, error))
+	{
+		std::cerr << "[SERVER] History store disabled: " << error << std::endl;
+		return;
+	}
+	next_msgid_ = history_store_.lastMsgid() + 1;
+	std::cout << "[SERVER] History store " << config_.historyDir << ": " << history_store_.segmentCount()
+			  << " segments, next msgid " << next_msgid_ << std::endl;
+}
+
+//* SNAPSHOT (snapshot_file)
+//* Startup: channels come back empty, with their topic, modes, key, limit
+//* and invites; the operators of before get +o back when they rejoin.
+void Server::restoreSnapshot()
+{
+	if (config_.snapshotFile.empty())
+		return;
+	std::string error;
+	unsigned long nextMsgid = 0;
+	long startedMs = monotonicMs();
+	size_t before = channels_.size();
+	if (!StateSnapshot::load(config_.snapshotFile, channels_, nextMsgid, error))
+	{
+		std::cerr << "[SERVER] Snapshot not restored: " << error << std::endl;
+		return;
+	}
+	for (size_t i = before; i < channels_.size(); ++i)
+	{
+		channels_[i]->getHistory().setBudget(historyRingBytes());
+		channel_index_[channels_[i]->getName()] = channels_[i];
+		channels_[i]->setListIndex(&list_index_);
+	}
+	next_msgid_ = std::max(next_msgid_, nextMsgid);
+	std::cout << "[SERVER] Snapshot restored: " << channels_.size() - before << " channels in "
+			  << monotonicMs() - startedMs << " ms" << std::endl;
+}
+
+//* Synchronous, while the channels still have members: before a drain
+//* releases anyone, or from the destructor
+void Server::writeFinalSnapshot()
+{
+	final_snapshot_done_ = true;
+	reapSnapshot(true);
+	if (config_.snapshotFile.empty())
+		return;
+	std::string data;
+	StateSnapshot::encode(channels_, next_msgid_, data);
+	if (!StateSnapshot::writeFile(config_.snapshotFile, data))
+		std::cerr << "[SERVER] Snapshot " << config_.snapshotFile << " failed: " << std::strerror(errno) << std::endl;
+}
+
+//* Periodic: a fork()ed child encodes and writes it from a copy-on-write
+//* view of memory, so the loop only pays for the fork itself
+void Server::startSnapshot()
+{
+	last_snapshot_ = std::time(NULL);
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		std::cerr << "[SERVER] Snapshot: fork failed: " << std::strerror(errno) << std::endl;
+		return;
+	}
+	if (pid == 0)
+	{
+		//* Child: no destructors, no stdio buffers shared with the parent
+		std::string data;
+		StateSnapshot::encode(channels_, next_msgid_, data);
+		_exit(StateSnapshot::writeFile(config_.snapshotFile, data) ? 0 : 1);
+	}
+	snapshot_pid_ = pid;
+}
+
+void Server::reapSnapshot(bool wait)
+{
+	if (!snapshot_pid_)
+		return;
+	int status;
+	pid_t done = waitpid(snapshot_pid_, &status, wait ? 0 : WNOHANG);
+	if (done == 0)
+		return;
+	snapshot_pid_ = 0;
+	if (done < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		std::cerr << "[SERVER] Snapshot " << config_.snapshotFile << " failed" << std::endl;
+}
+
+//* With the store on, CHATHISTORY reads the mappings: the rings would only
+//* hold a second copy
+size_t Server::historyRingBytes() const
+{
+	return (history_store_.enabled() ? 0 : config_.historyChannelBytes);
+}
+
+//* IDLE COMPACTION
+//* Buffers keep the capacity of their biggest burst. Once a second, a slice
+//* of clients_ (resuming where the last one stopped) is checked, and
+//* connections quiet for idle_compact_seconds give that memory back. The
+//* slice is sized so a full pass takes about one idle period, with at least
+//* COMPACT_MIN_SLICE per step, so the cost stays flat at any client count.
+void Server::compactIdleConnections(time_t now)
+{
+	static const size_t COMPACT_MIN_SLICE = 256;
+
+	last_compact_ = now;
+	if (clients_.empty())
+		return;
+
+	size_t slice = clients_.size() / config_.idleCompactSeconds + 1;
+	if (slice < COMPACT_MIN_SLICE)
+		slice = COMPACT_MIN_SLICE;
+	if (slice > clients_.size())
+		slice = clients_.size();
+
+	for (size_t n = 0; n < slice; ++n)
+	{
+		if (compact_cursor_ >= clients_.size())
+			compact_cursor_ = 0;
+		ClientConnection* client = clients_[compact_cursor_++];
+		if (client->isClosed() || now - client->getLastActivity() < static_cast<time_t>(config_.idleCompactSeconds))
+			continue;
+
+		size_t freed = client->compactBuffers();
+		if (client->getUser())
+			freed += client->getUser()->compact();
+		if (freed)
+		{
+			g_metrics.compactions.inc();
+			g_metrics.compactedBytes.add(freed);
+		}
+	}
+}
+
+//* COMMAND LATENCY
+//* One line per command that has run at least once, HDR percentiles in ns
+void Server::formatCommandLatency(std::vector<std::string>& lines) const
+{
+	for (std::map<std::string, CommandEntry>::const_iterator it = _commandMap.begin(); it != _commandMap.end(); ++it)
+	{
+		const Histogram& h = *it->second.latency;
+		if (h.count() == 0)
+			continue;
+		std::ostringstream line;
+		line << it->first << " count=" << h.count() << " p50=" << h.percentile(0.50)
+			 << "ns p99=" << h.percentile(0.99) << "ns p999=" << h.percentile(0.999)
+			 << "ns max=" << h.max() << "ns";
+		lines.push_back(line.str());
+	}
+}
+
+void Server::requestLatencyDump()
+{
+	latency_dump_pending_ = true;
+}
+
+void Server::dumpCommandLatency()
+{
+	latency_dump_pending_ = false;
+	std::vector<std::string> lines;
+	formatCommandLatency(lines);
+	std::cout << "[STATS] Command latency (" << Clock::sourceName() << "):" << std::endl;
+	for (size_t i = 0; i < lines.size(); ++i)
+		std::cout << "[STATS]   " << lines[i] << std::endl;
+}
+
+//* ============================================================================
+//* FLIGHT RECORDER
+//* ============================================================================
+
+void Server::requestFlightDump()
+{
+	flight_dump_pending_ = true;
+}
+
+void Server::dumpFlightRecorder(const std::string& reason)
+{
+	if (!recorder_.enabled())
+		return;
+	std::string path;
+	last_flight_dump_ = std::time(NULL);
+	if (recorder_.dump(config_.flightDumpDir, reason, path))
+		std::cout << "[SERVER] Flight recorder dumped to " << path << " (" << reason << ")" << std::endl;
+	else
+		std::cerr << "[SERVER] Flight recorder dump failed: " << path << ": " << strerror(errno) << std::endl;
+}
+
+//* A burst of disconnects that are not QUIT/shutdown (resets, timeouts...)
+//* is exactly what the recorder is for: dump it while the cause is still in
+//* the ring. At most one automatic dump per minute.
+void Server::noteAbnormalDisconnect()
+{
+	time_t now = std::time(NULL);
+	if (now != burst_second_)
+	{
+		burst_second_ = now;
+		burst_count_ = 0;
+	}
+	if (++burst_count_ == config_.flightDumpBurst && now - last_flight_dump_ >= 60)
+		dumpFlightRecorder("burst");
+}
+
+//* START CAPTURE
+//* Connections already open are written first as a synthetic prologue
+//* (OPEN, PASS/NICK/USER, JOIN) so a replay starts from the same state.
+bool Server::startCapture(unsigned int seconds, std::string& path)
+{
+	if (!capture_.start(config_.captureDir, seconds, path))
+		return (false);
+
+	for (size_t i = 0; i < clients_.size(); ++i)
+	{
+		ClientConnection* client = clients_[i];
+		if (client->getKind() != ClientConnection::KIND_CLIENT || client->isClosed())
+			continue;
+		capture_.prologue(client->getId(), "");
+		User* user = client->getUser();
+		if (!user)
+			continue;
+		if (client->hasSentPass())
+			capture_.prologue(client->getId(), "PASS *");
+		if (!user->getNickname().empty())
+			capture_.prologue(client->getId(), "NICK " + user->getNickname());
+		if (!user->getUsername().empty())
+			capture_.prologue(client->getId(), "USER " + user->getUsername() + " 0 * :" + user->getRealname());
+
+		const std::vector<Channel*>& channels = user->getChannels();
+		std::string join;
+		for (size_t c = 0; c < channels.size(); ++c)
+			join += (join.empty() ? "JOIN " : ",") + channels[c]->getName();
+		if (!join.empty())
+			capture_.prologue(client->getId(), join);
+	}
+	std::cout << "[SERVER] Capturing traffic to " << path << " for " << seconds << "s" << std::endl;
+	return (true);
+}
+
+void Server::stopCapture()
+{
+	if (!capture_.active())
+		return;
+	unsigned long records = capture_.records();
+	unsigned long bytes = capture_.bytes();
+	capture_.stop();
+	std::cout << "[SERVER] Capture finished: " << records << " records, " << bytes << " bytes" << std::endl;
+}
+
+void Server::renderMetrics(std::string& out)
+{
+	syncMetricGauges();
+	g_metrics.registry.renderText(out);
+}
+
+//* SERVE SCRAPE
+//* Metrics listener: whatever the request says, the answer is the full text
+//* exposition. It goes through the normal drain path (flush, FIN, read the
+//* request away until EOF) so a large reply is not cut by a RST.
+void Server::serveScrape(int fd, const std::string& host, const NetAddress& addr)
+{
+	ClientConnection* connection = new ClientConnection(fd, next_conn_id_++, host, addr);
+	connection->setKind(ClientConnection::KIND_SCRAPE);
+	clients_.push_back(connection);
+	if (by_fd_.size() <= static_cast<size_t>(fd))
+		by_fd_.resize(fd + 1, NULL);
+	by_fd_[fd] = connection;
+	addClientToPoll(connection);
+	g_metrics.scrapes.inc();
+
+	std::string body;
+	renderMetrics(body);
+	std::ostringstream head;
+	head << "HTTP/1.0 200 OK\r\n"
+		 << "Content-Type: text/plain; version=0.0.4\r\n"
+		 << "Content-Length: " << body.size() << "\r\n"
+		 << "Connection: close\r\n\r\n";
+	connection->queueSend(head.str() + body);
+	connection->closeConnection("Metrics scrape");
+	beginDrain(poll_fds_.size() - 1, connection);
+}
+
+//* ============================================================================
+//* TIMERS
+//* ============================================================================
+
+//* EXPIRE TIMERS
+//* Fires every deadline that is due. Timers are never cancelled, so each one
+//* is re-validated: same fd AND same connection id AND condition still true.
+void Server::expireTimers()
+{
+	std::vector<TimerWheel::Timer> expired;
+	timers_.advance(std::time(NULL), expired);
+
+	for (size_t i = 0; i < expired.size(); ++i)
+	{
+		ClientConnection* client = findClientByFd(expired[i].fd);
+		if (!client || client->getId() != expired[i].connId)
+			continue;
+
+		if (expired[i].kind == TimerWheel::REGISTRATION_DEADLINE && !client->isRegistered()
+			&& !client->isDraining() && client->getKind() == ClientConnection::KIND_CLIENT)
+		{
+			std::cout << "[SERVER] Client fd=" << client->getFd() << " registration timed out" << std::endl;
+			client->queueSend("ERROR :Closing Link: " + client->getHost() + " (Registration timed out)\r\n");
+			client->closeConnection("Registration timed out", DISC_REGISTRATION_TIMEOUT);
+			beginDrain(findPollIndex(client->getFd()), client);
+		}
+		else if (expired[i].kind == TimerWheel::DRAIN_DEADLINE && client->isDraining())
+		{
+			std::cout << "[SERVER] Client fd=" << client->getFd() << " drain timed out ("
+					  << client->getSendQueueSize() << " bytes dropped)" << std::endl;
+			g_metrics.drainTimeouts.inc();
+			recorder_.record(FlightRecorder::EV_DRAIN_TIMEOUT, client->getFd(), client->getId(), 0, 0,
+				client->getSendQueueSize());
+			disconnectClient(findPollIndex(client->getFd()));
+		}
+	}
+}
+
 //* ============================================================================
 //* HANDLE CLIENT EVENTS
 //* ============================================================================
@@ -232,11 +911,17 @@ void Server::acceptNewConnections()
 //* 2. Incoming data ready to read (POLLIN)
 //* 3. Socket ready for writing (POLLOUT)
 //* Manages the complete client I/O lifecycle: receive -> buffer -> parse -> respond
+//* A connection marked closed is not dropped here: it goes through beginDrain()
+//* so whatever it has queued (ERROR line, last replies) still reaches the peer.
 
 bool Server::handleClientEvent(size_t poll_index)
 {
     int fd = poll_fds_[poll_index].fd;
     short revents = poll_fds_[poll_index].revents;
+
+    if (revents == 0)
+        return true; // Nada que hacer (POLLOUT se recalcula en refreshPollEvents)
+
     ClientConnection* client = findClientByFd(fd);
 
     // Seguridad: Si no encontramos el objeto cliente pero está en poll, lo sacamos
@@ -248,10 +933,15 @@ bool Server::handleClientEvent(size_t poll_index)
         return false; // Cliente eliminado
     }
 
+    if (client->isDraining())
+        return handleDrainingEvent(poll_index, client);
+
     // 1. GESTIÓN DE ERRORES DE POLL
-    if (revents & (POLLERR | POLLHUP | POLLNVAL))
+    // POLLHUP with POLLIN still has data to read: let recv() see the EOF
+    if ((revents & (POLLERR | POLLNVAL)) || ((revents & POLLHUP) && !(revents & POLLIN)))
     {
         std::cout << "[SERVER] Client fd=" << fd << " disconnected (POLLHUP/ERR)" << std::endl;
+        client->closeConnection("Connection reset by peer", DISC_ERROR);
         disconnectClient(poll_index);
         return false; // Cliente eliminado
     }
@@ -261,33 +951,28 @@ bool Server::handleClientEvent(size_t poll_index)
     {
         char buffer[4096];
         ssize_t bytes = recv(fd, buffer, sizeof(buffer) - 1, 0); // No usamos SocketUtils para simplificar lógica aquí o úsalo si prefieres
+        profiler_.lap(LoopProfiler::PHASE_READ, fd);
 
         if (bytes > 0)
         {
             buffer[bytes] = '\0';
+            g_metrics.bytesIn.add(bytes);
             client->appendRecvData(std::string(buffer, bytes));
             client->updateActivity();
             processClientCommands(client);
-            
-            // [CORRECCION ZOMBIE] 
-            // Verificamos si un comando (ej: QUIT) marcó la conexión para cierre
-            if (client->isClosed())
-            {
-                disconnectClient(poll_index);
-                return false; // Cliente eliminado
-            }
         }
         else if (bytes == 0) // Conexión cerrada por el par
         {
+            // Half-close: the peer may still be reading, flush what is queued
             std::cout << "[SERVER] Client fd=" << fd << " closed connection gracefully" << std::endl;
-            disconnectClient(poll_index);
-            return false; // Cliente eliminado
+            client->closeConnection("Connection closed");
         }
         else // Error en recv
         {
             if (errno != EAGAIN && errno != EWOULDBLOCK)
             {
                 std::cerr << "[SERVER] recv() error on fd=" << fd << ": " << strerror(errno) << std::endl;
+                client->closeConnection(std::string("Read error: ") + strerror(errno), DISC_ERROR);
                 disconnectClient(poll_index);
                 return false; // Cliente eliminado
             }
@@ -297,33 +982,226 @@ bool Server::handleClientEvent(size_t poll_index)
     // 3. ESCRITURA (POLLOUT)
     // Solo intentamos escribir si el socket está listo Y hay datos pendientes
     if ((revents & POLLOUT) && client->hasPendingSend())
-    {
         sendPendingData(client);
-        
-        // Verificar de nuevo si hubo error fatal durante el envío
-        if (client->isClosed())
+
+    // [CORRECCION ZOMBIE]
+    // Un comando (QUIT, PASS incorrecto) o el par marcó la conexión para cierre:
+    // se vacía la cola de salida antes de cerrar
+    if (client->isClosed())
+        return beginDrain(poll_index, client);
+
+    return true; // Cliente sigue vivo
+}
+
+//* ============================================================================
+//* DRAINING (flush-before-close)
+//* ============================================================================
+//* Closing sequence for a connection that still has output queued:
+//*   1. releaseUser(): QUIT to channels, User freed, nick available again
+//*   2. flush: POLLOUT only, input ignored, until both output lanes are empty
+//*   3. shutdown(SHUT_WR): FIN goes out after the last byte
+//*   4. linger: read and discard until the peer's EOF, then close(). Closing
+//*      with unread input would send a RST that can destroy the data still
+//*      in flight, which is exactly the ERROR line we wanted to deliver.
+//* Every step is bounded by the DRAIN_DEADLINE timer (drain_timeout).
+
+bool Server::beginDrain(size_t poll_index, ClientConnection* client)
+{
+    if (client->isDraining())
+        return true;
+
+    if (!client->hasPendingSend())
+    {
+        disconnectClient(poll_index);
+        return false;
+    }
+
+    releaseUser(client);
+
+    time_t now = std::time(NULL);
+    client->startDraining(now + config_.drainTimeout);
+    timers_.schedule(now, config_.drainTimeout, client->getFd(), client->getId(), TimerWheel::DRAIN_DEADLINE);
+    poll_fds_[poll_index].events = POLLOUT;
+    return true;
+}
+
+bool Server::handleDrainingEvent(size_t poll_index, ClientConnection* client)
+{
+    short revents = poll_fds_[poll_index].revents;
+
+    if (revents & (POLLERR | POLLNVAL))
+    {
+        disconnectClient(poll_index);
+        return false;
+    }
+
+    if (!client->isLingering())
+    {
+        if (revents & (POLLOUT | POLLHUP))
+            sendPendingData(client);
+        if (client->hasPendingSend() && !(revents & POLLHUP))
+            return true;
+
+        //* Flushed (or the peer is gone): send FIN after the last byte
+        if (revents & POLLHUP)
         {
             disconnectClient(poll_index);
             return false;
         }
+        shutdown(client->getFd(), SHUT_WR);
+        client->startLingering();
+        poll_fds_[poll_index].events = POLLIN;
+        return true;
     }
 
-    // [ACTUALIZAR POLL EVENTS]
-    // Si el cliente sigue vivo, actualizamos qué eventos nos interesan.
-    // Siempre POLLIN. Solo POLLOUT si hay datos en el buffer de salida.
-    if (client->hasPendingSend())
-        poll_fds_[poll_index].events = POLLIN | POLLOUT;
-    else
-        poll_fds_[poll_index].events = POLLIN;
+    //* Lingering: discard whatever the peer still sends until its EOF
+    //* (one read per event, a chatty peer cannot pin the loop here)
+    char scratch[4096];
+    ssize_t bytes = recv(client->getFd(), scratch, sizeof(scratch), 0);
+    if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK) || (revents & POLLHUP))
+    {
+        disconnectClient(poll_index);
+        return false;
+    }
+    return true;
+}
 
-    return true; // Cliente sigue vivo
+//* ============================================================================
+//* SERVER-WIDE DRAIN (SIGTERM)
+//* ============================================================================
+
+void Server::requestDrain()
+{
+    //* Second SIGTERM while draining: stop now
+    if (drain_pending_)
+        running_ = false;
+    drain_pending_ = true;
+}
+
+//* Stop accepting, tell every client, and let the normal drain path flush them.
+//* run() exits once every connection is gone or shutdown_timeout expires.
+void Server::startServerDrain()
+{
+    draining_ = true;
+    drain_started_ms_ = monotonicMs();
+    std::cout << "[SERVER] Draining " << clients_.size() << " clients (timeout "
+              << config_.shutdownTimeout << "s)" << std::endl;
+
+    for (size_t i = 0; i < listeners_.size(); ++i)
+    {
+        size_t idx = findPollIndex(listeners_[i].fd);
+        if (idx < poll_fds_.size())
+            poll_fds_.erase(poll_fds_.begin() + idx);
+        close(listeners_[i].fd);
+        if (listeners_[i].kind == Listener::LISTEN_UNIX)
+            unlink(listeners_[i].path.c_str());
+    }
+    listeners_.clear();
+
+    //* Before anyone is released: every channel emptied is destroyed
+    writeFinalSnapshot();
+
+    //* Copy: beginDrain() may remove clients from clients_
+    std::vector<ClientConnection*> snapshot = clients_;
+    for (size_t i = 0; i < snapshot.size(); ++i)
+    {
+        ClientConnection* client = snapshot[i];
+        if (client->isDraining())
+            continue;
+        client->queueSend("ERROR :Closing Link: " + client->getHost() + " (Server shutting down)\r\n");
+        client->closeConnection("Server shutting down", DISC_SHUTDOWN);
+        beginDrain(findPollIndex(client->getFd()), client);
+    }
+    checkServerDrain();
+}
+
+void Server::checkServerDrain()
+{
+    long elapsed = monotonicMs() - drain_started_ms_;
+    bool expired = elapsed >= static_cast<long>(config_.shutdownTimeout) * 1000;
+    if (!clients_.empty() && !expired)
+        return;
+
+    last_drain_ms_ = elapsed;
+    std::cout << "[SERVER] Drain finished in " << elapsed << " ms";
+    if (!clients_.empty())
+        std::cout << " (" << clients_.size() << " clients still pending, closing them)";
+    std::cout << std::endl;
+    running_ = false;
+}
+
+long Server::getLastDrainMs() const
+{
+    return (last_drain_ms_);
 }
 
 //* ============================================================================
 //* DISCONNECT CLIENT
 //* ============================================================================
 
+//* RELEASE USER
+//* Drops the IRC side of a connection: QUIT to every shared channel, channel
+//* membership, empty channels, the User itself. The socket is left alone
+//* (it may still be draining). Safe to call twice.
+void Server::releaseUser(ClientConnection* client)
+{
+    User* user = client->getUser();
+
+    // Un enlace con otro servidor: sus servidores y usuarios se van con él
+    dropLink(client);
+    if (client->getKind() == ClientConnection::KIND_SERVER)
+        return;
+
+    if (client->getKind() == ClientConnection::KIND_CLIENT && !client->isRegistered()
+        && !client->isDraining() && unregistered_count_ > 0)
+        unregistered_count_--;
+    monitor_.clear(client);
+    bool wasRegistered = client->isRegistered();
+    client->setRegistered(false);   // A partir de aquí nadie debe encontrarlo por nick
+    endStream(client);
+
+    if (!user)
+        return;
+
+    // A. LIMPIEZA DE CANALES
+    // Hacemos una COPIA del vector de canales porque vamos a modificar
+    std::vector<Channel*> userChannels = user->getChannels();
+    std::string quitMsg = ":" + user->getPrefix() + " QUIT :" + client->getCloseReason() + "\r\n";
+    if (!user->getUid().empty())
+    {
+        sendToLinks(":" + user->getUid() + " QUIT :" + client->getCloseReason() + "\r\n", NULL);
+        uids_.erase(user->getUid());
+    }
+
+    for (std::vector<Channel*>::iterator it = userChannels.begin(); it != userChannels.end(); ++it)
+    {
+        Channel* channel = *it;
+
+        // 1. Notificar a los demás (QUIT message; en +u solo a los OPs)
+        channel->broadcastPresence(quitMsg, user, user);
+
+        // 2. Eliminar al usuario del canal
+        channel->removeMember(user);
+
+        // 3. Gestionar canales vacíos (Evitar fugas de memoria en canales)
+        if (channel->getUserCount() == 0)
+            destroyChannel(channel);    // Lo saca de la lista global y del índice
+    }
+
+    // B. MONITOR: quien lo vigila lo ve irse, una sola vez y detrás del QUIT
+    if (wasRegistered)
+        notifyMonitors(user, false);
+
+    std::map<std::string, User*>::iterator nick = nicks_.find(user->getNickname());
+    if (nick != nicks_.end() && nick->second == user)
+        nicks_.erase(nick);
+    client->setUser(NULL);
+    delete user; // El User debe borrarse manualmente
+}
 
+//* DISCONNECT CLIENT
+//* Immediate close: no flushing. Used for dead sockets and by the drain path
+//* once the output is gone (or its deadline passed).
 void Server::disconnectClient(size_t poll_index)
 {
     // 1. Obtener información básica antes de borrar nada
@@ -335,40 +1213,7 @@ void Server::disconnectClient(size_t poll_index)
     // 2. Si el cliente existe, limpiar lógica de IRC y objetos
     if (client)
     {
-        User* user = client->getUser();
-        if (user)
-        {
-            // A. LIMPIEZA DE CANALES
-            // Hacemos una COPIA del vector de canales porque vamos a modificar
-            std::vector<Channel*> userChannels = user->getChannels();
-
-            for (std::vector<Channel*>::iterator it = userChannels.begin(); it != userChannels.end(); ++it)
-            {
-                Channel* channel = *it;
-
-                // 1. Notificar a los demás (QUIT message)
-                std::string quitMsg = ":" + user->getPrefix() + " QUIT :Connection closed\r\n";
-                channel->broadcast(quitMsg, user);
-
-                // 2. Eliminar al usuario del canal
-                channel->removeMember(user);
-
-                // 3. Gestionar canales vacíos (Evitar fugas de memoria en canales)
-                if (channel->getUserCount() == 0)
-                {
-                    // Buscar y borrar el canal de la lista global del servidor
-                    for (std::vector<Channel*>::iterator chanIt = channels_.begin(); chanIt != channels_.end(); ++chanIt)
-                    {
-                        if (*chanIt == channel)
-                        {
-                            delete *chanIt;
-                            channels_.erase(chanIt);
-                            break; 
-                        }
-                    }
-                }
-            }
-        }
+        releaseUser(client);
 
         // B. ELIMINAR DE LA LISTA DE CLIENTES DEL SERVIDOR
         // (Usamos un bucle manual para encontrar y borrar el puntero en el vector)
@@ -380,11 +1225,21 @@ void Server::disconnectClient(size_t poll_index)
                 break;
             }
         }
+        by_fd_[fd] = NULL;
+        if (client->getKind() == ClientConnection::KIND_CLIENT)
+        {
+            addresses_.release(client->getAddress());
+            g_metrics.disconnects[client->getCloseCause()].inc();
+            recorder_.record(FlightRecorder::EV_DISCONNECT, fd, client->getId(), client->getCloseCause(), 0,
+                client->getSendQueueSize());
+            if (client->getCloseCause() != DISC_QUIT && client->getCloseCause() != DISC_SHUTDOWN
+                && client->getCloseCause() != DISC_KILLED)
+                noteAbnormalDisconnect();
+            capture_.close(client->getId());
+        }
 
         // C. CERRAR SOCKET Y LIBERAR MEMORIA
         close(fd);
-        if (user)
-            delete user; // El User debe borrarse manualmente
         delete client;   // Borramos la conexión
     }
     else
@@ -407,9 +1262,11 @@ void Server::processClientCommands(ClientConnection* client)
 {
     // Procesamos TODAS las líneas completas que haya en el buffer
     // (Importante por si llegaron varios comandos pegados)
-    while (client->hasCompleteLine())
+    // Tras un QUIT (o PASS incorrecto) lo que venga detrás se ignora
+    while (!client->isClosed() && client->hasCompleteLine())
     {
         std::string rawLine = client->popLine();
+        g_metrics.linesIn.inc();
         
         // Debug opcional
         // std::cout << "[DEBUG] < " << rawLine << std::endl;
@@ -420,39 +1277,215 @@ void Server::processClientCommands(ClientConnection* client)
         // 2. Si el comando está vacío (línea en blanco o solo espacios), ignoramos
         if (msg.command.empty())
             continue;
+        capture_.line(client->getId(), msg.command, rawLine);
+
+        // Otro servidor (o uno que ya presentó PASS ... TS): protocolo de enlace
+        if (client->getKind() == ClientConnection::KIND_SERVER || link_table_.session(client))
+        {
+            handleLinkMessage(client, msg);
+            continue;
+        }
+
+        // 3. Antes de registrarse solo se aceptan los comandos de registro
+        //    (el resto asume que existe un User completo)
+        if (!client->isRegistered() && msg.command != "PASS" && msg.command != "NICK"
+            && msg.command != "USER" && msg.command != "CAP" && msg.command != "QUIT"
+            && msg.command != "PING" && msg.command != "PONG" && msg.command != "SERVER")
+        {
+            sendError(client, ERR_NOTREGISTERED, "");
+            g_metrics.notRegistered.inc();
+            continue;
+        }
 
-        // 3. Buscamos el comando en el mapa
-        std::map<std::string, CommandHandler>::iterator it = _commandMap.find(msg.command);
+        // 4. Buscamos el comando en el mapa
+        std::map<std::string, CommandEntry>::iterator it = _commandMap.find(msg.command);
 
         if (it != _commandMap.end())
         {
             // Encontrado = Ejecutamos la función asociada
-            (this->*(it->second))(client, msg);
+            // Tiempo del handler completo, incluido el fan-out que encola
+            // (las vueltas del profiler dan el inicio y el final)
+            it->second.calls->inc();
+            unsigned long started = profiler_.lap(LoopProfiler::PHASE_PARSE, client->getFd());
+            (this->*(it->second.handler))(client, msg);
+            unsigned long finished = profiler_.lap(LoopProfiler::PHASE_DISPATCH, client->getFd(), it->first.c_str());
+            unsigned long elapsed = Clock::toNs(finished - started);
+            if (config_.commandTiming)
+                it->second.latency->record(elapsed);
+            recorder_.record(FlightRecorder::EV_COMMAND, client->getFd(), client->getId(), it->second.id,
+                elapsed, client->getSendQueueSize());
         }
         else
         {
             // COMANDO NO ENCONTRADO
             // Deberia enviar ERR_UNKNOWNCOMMAND (421)
             // Por ahora, un log simple:
+            g_metrics.unknownCommands.inc();
+            recorder_.record(FlightRecorder::EV_COMMAND, client->getFd(), client->getId(),
+                FlightRecorder::CODE_UNKNOWN, 0, client->getSendQueueSize());
             std::cerr << "[SERVER] Unknown command: " << msg.command << std::endl;
         }
     }
 }
 
+// Un solo sendmsg con las dos colas: control delante de bulk (ver prepareSend)
 void Server::sendPendingData(ClientConnection* client)
 {
-    const std::string& data = client->getSendBuffer();
-    if (data.empty()) return;
+    struct iovec iov[ClientConnection::SEND_IOV_MAX];
+    int count = client->prepareSend(iov);
+    if (count == 0) return;
 
-    // Enviar datos usando SocketUtils o send directamente
-    ssize_t bytesSent = send(client->getFd(), data.c_str(), data.length(), 0);
+    struct msghdr hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = count;
+    ssize_t bytesSent = sendmsg(client->getFd(), &hdr, MSG_NOSIGNAL);
+    profiler_.lap(LoopProfiler::PHASE_FLUSH, client->getFd());
 
     if (bytesSent > 0)
     {
         // Limpiar del buffer los bytes que ya se enviaron
+        size_t before[LANE_COUNT];
+        for (int i = 0; i < LANE_COUNT; ++i)
+            before[i] = client->getLaneSize(static_cast<OutputLane>(i));
         client->clearSentData(bytesSent);
+        for (int i = 0; i < LANE_COUNT; ++i)
+            g_metrics.laneBytesOut[i].add(before[i] - client->getLaneSize(static_cast<OutputLane>(i)));
+        g_metrics.bytesOut.add(bytesSent);
+    }
+    else if (bytesSent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+        // Error real (EPIPE, ECONNRESET): nada de lo pendiente llegará ya
+        client->clearSentData(client->getSendQueueSize());
+        client->closeConnection(std::string("Write error: ") + strerror(errno), DISC_ERROR);
     }
 }
+//* ============================================================================
+//* STREAMED REPLIES
+//* ============================================================================
+
+//* Replies held between two streams (see startStream), served as one more
+namespace
+{
+    class HeldReplies : public ReplyStream
+    {
+        public:
+            HeldReplies(const std::string& text) : text_(text), pos_(0) {}
+            bool fill(std::string& out, size_t budget)
+            {
+                // Se corta en un final de línea
+                size_t cut = (budget < text_.size() - pos_) ? pos_ + budget : text_.size();
+                size_t end = text_.find('\n', cut - 1);
+                end = (end == std::string::npos) ? text_.size() : end + 1;
+                out.append(text_, pos_, end - pos_);
+                pos_ = end;
+                return pos_ < text_.size();
+            }
+        private:
+            std::string text_;
+            size_t      pos_;
+    };
+}
+
+//* Streams queue per client: replies come out in the order of the commands
+//* (a bot's WHO for every channel it joins gets every answer). The first
+//* chunk goes out right away; while a stream is served the client's other
+//* replies are held behind it, and those held before a second stream are
+//* queued as a stream of their own, ahead of it
+void Server::startStream(ClientConnection* client, ReplyStream* stream)
+{
+    std::map<ClientConnection*, std::deque<ReplyStream*> >::iterator it = streams_.find(client);
+    if (it != streams_.end())
+    {
+        std::string held = client->takeHeldReplies();
+        if (!held.empty())
+            it->second.push_back(new HeldReplies(held));
+        it->second.push_back(stream);
+        return;
+    }
+
+    std::string out;
+    bool more = stream->fill(out, STREAM_CHUNK);
+    client->queueStreamOutput(out);
+    if (!more)
+    {
+        delete stream;
+        return;
+    }
+    streams_[client].push_back(stream);
+    client->holdReplies();
+}
+
+void Server::endStream(ClientConnection* client)
+{
+    std::map<ClientConnection*, std::deque<ReplyStream*> >::iterator it = streams_.find(client);
+    if (it == streams_.end())
+        return;
+    for (size_t i = 0; i < it->second.size(); ++i)
+        delete it->second[i];
+    streams_.erase(it);
+    client->releaseReplies();
+}
+
+//* Once per loop iteration, after the events: the first chunk goes out in
+//* the same iteration as the command, the next ones as the client reads
+void Server::pumpStreams()
+{
+    stream_backlog_ = false;
+    std::map<ClientConnection*, std::deque<ReplyStream*> >::iterator it = streams_.begin();
+    while (it != streams_.end())
+    {
+        ClientConnection* client = it->first;
+        std::deque<ReplyStream*>& queue = it->second;
+        std::string out;
+        bool pending = false;
+        // Un stream que termina deja sitio al siguiente en la misma vuelta.
+        // Son respuestas a un comando: van por control, en orden con las demás
+        while (!queue.empty() && client->getLaneSize(LANE_CONTROL) + out.size() < STREAM_LOW_WATER)
+        {
+            bool more = queue.front()->fill(out, STREAM_CHUNK);
+            if (more)
+            {
+                pending = true;
+                break;
+            }
+            delete queue.front();
+            queue.pop_front();
+        }
+        if (!out.empty())
+            client->queueStreamOutput(out);
+        else if (pending)
+            stream_backlog_ = true;     // Solo ha recorrido entradas sin coincidencias
+        if (queue.empty())
+        {
+            client->releaseReplies();   // Lo retenido sale detrás, en orden
+            streams_.erase(it++);
+        }
+        else
+            ++it;
+    }
+}
+
+//* UPGRADE: streams are not handed over, whatever is left goes to the SendQ
+void Server::finishStreams()
+{
+    for (std::map<ClientConnection*, std::deque<ReplyStream*> >::iterator it = streams_.begin();
+        it != streams_.end(); ++it)
+    {
+        std::string out;
+        for (size_t i = 0; i < it->second.size(); ++i)
+        {
+            while (it->second[i]->fill(out, static_cast<size_t>(-1)))
+                ;
+            delete it->second[i];
+        }
+        it->first->queueStreamOutput(out);
+        it->first->releaseReplies();
+    }
+    streams_.clear();
+    stream_backlog_ = false;
+}
+
 //* ============================================================================
 //* UTILITIES
 //* ============================================================================
@@ -478,33 +1511,129 @@ void Server::updatePollEvents(int fd, short events)
 	}
 }
 
-ClientConnection* Server::findClientByFd(int fd)
+size_t Server::findPollIndex(int fd) const
 {
-	for (size_t i = 0; i < clients_.size(); ++i) //* Just looking in the vector<ClientConnection*> if there is that client.
+	for (size_t i = 0; i < poll_fds_.size(); ++i)
 	{
-		if (clients_[i] && clients_[i]->getFd() == fd) 
-			return (clients_[i]);
+		if (poll_fds_[i].fd == fd)
+			return (i);
+	}
+	return (poll_fds_.size());
+}
+
+//* LAZY USER ALLOCATION
+//* The IRC identity only exists once the client starts registering.
+User* Server::ensureUser(ClientConnection* client)
+{
+	if (!client->getUser())
+	{
+		User* user = new User();
+		user->setHostname(client->getHost());
+		user->setServer(server_name_, 0);
+		user->setConnection(client);
+		client->setUser(user);
+	}
+	return (client->getUser());
+}
+
+Listener* Server::findListener(int fd)
+{
+	for (size_t i = 0; i < listeners_.size(); ++i)
+	{
+		if (listeners_[i].fd == fd)
+			return (&listeners_[i]);
 	}
 	return (NULL);
 }
 
+ClientConnection* Server::findClientByFd(int fd)
+{
+	//* by_fd_ is indexed by fd: no scan over clients_
+	if (fd < 0 || static_cast<size_t>(fd) >= by_fd_.size())
+		return (NULL);
+	return (by_fd_[fd]);
+}
+
+//* REFRESH POLL EVENTS
+//* A command from one client can queue output on any other (broadcast), so
+//* after each round every live connection asks for POLLOUT iff it has
+//* something pending. Draining connections manage their own events.
+void Server::refreshPollEvents()
+{
+	for (size_t i = 0; i < poll_fds_.size(); ++i)
+	{
+		ClientConnection* client = findClientByFd(poll_fds_[i].fd);
+		if (!client || client->isDraining())
+			continue;
+		poll_fds_[i].events = client->hasPendingSend() ? (POLLIN | POLLOUT) : POLLIN;
+	}
+}
+
+void Server::addCommand(const std::string& name, CommandHandler handler)
+{
+    CommandEntry entry;
+    entry.handler = handler;
+    entry.calls = NULL;
+    entry.latency = NULL;
+    entry.id = 0;
+    _commandMap[name] = entry;
+}
+
 void Server::initCommands()
 {
     // Mapeamos el string del comando a la función miembro correspondiente
-    _commandMap["PASS"] = &Server::cmdPass;
-    _commandMap["NICK"] = &Server::cmdNick;
-    _commandMap["USER"] = &Server::cmdUser;
-    _commandMap["PING"] = &Server::cmdPing;
-    _commandMap["PONG"] = &Server::cmdPong;
-    _commandMap["QUIT"] = &Server::cmdQuit;
-    _commandMap["JOIN"] = &Server::cmdJoin;
-    _commandMap["PART"] = &Server::cmdPart;
-    _commandMap["PRIVMSG"] = &Server::cmdPrivMsg;
-    _commandMap["NOTICE"] = &Server::cmdNotice;
-    _commandMap["KICK"] = &Server::cmdKick;
-    _commandMap["INVITE"] = &Server::cmdInvite;
-    _commandMap["TOPIC"] = &Server::cmdTopic;
-    _commandMap["MODE"] = &Server::cmdMode;
+    addCommand("PASS", &Server::cmdPass);
+    addCommand("NICK", &Server::cmdNick);
+    addCommand("USER", &Server::cmdUser);
+    addCommand("CAP", &Server::cmdCap);
+    addCommand("PING", &Server::cmdPing);
+    addCommand("PONG", &Server::cmdPong);
+    addCommand("QUIT", &Server::cmdQuit);
+    addCommand("MOTD", &Server::cmdMotd);
+    addCommand("JOIN", &Server::cmdJoin);
+    addCommand("PART", &Server::cmdPart);
+    addCommand("PRIVMSG", &Server::cmdPrivMsg);
+    addCommand("NOTICE", &Server::cmdNotice);
+    addCommand("CHATHISTORY", &Server::cmdChatHistory);
+    addCommand("LIST", &Server::cmdList);
+    addCommand("WHO", &Server::cmdWho);
+    addCommand("WHOIS", &Server::cmdWhois);
+    addCommand("MONITOR", &Server::cmdMonitor);
+    addCommand("KICK", &Server::cmdKick);
+    addCommand("INVITE", &Server::cmdInvite);
+    addCommand("TOPIC", &Server::cmdTopic);
+    addCommand("MODE", &Server::cmdMode);
+    addCommand("OPER", &Server::cmdOper);
+    addCommand("STATS", &Server::cmdStats);
+    addCommand("CAPTURE", &Server::cmdCapture);
+    addCommand("UPGRADE", &Server::cmdUpgrade);
+    addCommand("LINKS", &Server::cmdLinks);
+    addCommand("SERVER", &Server::cmdServer);
+    initLinkCommands();
     
     // El Parser ya se encarga de poner el comando en mayúsculas
-}
\ No newline at end of file
+
+    // Métricas por comando: cada familia registrada seguida (formato de texto)
+    std::map<std::string, CommandEntry>::iterator it;
+    std::vector<std::string> names;
+    for (it = _commandMap.begin(); it != _commandMap.end(); ++it)
+    {
+        it->second.id = static_cast<unsigned short>(names.size());
+        names.push_back(it->first);
+    }
+    recorder_.setNames(FlightRecorder::TABLE_COMMANDS, names);
+    names.clear();
+    for (int i = 0; i < DISC_REASON_COUNT; ++i)
+        names.push_back(ServerMetrics::disconnectReasonName(static_cast<DisconnectReason>(i)));
+    recorder_.setNames(FlightRecorder::TABLE_DISCONNECT_REASONS, names);
+    names.clear();
+    for (int i = 0; i < REJECT_REASON_COUNT; ++i)
+        names.push_back(ServerMetrics::rejectReasonName(static_cast<RejectReason>(i)));
+    recorder_.setNames(FlightRecorder::TABLE_REJECT_REASONS, names);
+    for (it = _commandMap.begin(); it != _commandMap.end(); ++it)
+        it->second.calls = g_metrics.registry.newCounter("ircserv_commands_total",
+            "command=\"" + it->first + "\"", "Commands dispatched, by command");
+    for (it = _commandMap.begin(); it != _commandMap.end(); ++it)
+        it->second.latency = g_metrics.registry.newHistogram("ircserv_command_duration_ns",
+            "command=\"" + it->first + "\"", "Handler time per command, fan-out included");
+}
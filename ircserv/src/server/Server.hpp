@@ -16,16 +16,34 @@
 #include <string>
 #include <vector>
 #include <poll.h>
+#include <sys/types.h>
 #include <map>
+#include <deque>
 #include "../irc/Message.hpp"
+#include "../irc/WelcomeBurst.hpp"
+#include "ServerConfig.hpp"
+#include "TimerWheel.hpp"
+#include "../net/AddressTable.hpp"
+#include "../net/Listener.hpp"
+#include "../metrics/Metrics.hpp"
+#include "../metrics/LoopProfiler.hpp"
+#include "../metrics/FlightRecorder.hpp"
+#include "../metrics/TrafficCapture.hpp"
+#include "../channel/HistoryStore.hpp"
+#include "../channel/ChannelListIndex.hpp"
+#include "LinkTable.hpp"
+#include "MonitorIndex.hpp"
 
 class ClientConnection;
 class Channel;
+class User;
+class ReplyStream;
 
 /**
  * Server: IRC Server main coordinator
  * * Responsibilities:
  * - Main poll() loop (SINGLE poll as required by 42)
+ * - Listening sockets (several: IPv4, IPv6/dual-stack, UNIX, metrics scrape)
  * - ClientConnection lifecycle management
  * - Event routing to appropriate handlers
  * - Channel management
@@ -37,37 +55,159 @@ class Channel;
 
 class Server {
 	public:
-		Server(int port, const std::string& password);
+		Server(int port, const std::string& password, const ServerConfig& config = ServerConfig());
 		~Server();
 
 		//* MAIN CONTROLLERS
 		bool start(); 								//* Create Socket, bind, listen
 		void run(); 								//* Loop poll()/select()
 		void stop();
+		void requestReload();						//* Async-signal-safe: reload applied by run()
+		void requestDrain();						//* Async-signal-safe: graceful shutdown (SIGTERM)
+		void requestLatencyDump();					//* Async-signal-safe: log command latencies (SIGUSR1)
+		void requestFlightDump();					//* Async-signal-safe: dump the flight recorder (SIGUSR2)
 	
 		//* GETTERS
 		const std::string& getPassword() const;
 		int getClientCount() const;
+		long getLastDrainMs() const;				//* Duration of the last server-wide drain
 		
 	private:
 		//* CONFIGURATION
 		int port_;
 		std::string password_;
-		int server_fd_; 							//* FD OF THE SERVER'S SOCKET
+		std::vector<Listener> listeners_;			//* LISTENING SOCKETS (TCP v4/v6/dual, UNIX)
 		bool running_;
+		bool reload_pending_;						//* Set by SIGHUP, handled in run()
+		bool drain_pending_;						//* Set by SIGTERM, handled in run()
+		bool latency_dump_pending_;					//* Set by SIGUSR1, handled in run()
+		bool flight_dump_pending_;					//* Set by SIGUSR2, handled in run()
+		bool draining_;								//* Server-wide drain in progress
+		long drain_started_ms_;						//* Monotonic ms when the drain began
+		long last_drain_ms_;						//* How long the last drain took (-1 = never)
+		time_t started_at_;							//* For STATS u
+		ServerConfig config_;
+		WelcomeBurst welcome_;						//* Prebuilt 001-004 + MOTD, rebuilt on reload
+
+		//* PRE-REGISTRATION ACCOUNTING
+		TimerWheel timers_;							//* Registration deadlines
+		size_t unregistered_count_;					//* Connections that have not finished PASS/NICK/USER
+		unsigned long next_conn_id_;				//* Source of ClientConnection ids
+		AddressTable addresses_;					//* Live connections + connect rate per source
+		LoopProfiler profiler_;						//* Per-phase time of each loop iteration
+		FlightRecorder recorder_;					//* Last N accepts/commands/disconnects
+		time_t burst_second_;						//* Abnormal disconnects counted in this second
+		unsigned int burst_count_;
+		time_t last_flight_dump_;
+		TrafficCapture capture_;					//* CAPTURE window: received lines for tools/ircreplay
+		size_t compact_cursor_;						//* Next clients_ index for the idle compaction sweep
+		time_t last_compact_;						//* Second of the last sweep step
+		unsigned long next_msgid_;					//* CHATHISTORY msgid of the next channel message
+		unsigned long next_batch_;					//* BATCH reference counter
+		HistoryStore history_store_;				//* history_dir: channel history on disk (mmap'd segments)
+		pid_t snapshot_pid_;						//* Child writing the snapshot (0 = none)
+		time_t last_snapshot_;						//* When the last one was started
+		bool final_snapshot_done_;					//* Written at the start of the drain
+		int upgrade_sock_;							//* UPGRADE: socketpair to the new binary (-1 = none)
+		pid_t upgrade_pid_;							//* UPGRADE: the new binary, until it takes over
+		time_t upgrade_deadline_;					//* UPGRADE: abort if not READY by then
+		unsigned long upgrade_requester_;			//* UPGRADE: connection id told about the outcome
+		int adopt_fd_;								//* IRCSERV_UPGRADE_FD: state arrives here (-1 = fresh start)
+
+		//* SERVER LINKS (TS6-style spanning tree)
+		std::string sid_;							//* server_id, fixed at startup
+		std::string server_name_;					//* server_name, fixed at startup
+		LinkTable link_table_;						//* Other servers + handshakes in progress
+		std::map<std::string, User*> uids_;			//* UID -> user, local and remote
+		std::map<std::string, User*> remote_nicks_;	//* nick -> user on another server (owned here)
+		unsigned long next_uid_;					//* Source of local UIDs
+		std::vector<time_t> connect_attempts_;		//* Per connect line: last attempt
 
 		//* COLLECTIONS
 		std::vector<ClientConnection*> clients_; 	//* STORAGE THE LIST OF CLIENTS
 		std::vector<Channel*> channels_; 			//* STORAGE THE LIST OF CHANNELS
+		std::map<std::string, Channel*> channel_index_;	//* name -> channel, for getChannel()
+		ChannelListIndex list_index_;				//* Channels by member count, for LIST
+		std::map<std::string, User*> nicks_;		//* nick -> local user (registering ones too)
+		MonitorIndex monitor_;						//* MONITOR: who watches which nick
+		std::map<ClientConnection*, std::deque<ReplyStream*> > streams_;	//* Replies in progress (LIST, WHO), owned
+		bool stream_backlog_;						//* A stream scanned without output: poll() must not block
 		std::vector<struct pollfd> poll_fds_; 		//* POOLS FUCTION
+		std::vector<ClientConnection*> by_fd_;		//* fd -> connection, O(1) lookup
 
 		//* INITIALIZATION
-		bool setupServerSocket();
+		bool setupListeners();
+		bool openListener(Listener& listener);
+		void reloadConfig();
 
 		//* CONECTION MANAGEMENT
-		void acceptNewConnections();
+		void acceptNewConnections(Listener& listener);
     	bool handleClientEvent(size_t poll_index);
    		void disconnectClient(size_t poll_index);
+		void releaseUser(ClientConnection* client);
+		bool beginDrain(size_t poll_index, ClientConnection* client);
+		bool handleDrainingEvent(size_t poll_index, ClientConnection* client);
+		void startServerDrain();
+		void checkServerDrain();
+		void expireTimers();
+		void rejectConnection(int fd, const std::string& errorLine, RejectReason reason);
+		void serveScrape(int fd, const std::string& host, const NetAddress& addr);
+		void renderMetrics(std::string& out);
+		void syncMetricGauges();
+		void compactIdleConnections(time_t now);
+		std::string isupportTokens() const;
+		void openHistoryStore();
+		void restoreSnapshot();
+		void startSnapshot();
+		void writeFinalSnapshot();
+		void reapSnapshot(bool wait);
+		size_t historyRingBytes() const;
+		void formatCommandLatency(std::vector<std::string>& lines) const;
+		void dumpCommandLatency();
+		void dumpFlightRecorder(const std::string& reason);
+		void noteAbnormalDisconnect();
+		bool startCapture(unsigned int seconds, std::string& path);
+		void stopCapture();
+		void applyAddressLimits();
+
+		//* HOT UPGRADE (ServerUpgrade.cpp)
+		bool beginUpgrade(unsigned long requester, std::string& error);
+		void pollUpgrade();
+		void abortUpgrade(const std::string& reason);
+		void handOffUpgrade();
+		void encodeUpgradeState(std::string& out, std::vector<int>& fds);
+		bool adoptUpgrade();
+		bool decodeUpgradeState(const std::string& state, const std::vector<int>& fds, unsigned long& requester);
+
+		//* SERVER LINKS (ServerLink.cpp)
+		void connectLinks(time_t now);
+		void openLink(size_t index);
+		void sendLinkHandshake(ClientConnection* link);
+		void establishLink(ClientConnection* link, const std::string& name, const std::string& description);
+		void sendBurst(ClientConnection* link);
+		void closeLink(ClientConnection* link, const std::string& reason);
+		void dropLink(ClientConnection* link);
+		void splitServers(const std::vector<std::string>& sids, const std::string& reason);
+		void sendToLinks(const std::string& line, ClientConnection* except);
+		void forwardToChannelLinks(Channel* channel, const std::string& line, ClientConnection* except);
+		void deliverToUser(User* dest, const std::string& line, const std::string& linkLine);
+		void sendChannelModeToLinks(User* source, Channel* channel, const std::string& change);
+		void introduceUser(User* user);
+		std::string uidLine(User* user, unsigned int hops);
+		void notifyCommonChannels(User* user, const std::string& line);
+		void quitRemoteUser(User* user, const std::string& reason);
+		void killUser(User* user, const std::string& reason, ClientConnection* except);
+		User* findLinkUser(ClientConnection* link, const std::string& uid);
+		void loseChannelTs(Channel* channel, time_t ts);
+		void applyLinkModes(Channel* channel, const std::string& source, const std::vector<std::string>& params,
+			size_t first, bool addOnly);
+		void handleLinkMessage(ClientConnection* link, const Message& msg);
+
+		//* STREAMED REPLIES (ReplyStream)
+		void startStream(ClientConnection* client, ReplyStream* stream);
+		void endStream(ClientConnection* client);
+		void pumpStreams();
+		void finishStreams();
 
 		//* COMMAND PROCESSING (for later)
 		void processClientCommands(ClientConnection* client);
@@ -76,11 +216,20 @@ class Server {
 		//* UTILITIES
 		void addClientToPoll(ClientConnection* client);
 		void updatePollEvents(int fd, short events);
+		void refreshPollEvents();
 		ClientConnection* findClientByFd(int fd);
+		Listener* findListener(int fd);
+		size_t findPollIndex(int fd) const;
+		User* ensureUser(ClientConnection* client);
 
         //* CHANNEL MANAGEMENT HELPER FUNCTIONS (CRÍTICO: FALTABAN ESTOS)
         Channel* getChannel(const std::string& name);
         Channel* createChannel(const std::string& name);
+        void destroyChannel(Channel* channel);
+        User* findUserByNick(const std::string& nick);		//* Registered users only
+        void setLocalNick(User* user, const std::string& nick);	//* Keeps nicks_ in step
+        void notifyMonitors(User* user, bool online);		//* 730/731 to the watchers of its nick
+        void relayToChannel(Channel* channel, User* sender, const std::string& line);	//* Broadcast + history
 
 		/*--------------------------------------------------------------------*/
         /* NUEVO: SISTEMA DE COMANDOS                                         */
@@ -91,10 +240,21 @@ class Server {
         typedef void (Server::*CommandHandler)(ClientConnection*, const Message&);
 
         // 2. Mapa para asociar strings ("JOIN") con funciones (&Server::cmdJoin)
-        std::map<std::string, CommandHandler> _commandMap;
+        //    Cada entrada lleva sus métricas: el dispatch no hace otra búsqueda
+        struct CommandEntry
+        {
+            CommandHandler handler;
+            Counter* calls;
+            Histogram* latency;						//* ns per handler call, fan-out included
+            unsigned short id;						//* Code in the flight recorder
+        };
+        std::map<std::string, CommandEntry> _commandMap;
+        std::map<std::string, CommandHandler> _linkCommandMap;	//* Lines from server links
 
         // 3. Función para rellenar el mapa al inicio
         void initCommands();
+        void addCommand(const std::string& name, CommandHandler handler);
+        void initLinkCommands();
 
 		/*--------------------------------------------------------------------*/
         /* NUEVO: PROTOTIPOS DE LOS COMANDOS (Implementar en Commands.cpp)    */
@@ -104,22 +264,68 @@ class Server {
         void cmdPass(ClientConnection* client, const Message& msg);
         void cmdNick(ClientConnection* client, const Message& msg);
         void cmdUser(ClientConnection* client, const Message& msg);
+        void cmdCap(ClientConnection* client, const Message& msg);
         void cmdPing(ClientConnection* client, const Message& msg);
         void cmdPong(ClientConnection* client, const Message& msg);
         void cmdQuit(ClientConnection* client, const Message& msg);
+        void cmdMotd(ClientConnection* client, const Message& msg);
+        void checkRegistration(ClientConnection* client);
 
         // Canales y Comunicación
         void cmdJoin(ClientConnection* client, const Message& msg);
         void cmdPart(ClientConnection* client, const Message& msg);
         void cmdPrivMsg(ClientConnection* client, const Message& msg);
         void cmdNotice(ClientConnection* client, const Message& msg);
+        void cmdChatHistory(ClientConnection* client, const Message& msg);
+        void cmdList(ClientConnection* client, const Message& msg);
+
+        // Consultas sobre usuarios (cmds_query.cpp)
+        void cmdWho(ClientConnection* client, const Message& msg);
+        void cmdWhois(ClientConnection* client, const Message& msg);
+        void cmdMonitor(ClientConnection* client, const Message& msg);
+        void sendMonitorStatus(ClientConnection* client, const std::vector<std::string>& targets);
 
         // Operadores
         void cmdKick(ClientConnection* client, const Message& msg);
         void cmdInvite(ClientConnection* client, const Message& msg);
         void cmdTopic(ClientConnection* client, const Message& msg);
         void cmdMode(ClientConnection* client, const Message& msg);
+
+        // Servidor (operadores de IRC)
+        void cmdOper(ClientConnection* client, const Message& msg);
+        void cmdStats(ClientConnection* client, const Message& msg);
+        void cmdCapture(ClientConnection* client, const Message& msg);
+        void cmdUpgrade(ClientConnection* client, const Message& msg);
+        void cmdLinks(ClientConnection* client, const Message& msg);
+        void cmdServer(ClientConnection* client, const Message& msg);		//* Inbound link handshake
+
+        // Enlaces entre servidores (cmds_link.cpp): "link" + comando TS6
+        void linkPass(ClientConnection* link, const Message& msg);
+        void linkServer(ClientConnection* link, const Message& msg);
+        void linkSid(ClientConnection* link, const Message& msg);
+        void linkSquit(ClientConnection* link, const Message& msg);
+        void linkUid(ClientConnection* link, const Message& msg);
+        void linkNick(ClientConnection* link, const Message& msg);
+        void linkQuit(ClientConnection* link, const Message& msg);
+        void linkKill(ClientConnection* link, const Message& msg);
+        void linkSjoin(ClientConnection* link, const Message& msg);
+        void linkJoin(ClientConnection* link, const Message& msg);
+        void linkPart(ClientConnection* link, const Message& msg);
+        void linkKick(ClientConnection* link, const Message& msg);
+        void linkTopic(ClientConnection* link, const Message& msg);
+        void linkTb(ClientConnection* link, const Message& msg);
+        void linkTmode(ClientConnection* link, const Message& msg);
+        void linkBmask(ClientConnection* link, const Message& msg);
+        void linkInvite(ClientConnection* link, const Message& msg);
+        void linkMessage(ClientConnection* link, const Message& msg);		//* PRIVMSG and NOTICE
+        void linkPing(ClientConnection* link, const Message& msg);
+        void linkPong(ClientConnection* link, const Message& msg);
+        void linkError(ClientConnection* link, const Message& msg);
+        void linkIgnore(ClientConnection* link, const Message& msg);		//* CAPAB, SVINFO
 	
+		//* tools/microbench.cpp drives the private lookups directly
+		friend class MicroBench;
+
 		//* NON-COPYABLE
 		Server(const Server&);
 		Server& operator=(const Server&);
@@ -0,0 +1,195 @@
+#include "ServerConfig.hpp"
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <cerrno>
+#include <sstream>
+#include <cctype>
+
+ServerConfig::ServerConfig() : path(""), acceptBudget(64), motdFile("ircd.motd"),
+	registrationTimeout(30), maxUnregistered(1024), drainTimeout(5), shutdownTimeout(10),
+	sendqControl(2 * 1024 * 1024), sendqBulk(8 * 1024 * 1024), idleCompactSeconds(60),
+	historyChannelBytes(65536), historyMaxLimit(100), historyDir(""), historySegmentBytes(16 * 1024 * 1024),
+	historySegments(8), historyPerChannel(10000), channelListLimit(100), monitorLimit(100), snapshotFile(""), snapshotInterval(300),
+	maxPerIp(16), connectRateLimit(10), connectRateHalflife(10), ipv6Cidr(64),
+	commandTiming(1), loopBudgetMs(50), flightRecorderEvents(65536), flightDumpDir("."),
+	flightDumpBurst(200), captureDir("."), captureMaxSeconds(300), serverName("ft_irc"), serverId("0FT"),
+	serverDescription("ft_irc server"), linkPassword(""), linkRetry(10), upgradeBinary("")
+{
+}
+
+//* Parse a non-negative decimal integer; rejects junk like "10s" or "-1"
+static bool parseUnsigned(const std::string& s, unsigned int& out)
+{
+	if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos)
+		return (false);
+	errno = 0;
+	unsigned long v = std::strtoul(s.c_str(), NULL, 10);
+	if (errno == ERANGE || v > 0xFFFFFFFFUL)
+		return (false);
+	out = static_cast<unsigned int>(v);
+	return (true);
+}
+
+//* TS6 server id: "0AB", "42X"...
+static bool validServerId(const std::string& s)
+{
+	return (s.size() == 3 && std::isdigit(s[0])
+		&& s.find_first_not_of("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ", 1) == std::string::npos);
+}
+
+//* Strip spaces and tabs at both ends of a config token
+static std::string trimToken(const std::string& s)
+{
+	size_t start = s.find_first_not_of(" \t\r");
+	if (start == std::string::npos)
+		return ("");
+	size_t end = s.find_last_not_of(" \t\r");
+	return (s.substr(start, end - start + 1));
+}
+
+bool ServerConfig::load(const std::string& file)
+{
+	std::ifstream in(file.c_str());
+	if (!in)
+	{
+		std::cerr << "[CONFIG] Cannot open " << file << std::endl;
+		return (false);
+	}
+
+	std::string line;
+	int lineNo = 0;
+	while (std::getline(in, line))
+	{
+		lineNo++;
+		line = trimToken(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		size_t eq = line.find('=');
+		if (eq == std::string::npos)
+		{
+			std::cerr << "[CONFIG] " << file << ":" << lineNo << ": expected key = value" << std::endl;
+			return (false);
+		}
+		std::string key = trimToken(line.substr(0, eq));
+		std::string value = trimToken(line.substr(eq + 1));
+
+		bool ok = true;
+		if (key == "listen")
+		{
+			Listener l;
+			ok = Listener::parse(value, l);
+			if (ok)
+				listeners.push_back(l);
+		}
+		else if (key == "metrics_listen")
+		{
+			//* Metrics are not authenticated: never expose them off-host
+			Listener l;
+			ok = Listener::parse(value, l) && l.isLocal();
+			l.role = Listener::ROLE_METRICS;
+			if (ok)
+				listeners.push_back(l);
+		}
+		else if (key == "command_timing")
+			ok = parseUnsigned(value, commandTiming) && commandTiming <= 1;
+		else if (key == "loop_budget_ms")
+			ok = parseUnsigned(value, loopBudgetMs);
+		else if (key == "flight_recorder_events")
+			ok = parseUnsigned(value, flightRecorderEvents) && flightRecorderEvents <= (1u << 24);
+		else if (key == "flight_dump_dir")
+			ok = !(flightDumpDir = value).empty();
+		else if (key == "flight_dump_burst")
+			ok = parseUnsigned(value, flightDumpBurst);
+		else if (key == "sendq_control")
+			ok = parseUnsigned(value, sendqControl);
+		else if (key == "sendq_bulk")
+			ok = parseUnsigned(value, sendqBulk);
+		else if (key == "idle_compact_seconds")
+			ok = parseUnsigned(value, idleCompactSeconds);
+		else if (key == "history_channel_bytes")
+			ok = parseUnsigned(value, historyChannelBytes);
+		else if (key == "history_max_limit")
+			ok = parseUnsigned(value, historyMaxLimit) && historyMaxLimit > 0;
+		else if (key == "channel_list_limit")
+			ok = parseUnsigned(value, channelListLimit) && channelListLimit > 0;
+		else if (key == "monitor_limit")
+			ok = parseUnsigned(value, monitorLimit) && monitorLimit > 0;
+		else if (key == "history_dir")
+			ok = !(historyDir = value).empty();
+		else if (key == "history_segment_bytes")
+			ok = parseUnsigned(value, historySegmentBytes) && historySegmentBytes >= 65536;
+		else if (key == "history_segments")
+			ok = parseUnsigned(value, historySegments) && historySegments > 0;
+		else if (key == "history_per_channel")
+			ok = parseUnsigned(value, historyPerChannel) && historyPerChannel > 0;
+		else if (key == "snapshot_file")
+			ok = !(snapshotFile = value).empty();
+		else if (key == "snapshot_interval")
+			ok = parseUnsigned(value, snapshotInterval) && snapshotInterval > 0;
+		else if (key == "capture_dir")
+			ok = !(captureDir = value).empty();
+		else if (key == "capture_max_seconds")
+			ok = parseUnsigned(value, captureMaxSeconds);
+		else if (key == "server_name")
+			ok = !(serverName = value).empty() && value.find_first_of(" :") == std::string::npos;
+		else if (key == "server_id")
+			ok = validServerId(serverId = value);
+		else if (key == "server_description")
+			serverDescription = value;
+		else if (key == "link_password")
+			ok = !(linkPassword = value).empty() && value.find(' ') == std::string::npos;
+		else if (key == "connect")
+		{
+			Listener l;
+			ok = Listener::parse(value, l) && l.kind == Listener::LISTEN_TCP;
+			if (ok)
+				connects.push_back(l);
+		}
+		else if (key == "link_retry")
+			ok = parseUnsigned(value, linkRetry) && linkRetry > 0;
+		else if (key == "upgrade_binary")
+			ok = !(upgradeBinary = value).empty() && value[0] == '/';
+		else if (key == "oper")
+		{
+			std::istringstream words(value);
+			std::string name;
+			std::string pass;
+			std::string extra;
+			ok = (words >> name >> pass) && !(words >> extra);
+			if (ok)
+				opers[name] = pass;
+		}
+		else if (key == "accept_budget")
+			ok = parseUnsigned(value, acceptBudget) && acceptBudget > 0;
+		else if (key == "motd_file")
+			motdFile = value;
+		else if (key == "registration_timeout")
+			ok = parseUnsigned(value, registrationTimeout) && registrationTimeout > 0;
+		else if (key == "max_unregistered")
+			ok = parseUnsigned(value, maxUnregistered);
+		else if (key == "drain_timeout")
+			ok = parseUnsigned(value, drainTimeout) && drainTimeout > 0;
+		else if (key == "shutdown_timeout")
+			ok = parseUnsigned(value, shutdownTimeout) && shutdownTimeout > 0;
+		else if (key == "max_per_ip")
+			ok = parseUnsigned(value, maxPerIp);
+		else if (key == "connect_rate_limit")
+			ok = parseUnsigned(value, connectRateLimit);
+		else if (key == "connect_rate_halflife")
+			ok = parseUnsigned(value, connectRateHalflife) && connectRateHalflife > 0;
+		else if (key == "ipv6_cidr")
+			ok = parseUnsigned(value, ipv6Cidr) && ipv6Cidr <= 128;
+		else
+			std::cerr << "[CONFIG] " << file << ":" << lineNo << ": unknown key '" << key << "' ignored" << std::endl;
+
+		if (!ok)
+		{
+			std::cerr << "[CONFIG] " << file << ":" << lineNo << ": invalid value for " << key << std::endl;
+			return (false);
+		}
+	}
+	path = file;
+	return (true);
+}
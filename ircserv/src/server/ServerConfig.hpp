@@ -0,0 +1,105 @@
+#ifndef SERVER_CONFIG_HPP
+#define SERVER_CONFIG_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include "../net/Listener.hpp"
+
+/**
+ * ServerConfig: runtime tunables for the IRC server
+ *
+ * Loaded from an optional "key = value" file passed as the third argument
+ * (./ircserv <port> <password> [config]). Lines starting with '#' are
+ * comments. Unknown keys are reported and ignored so an old binary can read
+ * a newer file. Every field has a sane default, so the file is optional.
+ *
+ * The file is re-read on SIGHUP (see Server::requestReload).
+ */
+
+struct ServerConfig
+{
+	std::string	path;						//* File this config was loaded from ("" = defaults only)
+
+	//* LISTENERS (read at startup only; a reload does not rebind)
+	std::vector<Listener>	listeners;		//* listen: repeatable, empty = "*:<port>"
+											//* metrics_listen: loopback/UNIX only, same syntax
+	unsigned int	acceptBudget;			//* accept_budget: default accepts per listener per loop
+
+	//* MOTD
+	std::string	motdFile;					//* motd_file: text file served as 375/372/376
+
+	//* REGISTRATION
+	unsigned int	registrationTimeout;	//* registration_timeout: seconds to finish PASS/NICK/USER
+	unsigned int	maxUnregistered;		//* max_unregistered: cap on connections not yet registered
+
+	//* CLOSING
+	unsigned int	drainTimeout;			//* drain_timeout: seconds a closing client may take to flush
+	unsigned int	shutdownTimeout;		//* shutdown_timeout: seconds for the whole SIGTERM drain
+
+	//* SENDQ (per client connection, 0 = unlimited; over it: "Max SendQ exceeded")
+	unsigned int	sendqControl;			//* sendq_control: PONG, numerics, ERROR, KICK, command replies
+	unsigned int	sendqBulk;				//* sendq_bulk: channel fan-out and chat, flushed after control
+
+	//* MEMORY
+	unsigned int	idleCompactSeconds;		//* idle_compact_seconds: quiet time before buffers are released (0 = off)
+
+	//* HISTORY
+	unsigned int	historyChannelBytes;	//* history_channel_bytes: CHATHISTORY budget per channel (0 = off)
+	unsigned int	historyMaxLimit;		//* history_max_limit: most messages one CHATHISTORY returns
+	std::string		historyDir;				//* history_dir: on-disk history segments, startup only (empty = off)
+	unsigned int	historySegmentBytes;	//* history_segment_bytes: size of one segment file
+	unsigned int	historySegments;		//* history_segments: sealed segments kept before the oldest is dropped
+	unsigned int	historyPerChannel;		//* history_per_channel: messages kept on disk per channel
+
+	//* CHANNEL LISTS
+	unsigned int	channelListLimit;		//* channel_list_limit: entries per +b/+e/+I list (ISUPPORT MAXLIST)
+
+	//* MONITOR
+	unsigned int	monitorLimit;			//* monitor_limit: nicks one client may MONITOR (ISUPPORT MONITOR=)
+
+	//* SNAPSHOT
+	std::string		snapshotFile;			//* snapshot_file: channel state restored at startup (empty = off)
+	unsigned int	snapshotInterval;		//* snapshot_interval: seconds between background snapshots
+
+	//* PER-SOURCE LIMITS (0 = unlimited)
+	unsigned int	maxPerIp;				//* max_per_ip: live connections per address (IPv6: per /64)
+	unsigned int	connectRateLimit;		//* connect_rate_limit: max decayed connect attempts
+	unsigned int	connectRateHalflife;	//* connect_rate_halflife: seconds for the rate to halve
+	unsigned int	ipv6Cidr;				//* ipv6_cidr: IPv6 prefix length used as the source key
+
+	//* PROFILING
+	unsigned int	commandTiming;			//* command_timing: 1 = per-command latency histograms
+	unsigned int	loopBudgetMs;			//* loop_budget_ms: warn when an iteration is busier (0 = off)
+	unsigned int	flightRecorderEvents;	//* flight_recorder_events: ring size, startup only (0 = off)
+	std::string		flightDumpDir;			//* flight_dump_dir: where dumps are written
+	unsigned int	flightDumpBurst;		//* flight_dump_burst: abnormal disconnects/s that trigger a dump
+	std::string		captureDir;				//* capture_dir: where CAPTURE writes its files
+	unsigned int	captureMaxSeconds;		//* capture_max_seconds: longest window CAPTURE accepts
+
+	//* SERVER LINKS (server_name/server_id: startup only)
+	std::string		serverName;				//* server_name: this server in LINKS and the link handshake
+	std::string		serverId;				//* server_id: TS6 SID, a digit + 2 of [A-Z0-9], unique in the tree
+	std::string		serverDescription;		//* server_description
+	std::string		linkPassword;			//* link_password: both ends share it (empty = no links)
+	std::vector<Listener>	connects;		//* connect = host:port: repeatable, links this server opens
+	unsigned int	linkRetry;				//* link_retry: seconds between attempts on a connect line
+
+	//* HOT UPGRADE
+	std::string		upgradeBinary;			//* upgrade_binary: what UPGRADE execs (empty = the running binary's path)
+
+	//* OPERATORS
+	std::map<std::string, std::string>	opers;	//* oper = <name> <password>: repeatable, for OPER
+
+	ServerConfig();
+
+	/**
+	 * Load settings from a config file on top of the current values
+	 *
+	 * @param file Path to the config file
+	 * @return false if the file cannot be opened or has a malformed line
+	 */
+	bool load(const std::string& file);
+};
+
+#endif
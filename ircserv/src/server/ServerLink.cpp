@@ -0,0 +1,523 @@
+#include "Server.hpp"
+#include "../client/ClientConnection.hpp"
+#include "../client/User.hpp"
+#include "../channel/Channel.hpp"
+#include "../net/SocketUtils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//* SJOIN member lists (and BMASK mask lists) are split so no line passes the 512-byte limit
+static const size_t SJOIN_MEMBERS_BYTES = 400;
+
+static unsigned long monotonicUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (static_cast<unsigned long>(ts.tv_sec) * 1000000UL + ts.tv_nsec / 1000UL);
+}
+
+static std::string number(unsigned long n)
+{
+	std::ostringstream oss;
+	oss << n;
+	return (oss.str());
+}
+
+//* ============================================================================
+//* OPENING LINKS
+//* ============================================================================
+
+//* Once per loop: every connect line without a session is retried after link_retry
+void Server::connectLinks(time_t now)
+{
+	if (connect_attempts_.size() != config_.connects.size())
+		connect_attempts_.resize(config_.connects.size(), 0);
+	for (size_t i = 0; i < config_.connects.size(); ++i)
+	{
+		if (link_table_.connecting(static_cast<int>(i)) || now - connect_attempts_[i] < (time_t)config_.linkRetry)
+			continue;
+		connect_attempts_[i] = now;
+		openLink(i);
+	}
+}
+
+//* Non-blocking connect: the handshake waits in the SendQ until POLLOUT says
+//* the socket is up; a refused connect comes back as POLLERR and is dropped
+void Server::openLink(size_t index)
+{
+	const Listener& target = config_.connects[index];
+	std::string host = (target.host.empty() || target.host == "*") ? "127.0.0.1" : target.host;
+
+	struct addrinfo hints;
+	struct addrinfo* res = NULL;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host.c_str(), number(target.port).c_str(), &hints, &res) != 0 || !res)
+	{
+		std::cerr << "[LINK] Cannot resolve " << target.describe() << std::endl;
+		return;
+	}
+	int fd = socket(res->ai_family, SOCK_STREAM, 0);
+	if (fd < 0 || !SocketUtils::setNonBlocking(fd)
+		|| (connect(fd, res->ai_addr, res->ai_addrlen) < 0 && errno != EINPROGRESS))
+	{
+		std::cerr << "[LINK] Connect to " << target.describe() << " failed: " << std::strerror(errno) << std::endl;
+		if (fd >= 0)
+			close(fd);
+		freeaddrinfo(res);
+		return;
+	}
+	freeaddrinfo(res);
+
+	NetAddress none;
+	std::memset(none.bytes, 0, sizeof(none.bytes));
+	ClientConnection* link = new ClientConnection(fd, next_conn_id_++, target.describe(), none);
+	link->setKind(ClientConnection::KIND_SERVER);
+	clients_.push_back(link);
+	if (by_fd_.size() <= static_cast<size_t>(fd))
+		by_fd_.resize(fd + 1, NULL);
+	by_fd_[fd] = link;
+	addClientToPoll(link);
+	link_table_.open(link, static_cast<int>(index));
+	sendLinkHandshake(link);
+	std::cout << "[LINK] Connecting to " << target.describe() << " (fd=" << fd << ")" << std::endl;
+}
+
+void Server::sendLinkHandshake(ClientConnection* link)
+{
+	std::ostringstream out;
+	out << "PASS " << config_.linkPassword << " TS 6 :" << sid_ << "\r\n"
+		<< "CAPAB :QS\r\n"
+		<< "SERVER " << server_name_ << " 1 :" << config_.serverDescription << "\r\n"
+		<< "SVINFO 6 6 0 :" << std::time(NULL) << "\r\n";
+	link->queueSend(out.str());
+}
+
+//* SERVER accepted (the password was checked by PASS): the connection is a
+//* peer from now on. The other servers hear about it, it gets our burst.
+void Server::establishLink(ClientConnection* link, const std::string& name, const std::string& description)
+{
+	LinkTable::Session* session = link_table_.session(link);
+	if (name == server_name_ || session->sid == sid_ || link_table_.find(session->sid)
+		|| link_table_.findByName(name))
+		return closeLink(link, "Server " + name + " already exists");
+
+	if (session->connectIndex < 0)
+		sendLinkHandshake(link);
+
+	LinkTable::Peer peer;
+	peer.sid = session->sid;
+	peer.name = name;
+	peer.description = description;
+	peer.hops = 1;
+	peer.uplink = sid_;
+	peer.route = link;
+	sendToLinks(":" + sid_ + " SID " + name + " 2 " + peer.sid + " :" + description + "\r\n", NULL);
+	link_table_.add(peer);
+	session->established = true;
+	std::cout << "[LINK] ✓ Linked to " << name << " (" << peer.sid << ") via " << link->getHost() << std::endl;
+	sendBurst(link);
+}
+
+//* BURST: every server, user and channel we know, then a PING whose PONG
+//* tells us the peer has processed all of it
+void Server::sendBurst(ClientConnection* link)
+{
+	LinkTable::Session* session = link_table_.session(link);
+	std::string out;
+
+	//* Servers, nearest first: every uplink is introduced before its leaves
+	const std::map<std::string, LinkTable::Peer>& peers = link_table_.peers();
+	for (unsigned int hops = 1; ; ++hops)
+	{
+		bool more = false;
+		for (std::map<std::string, LinkTable::Peer>::const_iterator it = peers.begin(); it != peers.end(); ++it)
+		{
+			const LinkTable::Peer& p = it->second;
+			more = more || p.hops > hops;
+			if (p.hops == hops && p.route != link)
+				out += ":" + p.uplink + " SID " + p.name + " " + number(p.hops + 1) + " " + p.sid
+					+ " :" + p.description + "\r\n";
+		}
+		if (!more)
+			break;
+	}
+
+	for (std::map<std::string, User*>::iterator it = uids_.begin(); it != uids_.end(); ++it)
+	{
+		User* user = it->second;
+		if (user->getRoute() == link)
+			continue;
+		LinkTable::Peer* home = user->isRemote() ? link_table_.find(user->getServerId()) : NULL;
+		out += uidLine(user, home ? home->hops + 1 : 1);
+	}
+
+	for (size_t i = 0; i < channels_.size(); ++i)
+	{
+		Channel* channel = channels_[i];
+		std::string head = ":" + sid_ + " SJOIN " + number(channel->getCreatedAt()) + " " + channel->getName()
+			+ " " + channel->getModes() + " :";
+		std::string members;
+		const std::vector<User*>& list = channel->getMembers();
+		for (size_t m = 0; m < list.size(); ++m)
+		{
+			if (list[m]->getUid().empty() || list[m]->getRoute() == link)
+				continue;
+			if (members.size() > SJOIN_MEMBERS_BYTES)
+			{
+				out += head + members + "\r\n";
+				members.clear();
+			}
+			if (!members.empty())
+				members += " ";
+			if (channel->isOperator(list[m]))
+				members += "@";
+			members += list[m]->getUid();
+		}
+		if (!members.empty())
+			out += head + members + "\r\n";
+		const char lists[] = "beI";
+		for (size_t l = 0; l < 3; ++l)
+		{
+			const std::list<MaskList::Entry>& entries = channel->getMaskList(lists[l])->entries();
+			std::string bmask = ":" + sid_ + " BMASK " + number(channel->getCreatedAt()) + " " + channel->getName()
+				+ " " + lists[l] + " :";
+			std::string masks;
+			for (std::list<MaskList::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			{
+				if (masks.size() > SJOIN_MEMBERS_BYTES)
+				{
+					out += bmask + masks + "\r\n";
+					masks.clear();
+				}
+				if (!masks.empty())
+					masks += " ";
+				masks += it->mask;
+			}
+			if (!masks.empty())
+				out += bmask + masks + "\r\n";
+		}
+		if (!channel->getTopic().empty())
+			out += ":" + sid_ + " TB " + channel->getName() + " " + number(channel->getCreatedAt())
+				+ " :" + channel->getTopic() + "\r\n";
+	}
+
+	out += ":" + sid_ + " PING " + server_name_ + " :" + session->sid + "\r\n";
+	session->burstStartedUs = monotonicUs();
+	link->queueSend(out);
+}
+
+//* ============================================================================
+//* CLOSING LINKS
+//* ============================================================================
+
+void Server::closeLink(ClientConnection* link, const std::string& reason)
+{
+	std::cout << "[LINK] Closing " << link->getHost() << ": " << reason << std::endl;
+	link->queueSend("ERROR :Closing Link: " + reason + "\r\n");
+	link->closeConnection(reason, DISC_ERROR);
+}
+
+//* From releaseUser(): the connection is going away. If it was a peer, the
+//* servers behind it and their users leave with it (netsplit) and the
+//* rest of the tree gets a SQUIT.
+void Server::dropLink(ClientConnection* link)
+{
+	LinkTable::Session* session = link_table_.session(link);
+	if (!session)
+		return;
+	std::string sid = session->sid;
+	bool established = session->established;
+	link_table_.close(link);
+	if (!established)
+		return;
+
+	LinkTable::Peer* peer = link_table_.find(sid);
+	if (!peer)
+		return;
+	std::string name = peer->name;
+	std::vector<std::string> gone;
+	link_table_.subtree(sid, gone);
+	size_t before = remote_nicks_.size();
+	splitServers(gone, server_name_ + " " + name);
+	sendToLinks(":" + sid_ + " SQUIT " + sid + " :" + link->getCloseReason() + "\r\n", NULL);
+	std::cout << "[LINK] Lost " << name << " (" << link->getCloseReason() << "): " << gone.size()
+			  << " servers, " << before - remote_nicks_.size() << " users" << std::endl;
+}
+
+//* Netsplit: the users of those servers quit, then the servers go
+void Server::splitServers(const std::vector<std::string>& sids, const std::string& reason)
+{
+	std::set<std::string> gone(sids.begin(), sids.end());
+	std::vector<User*> users;
+	for (std::map<std::string, User*>::iterator it = remote_nicks_.begin(); it != remote_nicks_.end(); ++it)
+		if (gone.count(it->second->getServerId()))
+			users.push_back(it->second);
+	for (size_t i = 0; i < users.size(); ++i)
+		quitRemoteUser(users[i], reason);
+	for (size_t i = 0; i < sids.size(); ++i)
+		link_table_.remove(sids[i]);
+}
+
+//* ============================================================================
+//* ROUTING
+//* ============================================================================
+
+//* State changes (users, membership, modes) reach every server
+void Server::sendToLinks(const std::string& line, ClientConnection* except)
+{
+	const std::vector<ClientConnection*>& links = link_table_.links();
+	for (size_t i = 0; i < links.size(); ++i)
+		if (links[i] != except)
+			links[i]->queueSend(line);
+}
+
+//* Channel messages only go down the links that have members of the channel
+void Server::forwardToChannelLinks(Channel* channel, const std::string& line, ClientConnection* except)
+{
+	const std::map<ClientConnection*, unsigned int>& routes = channel->getRoutes();
+	for (std::map<ClientConnection*, unsigned int>::const_iterator it = routes.begin(); it != routes.end(); ++it)
+	{
+		if (it->first == except)
+			continue;
+		it->first->queueSend(line);
+		g_metrics.linkForwards.inc();
+	}
+}
+
+//* Local user: the client line. Remote: the TS6 line, toward its server.
+//* Chat from someone else: bulk, behind the recipient's own replies
+void Server::deliverToUser(User* dest, const std::string& line, const std::string& linkLine)
+{
+	if (dest->isRemote())
+		dest->getRoute()->queueSend(linkLine);
+	else if (dest->getConnection())
+		dest->getConnection()->queueSend(line, LANE_BULK);
+}
+
+//* A local MODE change ("+o UID", "-k *", "+l 5") as TMODE with the channel TS
+void Server::sendChannelModeToLinks(User* source, Channel* channel, const std::string& change)
+{
+	sendToLinks(":" + source->getUid() + " TMODE " + number(channel->getCreatedAt()) + " " + channel->getName()
+		+ " " + change + "\r\n", NULL);
+}
+
+//* ============================================================================
+//* USERS
+//* ============================================================================
+
+//* Registration: a UID ("0FTAAAAAB") and a nick TS, announced to the tree
+void Server::introduceUser(User* user)
+{
+	static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	unsigned long n = next_uid_++;
+	char id[7];
+	for (int i = 5; i > 0; --i)
+	{
+		id[i] = digits[n % 36];
+		n /= 36;
+	}
+	id[0] = digits[n % 26];
+	id[6] = '\0';
+	user->setUid(sid_ + id);
+	user->setNickTs(std::time(NULL));
+	uids_[user->getUid()] = user;
+	sendToLinks(uidLine(user, 1), NULL);
+}
+
+std::string Server::uidLine(User* user, unsigned int hops)
+{
+	std::string modes = "+";
+	if (user->isInvisible())
+		modes += "i";
+	if (user->isOperator())
+		modes += "o";
+	return (":" + (user->isRemote() ? user->getServerId() : sid_) + " UID " + user->getNickname() + " "
+		+ number(hops) + " " + number(user->getNickTs()) + " " + modes + " " + user->getUsername() + " "
+		+ user->getHostname() + " 0 " + user->getUid() + " :" + user->getRealname() + "\r\n");
+}
+
+//* Local users sharing a channel with 'user', each once
+void Server::notifyCommonChannels(User* user, const std::string& line)
+{
+	std::set<ClientConnection*> recipients;
+	const std::vector<Channel*>& channels = user->getChannels();
+	for (size_t i = 0; i < channels.size(); ++i)
+	{
+		const std::vector<User*>& members = channels[i]->getPresenceAudience(user);
+		for (size_t j = 0; j < members.size(); ++j)
+			if (members[j] != user && members[j]->getConnection())
+				recipients.insert(members[j]->getConnection());
+	}
+	for (std::set<ClientConnection*>::iterator it = recipients.begin(); it != recipients.end(); ++it)
+		(*it)->queueSend(line, LANE_BULK);
+}
+
+//* A remote user leaves (QUIT, KILL, netsplit). Not propagated: the caller does.
+void Server::quitRemoteUser(User* user, const std::string& reason)
+{
+	notifyCommonChannels(user, ":" + user->getPrefix() + " QUIT :" + reason + "\r\n");
+	std::vector<Channel*> channels = user->getChannels();
+	for (size_t i = 0; i < channels.size(); ++i)
+	{
+		channels[i]->removeMember(user);
+		if (channels[i]->getUserCount() == 0)
+			destroyChannel(channels[i]);
+	}
+	notifyMonitors(user, false);
+	uids_.erase(user->getUid());
+	remote_nicks_.erase(user->getNickname());
+	delete user;
+}
+
+//* Nick collisions. A local victim is closed like any other connection (its
+//* QUIT reaches the links from releaseUser); the ERROR line in its SendQ
+//* keeps beginDrain() from touching poll_fds_ while the loop walks it.
+void Server::killUser(User* user, const std::string& reason, ClientConnection* except)
+{
+	std::cout << "[LINK] KILL " << user->getNickname() << " (" << reason << ")" << std::endl;
+	if (user->isRemote())
+	{
+		sendToLinks(":" + sid_ + " KILL " + user->getUid() + " :" + reason + "\r\n", except);
+		quitRemoteUser(user, "Killed (" + reason + ")");
+		return;
+	}
+	ClientConnection* client = user->getConnection();
+	client->queueSend("ERROR :Closing Link: " + client->getHost() + " (Killed (" + reason + "))\r\n");
+	client->closeConnection("Killed (" + reason + ")", DISC_KILLED);
+	beginDrain(findPollIndex(client->getFd()), client);
+}
+
+//* The source of a line must live behind the link it arrived on
+User* Server::findLinkUser(ClientConnection* link, const std::string& uid)
+{
+	std::map<std::string, User*>::iterator it = uids_.find(uid);
+	if (it == uids_.end() || it->second->getRoute() != link)
+		return (NULL);
+	return (it->second);
+}
+
+//* ============================================================================
+//* CHANNEL TS
+//* ============================================================================
+
+//* The other side's channel is older: ours loses its operators and modes
+void Server::loseChannelTs(Channel* channel, time_t ts)
+{
+	channel->setCreatedAt(ts);
+	const std::vector<User*> members = channel->getMembers();
+	for (size_t i = 0; i < members.size(); ++i)
+	{
+		if (!channel->isOperator(members[i]))
+			continue;
+		channel->removeOperator(members[i]);
+		channel->broadcast(":" + server_name_ + " MODE " + channel->getName() + " -o "
+			+ members[i]->getNickname() + "\r\n", NULL);
+	}
+	//* Our +b/+e/+I go with the TS: the older side's lists arrive in its burst
+	const char lists[] = "beI";
+	for (size_t l = 0; l < 3; ++l)
+	{
+		MaskList* list = channel->getMaskList(lists[l]);
+		const std::list<MaskList::Entry>& entries = list->entries();
+		for (std::list<MaskList::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			channel->broadcast(":" + server_name_ + " MODE " + channel->getName() + " -" + lists[l] + " "
+				+ it->mask + "\r\n", NULL);
+		list->clear();
+	}
+	std::string cleared = "-";
+	const char modes[] = "itklu";
+	for (size_t i = 0; i < 5; ++i)
+		if (channel->hasMode(modes[i]))
+			cleared += modes[i];
+	if (cleared.size() == 1)
+		return;
+	channel->setMode('i', false);
+	channel->setMode('t', false);
+	channel->setMode('u', false);
+	channel->setKey("");
+	channel->setLimit(0);
+	channel->broadcast(":" + server_name_ + " MODE " + channel->getName() + " " + cleared + "\r\n", NULL);
+}
+
+//* TMODE/SJOIN mode changes: "+ik-l key", "+o UID"... applied without
+//* permission checks (the origin server did them) and shown to the local
+//* members as one MODE line from 'source'
+void Server::applyLinkModes(Channel* channel, const std::string& source, const std::vector<std::string>& params,
+	size_t first, bool addOnly)
+{
+	if (first >= params.size())
+		return;
+	const std::string& modes = params[first];
+	size_t arg = first + 1;
+	char action = '+';
+	char shown = 0;
+	std::string applied;
+	std::string args;
+
+	for (size_t i = 0; i < modes.size(); ++i)
+	{
+		char mode = modes[i];
+		if (mode == '+' || mode == '-')
+		{
+			action = addOnly ? '+' : mode;
+			continue;
+		}
+		std::string value;
+		if (mode == 'i' || mode == 't' || mode == 'u')
+			channel->setMode(mode, action == '+');
+		else if (mode == 'k')
+		{
+			if (arg < params.size())
+				value = params[arg++];
+			channel->setKey(action == '+' ? value : "");
+			if (action == '-')
+				value = "*";
+		}
+		else if (mode == 'l')
+		{
+			if (action == '+' && arg < params.size())
+				value = params[arg++];
+			channel->setLimit(action == '+' ? std::atoi(value.c_str()) : 0);
+		}
+		else if (channel->getMaskList(mode) && arg < params.size())
+		{
+			//* Lists are not capped here: the origin server checked its own limit
+			MaskList* list = channel->getMaskList(mode);
+			value = MaskList::normalize(params[arg++]);
+			if (!(action == '+' ? list->add(value, source, std::time(NULL)) : list->remove(value)))
+				continue;
+		}
+		else if (mode == 'o' && arg < params.size())
+		{
+			std::map<std::string, User*>::iterator it = uids_.find(params[arg++]);
+			if (it == uids_.end() || !channel->isMember(it->second))
+				continue;
+			if (action == '+')
+				channel->addOperator(it->second);
+			else
+				channel->removeOperator(it->second);
+			value = it->second->getNickname();
+		}
+		else
+			continue;
+		if (shown != action)
+			applied += action;
+		shown = action;
+		applied += mode;
+		if (!value.empty())
+			args += " " + value;
+	}
+	if (!applied.empty())
+		channel->broadcast(":" + source + " MODE " + channel->getName() + " " + applied + args + "\r\n", NULL);
+}
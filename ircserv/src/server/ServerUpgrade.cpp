@@ -0,0 +1,495 @@
+#include "Server.hpp"
+#include "HotUpgrade.hpp"
+#include "../client/ClientConnection.hpp"
+#include "../client/User.hpp"
+#include "../channel/Channel.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//* Seconds the new binary gets to say READY, then to ACK the state
+static const int UPGRADE_READY_TIMEOUT = 10;
+static const int UPGRADE_ACK_TIMEOUT_MS = 10000;
+
+//* ============================================================================
+//* OLD PROCESS
+//* ============================================================================
+
+//* Path of the running binary; after a rebuild /proc/self/exe names the
+//* replaced file "... (deleted)": the path is what matters
+static std::string currentExecutable()
+{
+	char buf[4096];
+	ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+	if (n <= 0)
+		return ("");
+	std::string path(buf, n);
+	static const std::string deleted = " (deleted)";
+	if (path.size() > deleted.size() && path.compare(path.size() - deleted.size(), deleted.size(), deleted) == 0)
+		path.erase(path.size() - deleted.size());
+	return (path);
+}
+
+//* UPGRADE step 1: start the new binary and keep serving until it is READY
+bool Server::beginUpgrade(unsigned long requester, std::string& error)
+{
+	if (upgrade_sock_ >= 0)
+		return (error = "an upgrade is already in progress", false);
+	if (draining_)
+		return (error = "the server is shutting down", false);
+
+	std::string path = config_.upgradeBinary.empty() ? currentExecutable() : config_.upgradeBinary;
+	if (path.empty() || access(path.c_str(), X_OK) != 0)
+		return (error = "cannot execute '" + path + "'", false);
+
+	int pair[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+		return (error = std::string("socketpair: ") + std::strerror(errno), false);
+
+	std::ostringstream portArg;
+	portArg << port_;
+	//* Everything the child must not keep, listed before fork(): the poll set
+	//* (listeners, clients, links, scrapes) and an open CAPTURE file
+	std::vector<int> inherited;
+	for (size_t i = 0; i < poll_fds_.size(); ++i)
+		inherited.push_back(poll_fds_[i].fd);
+	for (size_t i = 0; i < clients_.size(); ++i)
+		inherited.push_back(clients_[i]->getFd());
+	for (size_t i = 0; i < listeners_.size(); ++i)
+		inherited.push_back(listeners_[i].fd);
+	if (capture_.fd() >= 0)
+		inherited.push_back(capture_.fd());
+	inherited.push_back(pair[0]);
+
+	std::vector<std::string> args;
+	args.push_back(path);
+	args.push_back(portArg.str());
+	args.push_back(password_);
+	if (!config_.path.empty())
+		args.push_back(config_.path);
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(pair[0]);
+		close(pair[1]);
+		return (error = std::string("fork: ") + std::strerror(errno), false);
+	}
+	if (pid == 0)
+	{
+		//* Child: keep only the socketpair end; every socket arrives again
+		//* over SCM_RIGHTS, a stray inherited copy would hold it open forever
+		int sock = pair[1];
+		for (size_t i = 0; i < inherited.size(); ++i)
+			if (inherited[i] > 2 && inherited[i] != sock)
+				close(inherited[i]);
+		char env[32];
+		std::snprintf(env, sizeof(env), "%d", sock);
+		setenv(HotUpgrade::ENV_FD, env, 1);
+		std::vector<char*> argv;
+		for (size_t i = 0; i < args.size(); ++i)
+			argv.push_back(const_cast<char*>(args[i].c_str()));
+		argv.push_back(NULL);
+		execv(path.c_str(), &argv[0]);
+		_exit(127);
+	}
+
+	close(pair[1]);
+	upgrade_sock_ = pair[0];
+	upgrade_pid_ = pid;
+	upgrade_deadline_ = std::time(NULL) + UPGRADE_READY_TIMEOUT;
+	upgrade_requester_ = requester;
+	std::cout << "[SERVER] Upgrade: started " << path << " (pid " << pid << ")" << std::endl;
+	return (true);
+}
+
+//* Called every loop iteration while an upgrade is pending
+void Server::pollUpgrade()
+{
+	int byte = HotUpgrade::receiveByte(upgrade_sock_, false);
+	if (byte == HotUpgrade::READY)
+		return handOffUpgrade();
+	if (byte == 0)
+		return abortUpgrade("the new binary exited before it was ready");
+	if (std::time(NULL) >= upgrade_deadline_)
+		abortUpgrade("the new binary did not get ready in time");
+}
+
+void Server::abortUpgrade(const std::string& reason)
+{
+	if (upgrade_pid_ > 0)
+	{
+		kill(upgrade_pid_, SIGKILL);
+		waitpid(upgrade_pid_, NULL, 0);
+	}
+	close(upgrade_sock_);
+	upgrade_sock_ = -1;
+	upgrade_pid_ = 0;
+	std::cerr << "[SERVER] Upgrade aborted: " << reason << std::endl;
+	for (size_t i = 0; i < clients_.size(); ++i)
+	{
+		if (clients_[i]->getId() == upgrade_requester_ && clients_[i]->isRegistered())
+			clients_[i]->queueSend(":ft_irc NOTICE " + clients_[i]->getUser()->getNickname()
+				+ " :Upgrade aborted: " + reason + "\r\n");
+	}
+}
+
+//* UPGRADE step 2: freeze, serialise, pass every socket, wait for ACK, exit.
+//* Nothing is read or written on the client sockets from here on: whatever
+//* is buffered travels in the state.
+void Server::handOffUpgrade()
+{
+	unsigned long frozenAt = HotUpgrade::monotonicUs();
+
+	stopCapture();
+	finishStreams();
+	//* Connections already closing are finished here (their QUIT reaches
+	//* the others through the buffers that are handed over). Server links
+	//* go too: the tree sees a netsplit and the connect lines relink.
+	for (size_t i = 0; i < poll_fds_.size(); )
+	{
+		ClientConnection* client = findClientByFd(poll_fds_[i].fd);
+		if (client && (client->isClosed() || client->getKind() != ClientConnection::KIND_CLIENT))
+			disconnectClient(i);
+		else
+			i++;
+	}
+	history_store_.close();							//* The new process maps it again
+
+	std::string state;
+	std::vector<int> fds;
+	encodeUpgradeState(state, fds);
+
+	if (!HotUpgrade::sendState(upgrade_sock_, state, fds, frozenAt)
+		|| HotUpgrade::receiveByte(upgrade_sock_, true, UPGRADE_ACK_TIMEOUT_MS) != HotUpgrade::ACK)
+	{
+		openHistoryStore();
+		return abortUpgrade("the new binary did not accept the state");
+	}
+
+	//* No destructor: it would shutdown() the sockets the new process owns
+	std::cout << "[SERVER] Upgrade: handed off " << clients_.size() << " clients, " << state.size()
+			  << " bytes of state in " << (HotUpgrade::monotonicUs() - frozenAt) / 1000.0 << " ms" << std::endl;
+	_exit(0);
+}
+
+//* Layout (HotUpgrade::Writer): counters; listeners; connections (+ User, MONITOR list);
+//* channels (modes, invites, b/e/I lists, members by connection index, history ring).
+//* fds: the listeners', then the connections', in the same order.
+void Server::encodeUpgradeState(std::string& out, std::vector<int>& fds)
+{
+	HotUpgrade::Writer w;
+	w.put(next_conn_id_);
+	w.put(next_msgid_);
+	w.put(next_batch_);
+	w.put(next_uid_);
+	w.put(static_cast<long>(started_at_));
+	w.put(upgrade_requester_);
+
+	w.put(static_cast<unsigned int>(listeners_.size()));
+	for (size_t i = 0; i < listeners_.size(); ++i)
+	{
+		const Listener& l = listeners_[i];
+		w.put(static_cast<int>(l.kind));
+		w.put(static_cast<int>(l.role));
+		w.putString(l.host);
+		w.put(l.port);
+		w.putString(l.path);
+		w.put(static_cast<unsigned char>(l.v6only));
+		w.put(l.acceptBudget);
+		fds.push_back(l.fd);
+	}
+
+	std::map<User*, unsigned int> index;
+	w.put(static_cast<unsigned int>(clients_.size()));
+	for (size_t i = 0; i < clients_.size(); ++i)
+	{
+		ClientConnection* c = clients_[i];
+		w.put(c->getId());
+		w.putString(c->getHost());
+		w.put(c->getAddress());
+		w.putString(c->getRecvBuffer());
+		w.putString(c->getPendingOutput());		//* Both lanes, in flush order
+		w.put(static_cast<unsigned char>(c->isRegistered()));
+		w.put(static_cast<unsigned char>(c->hasSentPass()));
+		w.put(static_cast<unsigned char>(c->isCapNegotiating()));
+		w.put(c->getCaps());
+		w.put(static_cast<long>(c->getLastActivity()));
+		User* u = c->getUser();
+		w.put(static_cast<unsigned char>(u != NULL));
+		if (u)
+		{
+			index[u] = static_cast<unsigned int>(i);
+			w.putString(u->getNickname());
+			w.putString(u->getUsername());
+			w.putString(u->getRealname());
+			w.putString(u->getHostname());
+			w.put(static_cast<unsigned char>(u->isOperator()));
+			w.put(static_cast<unsigned char>(u->isInvisible()));
+			w.put(static_cast<unsigned char>(u->isAway()));
+			w.putString(u->getAwayMessage());
+			w.putString(u->getUid());
+			w.put(static_cast<long>(u->getNickTs()));
+		}
+		const MonitorIndex::List* watching = monitor_.list(c);
+		w.put(static_cast<unsigned int>(watching ? watching->size() : 0));
+		if (watching)
+			for (MonitorIndex::List::const_iterator it = watching->begin(); it != watching->end(); ++it)
+				w.putString(*it);
+		fds.push_back(c->getFd());
+	}
+
+	w.put(static_cast<unsigned int>(channels_.size()));
+	for (size_t i = 0; i < channels_.size(); ++i)
+	{
+		const Channel* ch = channels_[i];
+		w.putString(ch->getName());
+		w.putString(ch->getTopic());
+		w.putString(ch->hasMode('k') ? ch->getKey() : "");
+		w.put(ch->hasMode('l') ? ch->getLimit() : 0);
+		w.put(static_cast<unsigned char>(ch->hasMode('i')));
+		w.put(static_cast<unsigned char>(ch->hasMode('t')));
+		w.put(static_cast<unsigned char>(ch->hasMode('u')));
+		w.put(static_cast<long>(ch->getCreatedAt()));
+
+		const std::set<std::string>& invites = ch->getInvites();
+		w.put(static_cast<unsigned int>(invites.size()));
+		for (std::set<std::string>::const_iterator it = invites.begin(); it != invites.end(); ++it)
+			w.putString(*it);
+		const std::set<std::string>& restored = ch->getRestoredOperators();
+		w.put(static_cast<unsigned int>(restored.size()));
+		for (std::set<std::string>::const_iterator it = restored.begin(); it != restored.end(); ++it)
+			w.putString(*it);
+		for (const char* mode = "beI"; *mode; ++mode)
+		{
+			const std::list<MaskList::Entry>& entries = ch->getMaskList(*mode)->entries();
+			w.put(static_cast<unsigned int>(entries.size()));
+			for (std::list<MaskList::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			{
+				w.putString(it->mask);
+				w.putString(it->setter);
+				w.put(static_cast<long>(it->setAt));
+			}
+		}
+
+		const std::vector<User*>& members = ch->getMembers();
+		w.put(static_cast<unsigned int>(members.size()));
+		for (size_t m = 0; m < members.size(); ++m)
+			w.put(index[members[m]] | (ch->isOperator(members[m]) ? 0x80000000u : 0));
+
+		std::vector<const ChannelHistory::Entry*> entries;
+		ch->getHistory().latest(ch->getHistory().size(), entries);
+		w.put(static_cast<unsigned int>(entries.size()));
+		for (size_t e = 0; e < entries.size(); ++e)
+		{
+			w.put(entries[e]->msgid);
+			w.put(entries[e]->timeMs);
+			w.putString(entries[e]->line.str());
+		}
+	}
+	out.swap(w.data);
+}
+
+//* ============================================================================
+//* NEW PROCESS
+//* ============================================================================
+
+//* Instead of binding: READY, receive the state and the sockets, rebuild,
+//* ACK. Any failure after the fds arrived exits at once, without the
+//* destructor: the old process still owns those sockets and resumes.
+bool Server::adoptUpgrade()
+{
+	int sock = adopt_fd_;
+	adopt_fd_ = -1;
+
+	std::string state;
+	std::vector<int> fds;
+	unsigned long frozenAt = 0;
+	if (!HotUpgrade::sendByte(sock, HotUpgrade::READY) || !HotUpgrade::receiveState(sock, state, fds, frozenAt))
+	{
+		std::cerr << "[SERVER] Upgrade: no state received" << std::endl;
+		_exit(1);
+	}
+	//* The old process closed the store before sending: map it first, so
+	//* the channels get the ring budget that goes with it
+	openHistoryStore();
+	unsigned long requester = 0;
+	if (!decodeUpgradeState(state, fds, requester))
+	{
+		std::cerr << "[SERVER] Upgrade: state rejected (different version?)" << std::endl;
+		_exit(1);
+	}
+	if (!HotUpgrade::sendByte(sock, HotUpgrade::ACK))
+		_exit(1);
+	close(sock);
+
+	double pauseMs = (HotUpgrade::monotonicUs() - frozenAt) / 1000.0;
+	std::ostringstream done;
+	done << "Upgrade complete: " << clients_.size() << " clients, " << channels_.size()
+		 << " channels, paused " << pauseMs << " ms";
+	std::cout << "[SERVER] " << done.str() << std::endl;
+	for (size_t i = 0; i < clients_.size(); ++i)
+	{
+		if (clients_[i]->getId() == requester && clients_[i]->isRegistered())
+			clients_[i]->queueSend(":ft_irc NOTICE " + clients_[i]->getUser()->getNickname()
+				+ " :" + done.str() + "\r\n");
+	}
+	running_ = true;
+	return (true);
+}
+
+bool Server::decodeUpgradeState(const std::string& state, const std::vector<int>& fds, unsigned long& requester)
+{
+	HotUpgrade::Reader r(state);
+	size_t nextFd = 0;
+	time_t now = std::time(NULL);
+
+	next_conn_id_ = r.get<unsigned long>();
+	next_msgid_ = r.get<unsigned long>();
+	next_batch_ = r.get<unsigned long>();
+	next_uid_ = r.get<unsigned long>();
+	started_at_ = static_cast<time_t>(r.get<long>());
+	requester = r.get<unsigned long>();
+
+	unsigned int listenerCount = r.get<unsigned int>();
+	for (unsigned int i = 0; i < listenerCount && r.ok() && nextFd < fds.size(); ++i)
+	{
+		Listener l;
+		l.kind = static_cast<Listener::Kind>(r.get<int>());
+		l.role = static_cast<Listener::Role>(r.get<int>());
+		l.host = r.getString();
+		l.port = r.get<int>();
+		l.path = r.getString();
+		l.v6only = r.get<unsigned char>() != 0;
+		l.acceptBudget = r.get<unsigned int>();
+		l.fd = fds[nextFd++];
+		listeners_.push_back(l);
+
+		struct pollfd pfd;
+		pfd.fd = l.fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		poll_fds_.push_back(pfd);
+		std::cout << "[SERVER] ✓ Adopted " << l.describe()
+				  << (l.role == Listener::ROLE_METRICS ? " [metrics]" : "") << " (fd=" << l.fd << ")" << std::endl;
+	}
+
+	unsigned int clientCount = r.get<unsigned int>();
+	clients_.reserve(clientCount);
+	for (unsigned int i = 0; i < clientCount && r.ok() && nextFd < fds.size(); ++i)
+	{
+		unsigned long id = r.get<unsigned long>();
+		std::string host = r.getString();
+		NetAddress addr = r.get<NetAddress>();
+		std::string recvBuf = r.getString();
+		std::string sendBuf = r.getString();
+		bool registered = r.get<unsigned char>() != 0;
+		bool sentPass = r.get<unsigned char>() != 0;
+		bool capNegotiating = r.get<unsigned char>() != 0;
+		unsigned int caps = r.get<unsigned int>();
+		time_t lastActivity = static_cast<time_t>(r.get<long>());
+		int fd = fds[nextFd++];
+
+		ClientConnection* c = new ClientConnection(fd, id, host, addr);
+		c->restoreBuffers(recvBuf, sendBuf);
+		c->setLastActivity(lastActivity);
+		if (sentPass)
+			c->markPassReceived();
+		c->setCapNegotiating(capNegotiating);
+		c->setCaps(caps);
+		if (r.get<unsigned char>())
+		{
+			User* u = ensureUser(c);
+			setLocalNick(u, r.getString());
+			u->setUsername(r.getString());
+			u->setRealname(r.getString());
+			u->setHostname(r.getString());
+			u->setOperator(r.get<unsigned char>() != 0);
+			u->setInvisible(r.get<unsigned char>() != 0);
+			u->setAway(r.get<unsigned char>() != 0);
+			u->setAwayMessage(r.getString());
+			u->setUid(r.getString());
+			u->setNickTs(static_cast<time_t>(r.get<long>()));
+			if (!u->getUid().empty())
+				uids_[u->getUid()] = u;
+		}
+		c->setRegistered(registered);
+		for (unsigned int m = r.get<unsigned int>(); m > 0; --m)
+			monitor_.add(c, r.getString());
+
+		clients_.push_back(c);
+		if (by_fd_.size() <= static_cast<size_t>(fd))
+			by_fd_.resize(fd + 1, NULL);
+		by_fd_[fd] = c;
+		addClientToPoll(c);
+		if (!addr.isZero())
+			addresses_.adopt(addr, now);
+		if (!registered)
+		{
+			//* Fresh deadline: the old one lived in the other process
+			unregistered_count_++;
+			timers_.schedule(now, config_.registrationTimeout, fd, id, TimerWheel::REGISTRATION_DEADLINE);
+		}
+	}
+
+	unsigned int channelCount = r.get<unsigned int>();
+	channels_.reserve(channelCount);
+	for (unsigned int i = 0; i < channelCount && r.ok(); ++i)
+	{
+		Channel* ch = createChannel(r.getString());
+		ch->setTopic(r.getString());
+		ch->setKey(r.getString());
+		ch->setLimit(r.get<int>());
+		ch->setMode('i', r.get<unsigned char>() != 0);
+		ch->setMode('t', r.get<unsigned char>() != 0);
+		ch->setMode('u', r.get<unsigned char>() != 0);
+		ch->setCreatedAt(static_cast<time_t>(r.get<long>()));
+
+		unsigned int invites = r.get<unsigned int>();
+		for (unsigned int k = 0; k < invites && r.ok(); ++k)
+			ch->addInvite(r.getString());
+		unsigned int restored = r.get<unsigned int>();
+		for (unsigned int k = 0; k < restored && r.ok(); ++k)
+			ch->addRestoredOperator(r.getString());
+		for (const char* mode = "beI"; *mode; ++mode)
+		{
+			unsigned int count = r.get<unsigned int>();
+			for (unsigned int k = 0; k < count && r.ok(); ++k)
+			{
+				std::string mask = r.getString();
+				std::string setter = r.getString();
+				ch->getMaskList(*mode)->add(mask, setter, static_cast<time_t>(r.get<long>()));
+			}
+		}
+
+		unsigned int members = r.get<unsigned int>();
+		for (unsigned int m = 0; m < members && r.ok(); ++m)
+		{
+			unsigned int ref = r.get<unsigned int>();
+			unsigned int idx = ref & 0x7FFFFFFFu;
+			User* u = (idx < clients_.size()) ? clients_[idx]->getUser() : NULL;
+			if (!u)
+				return (false);
+			ch->addMember(u);
+			u->joinChannel(ch);
+			if (ref & 0x80000000u)
+				ch->addOperator(u);
+		}
+
+		unsigned int history = r.get<unsigned int>();
+		for (unsigned int h = 0; h < history && r.ok(); ++h)
+		{
+			unsigned long msgid = r.get<unsigned long>();
+			long long timeMs = r.get<long long>();
+			ch->getHistory().append(SharedLine(r.getString()), msgid, timeMs);
+		}
+	}
+	return (r.done() && nextFd == fds.size());
+}
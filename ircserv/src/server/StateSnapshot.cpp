@@ -0,0 +1,320 @@
+#include "StateSnapshot.hpp"
+#include "../channel/Channel.hpp"
+#include "../client/User.hpp"
+#include <map>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ========================================================================
+// 								Encode
+// ========================================================================
+
+template <typename T>
+static void put(std::string& out, const T& value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static unsigned short clip(const std::string& s)
+{
+	return static_cast<unsigned short>(s.size() > 0xFFFF ? 0xFFFF : s.size());
+}
+
+void StateSnapshot::encode(const std::vector<Channel*>& channels, unsigned long nextMsgid, std::string& out)
+{
+	//* Users table: each member once, in first-seen order
+	std::map<User*, unsigned int> ids;
+	std::vector<User*> users;
+	for (size_t c = 0; c < channels.size(); ++c)
+	{
+		const std::vector<User*>& members = channels[c]->getMembers();
+		for (size_t m = 0; m < members.size(); ++m)
+			if (ids.insert(std::make_pair(members[m], static_cast<unsigned int>(users.size()))).second)
+				users.push_back(members[m]);
+	}
+
+	FileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "IRCSNP1", 8);
+	header.version = VERSION;
+	header.headerSize = sizeof(FileHeader);
+	header.createdAt = static_cast<unsigned long>(std::time(NULL));
+	header.nextMsgid = nextMsgid;
+	header.userCount = static_cast<unsigned int>(users.size());
+	header.channelCount = static_cast<unsigned int>(channels.size());
+
+	out.clear();
+	out.reserve(sizeof(header) + users.size() * 64 + channels.size() * 96);
+	put(out, header);
+
+	for (size_t i = 0; i < users.size(); ++i)
+	{
+		UserRecord r;
+		r.nickLength = clip(users[i]->getNickname());
+		r.userLength = clip(users[i]->getUsername());
+		r.hostLength = clip(users[i]->getHostname());
+		r.realLength = clip(users[i]->getRealname());
+		put(out, r);
+		out.append(users[i]->getNickname(), 0, r.nickLength);
+		out.append(users[i]->getUsername(), 0, r.userLength);
+		out.append(users[i]->getHostname(), 0, r.hostLength);
+		out.append(users[i]->getRealname(), 0, r.realLength);
+	}
+
+	for (size_t c = 0; c < channels.size(); ++c)
+	{
+		const Channel* channel = channels[c];
+		const std::set<std::string>& invites = channel->getInvites();
+		const std::vector<User*>& members = channel->getMembers();
+
+		ChannelRecord r;
+		r.limit = channel->hasMode('l') ? static_cast<unsigned int>(channel->getLimit()) : 0;
+		r.inviteCount = static_cast<unsigned int>(invites.size());
+		r.memberCount = static_cast<unsigned int>(members.size());
+		r.nameLength = clip(channel->getName());
+		r.topicLength = clip(channel->getTopic());
+		r.keyLength = channel->hasMode('k') ? clip(channel->getKey()) : 0;
+		r.flags = (channel->hasMode('i') ? FLAG_INVITE_ONLY : 0) | (channel->hasMode('t') ? FLAG_TOPIC_OPS : 0)
+			| (channel->hasMode('u') ? FLAG_AUDITORIUM : 0);
+		put(out, r);
+		out.append(channel->getName(), 0, r.nameLength);
+		out.append(channel->getTopic(), 0, r.topicLength);
+		out.append(channel->getKey(), 0, r.keyLength);
+
+		for (std::set<std::string>::const_iterator it = invites.begin(); it != invites.end(); ++it)
+		{
+			unsigned short length = clip(*it);
+			put(out, length);
+			out.append(*it, 0, length);
+		}
+		for (size_t m = 0; m < members.size(); ++m)
+		{
+			unsigned int id = ids[members[m]];
+			if (channel->isOperator(members[m]))
+				id |= MEMBER_OPERATOR;
+			put(out, id);
+		}
+
+		const char lists[] = "beI";
+		unsigned int maskCount = 0;
+		for (size_t l = 0; l < 3; ++l)
+			maskCount += static_cast<unsigned int>(channel->getMaskList(lists[l])->size());
+		put(out, maskCount);
+		for (size_t l = 0; l < 3; ++l)
+		{
+			const std::list<MaskList::Entry>& entries = channel->getMaskList(lists[l])->entries();
+			for (std::list<MaskList::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			{
+				MaskRecord m;
+				std::memset(&m, 0, sizeof(m));
+				m.setAt = static_cast<unsigned long>(it->setAt);
+				m.maskLength = clip(it->mask);
+				m.setterLength = clip(it->setter);
+				m.mode = lists[l];
+				put(out, m);
+				out.append(it->mask, 0, m.maskLength);
+				out.append(it->setter, 0, m.setterLength);
+			}
+		}
+	}
+
+	reinterpret_cast<FileHeader*>(&out[0])->fileBytes = out.size();
+}
+
+bool StateSnapshot::writeFile(const std::string& path, const std::string& data)
+{
+	std::string tmp = path + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0640);
+	if (fd < 0)
+		return false;
+	size_t done = 0;
+	while (done < data.size())
+	{
+		ssize_t n = write(fd, data.data() + done, data.size() - done);
+		if (n <= 0)
+			break;
+		done += static_cast<size_t>(n);
+	}
+	bool ok = (done == data.size() && fsync(fd) == 0);
+	close(fd);
+	if (!ok || std::rename(tmp.c_str(), path.c_str()) < 0)
+	{
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+// ========================================================================
+// 								Load
+// ========================================================================
+
+namespace
+{
+	//* Bounds-checked forward reader over the mapping
+	struct Reader
+	{
+		const char*	at;
+		const char*	end;
+
+		bool	take(void* out, size_t n)
+		{
+			if (static_cast<size_t>(end - at) < n)
+				return false;
+			std::memcpy(out, at, n);
+			at += n;
+			return true;
+		}
+
+		bool	take(std::string& out, size_t n)
+		{
+			if (static_cast<size_t>(end - at) < n)
+				return false;
+			out.assign(at, n);
+			at += n;
+			return true;
+		}
+	};
+}
+
+//* The counts come from the file: each record has at least its fixed part, so
+//* counts the remaining bytes cannot hold mean a corrupt file, not a big table
+static bool countsFit(const Reader& in, const StateSnapshot::FileHeader& header)
+{
+	size_t bytes = static_cast<size_t>(in.end - in.at);
+	if (header.userCount > bytes / sizeof(StateSnapshot::UserRecord))
+		return false;
+	bytes -= header.userCount * sizeof(StateSnapshot::UserRecord);
+	return header.channelCount <= bytes / sizeof(StateSnapshot::ChannelRecord);
+}
+
+static bool decode(Reader& in, const StateSnapshot::FileHeader& header, std::vector<Channel*>& channels)
+{
+	//* Only operators need their mask back: "nick!user@host"
+	std::vector<std::string> masks(header.userCount);
+	for (unsigned int i = 0; i < header.userCount; ++i)
+	{
+		StateSnapshot::UserRecord r;
+		std::string nick;
+		std::string user;
+		std::string host;
+		std::string real;
+		if (!in.take(&r, sizeof(r)) || !in.take(nick, r.nickLength) || !in.take(user, r.userLength)
+			|| !in.take(host, r.hostLength) || !in.take(real, r.realLength))
+			return false;
+		masks[i] = nick + "!" + user + "@" + host;
+	}
+
+	for (unsigned int c = 0; c < header.channelCount; ++c)
+	{
+		StateSnapshot::ChannelRecord r;
+		std::string name;
+		std::string topic;
+		std::string key;
+		if (!in.take(&r, sizeof(r)) || !in.take(name, r.nameLength) || !in.take(topic, r.topicLength)
+			|| !in.take(key, r.keyLength) || name.empty())
+			return false;
+
+		Channel* channel = new Channel(name);
+		channels.push_back(channel);
+		channel->setTopic(topic);
+		channel->setKey(key);
+		channel->setLimit(static_cast<int>(r.limit));
+		channel->setMode('i', r.flags & StateSnapshot::FLAG_INVITE_ONLY);
+		channel->setMode('t', r.flags & StateSnapshot::FLAG_TOPIC_OPS);
+		channel->setMode('u', r.flags & StateSnapshot::FLAG_AUDITORIUM);
+
+		for (unsigned int i = 0; i < r.inviteCount; ++i)
+		{
+			unsigned short length;
+			std::string nick;
+			if (!in.take(&length, sizeof(length)) || !in.take(nick, length))
+				return false;
+			channel->addInvite(nick);
+		}
+		for (unsigned int m = 0; m < r.memberCount; ++m)
+		{
+			unsigned int id;
+			if (!in.take(&id, sizeof(id)) || (id & ~StateSnapshot::MEMBER_OPERATOR) >= header.userCount)
+				return false;
+			if (id & StateSnapshot::MEMBER_OPERATOR)
+				channel->addRestoredOperator(masks[id & ~StateSnapshot::MEMBER_OPERATOR]);
+		}
+
+		unsigned int maskCount = 0;
+		if (header.version >= 2 && !in.take(&maskCount, sizeof(maskCount)))
+			return false;
+		for (unsigned int i = 0; i < maskCount; ++i)
+		{
+			StateSnapshot::MaskRecord m;
+			std::string mask;
+			std::string setter;
+			if (!in.take(&m, sizeof(m)) || !in.take(mask, m.maskLength) || !in.take(setter, m.setterLength)
+				|| !channel->getMaskList(m.mode))
+				return false;
+			channel->getMaskList(m.mode)->add(mask, setter, static_cast<time_t>(m.setAt));
+		}
+	}
+	return in.at == in.end;
+}
+
+bool StateSnapshot::load(const std::string& path, std::vector<Channel*>& channels, unsigned long& nextMsgid,
+	std::string& error)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		error = path + ": " + std::strerror(errno);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	size_t size = static_cast<size_t>(st.st_size);
+	void* base = size >= sizeof(FileHeader) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		error = path + ": too short or cannot map";
+		return false;
+	}
+	madvise(base, size, MADV_SEQUENTIAL);
+
+	FileHeader header;
+	std::memcpy(&header, base, sizeof(header));
+	if (std::memcmp(header.magic, "IRCSNP1", 8) != 0 || (header.version != 1 && header.version != VERSION)
+		|| header.headerSize != sizeof(FileHeader) || header.fileBytes != size)
+	{
+		munmap(base, size);
+		error = path + ": not a snapshot, or truncated";
+		return false;
+	}
+
+	Reader in;
+	in.at = static_cast<const char*>(base) + sizeof(FileHeader);
+	in.end = static_cast<const char*>(base) + size;
+	size_t before = channels.size();
+	bool ok = countsFit(in, header);
+	if (ok)
+	{
+		channels.reserve(before + header.channelCount);
+		ok = decode(in, header, channels);
+	}
+	munmap(base, size);
+	if (!ok)
+	{
+		for (size_t i = before; i < channels.size(); ++i)
+			delete channels[i];
+		channels.resize(before);
+		error = path + ": corrupt record";
+		return false;
+	}
+	nextMsgid = header.nextMsgid;
+	return true;
+}
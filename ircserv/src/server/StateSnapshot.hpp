@@ -0,0 +1,107 @@
+#ifndef STATE_SNAPSHOT_HPP
+#define STATE_SNAPSHOT_HPP
+
+#include <string>
+#include <vector>
+
+class Channel;
+
+/**
+ * StateSnapshot: channel state saved across restarts
+ *
+ * What a restart would otherwise lose: every channel's topic, key, limit,
+ * +i/+t/+u, invite list, +b/+e/+I lists and who its operators were.
+ * Members are written once in a user table (nick, user, host, realname)
+ * and channels refer to them by index, with the top bit marking an operator.
+ *
+ * The server encodes the snapshot in a fork()ed child (the parent's memory
+ * is shared copy-on-write, so the loop never waits for the disk), writes it
+ * to a temporary file and renames it over the old one: a reader sees the
+ * previous snapshot or the new one, never half of one.
+ *
+ * load() maps the file once, sizes the channel table from the header and
+ * builds the channels with a single forward pass over the records.
+ *
+ * File layout (little endian, as written by the host; strings unterminated):
+ *   FileHeader
+ *   { UserRecord; nick; user; host; realname } * userCount
+ *   { ChannelRecord; name; topic; key;
+ *     { u16 length; nick } * inviteCount; u32 member * memberCount;
+ *     u32 maskCount; { MaskRecord; mask; setter } * maskCount } * channelCount
+ *
+ * Version 1 files (no mask lists) are still read.
+ */
+
+class StateSnapshot
+{
+	public:
+		struct FileHeader
+		{
+			char			magic[8];				//* "IRCSNP1\0"
+			unsigned int	version;
+			unsigned int	headerSize;				//* sizeof(FileHeader)
+			unsigned long	createdAt;				//* Unix time
+			unsigned long	nextMsgid;				//* CHATHISTORY sequence
+			unsigned long	fileBytes;				//* Whole file: a short file is rejected
+			unsigned int	userCount;
+			unsigned int	channelCount;
+		};
+
+		struct UserRecord
+		{
+			unsigned short	nickLength;
+			unsigned short	userLength;
+			unsigned short	hostLength;
+			unsigned short	realLength;
+		};
+
+		struct ChannelRecord
+		{
+			unsigned int	limit;
+			unsigned int	inviteCount;
+			unsigned int	memberCount;
+			unsigned short	nameLength;
+			unsigned short	topicLength;
+			unsigned short	keyLength;
+			unsigned short	flags;					//* ChannelFlag bits
+		};
+
+		struct MaskRecord
+		{
+			unsigned long	setAt;
+			unsigned short	maskLength;
+			unsigned short	setterLength;
+			char			mode;					//* 'b', 'e' or 'I'
+		};
+
+		enum ChannelFlag
+		{
+			FLAG_INVITE_ONLY = 1,
+			FLAG_TOPIC_OPS = 2,
+			FLAG_AUDITORIUM = 4
+		};
+
+		static const unsigned int VERSION = 2;
+		static const unsigned int MEMBER_OPERATOR = 0x80000000u;
+
+		//* Serialize the channels (and their members) into 'out'
+		static void	encode(const std::vector<Channel*>& channels, unsigned long nextMsgid, std::string& out);
+
+		//* 'path'.tmp, fsync, rename over 'path'
+		static bool	writeFile(const std::string& path, const std::string& data);
+
+		/**
+		 * Map 'path' and rebuild its channels
+		 *
+		 * @param channels [OUT] Reserved to the stored count, then appended to
+		 * @param nextMsgid [OUT] Sequence saved with the snapshot
+		 * @param error [OUT] Why nothing was restored
+		 */
+		static bool	load(const std::string& path, std::vector<Channel*>& channels, unsigned long& nextMsgid,
+						std::string& error);
+
+	private:
+		StateSnapshot();
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "TimerWheel.hpp"
+
+TimerWheel::TimerWheel(size_t slots) : slots_(slots), cursor_(0), now_(std::time(NULL)), count_(0)
+{
+}
+
+void TimerWheel::schedule(time_t now, unsigned int delay, int fd, unsigned long connId, Kind kind)
+{
+	//* Align with the wheel: a late advance() must not shorten the deadline
+	if (now < now_)
+		now = now_;
+	size_t ticks = static_cast<size_t>(now - now_) + (delay ? delay : 1);
+
+	Entry entry;
+	entry.timer.fd = fd;
+	entry.timer.connId = connId;
+	entry.timer.kind = kind;
+	entry.rounds = static_cast<unsigned int>((ticks - 1) / slots_.size());
+
+	slots_[(cursor_ + ticks) % slots_.size()].push_back(entry);
+	count_++;
+}
+
+void TimerWheel::advance(time_t now, std::vector<Timer>& expired)
+{
+	//* Clock went backwards: just resync, nothing fires early
+	if (now <= now_)
+	{
+		if (now < now_)
+			now_ = now;
+		return;
+	}
+
+	//* Empty wheel: jump straight to 'now'. Otherwise walk every second
+	//* missed (e.g. a slow iteration) so no slot is skipped.
+	time_t steps = now - now_;
+	if (count_ == 0)
+	{
+		cursor_ = (cursor_ + steps) % slots_.size();
+		now_ = now;
+		return;
+	}
+
+	for (time_t s = 0; s < steps; ++s)
+	{
+		cursor_ = (cursor_ + 1) % slots_.size();
+		std::vector<Entry>& slot = slots_[cursor_];
+
+		size_t keep = 0;
+		for (size_t i = 0; i < slot.size(); ++i)
+		{
+			if (slot[i].rounds == 0)
+			{
+				expired.push_back(slot[i].timer);
+				count_--;
+			}
+			else
+			{
+				slot[i].rounds--;
+				slot[keep++] = slot[i];
+			}
+		}
+		slot.resize(keep);
+	}
+	now_ = now;
+}
+
+bool TimerWheel::empty() const
+{
+	return (count_ == 0);
+}
+
+size_t TimerWheel::size() const
+{
+	return (count_);
+}
@@ -0,0 +1,60 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <vector>
+#include <ctime>
+
+/**
+ * TimerWheel: hashed timing wheel with one-second resolution
+ *
+ * Scheduling and expiring are O(1) per timer, no matter how many connections
+ * are waiting. Deadlines further away than the wheel size just go around
+ * again (rounds counter).
+ *
+ * There is no cancel(): a timer carries the fd AND the connection id it was
+ * armed for, and the owner re-validates it when it fires. If the connection
+ * is gone, the fd was reused, or the condition no longer holds (e.g. the
+ * client registered in time), the expired timer is simply ignored.
+ */
+
+class TimerWheel
+{
+	public:
+		enum Kind
+		{
+			REGISTRATION_DEADLINE,						//* Close if still unregistered
+			DRAIN_DEADLINE								//* Force close if still draining
+		};
+
+		struct Timer
+		{
+			int				fd;
+			unsigned long	connId;						//* ClientConnection::getId() when armed
+			Kind			kind;
+		};
+
+		TimerWheel(size_t slots = 64);
+
+		//* Arm a timer 'delay' seconds after 'now'
+		void	schedule(time_t now, unsigned int delay, int fd, unsigned long connId, Kind kind);
+
+		//* Move the wheel up to 'now' and collect every timer that is due
+		void	advance(time_t now, std::vector<Timer>& expired);
+
+		bool	empty() const;
+		size_t	size() const;
+
+	private:
+		struct Entry
+		{
+			Timer			timer;
+			unsigned int	rounds;						//* Full turns left before it fires
+		};
+
+		std::vector< std::vector<Entry> >	slots_;
+		size_t								cursor_;	//* Slot of the last processed second
+		time_t								now_;		//* Last second processed
+		size_t								count_;
+};
+
+#endif
@@ -0,0 +1,146 @@
+// flightdump: print an ircserv flight recorder dump
+//
+//   make flightdump
+//   ./tools/flightdump ircserv-flight-<time>-<reason>.bin [-n LAST]
+//
+// One event per line, oldest first: wall clock time, time before the dump,
+// event type and its fields. Command / reason codes are resolved with the
+// name tables stored in the file itself.
+
+#include "FlightRecorder.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+typedef FlightRecorder::Event Event;
+typedef FlightRecorder::FileHeader FileHeader;
+
+static bool readExact(FILE* f, void* out, size_t size)
+{
+	return size == 0 || std::fread(out, 1, size, f) == size;
+}
+
+static const char* typeName(unsigned short type)
+{
+	switch (type)
+	{
+		case FlightRecorder::EV_ACCEPT:			return "ACCEPT";
+		case FlightRecorder::EV_REJECT:			return "REJECT";
+		case FlightRecorder::EV_DISCONNECT:		return "DISCONNECT";
+		case FlightRecorder::EV_COMMAND:		return "COMMAND";
+		case FlightRecorder::EV_DRAIN_TIMEOUT:	return "DRAIN_TIMEOUT";
+		case FlightRecorder::EV_LOOP_STALL:		return "LOOP_STALL";
+		case FlightRecorder::EV_DUMP:			return "DUMP";
+	}
+	return "?";
+}
+
+static std::string lookup(const std::vector<std::string>& table, unsigned short code)
+{
+	if (code == FlightRecorder::CODE_UNKNOWN)
+		return "<unknown>";
+	if (code < table.size())
+		return table[code];
+	char buf[16];
+	std::snprintf(buf, sizeof(buf), "#%u", code);
+	return buf;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2 && !(argc == 4 && std::strcmp(argv[2], "-n") == 0))
+	{
+		std::fprintf(stderr, "Usage: %s <dump.bin> [-n LAST]\n", argv[0]);
+		return 1;
+	}
+	unsigned long last = (argc == 4) ? std::strtoul(argv[3], NULL, 10) : 0;
+
+	FILE* f = std::fopen(argv[1], "rb");
+	if (!f)
+	{
+		std::perror(argv[1]);
+		return 1;
+	}
+
+	FileHeader header;
+	if (!readExact(f, &header, sizeof(header)) || std::memcmp(header.magic, "IRCFLT1", 8) != 0)
+	{
+		std::fprintf(stderr, "%s: not a flight recorder dump\n", argv[1]);
+		return 1;
+	}
+	if (header.version != FlightRecorder::VERSION || header.eventSize != sizeof(Event))
+	{
+		std::fprintf(stderr, "%s: unsupported version %u (event size %u)\n", argv[1],
+			header.version, header.eventSize);
+		return 1;
+	}
+
+	std::vector<std::string> tables[FlightRecorder::NAME_TABLE_COUNT];
+	for (int t = 0; t < FlightRecorder::NAME_TABLE_COUNT; ++t)
+	{
+		unsigned int count;
+		if (!readExact(f, &count, sizeof(count)))
+			return 1;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			unsigned char len;
+			char buf[256];
+			if (!readExact(f, &len, 1) || !readExact(f, buf, len))
+				return 1;
+			tables[t].push_back(std::string(buf, len));
+		}
+	}
+
+	std::printf("# %lu events (%lu recorded since start%s)\n", header.events, header.recorded,
+		header.recorded > header.events ? ", ring wrapped" : "");
+
+	unsigned long skip = (last && last < header.events) ? header.events - last : 0;
+	Event e;
+	for (unsigned long i = 0; i < header.events && readExact(f, &e, sizeof(e)); ++i)
+	{
+		if (i < skip)
+			continue;
+
+		unsigned long wall = header.startRealtimeNs + e.timeNs;
+		time_t sec = static_cast<time_t>(wall / 1000000000UL);
+		char stamp[32];
+		std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::localtime(&sec));
+		double before = (static_cast<double>(header.dumpTimeNs) - static_cast<double>(e.timeNs)) / 1e9;
+
+		std::printf("%s.%06lu -%.6fs %-13s", stamp, (wall % 1000000000UL) / 1000, before, typeName(e.type));
+		if (e.fd >= 0)
+			std::printf(" fd=%d", e.fd);
+		if (e.connId)
+			std::printf(" conn=%u", e.connId);
+
+		switch (e.type)
+		{
+			case FlightRecorder::EV_ACCEPT:
+				std::printf(" via=%s", e.code ? "unix" : "tcp");
+				break;
+			case FlightRecorder::EV_REJECT:
+				std::printf(" reason=%s", lookup(tables[FlightRecorder::TABLE_REJECT_REASONS], e.code).c_str());
+				break;
+			case FlightRecorder::EV_DISCONNECT:
+				std::printf(" reason=%s unsent=%u",
+					lookup(tables[FlightRecorder::TABLE_DISCONNECT_REASONS], e.code).c_str(), e.bytes);
+				break;
+			case FlightRecorder::EV_COMMAND:
+				std::printf(" %s %uns sendq=%u",
+					lookup(tables[FlightRecorder::TABLE_COMMANDS], e.code).c_str(), e.durationNs, e.bytes);
+				break;
+			case FlightRecorder::EV_DRAIN_TIMEOUT:
+				std::printf(" dropped=%u", e.bytes);
+				break;
+			case FlightRecorder::EV_LOOP_STALL:
+				std::printf(" busy=%uus", e.durationNs / 1000);
+				break;
+		}
+		std::printf("\n");
+	}
+	std::fclose(f);
+	return 0;
+}
@@ -0,0 +1,633 @@
+// ircbench: synthetic load generator for ircserv (localhost, epoll, non-blocking)
+//
+//   make bench
+//   ./tools/ircbench [options]
+//
+//   -p PORT[,PORT] server port (6667); a list spreads the clients round-robin
+//                  over linked servers (tools/linkbench.sh)
+//   -w PASS        connection password (password123)
+//   -c CLIENTS     simulated clients (1000; 50000 works with a raised ulimit -n)
+//   -C CHANNELS    channels in the topology (10)
+//   -j JOINS       channels joined per client (1)
+//   -t TOPOLOGY    uniform | single | zipf  (how clients are spread on channels)
+//   -s SCENARIO    privmsg | joinpart | nick
+//   -r RATE        operations per second, all clients together (1000)
+//   -d SECONDS     measured duration (10)
+//   -R RAMP        connections registering at the same time (200)
+//   -i PER_IP      clients per source address: 127.1.x.y (8)
+//
+// Every operation carries its send time: PRIVMSG and PART bodies embed
+// "BENCH <ns>", so each receiver measures end-to-end delivery latency;
+// JOIN and NICK are timed until the server echoes them back to the sender.
+// Source addresses are spread over 127.1.0.0/16 so per-address limits
+// (max_per_ip, connect_rate_limit) do not cap the run; for big runs give the
+// server e.g. "max_unregistered = 4096" and a matching ulimit -n.
+
+#include "Histogram.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <sstream>
+
+// ========================================================================
+// 							   Options
+// ========================================================================
+
+struct Options
+{
+	std::vector<int>	ports;
+	std::string		password;
+	unsigned int	clients;
+	unsigned int	channels;
+	unsigned int	joins;
+	std::string		topology;
+	std::string		scenario;
+	unsigned int	rate;
+	unsigned int	duration;
+	unsigned int	ramp;
+	unsigned int	perIp;
+
+	Options() : ports(1, 6667), password("password123"), clients(1000), channels(10), joins(1),
+		topology("uniform"), scenario("privmsg"), rate(1000), duration(10), ramp(200), perIp(8) {}
+};
+
+static void usage(const char* argv0)
+{
+	std::fprintf(stderr, "Usage: %s [-p port[,port...]] [-w pass] [-c clients] [-C channels] [-j joins]\n"
+		"       [-t uniform|single|zipf] [-s privmsg|joinpart|nick] [-r ops/s] [-d seconds]\n"
+		"       [-R ramp] [-i clients-per-ip]\n", argv0);
+	std::exit(2);
+}
+
+static bool parseOptions(int argc, char** argv, Options& o)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string flag = argv[i];
+		if (i + 1 >= argc)
+			return false;
+		std::string v = argv[++i];
+		unsigned int n = static_cast<unsigned int>(std::strtoul(v.c_str(), NULL, 10));
+		if (flag == "-p")
+		{
+			o.ports.clear();
+			std::istringstream list(v);
+			std::string port;
+			while (std::getline(list, port, ','))
+			{
+				o.ports.push_back(std::atoi(port.c_str()));
+				if (o.ports.back() <= 0)
+					return false;
+			}
+		}
+		else if (flag == "-w") o.password = v;
+		else if (flag == "-c") o.clients = n;
+		else if (flag == "-C") o.channels = n;
+		else if (flag == "-j") o.joins = n;
+		else if (flag == "-t") o.topology = v;
+		else if (flag == "-s") o.scenario = v;
+		else if (flag == "-r") o.rate = n;
+		else if (flag == "-d") o.duration = n;
+		else if (flag == "-R") o.ramp = n;
+		else if (flag == "-i") o.perIp = n;
+		else return false;
+	}
+	if (o.topology != "uniform" && o.topology != "single" && o.topology != "zipf")
+		return false;
+	if (o.scenario != "privmsg" && o.scenario != "joinpart" && o.scenario != "nick")
+		return false;
+	return o.clients > 0 && o.channels > 0 && o.joins > 0 && o.joins <= o.channels
+		&& o.ramp > 0 && o.perIp > 0 && !o.ports.empty();
+}
+
+// ========================================================================
+// 							   State
+// ========================================================================
+
+static unsigned long nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + static_cast<unsigned long>(ts.tv_nsec);
+}
+
+enum ClientState
+{
+	ST_IDLE,									//* Not connected yet
+	ST_CONNECTING,
+	ST_REGISTERING,
+	ST_JOINING,
+	ST_READY,
+	ST_DEAD
+};
+
+struct Client
+{
+	int					fd;
+	ClientState			state;
+	std::string			in;
+	std::string			out;
+	bool				wantWrite;
+	std::string			nick;
+	unsigned int		generation;				//* NICK storm: b<i>g<gen>
+	std::vector<unsigned int>	channels;
+	unsigned int		joinsPending;
+	bool				parted;					//* JOIN/PART storm: out of its first channel
+	unsigned long		pendingNs;				//* Echo-timed operation in flight (0 = none)
+	std::string			pendingNick;
+
+	Client() : fd(-1), state(ST_IDLE), wantWrite(false), generation(0), joinsPending(0),
+		parted(false), pendingNs(0) {}
+};
+
+struct Stats
+{
+	unsigned long	sent;
+	unsigned long	delivered;
+	unsigned long	echoed;
+	unsigned long	bytesIn;
+	unsigned long	errors;
+	Histogram		delivery;					//* ns, embedded timestamps
+	Histogram		echo;						//* ns, own JOIN/PART/NICK coming back
+
+	Stats() : sent(0), delivered(0), echoed(0), bytesIn(0), errors(0) {}
+};
+
+static Options				g_opt;
+static std::vector<Client>	g_clients;
+static int					g_epoll = -1;
+static Stats				g_stats;
+static bool					g_measuring = false;
+static unsigned int			g_registered = 0;
+static unsigned int			g_ready = 0;
+static unsigned int			g_inFlight = 0;	//* Connecting or registering
+
+// ========================================================================
+// 							  Topology
+// ========================================================================
+
+//* Zipf(s=1) over the channels: a few huge channels and a long tail
+static unsigned int zipfPick(const std::vector<double>& cdf)
+{
+	double u = static_cast<double>(std::rand()) / RAND_MAX;
+	size_t lo = 0;
+	size_t hi = cdf.size() - 1;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return static_cast<unsigned int>(lo);
+}
+
+static void buildTopology()
+{
+	std::vector<double> cdf;
+	if (g_opt.topology == "zipf")
+	{
+		double sum = 0;
+		for (unsigned int k = 1; k <= g_opt.channels; ++k)
+			sum += 1.0 / k;
+		double acc = 0;
+		for (unsigned int k = 1; k <= g_opt.channels; ++k)
+		{
+			acc += 1.0 / k / sum;
+			cdf.push_back(acc);
+		}
+	}
+
+	for (unsigned int i = 0; i < g_clients.size(); ++i)
+	{
+		Client& c = g_clients[i];
+		while (c.channels.size() < g_opt.joins)
+		{
+			unsigned int ch;
+			if (g_opt.topology == "single")
+				ch = static_cast<unsigned int>(c.channels.size());
+			else if (g_opt.topology == "zipf")
+				ch = zipfPick(cdf);
+			else
+				ch = (i + static_cast<unsigned int>(c.channels.size()) * 7919u) % g_opt.channels;
+			bool dup = false;
+			for (size_t k = 0; k < c.channels.size(); ++k)
+				dup = dup || c.channels[k] == ch;
+			if (!dup)
+				c.channels.push_back(ch);
+			else if (g_opt.topology != "zipf")
+				c.channels.push_back((ch + 1) % g_opt.channels);
+		}
+	}
+}
+
+// ========================================================================
+// 								 I/O
+// ========================================================================
+
+static void setEvents(Client& c, unsigned int idx)
+{
+	struct epoll_event ev;
+	ev.events = c.wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+	ev.data.u32 = idx;
+	epoll_ctl(g_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+static void kill(Client& c)
+{
+	if (c.state == ST_CONNECTING || c.state == ST_REGISTERING)
+		g_inFlight--;
+	if (c.state == ST_READY)
+		g_ready--;
+	if (c.fd >= 0)
+		close(c.fd);
+	c.fd = -1;
+	c.state = ST_DEAD;
+	g_stats.errors++;
+}
+
+static void flush(Client& c, unsigned int idx)
+{
+	while (!c.out.empty())
+	{
+		ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+		if (n > 0)
+			c.out.erase(0, static_cast<size_t>(n));
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+			return kill(c);
+	}
+	bool want = !c.out.empty();
+	if (want != c.wantWrite)
+	{
+		c.wantWrite = want;
+		setEvents(c, idx);
+	}
+}
+
+static void queue(Client& c, unsigned int idx, const std::string& line)
+{
+	c.out += line;
+	c.out += "\r\n";
+	flush(c, idx);
+}
+
+static std::string channelName(unsigned int ch)
+{
+	std::ostringstream oss;
+	oss << "#b" << ch;
+	return oss.str();
+}
+
+static bool connectOne(unsigned int idx)
+{
+	Client& c = g_clients[idx];
+	c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (c.fd < 0)
+	{
+		std::perror("socket");
+		return false;
+	}
+
+	//* Source address 127.1.x.y, one per g_opt.perIp clients
+	unsigned int src = idx / g_opt.perIp + 1;
+	struct sockaddr_in local;
+	std::memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl((127u << 24) | (1u << 16) | (src & 0xFFFF));
+	bind(c.fd, reinterpret_cast<struct sockaddr*>(&local), sizeof(local));
+
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<unsigned short>(g_opt.ports[idx % g_opt.ports.size()]));
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(c.fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS)
+	{
+		kill(c);
+		return true;
+	}
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLOUT;
+	ev.data.u32 = idx;
+	epoll_ctl(g_epoll, EPOLL_CTL_ADD, c.fd, &ev);
+	c.wantWrite = true;
+	c.state = ST_CONNECTING;
+	g_inFlight++;
+
+	std::ostringstream nick;
+	nick << "b" << idx;
+	c.nick = nick.str();
+	return true;
+}
+
+// ========================================================================
+// 							Protocol handling
+// ========================================================================
+
+//* "BENCH <ns>" anywhere in the line -> delivery latency
+static void timeDelivery(const std::string& line)
+{
+	size_t pos = line.find(":BENCH ");
+	if (pos == std::string::npos)
+		return;
+	unsigned long sentAt = std::strtoul(line.c_str() + pos + 7, NULL, 10);
+	unsigned long now = nowNs();
+	if (g_measuring && sentAt && now >= sentAt)
+	{
+		g_stats.delivered++;
+		g_stats.delivery.record(now - sentAt);
+	}
+}
+
+static void timeEcho(Client& c)
+{
+	if (!c.pendingNs)
+		return;
+	if (g_measuring)
+	{
+		g_stats.echoed++;
+		g_stats.echo.record(nowNs() - c.pendingNs);
+	}
+	c.pendingNs = 0;
+}
+
+static void handleLine(Client& c, unsigned int idx, const std::string& line)
+{
+	if (line.compare(0, 5, "PING ") == 0)
+		return queue(c, idx, "PONG " + line.substr(5));
+	if (line.compare(0, 6, "ERROR ") == 0)
+		return kill(c);
+
+	//* Numerics: ":server NNN nick ..."
+	size_t sp = line.find(' ');
+	if (sp == std::string::npos)
+		return;
+	std::string verb = line.substr(sp + 1, line.find(' ', sp + 1) - sp - 1);
+
+	if (verb == "001" && c.state == ST_REGISTERING)
+	{
+		c.state = ST_JOINING;
+		g_inFlight--;
+		g_registered++;
+		c.joinsPending = static_cast<unsigned int>(c.channels.size());
+		std::string joins = "JOIN ";
+		for (size_t k = 0; k < c.channels.size(); ++k)
+			joins += (k ? "," : "") + channelName(c.channels[k]);
+		return queue(c, idx, joins);
+	}
+	if (verb == "433" || verb == "464")
+		return kill(c);
+
+	bool self = line.size() > c.nick.size() + 1 && line[0] == ':'
+		&& line.compare(1, c.nick.size(), c.nick) == 0 && line[c.nick.size() + 1] == '!';
+
+	if (verb == "PRIVMSG")
+		timeDelivery(line);
+	else if (verb == "JOIN" && self)
+	{
+		if (c.state == ST_JOINING && --c.joinsPending == 0)
+		{
+			c.state = ST_READY;
+			g_ready++;
+		}
+		else
+			timeEcho(c);
+	}
+	else if (verb == "PART")
+	{
+		if (self)
+			timeEcho(c);
+		else
+			timeDelivery(line);
+	}
+	else if (verb == "NICK" && self)
+	{
+		timeEcho(c);
+		c.nick = c.pendingNick;
+	}
+}
+
+static void handleReadable(Client& c, unsigned int idx)
+{
+	char buf[16384];
+	for (;;)
+	{
+		ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+		if (n > 0)
+		{
+			g_stats.bytesIn += static_cast<unsigned long>(n);
+			c.in.append(buf, static_cast<size_t>(n));
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		return kill(c);
+	}
+
+	size_t start = 0;
+	size_t end;
+	while (c.state != ST_DEAD && (end = c.in.find("\r\n", start)) != std::string::npos)
+	{
+		handleLine(c, idx, c.in.substr(start, end - start));
+		start = end + 2;
+	}
+	if (c.state != ST_DEAD)
+		c.in.erase(0, start);
+}
+
+static void handleWritable(Client& c, unsigned int idx)
+{
+	if (c.state == ST_CONNECTING)
+	{
+		int err = 0;
+		socklen_t len = sizeof(err);
+		getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+		if (err != 0)
+			return kill(c);
+		c.state = ST_REGISTERING;
+		c.out += "PASS " + g_opt.password + "\r\nNICK " + c.nick + "\r\nUSER " + c.nick + " 0 * :ircbench\r\n";
+	}
+	flush(c, idx);
+}
+
+// ========================================================================
+// 							  Operations
+// ========================================================================
+
+static void issueOperation(Client& c, unsigned int idx)
+{
+	std::ostringstream line;
+	unsigned long now = nowNs();
+
+	if (g_opt.scenario == "privmsg")
+	{
+		unsigned int ch = c.channels[static_cast<size_t>(std::rand()) % c.channels.size()];
+		line << "PRIVMSG " << channelName(ch) << " :BENCH " << now;
+	}
+	else if (g_opt.scenario == "joinpart")
+	{
+		if (c.pendingNs)
+			return;
+		if (c.parted)
+			line << "JOIN " << channelName(c.channels[0]);
+		else
+			line << "PART " << channelName(c.channels[0]) << " :BENCH " << now;
+		c.parted = !c.parted;
+		c.pendingNs = now;
+	}
+	else
+	{
+		if (c.pendingNs)
+			return;
+		std::ostringstream nick;
+		nick << "b" << idx << "g" << ++c.generation;
+		c.pendingNick = nick.str();
+		line << "NICK " << c.pendingNick;
+		c.pendingNs = now;
+	}
+	g_stats.sent++;
+	queue(c, idx, line.str());
+}
+
+// ========================================================================
+// 								 Main
+// ========================================================================
+
+static void pump(int timeoutMs)
+{
+	struct epoll_event events[1024];
+	int n = epoll_wait(g_epoll, events, 1024, timeoutMs);
+	for (int i = 0; i < n; ++i)
+	{
+		unsigned int idx = events[i].data.u32;
+		Client& c = g_clients[idx];
+		if (c.state == ST_DEAD)
+			continue;
+		if (events[i].events & (EPOLLOUT | EPOLLERR))
+			handleWritable(c, idx);
+		if (c.state != ST_DEAD && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+			handleReadable(c, idx);
+	}
+}
+
+static void printLatency(const char* what, const Histogram& h)
+{
+	if (h.count() == 0)
+		return;
+	std::printf("%-9s latency: p50 %.3f ms  p90 %.3f ms  p99 %.3f ms  p999 %.3f ms  max %.3f ms  (n=%lu)\n",
+		what, h.percentile(0.50) / 1e6, h.percentile(0.90) / 1e6, h.percentile(0.99) / 1e6,
+		h.percentile(0.999) / 1e6, h.max() / 1e6, h.count());
+}
+
+int main(int argc, char** argv)
+{
+	if (!parseOptions(argc, argv, g_opt))
+		usage(argv[0]);
+
+	//* One fd per simulated client
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < g_opt.clients + 16)
+		std::fprintf(stderr, "warning: ulimit -n is %lu, fewer than %u clients will connect\n",
+			static_cast<unsigned long>(rl.rlim_cur), g_opt.clients);
+
+	std::srand(42);
+	g_clients.resize(g_opt.clients);
+	buildTopology();
+	g_epoll = epoll_create1(0);
+
+	//* PHASE 1: connect, register and join, at most 'ramp' in flight
+	unsigned long t0 = nowNs();
+	unsigned int next = 0;
+	unsigned long lastProgress = t0;
+	while (g_ready + g_stats.errors < g_opt.clients)
+	{
+		while (next < g_opt.clients && g_inFlight < g_opt.ramp)
+		{
+			if (!connectOne(next++))
+				return 1;
+		}
+		pump(10);
+		unsigned long now = nowNs();
+		if (now - lastProgress > 1000000000UL)
+		{
+			lastProgress = now;
+			std::fprintf(stderr, "\rconnected %u/%u, ready %u, failed %lu   ", next, g_opt.clients, g_ready,
+				g_stats.errors);
+		}
+		if (now - t0 > 600000000000UL)
+			break;
+	}
+	double setup = (nowNs() - t0) / 1e9;
+	std::fprintf(stderr, "\n");
+	std::printf("setup: %u clients ready in %.2f s (%.0f/s), %lu failed, topology %s, %u channels, %u joins/client\n",
+		g_ready, setup, g_ready / setup, g_stats.errors, g_opt.topology.c_str(), g_opt.channels, g_opt.joins);
+	if (g_ready == 0)
+		return 1;
+
+	//* PHASE 2: paced operations for 'duration' seconds, round-robin over ready clients
+	std::vector<unsigned int> ready;
+	for (unsigned int i = 0; i < g_clients.size(); ++i)
+		if (g_clients[i].state == ST_READY)
+			ready.push_back(i);
+
+	g_measuring = true;
+	unsigned long start = nowNs();
+	unsigned long stop = start + static_cast<unsigned long>(g_opt.duration) * 1000000000UL;
+	unsigned long issued = 0;
+	size_t cursor = 0;
+	unsigned long bytesBefore = g_stats.bytesIn;
+	while (nowNs() < stop)
+	{
+		unsigned long due = static_cast<unsigned long>((nowNs() - start) / 1e9 * g_opt.rate);
+		size_t attempts = 0;
+		while (issued < due && attempts++ < ready.size())
+		{
+			unsigned int idx = ready[cursor++ % ready.size()];
+			Client& c = g_clients[idx];
+			if (c.state != ST_READY)
+				continue;
+			unsigned long before = g_stats.sent;
+			issueOperation(c, idx);
+			if (g_stats.sent != before)
+				issued++;
+		}
+		pump(1);
+	}
+
+	//* PHASE 3: let in-flight messages land (not counted as elapsed time)
+	unsigned long drainEnd = nowNs() + 1000000000UL;
+	while (nowNs() < drainEnd)
+		pump(10);
+	g_measuring = false;
+
+	double elapsed = g_opt.duration;
+	std::printf("scenario %s: sent %lu ops (%.0f/s, target %u/s), delivered %lu (%.0f/s), echoed %lu, "
+		"%.1f MB/s in\n", g_opt.scenario.c_str(), g_stats.sent, g_stats.sent / elapsed, g_opt.rate,
+		g_stats.delivered, g_stats.delivered / elapsed, g_stats.echoed,
+		(g_stats.bytesIn - bytesBefore) / elapsed / 1e6);
+	printLatency("delivery", g_stats.delivery);
+	printLatency("echo", g_stats.echo);
+	std::printf("connections lost: %lu\n", g_stats.errors);
+	return 0;
+}
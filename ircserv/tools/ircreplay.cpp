@@ -0,0 +1,566 @@
+// ircreplay: re-drive a CAPTURE file against a local ircserv
+//
+//   make replay
+//   ./tools/ircreplay <ircserv-capture-*.bin> [options]
+//
+//   -p PORT        server port (6667)
+//   -w PASS        password sent for the redacted "PASS *" lines (password123)
+//   -O PASS        password for redacted "OPER <name> *" lines (default: sent as is)
+//   -x SPEED       time scale: 1 = as captured, 10 = ten times faster, 0 = no pacing (1)
+//   -m PORT        metrics_listen port on 127.0.0.1: report server-side rates
+//   -P MS          probe interval (10): a separate client PINGs the server and
+//                  times the PONG, i.e. how long a line waits under this load
+//   -i N           connections per source address (1)
+//
+// Each connection binds its own source, 127.1.x.y (like ircbench), so the
+// server's per-IP limits (max_per_ip, connect_rate_limit) see as many
+// sources as the capture had clients instead of rejecting the replay.
+//
+// Every connection of the capture is opened at its (scaled) time and its
+// lines are sent when due; whatever the server answers is read and dropped.
+// The report gives the achieved line rate, how far behind schedule the
+// replay ran, the probe round trip, and with -m the server's own view:
+// lines/s, loop busy time and dispatch latency percentiles over the run.
+
+#include "TrafficCapture.hpp"
+#include "Histogram.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+
+typedef TrafficCapture::Record Record;
+typedef TrafficCapture::FileHeader FileHeader;
+
+struct Entry
+{
+	unsigned long	timeNs;
+	unsigned int	connId;
+	unsigned short	type;
+	std::string		line;
+};
+
+struct Conn
+{
+	int			fd;
+	bool		connected;
+	bool		closing;						//* CLOSE seen: close once flushed
+	bool		quit;							//* QUIT sent: the server's EOF is expected
+	std::string	out;
+	std::string	in;								//* Probe only
+
+	Conn() : fd(-1), connected(false), closing(false), quit(false) {}
+};
+
+static int							g_port = 6667;
+static unsigned int					g_perIp = 1;
+static int							g_epoll = -1;
+static std::vector<Conn>			g_conns;	//* Index 0 is the probe
+static std::map<unsigned int, size_t>	g_byId;
+static unsigned long				g_lost = 0;
+
+static unsigned long nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + static_cast<unsigned long>(ts.tv_nsec);
+}
+
+// ========================================================================
+// 							  Capture file
+// ========================================================================
+
+static bool readExact(FILE* f, void* out, size_t size)
+{
+	return size == 0 || std::fread(out, 1, size, f) == size;
+}
+
+static bool loadCapture(const char* path, std::vector<Entry>& entries)
+{
+	FILE* f = std::fopen(path, "rb");
+	if (!f)
+	{
+		std::perror(path);
+		return false;
+	}
+	FileHeader header;
+	if (!readExact(f, &header, sizeof(header)) || std::memcmp(header.magic, "IRCCAP1", 8) != 0
+		|| header.version != TrafficCapture::VERSION || header.recordSize != sizeof(Record))
+	{
+		std::fprintf(stderr, "%s: not a capture file (or another version)\n", path);
+		std::fclose(f);
+		return false;
+	}
+
+	Record r;
+	char buf[65536];
+	while (readExact(f, &r, sizeof(r)))
+	{
+		if (!readExact(f, buf, r.length))
+			break;
+		Entry e;
+		e.timeNs = r.timeNs;
+		e.connId = r.connId;
+		e.type = r.type;
+		e.line.assign(buf, r.length);
+		entries.push_back(e);
+	}
+	std::fclose(f);
+	return true;
+}
+
+// ========================================================================
+// 							  Connections
+// ========================================================================
+
+static void watch(size_t idx, bool wantWrite)
+{
+	struct epoll_event ev;
+	ev.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+	ev.data.u64 = idx;
+	epoll_ctl(g_epoll, EPOLL_CTL_MOD, g_conns[idx].fd, &ev);
+}
+
+static void drop(size_t idx, bool lost)
+{
+	Conn& c = g_conns[idx];
+	if (c.fd < 0)
+		return;
+	close(c.fd);
+	c.fd = -1;
+	if (lost)
+		g_lost++;
+}
+
+static size_t openConn()
+{
+	Conn c;
+	c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	g_conns.push_back(c);
+	size_t idx = g_conns.size() - 1;
+	if (c.fd < 0)
+		return idx;
+
+	//* Source address 127.1.x.y, one per g_perIp connections
+	unsigned int src = idx / g_perIp + 1;
+	struct sockaddr_in local;
+	std::memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl((127u << 24) | (1u << 16) | (src & 0xFFFF));
+	bind(c.fd, reinterpret_cast<struct sockaddr*>(&local), sizeof(local));
+
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<unsigned short>(g_port));
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(c.fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS)
+	{
+		drop(idx, true);
+		return idx;
+	}
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLOUT;
+	ev.data.u64 = idx;
+	epoll_ctl(g_epoll, EPOLL_CTL_ADD, c.fd, &ev);
+	return idx;
+}
+
+static void flush(size_t idx)
+{
+	Conn& c = g_conns[idx];
+	if (c.fd < 0 || !c.connected)
+		return;
+	while (!c.out.empty())
+	{
+		ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+		if (n > 0)
+			c.out.erase(0, static_cast<size_t>(n));
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+			return drop(idx, true);
+	}
+	if (c.out.empty() && c.closing)
+		return drop(idx, false);
+	watch(idx, !c.out.empty());
+}
+
+static void queue(size_t idx, const std::string& line)
+{
+	g_conns[idx].out += line + "\r\n";
+	flush(idx);
+}
+
+// ========================================================================
+// 								 Probe
+// ========================================================================
+
+struct Probe
+{
+	bool			ready;
+	unsigned long	pendingSince;				//* PING in flight (0 = none)
+	Histogram		rtt;
+
+	Probe() : ready(false), pendingSince(0) {}
+};
+
+static Probe g_probe;
+
+static void probeLines()
+{
+	Conn& c = g_conns[0];
+	size_t end;
+	while ((end = c.in.find("\r\n")) != std::string::npos)
+	{
+		std::string line = c.in.substr(0, end);
+		c.in.erase(0, end + 2);
+		if (line.find(" 001 ") != std::string::npos)
+			g_probe.ready = true;
+		else if (line.compare(0, 5, "PONG ") == 0 && g_probe.pendingSince)
+		{
+			g_probe.rtt.record(nowNs() - g_probe.pendingSince);
+			g_probe.pendingSince = 0;
+		}
+		else if (line.compare(0, 5, "PING ") == 0)
+			queue(0, "PONG " + line.substr(5));
+	}
+}
+
+// ========================================================================
+// 								Events
+// ========================================================================
+
+static void pump(int timeoutMs)
+{
+	struct epoll_event events[512];
+	int n = epoll_wait(g_epoll, events, 512, timeoutMs);
+	char buf[65536];
+	for (int i = 0; i < n; ++i)
+	{
+		size_t idx = static_cast<size_t>(events[i].data.u64);
+		Conn& c = g_conns[idx];
+		if (c.fd < 0)
+			continue;
+		if (!c.connected && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+		{
+			int err = 0;
+			socklen_t len = sizeof(err);
+			getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			if (err != 0)
+			{
+				drop(idx, true);
+				continue;
+			}
+			c.connected = true;
+		}
+		if (events[i].events & EPOLLOUT)
+			flush(idx);
+		if (c.fd >= 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+		{
+			ssize_t got;
+			while ((got = recv(c.fd, buf, sizeof(buf), 0)) > 0)
+			{
+				if (idx == 0)
+					c.in.append(buf, static_cast<size_t>(got));
+			}
+			if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+				drop(idx, !c.closing && !c.quit);
+			else if (idx == 0)
+				probeLines();
+		}
+	}
+}
+
+// ========================================================================
+// 						   Server-side metrics
+// ========================================================================
+
+//* One scrape of the metrics listener: series -> value
+static bool scrape(int port, std::map<std::string, double>& series)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<unsigned short>(port));
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	const char* request = "GET /metrics HTTP/1.0\r\n\r\n";
+	send(fd, request, std::strlen(request), MSG_NOSIGNAL);
+	shutdown(fd, SHUT_WR);
+
+	std::string text;
+	char buf[65536];
+	ssize_t n;
+	while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+		text.append(buf, static_cast<size_t>(n));
+	close(fd);
+
+	std::istringstream in(text);
+	std::string line;
+	bool body = false;
+	while (std::getline(in, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (!body)
+		{
+			body = line.empty();
+			continue;
+		}
+		if (line.empty() || line[0] == '#')
+			continue;
+		size_t sp = line.rfind(' ');
+		if (sp != std::string::npos)
+			series[line.substr(0, sp)] = std::strtod(line.c_str() + sp + 1, NULL);
+	}
+	return !series.empty();
+}
+
+static double delta(std::map<std::string, double>& before, std::map<std::string, double>& after,
+	const std::string& key)
+{
+	return after[key] - before[key];
+}
+
+/**
+ * Dispatch latency over the run, all commands together
+ *
+ * Each ircserv_command_duration_ns histogram is exposed as cumulative
+ * buckets at le = 2^k - 1, cut after its max. Past its last bucket a series
+ * is at its _count. Summing before/after differences per bound gives the
+ * cumulative distribution of the commands dispatched during the replay.
+ */
+static void dispatchPercentiles(std::map<std::string, double>& before, std::map<std::string, double>& after)
+{
+	const std::string prefix = "ircserv_command_duration_ns_bucket{";
+	double window[64] = { 0 };
+	double total = 0;
+
+	std::map<std::string, double>* snaps[2] = { &before, &after };
+	for (int s = 0; s < 2; ++s)
+	{
+		double sign = s ? 1 : -1;
+		std::map<std::string, std::map<int, double> > buckets;
+		for (std::map<std::string, double>::iterator it = snaps[s]->lower_bound(prefix);
+			it != snaps[s]->end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+		{
+			size_t le = it->first.find(",le=\"");
+			if (le == std::string::npos || it->first.compare(le + 5, 4, "+Inf") == 0)
+				continue;
+			unsigned long bound = std::strtoul(it->first.c_str() + le + 5, NULL, 10);
+			int k = 0;
+			while (k < 63 && ((1UL << k) - 1) < bound)
+				k++;
+			buckets[it->first.substr(prefix.size(), le - prefix.size())][k] = it->second;
+		}
+		for (std::map<std::string, std::map<int, double> >::iterator b = buckets.begin(); b != buckets.end(); ++b)
+		{
+			double count = (*snaps[s])["ircserv_command_duration_ns_count{" + b->first + "}"];
+			total += sign * count;
+			for (int k = 0; k < 64; ++k)
+			{
+				std::map<int, double>::iterator v = b->second.find(k);
+				window[k] += sign * (v != b->second.end() ? v->second : (k > b->second.rbegin()->first ? count : 0));
+			}
+		}
+	}
+	if (total <= 0)
+		return;
+
+	static const double quantiles[] = { 0.50, 0.99, 0.999 };
+	std::printf("server dispatch: %.0f commands,", total);
+	for (size_t q = 0; q < 3; ++q)
+	{
+		int k = 0;
+		while (k < 63 && window[k] < quantiles[q] * total)
+			k++;
+		std::printf(" p%g <= %lu ns", quantiles[q] * 100, (1UL << k) - 1);
+	}
+	std::printf("\n");
+}
+
+// ========================================================================
+// 								 Main
+// ========================================================================
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::fprintf(stderr, "Usage: %s <capture.bin> [-p port] [-w pass] [-O operpass] [-x speed] [-m metrics-port] "
+			"[-P probe-ms] [-i per-ip]\n", argv[0]);
+		return 2;
+	}
+	std::string password = "password123";
+	std::string operPassword;
+	double speed = 1;
+	int metricsPort = 0;
+	unsigned long probeNs = 10000000UL;
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		const char* v = argv[i + 1];
+		if (flag == "-p") g_port = std::atoi(v);
+		else if (flag == "-w") password = v;
+		else if (flag == "-O") operPassword = v;
+		else if (flag == "-x") speed = std::strtod(v, NULL);
+		else if (flag == "-m") metricsPort = std::atoi(v);
+		else if (flag == "-P") probeNs = std::strtoul(v, NULL, 10) * 1000000UL;
+		else if (flag == "-i" && std::atoi(v) > 0) g_perIp = std::atoi(v);
+		else
+		{
+			std::fprintf(stderr, "unknown option %s\n", flag.c_str());
+			return 2;
+		}
+	}
+
+	std::vector<Entry> entries;
+	if (!loadCapture(argv[1], entries))
+		return 1;
+	if (entries.empty())
+	{
+		std::fprintf(stderr, "%s: empty capture\n", argv[1]);
+		return 1;
+	}
+	unsigned long span = entries.back().timeNs;
+
+	g_epoll = epoll_create1(0);
+	std::map<std::string, double> before;
+	std::map<std::string, double> after;
+	if (metricsPort && !scrape(metricsPort, before))
+	{
+		std::fprintf(stderr, "cannot scrape 127.0.0.1:%d\n", metricsPort);
+		return 1;
+	}
+
+	//* Probe: its own registered client, not part of the capture
+	openConn();
+	queue(0, "PASS " + password + "\r\nNICK replayprobe\r\nUSER probe 0 * :ircreplay");
+	unsigned long waitUntil = nowNs() + 2000000000UL;
+	while (!g_probe.ready && nowNs() < waitUntil)
+		pump(10);
+	if (!g_probe.ready)
+		std::fprintf(stderr, "warning: probe did not register, no round trip numbers\n");
+
+	Histogram lag;
+	unsigned long lines = 0;
+	unsigned long connections = 0;
+	unsigned long start = nowNs();
+	unsigned long nextProbe = start;
+	size_t next = 0;
+
+	while (next < entries.size())
+	{
+		unsigned long now = nowNs();
+		while (next < entries.size())
+		{
+			const Entry& e = entries[next];
+			unsigned long due = speed > 0 ? start + static_cast<unsigned long>(e.timeNs / speed) : now;
+			if (due > now)
+				break;
+			lag.record(now - due);
+
+			if (e.type == TrafficCapture::REC_OPEN)
+			{
+				g_byId[e.connId] = openConn();
+				connections++;
+			}
+			else if (g_byId.count(e.connId))
+			{
+				size_t idx = g_byId[e.connId];
+				if (e.type == TrafficCapture::REC_CLOSE)
+				{
+					g_conns[idx].closing = true;
+					if (g_conns[idx].connected)
+						flush(idx);
+					g_byId.erase(e.connId);
+				}
+				else
+				{
+					std::string line = e.line;
+					if (line == "PASS *")
+						line = "PASS " + password;
+					else if (!operPassword.empty() && line.compare(0, 5, "OPER ") == 0
+						&& line.size() > 2 && line.compare(line.size() - 2, 2, " *") == 0)
+						line = line.substr(0, line.size() - 1) + operPassword;
+					if (line.size() >= 4 && strncasecmp(line.c_str(), "QUIT", 4) == 0)
+						g_conns[idx].quit = true;
+					g_conns[idx].out += line + "\r\n";
+					flush(idx);
+					lines++;
+				}
+			}
+			next++;
+		}
+
+		if (g_probe.ready && !g_probe.pendingSince && now >= nextProbe)
+		{
+			std::ostringstream ping;
+			ping << "PING :" << now;
+			g_probe.pendingSince = now;
+			queue(0, ping.str());
+			nextProbe = now + probeNs;
+		}
+
+		int timeout = 0;
+		if (next < entries.size() && speed > 0)
+		{
+			unsigned long due = start + static_cast<unsigned long>(entries[next].timeNs / speed);
+			timeout = due > now ? static_cast<int>((due - now) / 1000000UL) : 0;
+			if (timeout > 1)
+				timeout = 1;
+		}
+		pump(timeout);
+	}
+	double elapsed = (nowNs() - start) / 1e9;
+
+	//* Let the server digest what was sent before the final scrape
+	unsigned long drainEnd = nowNs() + 500000000UL;
+	while (nowNs() < drainEnd)
+		pump(10);
+	if (metricsPort)
+		scrape(metricsPort, after);
+
+	std::printf("replayed %lu lines on %lu connections in %.2f s (%.0f lines/s), capture span %.2f s, speed %gx\n",
+		lines, connections, elapsed, lines / elapsed, span / 1e9, speed);
+	std::printf("schedule lag: p50 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+		lag.percentile(0.50) / 1e6, lag.percentile(0.99) / 1e6, lag.max() / 1e6);
+	if (g_probe.rtt.count())
+		std::printf("probe rtt:    p50 %.3f ms  p99 %.3f ms  p999 %.3f ms  max %.3f ms  (n=%lu)\n",
+			g_probe.rtt.percentile(0.50) / 1e6, g_probe.rtt.percentile(0.99) / 1e6,
+			g_probe.rtt.percentile(0.999) / 1e6, g_probe.rtt.max() / 1e6, g_probe.rtt.count());
+	if (metricsPort && !after.empty())
+	{
+		double busy = 0;
+		static const char* phases[] = { "accept", "read", "parse", "dispatch", "flush", "other" };
+		for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); ++p)
+			busy += delta(before, after, std::string("ircserv_loop_phase_ns_total{phase=\"") + phases[p] + "\"}");
+		double seconds = elapsed + 0.5;
+		std::printf("server: %.0f lines in (%.0f/s), %.1f MB out (%.1f MB/s), loop busy %.1f%%\n",
+			delta(before, after, "ircserv_lines_in_total"),
+			delta(before, after, "ircserv_lines_in_total") / seconds,
+			delta(before, after, "ircserv_bytes_out_total") / 1e6,
+			delta(before, after, "ircserv_bytes_out_total") / 1e6 / seconds, busy / 1e9 / seconds * 100);
+		dispatchPercentiles(before, after);
+	}
+	std::printf("connections lost: %lu\n", g_lost);
+	return 0;
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+# linkbench: the same ircbench load against one ircserv and against three
+# linked ones (A - B - C on loopback), to compare aggregate capacity.
+#
+#   make linkbench
+#   ./tools/linkbench.sh [ircbench options]      (default: -c 3000 -C 30 -r 20000 -d 10)
+#
+# With three servers every client talks to one of them (round-robin) and
+# channel traffic crosses the links only toward servers with members; each
+# server does the local fan-out for its own third of the clients.
+
+set -e
+cd "$(dirname "$0")/.."
+
+BASE=${LINKBENCH_PORT:-7100}
+DIR=$(mktemp -d /tmp/linkbench.XXXXXX)
+PIDS=""
+[ $# -gt 0 ] || set -- -c 3000 -C 30 -r 20000 -d 10
+
+cleanup()
+{
+	[ -z "$PIDS" ] || kill $PIDS 2>/dev/null || true
+	wait 2>/dev/null || true
+	rm -rf "$DIR"
+}
+trap cleanup EXIT INT TERM
+
+# start <name> <sid> <port> [uplink port]
+start()
+{
+	{
+		echo "server_name = $1.bench"
+		echo "server_id = $2"
+		echo "link_password = linkbench"
+		echo "link_retry = 1"
+		echo "max_unregistered = 4096"
+		echo "max_per_ip = 64"
+		[ -z "$4" ] || echo "connect = 127.0.0.1:$4"
+	} > "$DIR/$1.conf"
+	./ircserv "$3" password123 "$DIR/$1.conf" > "$DIR/$1.log" 2>&1 &
+	PIDS="$PIDS $!"
+}
+
+stop()
+{
+	kill $PIDS 2>/dev/null || true
+	wait 2>/dev/null || true
+	PIDS=""
+}
+
+echo "== 1 server (port $BASE)"
+start a 0AA "$BASE"
+sleep 0.5
+./tools/ircbench -p "$BASE" "$@"
+stop
+
+echo
+echo "== 3 linked servers (ports $BASE-$((BASE + 2)), A - B - C)"
+start a 0AA "$BASE"
+start b 0BB "$((BASE + 1))" "$BASE"
+start c 0CC "$((BASE + 2))" "$((BASE + 1))"
+sleep 2.5
+grep -h "acknowledged" "$DIR"/*.log || { echo "links did not come up"; exit 1; }
+./tools/ircbench -p "$BASE,$((BASE + 1)),$((BASE + 2))" "$@"
@@ -0,0 +1,839 @@
+// microbench: repeatable microbenchmarks of the server hot paths
+//
+//   make microbench
+//   ./tools/microbench [-o results.json] [-f filter]
+//
+// Built against the server's own objects (same flags as ircserv), so it
+// measures exactly what ships. Each case is calibrated to run ~20 ms per
+// repetition; the result is the median of REPEATS repetitions, in ns per
+// operation, written as JSON to compare commits:
+//
+//   { "clock": "tsc", "results": [ { "name": "broadcast", "size": 1000,
+//     "ns_per_op": 12345.6, "min_ns_per_op": 12001.2, "iterations": 1600 }, ... ] }
+//
+// Sizes are members (broadcast, names, who, presence; join_storm: across 50 channels), channels (getChannel, list, snapshot),
+// registered users (nick lookup) or list entries (join_bans). Fixtures use fake fds: nothing touches the network.
+
+#include "Server.hpp"
+#include "Parser.hpp"
+#include "CommandHelpers.hpp"
+#include "NumericReplies.hpp"
+#include "ClientConnection.hpp"
+#include "User.hpp"
+#include "Channel.hpp"
+#include "Clock.hpp"
+#include "StateSnapshot.hpp"
+#include "ListStream.hpp"
+#include "WhoStream.hpp"
+#include "MaskList.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/uio.h>
+
+static const unsigned int REPEATS = 7;
+static const unsigned long TARGET_NS = 20000000UL;
+
+static volatile unsigned long g_sink;		//* Keeps results alive
+
+struct Result
+{
+	std::string		name;
+	unsigned int	size;
+	unsigned long	iterations;
+	double			nsPerOp;
+	double			minNsPerOp;
+};
+
+// ========================================================================
+// 							   Harness
+// ========================================================================
+
+//* One benchmark case: run() is timed, reset() (buffers, state) is not
+class Case
+{
+	public:
+		virtual ~Case() {}
+		virtual void	run(unsigned long iterations) = 0;
+		virtual void	reset() {}
+};
+
+static double timeRun(Case& c, unsigned long iterations)
+{
+	c.reset();
+	unsigned long start = Clock::now();
+	c.run(iterations);
+	return static_cast<double>(Clock::toNs(Clock::now() - start));
+}
+
+static Result measure(const std::string& name, unsigned int size, Case& c)
+{
+	//* Grow the batch until one repetition takes TARGET_NS
+	unsigned long iterations = 1;
+	double ns = timeRun(c, iterations);
+	while (ns < TARGET_NS && iterations < (1UL << 30))
+	{
+		double factor = ns > 0 ? TARGET_NS / ns : 16;
+		iterations = static_cast<unsigned long>(iterations * std::min(std::max(factor * 1.1, 1.5), 16.0)) + 1;
+		ns = timeRun(c, iterations);
+	}
+
+	std::vector<double> samples;
+	for (unsigned int r = 0; r < REPEATS; ++r)
+		samples.push_back(timeRun(c, iterations) / iterations);
+	std::sort(samples.begin(), samples.end());
+
+	Result res;
+	res.name = name;
+	res.size = size;
+	res.iterations = iterations;
+	res.nsPerOp = samples[REPEATS / 2];
+	res.minNsPerOp = samples[0];
+	std::fprintf(stderr, "%-22s %6u %14.1f ns/op  (min %.1f, %lu iterations)\n", name.c_str(), size,
+		res.nsPerOp, res.minNsPerOp, iterations);
+	return res;
+}
+
+// ========================================================================
+// 							   Fixture
+// ========================================================================
+
+/**
+ * MicroBench: a Server with fake registered clients and channels
+ *
+ * Friend of Server, so it fills clients_/channels_ directly and calls the
+ * private lookups the command handlers use. ~Server frees everything.
+ */
+class MicroBench
+{
+	public:
+		//* No SendQ limits: runs queue far more than any client would
+		MicroBench() : server_(0, "bench")
+		{
+			ClientConnection::setLaneLimits(0, 0);
+		}
+
+		//* Registered client with nick "u<i>" and a fake fd
+		ClientConnection* addClient(unsigned int i)
+		{
+			std::ostringstream nick;
+			nick << "u" << i;
+			NetAddress addr;
+			std::memset(&addr, 0, sizeof(addr));
+			ClientConnection* conn = new ClientConnection(-1, i + 1, "127.0.0.1", addr);
+			server_.clients_.push_back(conn);
+			User* user = server_.ensureUser(conn);
+			server_.setLocalNick(user, nick.str());
+			user->setUsername("bench");
+			conn->setRegistered(true);
+			return conn;
+		}
+
+		Channel* addChannel(const std::string& name)
+		{
+			return server_.createChannel(name);
+		}
+
+		Channel* getChannel(const std::string& name)
+		{
+			return server_.getChannel(name);
+		}
+
+		User* findUserByNick(const std::string& nick)
+		{
+			return server_.findUserByNick(nick);
+		}
+
+		const std::vector<ClientConnection*>& clients() const
+		{
+			return server_.clients_;
+		}
+
+		const std::vector<Channel*>& channels() const
+		{
+			return server_.channels_;
+		}
+
+		const ChannelListIndex& listIndex() const
+		{
+			return server_.list_index_;
+		}
+
+		//* JOIN / PART straight into the handlers (no parsing, no dispatch)
+		void join(ClientConnection* client, const std::string& targets)
+		{
+			Message msg;
+			msg.command = "JOIN";
+			msg.params.push_back(targets);
+			server_.cmdJoin(client, msg);
+		}
+
+		void part(ClientConnection* client, const std::string& targets)
+		{
+			Message msg;
+			msg.command = "PART";
+			msg.params.push_back(targets);
+			server_.cmdPart(client, msg);
+		}
+
+		WhoStream* whoStream(const std::string& mask, User* requester)
+		{
+			return new WhoStream(WhoStream::parseQuery(mask, ""), requester, server_.channel_index_,
+				server_.nicks_, server_.remote_nicks_);
+		}
+
+	private:
+		Server	server_;
+};
+
+// ========================================================================
+// 								Cases
+// ========================================================================
+
+class ParseCase : public Case
+{
+	public:
+		ParseCase()
+		{
+			lines_.push_back(":nick!user@host PRIVMSG #channel :hello there, this is a typical chat line");
+			lines_.push_back("JOIN #a,#b,#c key1,key2");
+			lines_.push_back("PING :ft_irc");
+			lines_.push_back("MODE #channel +ol nick 50");
+		}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+				g_sink += Parser::parse(lines_[i & 3]).params.size();
+		}
+	private:
+		std::vector<std::string> lines_;
+};
+
+//* One 4 KiB recv() worth of lines appended, then every line popped; per line
+class FramingCase : public Case
+{
+	public:
+		FramingCase() : conn_(-1, 1, "127.0.0.1", zero()), lines_(0)
+		{
+			while (chunk_.size() < 4096)
+			{
+				chunk_ += "PRIVMSG #channel :hello there, this is a typical chat line\r\n";
+				lines_++;
+			}
+		}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; i += lines_)
+			{
+				conn_.appendRecvData(chunk_);
+				while (conn_.hasCompleteLine())
+					g_sink += conn_.popLine().size();
+			}
+		}
+	private:
+		static NetAddress zero()
+		{
+			NetAddress a;
+			std::memset(&a, 0, sizeof(a));
+			return a;
+		}
+		ClientConnection	conn_;
+		std::string			chunk_;
+		unsigned long		lines_;
+};
+
+class BroadcastCase : public Case
+{
+	public:
+		BroadcastCase(MicroBench& bench, Channel* channel) : bench_(bench), channel_(channel),
+			msg_(":u0!bench@127.0.0.1 PRIVMSG #bench :hello there, this is a typical chat line\r\n") {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+				channel_->broadcast(msg_, NULL);
+		}
+		void reset()
+		{
+			const std::vector<ClientConnection*>& clients = bench_.clients();
+			for (size_t i = 0; i < clients.size(); ++i)
+				clients[i]->clearSentData(clients[i]->getSendQueueSize());
+		}
+	private:
+		MicroBench&	bench_;
+		Channel*	channel_;
+		std::string	msg_;
+};
+
+//* One non-op's JOIN line (PART and QUIT cost the same) in a channel with
+//* and without +u: one queueSend per recipient, so time follows the bytes
+class PresenceCase : public Case
+{
+	public:
+		PresenceCase(MicroBench& bench, Channel* channel, User* user) : bench_(bench), channel_(channel),
+			user_(user), msg_(":" + user->getPrefix() + " JOIN #bench\r\n") {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+				channel_->broadcastPresence(msg_, user_, NULL);
+		}
+		void reset()
+		{
+			const std::vector<ClientConnection*>& clients = bench_.clients();
+			for (size_t i = 0; i < clients.size(); ++i)
+				clients[i]->clearSentData(clients[i]->getSendQueueSize());
+		}
+	private:
+		MicroBench&	bench_;
+		Channel*	channel_;
+		User*		user_;
+		std::string	msg_;
+};
+
+class NamesCase : public Case
+{
+	public:
+		NamesCase(Channel* channel) : channel_(channel) {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+			{
+				std::string out;
+				channel_->appendNamesReply(out, ":ft_irc 353 u0 = #bench :", channel_->getMembers()[0]);
+				g_sink += out.size();
+			}
+		}
+	private:
+		Channel* channel_;
+};
+
+//* What a client does on connect: JOIN 50 channels in one line (and PART
+//* them again, timed too: both sides of a restart storm)
+class JoinStormCase : public Case
+{
+	public:
+		JoinStormCase(MicroBench& bench, ClientConnection* client, const std::string& targets)
+			: bench_(bench), client_(client), targets_(targets) {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+			{
+				bench_.join(client_, targets_);
+				bench_.part(client_, targets_);
+				g_sink += client_->getSendQueueSize();
+				client_->clearSentData(client_->getSendQueueSize());
+			}
+		}
+		void reset()
+		{
+			const std::vector<ClientConnection*>& clients = bench_.clients();
+			for (size_t i = 0; i < clients.size(); ++i)
+				clients[i]->clearSentData(clients[i]->getSendQueueSize());
+		}
+	private:
+		MicroBench&			bench_;
+		ClientConnection*	client_;
+		std::string			targets_;
+};
+
+//* Round-robin over every existing name: the average lookup
+class GetChannelCase : public Case
+{
+	public:
+		GetChannelCase(MicroBench& bench, const std::vector<std::string>& names) : bench_(bench), names_(names) {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+				g_sink += bench_.getChannel(names_[i % names_.size()]) != NULL;
+		}
+	private:
+		MicroBench&					bench_;
+		std::vector<std::string>	names_;
+};
+
+//* A whole "LIST >10" stream, chunk by chunk as pumpStreams() would ask for it
+class ListCase : public Case
+{
+	public:
+		ListCase(MicroBench& bench, const ListStream::Filter& filter) : bench_(bench), filter_(filter) {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+			{
+				ListStream stream(bench_.listIndex(), "u0", filter_);
+				std::string out;
+				while (stream.fill(out, 32 * 1024))
+				{
+					g_sink += out.size();
+					out.clear();
+				}
+				g_sink += out.size();
+			}
+		}
+	private:
+		MicroBench&			bench_;
+		ListStream::Filter	filter_;
+};
+
+//* A whole "WHO #bench" stream from one of its members
+class WhoCase : public Case
+{
+	public:
+		WhoCase(MicroBench& bench, User* requester) : bench_(bench), requester_(requester) {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+			{
+				WhoStream* stream = bench_.whoStream("#bench", requester_);
+				std::string out;
+				while (stream->fill(out, 32 * 1024))
+				{
+					g_sink += out.size();
+					out.clear();
+				}
+				g_sink += out.size();
+				delete stream;
+			}
+		}
+	private:
+		MicroBench&		bench_;
+		User*			requester_;
+};
+
+//* The JOIN ban check: 64 joiners that match nothing (the worst case, every
+//* mask is a candidate) against a +b list. "linear" is the glob-per-mask
+//* reference the compiled list replaces
+class JoinBansCase : public Case
+{
+	public:
+		JoinBansCase(const MaskList& bans, bool linear) : bans_(bans), linear_(linear)
+		{
+			for (unsigned int i = 0; i < 64; ++i)
+			{
+				std::ostringstream nick, host;
+				nick << "Joiner" << i;
+				host << "host-" << i << ".isp" << (i % 7) << ".example.net";
+				nicks_.push_back(nick.str());
+				hosts_.push_back(host.str());
+			}
+		}
+		void run(unsigned long iterations)
+		{
+			const std::list<MaskList::Entry>& entries = bans_.entries();
+			for (unsigned long i = 0; i < iterations; ++i)
+			{
+				size_t j = i % nicks_.size();
+				if (!linear_)
+				{
+					g_sink += bans_.matches(nicks_[j], "user", hosts_[j]);
+					continue;
+				}
+				std::string prefix = nicks_[j] + "!user@" + hosts_[j];
+				for (std::list<MaskList::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+					if (matchMask(it->mask, prefix))
+					{
+						++g_sink;
+						break;
+					}
+			}
+		}
+	private:
+		const MaskList&				bans_;
+		bool						linear_;
+		std::vector<std::string>	nicks_;
+		std::vector<std::string>	hosts_;
+};
+
+//* What the fork()ed snapshot child does: serialize every channel
+class SnapshotEncodeCase : public Case
+{
+	public:
+		SnapshotEncodeCase(MicroBench& bench) : bench_(bench) {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+			{
+				StateSnapshot::encode(bench_.channels(), 1, data_);
+				g_sink += data_.size();
+			}
+		}
+	private:
+		MicroBench&		bench_;
+		std::string		data_;
+};
+
+//* Startup restore: map the file and rebuild every channel (the
+//* Channel objects are freed outside the timed part)
+class SnapshotLoadCase : public Case
+{
+	public:
+		SnapshotLoadCase(const std::string& path) : path_(path) {}
+		~SnapshotLoadCase() { reset(); }
+		void run(unsigned long iterations)
+		{
+			std::string error;
+			unsigned long nextMsgid;
+			for (unsigned long i = 0; i < iterations; ++i)
+				g_sink += StateSnapshot::load(path_, loaded_, nextMsgid, error);
+		}
+		void reset()
+		{
+			for (size_t i = 0; i < loaded_.size(); ++i)
+				delete loaded_[i];
+			loaded_.clear();
+		}
+	private:
+		std::string				path_;
+		std::vector<Channel*>	loaded_;
+};
+
+class NickLookupCase : public Case
+{
+	public:
+		NickLookupCase(MicroBench& bench, unsigned int users) : bench_(bench)
+		{
+			for (unsigned int i = 0; i < users; ++i)
+			{
+				std::ostringstream nick;
+				nick << "u" << i;
+				nicks_.push_back(nick.str());
+			}
+		}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+				g_sink += bench_.findUserByNick(nicks_[i % nicks_.size()]) != NULL;
+		}
+	private:
+		MicroBench&					bench_;
+		std::vector<std::string>	nicks_;
+};
+
+//* A PONG queued behind a megabyte of channel backlog: it is the first
+//* slice handed to sendmsg, and the kernel takes just that much
+class PongFlushCase : public Case
+{
+	public:
+		PongFlushCase(ClientConnection* client) : client_(client), pong_("PONG ft_irc :1700000000\r\n")
+		{
+			std::string line(":u1!bench@127.0.0.1 PRIVMSG #bench :hello there, this is a typical chat line\r\n");
+			while (client_->getLaneSize(LANE_BULK) < 1024 * 1024)
+				client_->queueSend(line, LANE_BULK);
+		}
+		void run(unsigned long iterations)
+		{
+			struct iovec iov[ClientConnection::SEND_IOV_MAX];
+			for (unsigned long i = 0; i < iterations; ++i)
+			{
+				client_->queueSend(pong_);
+				client_->prepareSend(iov);
+				g_sink += iov[0].iov_len;
+				client_->clearSentData(iov[0].iov_len);
+			}
+		}
+	private:
+		ClientConnection*	client_;
+		std::string			pong_;
+};
+
+class SendErrorCase : public Case
+{
+	public:
+		SendErrorCase(ClientConnection* client) : client_(client) {}
+		void run(unsigned long iterations)
+		{
+			for (unsigned long i = 0; i < iterations; ++i)
+				sendError(client_, (i & 1) ? ERR_NOSUCHCHANNEL : ERR_NOTREGISTERED, "#nowhere");
+		}
+		void reset()
+		{
+			client_->clearSentData(client_->getSendQueueSize());
+		}
+	private:
+		ClientConnection* client_;
+};
+
+// ========================================================================
+// 								 Main
+// ========================================================================
+
+static bool selected(const std::string& filter, const std::string& name)
+{
+	return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+static void writeJson(std::ostream& out, const std::vector<Result>& results)
+{
+	out << "{\n  \"clock\": \"" << Clock::sourceName() << "\",\n  \"repeats\": " << REPEATS
+		<< ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& r = results[i];
+		char line[256];
+		std::snprintf(line, sizeof(line), "    { \"name\": \"%s\", \"size\": %u, \"ns_per_op\": %.1f, "
+			"\"min_ns_per_op\": %.1f, \"iterations\": %lu }%s\n", r.name.c_str(), r.size, r.nsPerOp,
+			r.minNsPerOp, r.iterations, i + 1 < results.size() ? "," : "");
+		out << line;
+	}
+	out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv)
+{
+	std::string output;
+	std::string filter;
+	bool usage = (argc % 2 == 0);
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "-o") == 0)
+			output = argv[i + 1];
+		else if (std::strcmp(argv[i], "-f") == 0)
+			filter = argv[i + 1];
+		else
+			usage = true;
+	}
+	if (usage)
+	{
+		std::fprintf(stderr, "Usage: %s [-o results.json] [-f filter]\n", argv[0]);
+		return 1;
+	}
+
+	//* Server logs every step to std::cout: keep stdout for the JSON
+	std::ostringstream quiet;
+	std::streambuf* stdoutBuf = std::cout.rdbuf(quiet.rdbuf());
+
+	std::vector<Result> results;
+	static const unsigned int sizes[] = { 10, 1000, 10000 };
+
+	if (selected(filter, "parse"))
+	{
+		ParseCase c;
+		results.push_back(measure("parse", 1, c));
+	}
+	if (selected(filter, "framing"))
+	{
+		FramingCase c;
+		results.push_back(measure("framing", 1, c));
+	}
+	if (selected(filter, "send_error"))
+	{
+		MicroBench bench;
+		SendErrorCase c(bench.addClient(0));
+		results.push_back(measure("send_error", 1, c));
+	}
+	if (selected(filter, "pong_flush"))
+	{
+		MicroBench bench;
+		PongFlushCase c(bench.addClient(0));
+		results.push_back(measure("pong_flush", 1, c));
+	}
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		unsigned int n = sizes[s];
+
+		//* n members in one channel (half of them operators)
+		if (selected(filter, "broadcast") || selected(filter, "names") || selected(filter, "nick_lookup")
+			|| selected(filter, "who"))
+		{
+			MicroBench bench;
+			Channel* channel = bench.addChannel("#bench");
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				User* user = bench.addClient(i)->getUser();
+				channel->addMember(user);
+				user->joinChannel(channel);
+				if (i % 2 == 0)
+					channel->addOperator(user);
+			}
+			if (selected(filter, "broadcast"))
+			{
+				BroadcastCase c(bench, channel);
+				results.push_back(measure("broadcast", n, c));
+			}
+			if (selected(filter, "names"))
+			{
+				NamesCase c(channel);
+				results.push_back(measure("names", n, c));
+			}
+			if (selected(filter, "nick_lookup"))
+			{
+				NickLookupCase c(bench, n);
+				results.push_back(measure("nick_lookup", n, c));
+			}
+			if (selected(filter, "who"))
+			{
+				WhoCase c(bench, channel->getMembers()[0]);
+				results.push_back(measure("who", n, c));
+			}
+		}
+
+		//* n bans of the usual shapes: domain, IP range, single host, nick
+		if (selected(filter, "join_bans"))
+		{
+			MaskList bans;
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				std::ostringstream mask;
+				switch (i % 4)
+				{
+					case 0: mask << "*!*@*.spam" << i << ".example.org"; break;
+					case 1: mask << "*!*@10." << (i / 256 % 256) << "." << (i % 256) << ".*"; break;
+					case 2: mask << "*!*@bad-" << i << ".example.com"; break;
+					default: mask << "troll" << i << "!*@*"; break;
+				}
+				bans.add(mask.str(), "bench", 0);
+			}
+			JoinBansCase compiled(bans, false);
+			results.push_back(measure("join_bans", n, compiled));
+			JoinBansCase linear(bans, true);
+			results.push_back(measure("join_bans_linear", n, linear));
+		}
+
+		//* n members, one in a hundred an operator: a JOIN without and with +u
+		if (selected(filter, "presence"))
+		{
+			MicroBench bench;
+			Channel* channel = bench.addChannel("#bench");
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				User* user = bench.addClient(i)->getUser();
+				channel->addMember(user);
+				user->joinChannel(channel);
+				if (i % 100 == 0)
+					channel->addOperator(user);
+			}
+			User* joiner = channel->getMembers()[n - 1];
+			PresenceCase c(bench, channel, joiner);
+			results.push_back(measure("presence", n, c));
+			channel->setMode('u', true);
+			results.push_back(measure("presence_auditorium", n, c));
+		}
+
+		//* 50 channels of n/50 members (at least one) each, with a topic
+		if (selected(filter, "join_storm"))
+		{
+			static const unsigned int CHANNELS = 50;
+			MicroBench bench;
+			std::string targets;
+			std::vector<Channel*> channels;
+			for (unsigned int c = 0; c < CHANNELS; ++c)
+			{
+				std::ostringstream name;
+				name << "#storm" << c;
+				targets += (c ? "," : "") + name.str();
+				channels.push_back(bench.addChannel(name.str()));
+				channels.back()->setTopic("Welcome to " + name.str() + ", be nice");
+			}
+			for (unsigned int i = 0; i < std::max(n, CHANNELS); ++i)
+			{
+				User* user = bench.addClient(i)->getUser();
+				Channel* channel = channels[i % CHANNELS];
+				channel->addMember(user);
+				user->joinChannel(channel);
+			}
+			JoinStormCase c(bench, bench.addClient(n + CHANNELS), targets);
+			results.push_back(measure("join_storm", n, c));
+		}
+
+		//* n channels
+		if (selected(filter, "get_channel"))
+		{
+			MicroBench bench;
+			std::vector<std::string> names;
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				std::ostringstream name;
+				name << "#chan" << i;
+				names.push_back(name.str());
+				bench.addChannel(name.str());
+			}
+			GetChannelCase c(bench, names);
+			results.push_back(measure("get_channel", n, c));
+		}
+
+		//* n channels, one in a hundred with 20 members, the rest with one:
+		//* "LIST >10" only walks the big ones
+		if (selected(filter, "list"))
+		{
+			MicroBench bench;
+			std::vector<User*> users;
+			for (unsigned int i = 0; i < 20; ++i)
+				users.push_back(bench.addClient(i)->getUser());
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				std::ostringstream name;
+				name << "#chan" << i;
+				Channel* channel = bench.addChannel(name.str());
+				for (unsigned int m = 0; m < (i % 100 == 0 ? users.size() : 1); ++m)
+					channel->addMember(users[m]);
+			}
+			ListStream::Filter big;
+			ListStream::parseToken(">10", 0, big);
+			ListCase c(bench, big);
+			results.push_back(measure("list_gt10", n, c));
+		}
+	}
+
+	//* 100k channels with a topic, modes, two invites and an operator each
+	//* (10k distinct users), encoded and restored
+	if (selected(filter, "snapshot"))
+	{
+		static const unsigned int CHANNELS = 100000;
+		MicroBench bench;
+		std::vector<User*> users;
+		for (unsigned int i = 0; i < CHANNELS / 10; ++i)
+			users.push_back(bench.addClient(i)->getUser());
+		for (unsigned int i = 0; i < CHANNELS; ++i)
+		{
+			std::ostringstream name;
+			name << "#chan" << i;
+			Channel* channel = bench.addChannel(name.str());
+			channel->setTopic("Topic of " + name.str() + ": the usual long-ish sentence about it");
+			channel->setMode('t', true);
+			channel->setLimit(50);
+			channel->addInvite("friend");
+			channel->addInvite("other");
+			User* user = users[i % users.size()];
+			channel->addMember(user);
+			channel->addOperator(user);
+		}
+		SnapshotEncodeCase encode(bench);
+		if (selected(filter, "snapshot_encode"))
+			results.push_back(measure("snapshot_encode", CHANNELS, encode));
+		if (selected(filter, "snapshot_load"))
+		{
+			std::ostringstream path;
+			path << "/tmp/ircserv-microbench-" << getpid() << ".snap";
+			std::string data;
+			StateSnapshot::encode(bench.channels(), 1, data);
+			if (StateSnapshot::writeFile(path.str(), data))
+			{
+				SnapshotLoadCase c(path.str());
+				results.push_back(measure("snapshot_load", CHANNELS, c));
+			}
+			unlink(path.str().c_str());
+		}
+	}
+
+	std::cout.rdbuf(stdoutBuf);
+	if (output.empty())
+		writeJson(std::cout, results);
+	else
+	{
+		std::ofstream file(output.c_str());
+		if (!file)
+		{
+			std::perror(output.c_str());
+			return 1;
+		}
+		writeJson(file, results);
+	}
+	return 0;
+}
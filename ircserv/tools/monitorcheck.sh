@@ -0,0 +1,90 @@
+#!/bin/bash
+# monitorcheck: MONITOR against nicks that differ only in case. Nicks are
+# compared exactly (the nick index and the watch index agree): "Alice" and
+# "alice" are two users, each with its own 730/731.
+#
+#   make monitorcheck
+#
+# Exits non-zero on the first reply that is missing or unexpected.
+
+set -e
+cd "$(dirname "$0")/.."
+
+PORT=${MONITORCHECK_PORT:-7200}
+DIR=$(mktemp -d /tmp/monitorcheck.XXXXXX)
+PID=""
+
+cleanup()
+{
+	[ -z "$PID" ] || kill "$PID" 2>/dev/null || true
+	wait 2>/dev/null || true
+	rm -rf "$DIR"
+}
+trap cleanup EXIT INT TERM
+
+{
+	echo "max_per_ip = 0"
+	echo "connect_rate_limit = 0"
+} > "$DIR/check.conf"
+./ircserv "$PORT" password123 "$DIR/check.conf" > "$DIR/server.log" 2>&1 &
+PID=$!
+sleep 0.5
+
+# connect <fd> <nick>
+connect()
+{
+	eval "exec $1<>/dev/tcp/127.0.0.1/$PORT"
+	printf 'PASS password123\r\nNICK %s\r\nUSER %s 0 * :%s\r\n' "$2" "$2" "$2" >&"$1"
+}
+
+# say <fd> <line>
+say()
+{
+	printf '%s\r\n' "$2" >&"$1"
+}
+
+# replies <fd>: what arrived until the connection goes quiet, without CRs
+replies()
+{
+	local line
+	: > "$DIR/out"
+	while IFS= read -r -t 0.5 line <&"$1"; do
+		printf '%s\n' "${line%$'\r'}" >> "$DIR/out"
+	done
+}
+
+expect()
+{
+	grep -qF -- "$1" "$DIR/out" || { echo "FAIL: $2: no '$1'"; cat "$DIR/out"; exit 1; }
+}
+
+refuse()
+{
+	! grep -qF -- "$1" "$DIR/out" || { echo "FAIL: $2: unexpected '$1'"; cat "$DIR/out"; exit 1; }
+}
+
+connect 3 watcher
+connect 4 alice
+replies 3
+replies 4
+
+say 3 "MONITOR + Alice,alice"
+replies 3
+expect ":ft_irc 731 watcher :Alice" "status of an offline nick"
+expect ":ft_irc 730 watcher :alice!alice@" "status of an online nick"
+
+connect 5 Alice
+replies 3
+expect ":ft_irc 730 watcher :Alice!Alice@" "Alice comes online"
+refuse ":ft_irc 730 watcher :alice!" "Alice comes online"
+
+say 5 "QUIT :bye"
+replies 3
+expect ":ft_irc 731 watcher :Alice" "Alice quits"
+refuse ":ft_irc 731 watcher :alice" "Alice quits"
+
+say 4 "QUIT :bye"
+replies 3
+expect ":ft_irc 731 watcher :alice" "alice quits"
+
+echo "monitorcheck: OK"